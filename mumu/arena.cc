@@ -0,0 +1,83 @@
+#include "arena.h"
+#include <algorithm>
+#include <cstdlib>
+
+namespace muhui {
+
+/// reset合并内存块时保留的最大容量, 避免偶尔一次大请求长期占用内存
+static const size_t s_max_retain_size = 64 * 1024;
+
+Arena::Arena(size_t block_size)
+    : m_blockSize(std::max<size_t>(block_size, 256)) {
+}
+
+Arena::~Arena() {
+    FreeBlocks(m_blocks);
+    FreeBlocks(m_large);
+}
+
+void Arena::FreeBlocks(Block* b) {
+    while(b) {
+        Block* next = b->next;
+        free(b);
+        b = next;
+    }
+}
+
+Arena::Block* Arena::newBlock(size_t size) {
+    Block* b = (Block*)malloc(sizeof(Block) + size);
+    if(!b) {
+        throw std::bad_alloc();
+    }
+    b->next = nullptr;
+    b->size = size;
+    m_capacity += size;
+    return b;
+}
+
+void* Arena::allocSlow(size_t size, size_t align) {
+    //Block头之后的地址按max_align_t对齐, 更大的对齐需要额外空间
+    size_t need = size + (align > alignof(std::max_align_t) ? align : 0);
+    if(need > m_blockSize / 2) {
+        //大对象单独申请, 不浪费当前块的剩余空间
+        Block* b = newBlock(need);
+        b->next = m_large;
+        m_large = b;
+        m_used += size;
+        uintptr_t p = ((uintptr_t)(b + 1) + align - 1) & ~(uintptr_t)(align - 1);
+        return (void*)p;
+    }
+    Block* b = newBlock(m_blockSize);
+    b->next = m_blocks;
+    m_blocks = b;
+    m_ptr = (char*)(b + 1);
+    m_end = m_ptr + b->size;
+    return alloc(size, align);
+}
+
+void Arena::reset() {
+    FreeBlocks(m_large);
+    m_large = nullptr;
+    m_used = 0;
+    if(!m_blocks) {
+        m_capacity = 0;
+        return;
+    }
+    if(m_blocks->next) {
+        //上一轮用了多个块, 合并成一个块, 下一轮同样的用量不再分配
+        size_t size = 0;
+        for(Block* b = m_blocks; b; b = b->next) {
+            size += b->size;
+        }
+        FreeBlocks(m_blocks);
+        m_blocks = nullptr;
+        m_capacity = 0;
+        m_blocks = newBlock(std::min(size, std::max(s_max_retain_size, m_blockSize)));
+    } else {
+        m_capacity = m_blocks->size;
+    }
+    m_ptr = (char*)(m_blocks + 1);
+    m_end = m_ptr + m_blocks->size;
+}
+
+} // namespace muhui
@@ -0,0 +1,151 @@
+/**
+ * @file arena.h
+ * @author muhui (2571579302@qq.com)
+ * @brief 线性(bump)内存分配器
+ * @version 0.1
+ * @date 2023-02-15
+ */
+#ifndef __MUHUI_ARENA_H__
+#define __MUHUI_ARENA_H__
+#include "noncopyable.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+namespace muhui {
+
+/**
+ * @brief 线性内存分配器
+ * @details 从大块内存中顺序切分, 单独释放是空操作, reset时一次性回收全部内存.
+ *          适合生命周期相同的一批小对象, 例如一个HTTP请求处理过程中的临时对象.
+ *          reset会保留内存块, 上一轮用了多个块时合并成一个更大的块,
+ *          之后同样规模的使用不再调用malloc. 非线程安全
+ */
+class Arena : Noncopyable {
+public:
+    typedef std::shared_ptr<Arena> ptr;
+
+    /**
+     * @brief 构造函数
+     * @param[in] block_size 内存块大小, 超过一半块大小的分配单独申请
+     */
+    Arena(size_t block_size = 4096);
+
+    /**
+     * @brief 析构函数, 释放全部内存块
+     */
+    ~Arena();
+
+    /**
+     * @brief 分配内存
+     * @param[in] size 大小
+     * @param[in] align 对齐, 必须是2的幂
+     * @return 内存地址, 直到reset或析构前有效
+     */
+    void* alloc(size_t size, size_t align = alignof(std::max_align_t)) {
+        uintptr_t p = ((uintptr_t)m_ptr + align - 1) & ~(uintptr_t)(align - 1);
+        if(m_ptr && p + size <= (uintptr_t)m_end) {
+            m_ptr = (char*)(p + size);
+            m_used += size;
+            return (void*)p;
+        }
+        return allocSlow(size, align);
+    }
+
+    /**
+     * @brief 回收全部已分配的内存, 之前分配的地址全部失效
+     */
+    void reset();
+
+    /**
+     * @brief 返回已分配的字节数(不含对齐填充)
+     */
+    size_t getUsed() const { return m_used;}
+
+    /**
+     * @brief 返回持有的内存块总大小
+     */
+    size_t getCapacity() const { return m_capacity;}
+private:
+    /// 内存块头, 数据紧跟在块头之后
+    struct Block {
+        Block* next;
+        size_t size;
+    };
+
+    void* allocSlow(size_t size, size_t align);
+    Block* newBlock(size_t size);
+    static void FreeBlocks(Block* b);
+private:
+    /// 普通内存块链表, 头部为当前块
+    Block* m_blocks = nullptr;
+    /// 大对象单独申请的内存块
+    Block* m_large = nullptr;
+    /// 当前块空闲位置
+    char* m_ptr = nullptr;
+    /// 当前块结束位置
+    char* m_end = nullptr;
+    /// 内存块大小
+    size_t m_blockSize;
+    /// 已分配的字节数
+    size_t m_used = 0;
+    /// 内存块总大小
+    size_t m_capacity = 0;
+};
+
+/**
+ * @brief 从Arena分配内存的STL分配器
+ * @details 持有Arena的智能指针, 使用它的容器/对象存在期间Arena不会被析构.
+ *          arena为空时退化为普通的operator new/delete,
+ *          同一个类型既可以放在Arena中也可以长期存在
+ */
+template<class T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    template<class U>
+    struct rebind {
+        typedef ArenaAllocator<U> other;
+    };
+
+    ArenaAllocator(Arena::ptr arena = nullptr) noexcept
+        : m_arena(arena) {
+    }
+
+    template<class U>
+    ArenaAllocator(const ArenaAllocator<U>& o) noexcept
+        : m_arena(o.getArena()) {
+    }
+
+    T* allocate(size_t n) {
+        if(m_arena) {
+            return (T*)m_arena->alloc(n * sizeof(T), alignof(T));
+        }
+        return (T*)::operator new(n * sizeof(T));
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+        if(!m_arena) {
+            ::operator delete(p);
+        }
+    }
+
+    const Arena::ptr& getArena() const { return m_arena;}
+private:
+    Arena::ptr m_arena;
+};
+
+template<class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+    return a.getArena() == b.getArena();
+}
+
+template<class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+    return a.getArena() != b.getArena();
+}
+
+} // namespace muhui
+#endif // !__MUHUI_ARENA_H__
@@ -0,0 +1,488 @@
+#include "binlog.h"
+#include "config.h"
+#include <ctype.h>
+#include <time.h>
+
+namespace muhui {
+
+namespace {
+
+/**
+ * @brief 已注册的格式, 下标为ID - 1
+ */
+struct FormatRegistry {
+    Mutex mutex;
+    std::vector<const BinLogFormat*> formats;
+};
+
+FormatRegistry& GetRegistry() {
+    static FormatRegistry s_registry;
+    return s_registry;
+}
+
+template<class T>
+bool ReadRaw(const char*& p, const char* end, T& v) {
+    if(p + sizeof(v) > end) {
+        return false;
+    }
+    memcpy(&v, p, sizeof(v));
+    p += sizeof(v);
+    return true;
+}
+
+template<class L>
+bool ReadString(const char*& p, const char* end, std::string& v) {
+    L len = 0;
+    if(!ReadRaw(p, end, len) || p + len > end) {
+        return false;
+    }
+    v.assign(p, len);
+    p += len;
+    return true;
+}
+
+template<class T>
+void AppendRaw(std::string& out, const T& v) {
+    out.append((const char*)&v, sizeof(v));
+}
+
+void AppendString16(std::string& out, const char* str) {
+    uint16_t len = std::min(strlen(str), (size_t)UINT16_MAX);
+    AppendRaw(out, len);
+    out.append(str, len);
+}
+
+/**
+ * @brief 按单个printf格式输出一个参数
+ */
+void AppendFormat(std::string& out, const char* spec, ...) __attribute__((format(printf, 2, 3)));
+
+void AppendFormat(std::string& out, const char* spec, ...) {
+    char buf[128];
+    va_list al;
+    va_start(al, spec);
+    int len = vsnprintf(buf, sizeof(buf), spec, al);
+    va_end(al);
+    if(len < 0) {
+        return;
+    }
+    if((size_t)len < sizeof(buf)) {
+        out.append(buf, len);
+        return;
+    }
+    size_t pos = out.size();
+    out.resize(pos + len + 1);
+    va_start(al, spec);
+    vsnprintf(&out[pos], len + 1, spec, al);
+    va_end(al);
+    out.resize(pos + len);
+}
+
+}
+
+BinLogFormat::BinLogFormat(LogLevel::Level level, const char* file, int32_t line
+                           , const char* types, const char* fmt)
+    : m_level(level)
+    , m_file(file)
+    , m_line(line)
+    , m_types(types)
+    , m_fmt(fmt) {
+    FormatRegistry& r = GetRegistry();
+    Mutex::Lock lock(r.mutex);
+    r.formats.push_back(this);
+    m_id = r.formats.size();
+}
+
+size_t BinLogFormat::GetCount() {
+    FormatRegistry& r = GetRegistry();
+    Mutex::Lock lock(r.mutex);
+    return r.formats.size();
+}
+
+const BinLogFormat* BinLogFormat::Get(uint32_t id) {
+    FormatRegistry& r = GetRegistry();
+    Mutex::Lock lock(r.mutex);
+    if(id == 0 || id > r.formats.size()) {
+        return nullptr;
+    }
+    return r.formats[id - 1];
+}
+
+std::string BinLogFormat::Format(const std::string& fmt, const std::string& types
+                                 , const char* args, size_t len) {
+    std::string out;
+    const char* p = args;
+    const char* end = args + len;
+    size_t argi = 0;
+    std::string spec;
+    for(size_t i = 0; i < fmt.size(); ++i) {
+        if(fmt[i] != '%') {
+            out.push_back(fmt[i]);
+            continue;
+        }
+        if(i + 1 < fmt.size() && fmt[i + 1] == '%') {
+            out.push_back('%');
+            ++i;
+            continue;
+        }
+        //标志、宽度、精度原样保留, 长度修饰按参数类型重新生成
+        size_t begin = i++;
+        spec = "%";
+        while(i < fmt.size() && strchr("-+ #0", fmt[i])) {
+            spec.push_back(fmt[i++]);
+        }
+        while(i < fmt.size() && (isdigit(fmt[i]) || fmt[i] == '.')) {
+            spec.push_back(fmt[i++]);
+        }
+        while(i < fmt.size() && strchr("hlLqjzt", fmt[i])) {
+            ++i;
+        }
+        if(i >= fmt.size()) {
+            out.append(fmt, begin, std::string::npos);
+            break;
+        }
+        char conv = fmt[i];
+        if(argi >= types.size()) {
+            out.append(fmt, begin, i - begin + 1);
+            continue;
+        }
+        bool int_conv = strchr("diouxX", conv) != nullptr;
+        bool float_conv = strchr("eEfFgGaA", conv) != nullptr;
+        switch(types[argi++]) {
+            case binlog::ARG_INT:
+            case binlog::ARG_UINT: {
+                int64_t v = 0;
+                if(!ReadRaw(p, end, v)) {
+                    return out + "<truncated>";
+                }
+                if(float_conv) {
+                    spec.push_back(conv);
+                    AppendFormat(out, spec.c_str(), (double)v);
+                } else if(conv == 'c') {
+                    spec.push_back(conv);
+                    AppendFormat(out, spec.c_str(), (int)v);
+                } else {
+                    spec += "ll";
+                    spec.push_back(int_conv ? conv
+                            : (types[argi - 1] == binlog::ARG_INT ? 'd' : 'u'));
+                    AppendFormat(out, spec.c_str(), (long long)v);
+                }
+                break;
+            }
+            case binlog::ARG_DOUBLE: {
+                double v = 0;
+                if(!ReadRaw(p, end, v)) {
+                    return out + "<truncated>";
+                }
+                if(int_conv) {
+                    spec += "ll";
+                    spec.push_back(conv);
+                    AppendFormat(out, spec.c_str(), (long long)v);
+                } else {
+                    spec.push_back(float_conv ? conv : 'g');
+                    AppendFormat(out, spec.c_str(), v);
+                }
+                break;
+            }
+            case binlog::ARG_CHAR: {
+                char v = 0;
+                if(!ReadRaw(p, end, v)) {
+                    return out + "<truncated>";
+                }
+                if(int_conv) {
+                    spec.push_back(conv);
+                    AppendFormat(out, spec.c_str(), (int)v);
+                } else {
+                    spec.push_back('c');
+                    AppendFormat(out, spec.c_str(), (int)v);
+                }
+                break;
+            }
+            case binlog::ARG_POINTER: {
+                uint64_t v = 0;
+                if(!ReadRaw(p, end, v)) {
+                    return out + "<truncated>";
+                }
+                if(int_conv) {
+                    spec += "ll";
+                    spec.push_back(conv);
+                    AppendFormat(out, spec.c_str(), (unsigned long long)v);
+                } else {
+                    spec.push_back('p');
+                    AppendFormat(out, spec.c_str(), (void*)(uintptr_t)v);
+                }
+                break;
+            }
+            case binlog::ARG_STRING: {
+                std::string v;
+                if(!ReadString<uint32_t>(p, end, v)) {
+                    return out + "<truncated>";
+                }
+                if(spec.size() == 1) {
+                    out.append(v);
+                } else {
+                    spec.push_back('s');
+                    AppendFormat(out, spec.c_str(), v.c_str());
+                }
+                break;
+            }
+            default:
+                out.append(fmt, begin, i - begin + 1);
+                break;
+        }
+    }
+    return out;
+}
+
+namespace binlog {
+
+const char* const MAGIC = "MUHUIBL1";
+
+void Encoder::putString(const char* str, size_t len) {
+    size_t avail = m_end - m_pos;
+    if(avail < sizeof(uint32_t)) {
+        return;
+    }
+    //放不下时截断
+    len = std::min(len, avail - sizeof(uint32_t));
+    putRaw((uint32_t)len);
+    memcpy(m_pos, str, len);
+    m_pos += len;
+}
+
+Encoder& GetEncoder() {
+    static thread_local Encoder s_encoder;
+    return s_encoder;
+}
+
+uint64_t GetTimeNs() {
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+std::string Reader::Line::toString() const {
+    char buf[64];
+    time_t sec = time / 1000000000;
+    struct tm tm;
+    localtime_r(&sec, &tm);
+    size_t n = strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    snprintf(buf + n, sizeof(buf) - n, ".%06u", (unsigned)(time % 1000000000 / 1000));
+
+    std::stringstream ss;
+    ss << buf;
+    if(dropped) {
+        ss << "\t[dropped " << dropped << " log lines]";
+    } else {
+        ss << '\t' << threadId << '\t' << fiberId << "\t[" << LogLevel::ToString(level)
+           << "]\t" << file << ':' << line << '\t' << message;
+    }
+    return ss.str();
+}
+
+Reader::Reader(std::istream& is)
+    : m_is(is) {
+}
+
+bool Reader::next(Line& line) {
+    while(true) {
+        uint32_t len = 0;
+        if(!m_is.read((char*)&len, sizeof(len))) {
+            if(m_is.gcount() != 0) {
+                m_error = "truncated record length";
+            }
+            return false;
+        }
+        //记录长度不会超过MAX_RECORD_SIZE, 格式描述受uint16限制
+        if(len == 0 || len > MAX_RECORD_SIZE + 3 * UINT16_MAX) {
+            m_error = "invalid record length " + std::to_string(len);
+            return false;
+        }
+        m_record.resize(len);
+        if(!m_is.read(&m_record[0], len)) {
+            m_error = "truncated record";
+            return false;
+        }
+        const char* p = m_record.data() + 1;
+        const char* end = m_record.data() + len;
+        line.dropped = 0;
+        switch((uint8_t)m_record[0]) {
+            case SESSION:
+                if(len < 1 + MAGIC_SIZE || memcmp(p, MAGIC, MAGIC_SIZE)) {
+                    m_error = "bad magic";
+                    return false;
+                }
+                m_formats.clear();
+                continue;
+            case FORMAT: {
+                uint32_t id = 0;
+                uint8_t level = 0;
+                Format f;
+                if(!ReadRaw(p, end, id) || !ReadRaw(p, end, level)
+                        || !ReadRaw(p, end, f.line)
+                        || !ReadString<uint16_t>(p, end, f.file)
+                        || !ReadString<uint16_t>(p, end, f.types)
+                        || !ReadString<uint16_t>(p, end, f.fmt)) {
+                    m_error = "bad format record";
+                    return false;
+                }
+                f.level = (LogLevel::Level)level;
+                m_formats[id] = std::move(f);
+                continue;
+            }
+            case LOG: {
+                uint32_t id = 0;
+                if(!ReadRaw(p, end, id) || !ReadRaw(p, end, line.time)
+                        || !ReadRaw(p, end, line.threadId)
+                        || !ReadRaw(p, end, line.fiberId)) {
+                    m_error = "bad log record";
+                    return false;
+                }
+                auto it = m_formats.find(id);
+                if(it == m_formats.end()) {
+                    m_error = "unknown format id " + std::to_string(id);
+                    return false;
+                }
+                line.level = it->second.level;
+                line.file = it->second.file;
+                line.line = it->second.line;
+                line.message = BinLogFormat::Format(it->second.fmt, it->second.types, p, end - p);
+                return true;
+            }
+            case DROPPED:
+                if(!ReadRaw(p, end, line.dropped)) {
+                    m_error = "bad dropped record";
+                    return false;
+                }
+                line.time = 0;
+                line.message.clear();
+                return true;
+            case TEXT: {
+                uint8_t level = 0;
+                if(!ReadRaw(p, end, level) || !ReadRaw(p, end, line.time)
+                        || !ReadRaw(p, end, line.threadId)
+                        || !ReadRaw(p, end, line.fiberId)
+                        || !ReadRaw(p, end, line.line)
+                        || !ReadString<uint32_t>(p, end, line.file)
+                        || !ReadString<uint32_t>(p, end, line.message)) {
+                    m_error = "bad text record";
+                    return false;
+                }
+                line.level = (LogLevel::Level)level;
+                return true;
+            }
+            default:
+                //未知类型跳过, 兼容以后增加的记录
+                continue;
+        }
+    }
+}
+
+}
+
+void LogAppender::logBinary(const std::shared_ptr<Logger>& logger, const BinLogFormat& format
+                            , const char* data, size_t len) {
+    if(format.getLevel() < m_level || len < binlog::LOG_HEADER_SIZE) {
+        return;
+    }
+    uint64_t ts = 0;
+    uint32_t tid = 0;
+    uint32_t fid = 0;
+    memcpy(&ts, data + 9, sizeof(ts));
+    memcpy(&tid, data + 17, sizeof(tid));
+    memcpy(&fid, data + 21, sizeof(fid));
+    LogEvent::ptr event = LogEvent::Create(logger, format.getLevel(), format.getFile()
+            , format.getLine(), 0, tid, fid, ts / 1000000000);
+    std::string msg = BinLogFormat::Format(format.getFormat(), format.getTypes()
+            , data + binlog::LOG_HEADER_SIZE, len - binlog::LOG_HEADER_SIZE);
+    event->getSS().write(msg.data(), msg.size());
+    log(logger, format.getLevel(), event);
+}
+
+BinLogAppender::BinLogAppender(const std::string& filename, size_t buffer_size
+                               , OverflowPolicy overflow)
+    : AsyncLogAppender(filename, std::max(buffer_size, (size_t)binlog::MAX_RECORD_SIZE * 4)
+                       , overflow, false)
+    , m_sessionWritten(false)
+    , m_formatWritten(0) {
+    start();
+}
+
+BinLogAppender::~BinLogAppender() {
+    stop();
+}
+
+void BinLogAppender::log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
+    if(level < m_level) {
+        return;
+    }
+    const char* file = event->getFilename() ? event->getFilename() : "";
+    binlog::Encoder& e = binlog::GetEncoder();
+    e.begin(binlog::TEXT);
+    e.putRaw((uint8_t)level);
+    e.putRaw(binlog::GetTimeNs());
+    e.putRaw(event->getThreadId());
+    e.putRaw(event->getFiberId());
+    e.putRaw((int32_t)event->getLine());
+    e.putString(file, strlen(file));
+    LogStream& ss = event->getSS();
+    e.putString(ss.data(), ss.size());
+    e.finish();
+    push(e.data(), e.size());
+}
+
+void BinLogAppender::logBinary(const std::shared_ptr<Logger>& logger, const BinLogFormat& format
+                               , const char* data, size_t len) {
+    if(format.getLevel() < m_level) {
+        return;
+    }
+    push(data, len);
+}
+
+void BinLogAppender::onWrite(std::string& head, uint64_t dropped) {
+    if(!m_sessionWritten) {
+        m_sessionWritten = true;
+        AppendRaw(head, (uint32_t)(1 + binlog::MAGIC_SIZE + sizeof(uint64_t)));
+        AppendRaw(head, (uint8_t)binlog::SESSION);
+        head.append(binlog::MAGIC, binlog::MAGIC_SIZE);
+        AppendRaw(head, GetCurrentUS());
+    }
+    //本批记录引用的格式一定在这之前注册
+    size_t count = BinLogFormat::GetCount();
+    for(; m_formatWritten < count; ++m_formatWritten) {
+        const BinLogFormat* f = BinLogFormat::Get(m_formatWritten + 1);
+        size_t pos = head.size();
+        AppendRaw(head, (uint32_t)0);
+        AppendRaw(head, (uint8_t)binlog::FORMAT);
+        AppendRaw(head, f->getId());
+        AppendRaw(head, (uint8_t)f->getLevel());
+        AppendRaw(head, f->getLine());
+        AppendString16(head, f->getFile());
+        AppendString16(head, f->getTypes());
+        AppendString16(head, f->getFormat());
+        uint32_t len = head.size() - pos - sizeof(uint32_t);
+        memcpy(&head[pos], &len, sizeof(len));
+    }
+    if(dropped) {
+        AppendRaw(head, (uint32_t)(1 + sizeof(uint64_t)));
+        AppendRaw(head, (uint8_t)binlog::DROPPED);
+        AppendRaw(head, dropped);
+    }
+}
+
+std::string BinLogAppender::toYamlString() {
+    MutexType::Lock lock(m_mutex);
+    YAML::Node node;
+    node["type"] = "BinLogAppender";
+    node["file"] = getFilename();
+    node["buffer_size"] = getBufferSize();
+    node["overflow"] = OverflowToString(getOverflow());
+    if(m_level != LogLevel::UNKONW) {
+        node["level"] = LogLevel::ToString(m_level);
+    }
+    std::stringstream ss;
+    ss << node;
+    return ss.str();
+}
+
+}
@@ -0,0 +1,396 @@
+/**
+ * @file binlog.h
+ * @author muhui (2571579302@qq.com)
+ * @brief 二进制日志: 运行时不格式化, 只记录格式ID、时间戳和参数的原始字节, 离线解码
+ * @version 0.1
+ * @date 2023-03-02
+ */
+#ifndef __MUHUI_BINLOG_H__
+#define __MUHUI_BINLOG_H__
+#include "log.h"
+#include <type_traits>
+
+/**
+ * @brief 写二进制日志
+ * @details 用法: MUHUI_BINLOG_INFO(g_logger, "user %s login, uid=%d cost=%.3f", name, uid, cost);
+ *          每个调用点一个静态的BinLogFormat(第一次执行时注册, 参数类型由编译期推导),
+ *          之后只把格式ID、时间戳和参数写入当前线程的缓冲区.
+ *          fmt必须是字符串常量. 支持整数、浮点数、bool、char、枚举、const char*、std::string和指针参数.
+ *          输出到BinLogAppender时写入二进制文件, 用tools/binlog_decode解码;
+ *          输出到其它Appender时按格式转成文本
+ */
+#define MUHUI_BINLOG_LEVEL(logger, level, fmt, ...) \
+    do { \
+        if(logger->getLevel() <= level) { \
+            static const muhui::BinLogFormat s_muhui_binlog_format(level, __FILE__, __LINE__, \
+                    decltype(muhui::binlog::MakeSignature(fmt, ##__VA_ARGS__))::Get(), fmt); \
+            muhui::binlog::Log(logger, s_muhui_binlog_format, ##__VA_ARGS__); \
+        } \
+    } while(0)
+
+#define MUHUI_BINLOG_DEBUG(logger, fmt, ...) MUHUI_BINLOG_LEVEL(logger, muhui::LogLevel::DEBUG, fmt, ##__VA_ARGS__)
+#define MUHUI_BINLOG_INFO(logger, fmt, ...) MUHUI_BINLOG_LEVEL(logger, muhui::LogLevel::INFO, fmt, ##__VA_ARGS__)
+#define MUHUI_BINLOG_WARN(logger, fmt, ...) MUHUI_BINLOG_LEVEL(logger, muhui::LogLevel::WARN, fmt, ##__VA_ARGS__)
+#define MUHUI_BINLOG_ERROR(logger, fmt, ...) MUHUI_BINLOG_LEVEL(logger, muhui::LogLevel::ERROR, fmt, ##__VA_ARGS__)
+#define MUHUI_BINLOG_FATAL(logger, fmt, ...) MUHUI_BINLOG_LEVEL(logger, muhui::LogLevel::FATAL, fmt, ##__VA_ARGS__)
+
+namespace muhui {
+
+/**
+ * @brief 二进制日志的格式描述
+ * @details 构造时分配进程内唯一的ID并注册, 对象需要是静态的(不会析构前被引用)
+ */
+class BinLogFormat {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] level 日志级别
+     * @param[in] file 文件名
+     * @param[in] line 行号
+     * @param[in] types 参数类型, 每个字符一个参数, 见binlog::ArgType
+     * @param[in] fmt printf风格的格式
+     */
+    BinLogFormat(LogLevel::Level level, const char* file, int32_t line
+                 , const char* types, const char* fmt);
+
+    uint32_t getId() const { return m_id;}
+    LogLevel::Level getLevel() const { return m_level;}
+    const char* getFile() const { return m_file;}
+    int32_t getLine() const { return m_line;}
+    const char* getTypes() const { return m_types;}
+    const char* getFormat() const { return m_fmt;}
+
+    /**
+     * @brief 按格式和参数类型把参数转成文本
+     * @param[in] fmt printf风格的格式
+     * @param[in] types 参数类型
+     * @param[in] args 参数的原始字节
+     * @param[in] len 参数的字节数
+     */
+    static std::string Format(const std::string& fmt, const std::string& types
+                              , const char* args, size_t len);
+
+    /**
+     * @brief 获取已注册的格式数量
+     */
+    static size_t GetCount();
+
+    /**
+     * @brief 获取已注册的格式, ID从1开始
+     */
+    static const BinLogFormat* Get(uint32_t id);
+private:
+    uint32_t m_id;
+    LogLevel::Level m_level;
+    const char* m_file;
+    int32_t m_line;
+    const char* m_types;
+    const char* m_fmt;
+};
+
+namespace binlog {
+
+/**
+ * @brief 文件中的记录类型
+ * @details 每条记录: uint32 长度(不含这4字节) + uint8 类型 + 内容, 整数为本机字节序
+ */
+enum RecordType {
+    /// 进程打开文件时写入: 8字节魔数 + uint64 开始时间(微秒), 之后的格式ID重新开始
+    SESSION = 0,
+    /// 格式描述: uint32 ID + uint8 级别 + int32 行号 + 文件名 + 参数类型 + 格式(均为uint16长度 + 内容)
+    FORMAT = 1,
+    /// 日志: uint32 格式ID + uint64 时间戳(纳秒) + uint32 线程ID + uint32 协程ID + 参数
+    LOG = 2,
+    /// 丢弃的行数: uint64
+    DROPPED = 3,
+    /// 普通日志: uint8 级别 + uint64 时间戳(纳秒) + uint32 线程ID + uint32 协程ID + int32 行号
+    ///           + 文件名 + 内容(均为uint32长度 + 内容)
+    TEXT = 4
+};
+
+/// 文件魔数
+extern const char* const MAGIC;
+enum {
+    /// 魔数长度
+    MAGIC_SIZE = 8,
+    /// 单条日志记录的最大长度, 超过时截断字符串参数
+    MAX_RECORD_SIZE = 4096,
+    /// LOG记录参数之前的长度: 长度 + 类型 + 格式ID + 时间戳 + 线程ID + 协程ID
+    LOG_HEADER_SIZE = 4 + 1 + 4 + 8 + 4 + 4
+};
+
+/**
+ * @brief 参数类型
+ * @details 整数都按8字节写入, 浮点数按double写入, 字符串为uint32长度 + 内容
+ */
+enum ArgType {
+    ARG_INT = 'i',
+    ARG_UINT = 'u',
+    ARG_DOUBLE = 'd',
+    ARG_CHAR = 'c',
+    ARG_STRING = 's',
+    ARG_POINTER = 'p'
+};
+
+template<class T, class Enable = void>
+struct ArgTraits;
+
+template<class T>
+struct ArgTraits<T, typename std::enable_if<std::is_integral<T>::value
+        && std::is_signed<T>::value && !std::is_same<T, char>::value>::type> {
+    static const char type = ARG_INT;
+};
+
+template<class T>
+struct ArgTraits<T, typename std::enable_if<std::is_integral<T>::value
+        && !std::is_signed<T>::value && !std::is_same<T, char>::value>::type> {
+    static const char type = ARG_UINT;
+};
+
+template<>
+struct ArgTraits<char> {
+    static const char type = ARG_CHAR;
+};
+
+template<class T>
+struct ArgTraits<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+    static const char type = ARG_DOUBLE;
+};
+
+template<class T>
+struct ArgTraits<T, typename std::enable_if<std::is_enum<T>::value>::type> {
+    static const char type = ARG_INT;
+};
+
+template<>
+struct ArgTraits<const char*> {
+    static const char type = ARG_STRING;
+};
+
+template<>
+struct ArgTraits<char*> {
+    static const char type = ARG_STRING;
+};
+
+template<>
+struct ArgTraits<std::string> {
+    static const char type = ARG_STRING;
+};
+
+template<class T>
+struct ArgTraits<T*, typename std::enable_if<!std::is_same<typename std::remove_cv<T>::type, char>::value>::type> {
+    static const char type = ARG_POINTER;
+};
+
+/**
+ * @brief 参数类型串, 编译期由参数类型生成
+ */
+template<class... Args>
+struct Signature {
+    static const char* Get() {
+        static const char s_types[] = {ArgTraits<Args>::type..., 0};
+        return s_types;
+    }
+};
+
+/**
+ * @brief 只用于decltype推导参数类型, 第一个参数为格式
+ */
+template<class... Args>
+Signature<typename std::decay<Args>::type...> MakeSignature(const char* fmt, Args&&... args);
+
+/**
+ * @brief 编码一条日志记录的缓冲区(每个线程一个)
+ */
+class Encoder {
+public:
+    Encoder() : m_pos(m_data), m_end(m_data + sizeof(m_data)) {}
+
+    void reset() { m_pos = m_data;}
+    const char* data() const { return m_data;}
+    size_t size() const { return m_pos - m_data;}
+
+    template<class T>
+    void putRaw(const T& v) {
+        if(m_pos + sizeof(v) <= m_end) {
+            memcpy(m_pos, &v, sizeof(v));
+            m_pos += sizeof(v);
+        }
+    }
+
+    void putString(const char* str, size_t len);
+
+    /**
+     * @brief 写入记录头, 长度在finish中回填
+     */
+    void begin(RecordType type) {
+        reset();
+        putRaw((uint32_t)0);
+        putRaw((uint8_t)type);
+    }
+
+    void finish() {
+        uint32_t len = size() - sizeof(uint32_t);
+        memcpy(m_data, &len, sizeof(len));
+    }
+private:
+    char m_data[MAX_RECORD_SIZE];
+    char* m_pos;
+    char* m_end;
+};
+
+template<class T>
+inline typename std::enable_if<ArgTraits<T>::type == ARG_INT>::type Put(Encoder& e, T v) {
+    e.putRaw((int64_t)v);
+}
+
+template<class T>
+inline typename std::enable_if<ArgTraits<T>::type == ARG_UINT>::type Put(Encoder& e, T v) {
+    e.putRaw((uint64_t)v);
+}
+
+template<class T>
+inline typename std::enable_if<ArgTraits<T>::type == ARG_DOUBLE>::type Put(Encoder& e, T v) {
+    e.putRaw((double)v);
+}
+
+template<class T>
+inline typename std::enable_if<ArgTraits<T>::type == ARG_POINTER>::type Put(Encoder& e, T v) {
+    e.putRaw((uint64_t)(uintptr_t)v);
+}
+
+inline void Put(Encoder& e, char v) {
+    e.putRaw(v);
+}
+
+inline void Put(Encoder& e, const char* v) {
+    if(v) {
+        e.putString(v, strlen(v));
+    } else {
+        e.putString("(null)", 6);
+    }
+}
+
+inline void Put(Encoder& e, const std::string& v) {
+    e.putString(v.c_str(), v.size());
+}
+
+inline void PutArgs(Encoder& e) {
+}
+
+template<class T, class... Args>
+inline void PutArgs(Encoder& e, const T& v, const Args&... args) {
+    Put(e, v);
+    PutArgs(e, args...);
+}
+
+/**
+ * @brief 当前线程的编码缓冲区
+ */
+Encoder& GetEncoder();
+
+/**
+ * @brief 当前时间(纳秒)
+ */
+uint64_t GetTimeNs();
+
+/**
+ * @brief 编码并交给日志器输出
+ */
+template<class... Args>
+void Log(const std::shared_ptr<Logger>& logger, const BinLogFormat& format
+         , const Args&... args) {
+    Encoder& e = GetEncoder();
+    e.begin(LOG);
+    e.putRaw(format.getId());
+    e.putRaw(GetTimeNs());
+    e.putRaw((uint32_t)GetThreadId());
+    e.putRaw((uint32_t)GetFiberId());
+    PutArgs(e, args...);
+    e.finish();
+    logger->logBinary(logger, format, e.data(), e.size());
+}
+
+/**
+ * @brief 从二进制日志文件读取并解码为文本
+ */
+class Reader {
+public:
+    /**
+     * @brief 解码后的一条日志
+     */
+    struct Line {
+        /// 时间戳(纳秒)
+        uint64_t time = 0;
+        uint32_t threadId = 0;
+        uint32_t fiberId = 0;
+        LogLevel::Level level = LogLevel::UNKONW;
+        std::string file;
+        int32_t line = 0;
+        /// 格式化后的内容
+        std::string message;
+        /// 丢弃记录: 丢弃的行数, 其它为0
+        uint64_t dropped = 0;
+
+        /**
+         * @brief 转成默认格式的一行文本(不含换行)
+         */
+        std::string toString() const;
+    };
+
+    Reader(std::istream& is);
+
+    /**
+     * @brief 读取下一条日志
+     * @return 文件结束或格式错误时返回false, 格式错误时getError不为空
+     */
+    bool next(Line& line);
+
+    const std::string& getError() const { return m_error;}
+private:
+    struct Format {
+        LogLevel::Level level;
+        int32_t line;
+        std::string file;
+        std::string types;
+        std::string fmt;
+    };
+private:
+    std::istream& m_is;
+    std::string m_record;
+    std::unordered_map<uint32_t, Format> m_formats;
+    std::string m_error;
+};
+
+}
+
+/**
+ * @brief 二进制日志文件Appender
+ * @details 基于AsyncLogAppender: 日志记录写入每个线程的缓冲区, 后台线程批量写文件.
+ *          后台线程在写日志记录之前写入新注册的格式描述, 文件可以离线解码.
+ *          普通日志(MUHUI_LOG_*)的内容作为TEXT记录写入
+ */
+class BinLogAppender : public AsyncLogAppender {
+public:
+    typedef std::shared_ptr<BinLogAppender> ptr;
+
+    BinLogAppender(const std::string& filename, size_t buffer_size = 1024 * 1024
+                   , OverflowPolicy overflow = BLOCK);
+    ~BinLogAppender();
+
+    void log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override;
+    void logBinary(const std::shared_ptr<Logger>& logger, const BinLogFormat& format
+                   , const char* data, size_t len) override;
+    std::string toYamlString() override;
+protected:
+    void onWrite(std::string& head, uint64_t dropped) override;
+private:
+    /// 是否已写入SESSION记录
+    bool m_sessionWritten;
+    /// 已写入的格式数量
+    size_t m_formatWritten;
+};
+
+}
+
+#endif
@@ -10,6 +10,10 @@
 
 #define LOG_TAG "CONFIG"
 #include "config.h"
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
 
 namespace muhui
 {
@@ -54,14 +58,13 @@ static void ListAllMember(const std::string& prefix,
         }
     }
 }
-void Config::LoadFromYaml(const YAML::Node& root)
+std::vector<ConfigVarBase::Change::ptr> Config::Diff(const YAML::Node& root)
 {
     std::list<std::pair<std::string, YAML::Node>> all_nodes;
     ListAllMember("", root, all_nodes);
+    std::vector<ConfigVarBase::Change::ptr> changes;
     for(auto& i : all_nodes)
     {
-        //std::cout << i.first << std::endl;
-        //std::cout << i.second << std::endl;
         std::string key = i.first;
         if(key.empty())
         {
@@ -72,16 +75,61 @@ void Config::LoadFromYaml(const YAML::Node& root)
 
         if(var)
         {
+            ConfigVarBase::Change::ptr change;
             if(i.second.IsScalar())
             {
-                var->fromString(i.second.Scalar());
+                change = var->diff(i.second.Scalar());
             } else {
                 std::stringstream ss;
                 ss << i.second;
-                var->fromString(ss.str());
+                change = var->diff(ss.str());
+            }
+            if(change)
+            {
+                changes.push_back(change);
             }
         }
     }
+    return changes;
+}
+
+size_t Config::Apply(const std::vector<ConfigVarBase::Change::ptr>& changes)
+{
+    Mutex::Lock lock(GetApplyMutex());
+    std::vector<ConfigVarBase::Change::ptr> applied;
+    for(auto& i : changes)
+    {
+        if(i->apply())
+        {
+            applied.push_back(i);
+        }
+    }
+    //全部写入之后再通知
+    for(auto& i : applied)
+    {
+        MUHUI_LOG_INFO(MUHUI_LOG_ROOT()) << "Config changed: " << i->getName();
+        i->notify();
+    }
+    return applied.size();
+}
+
+void Config::LoadFromYaml(const YAML::Node& root)
+{
+    Apply(Diff(root));
+}
+
+bool Config::LoadFromFile(const std::string& path)
+{
+    YAML::Node root;
+    try{
+        root = YAML::LoadFile(path);
+    }catch(std::exception& e){
+        MUHUI_LOG_ERROR(MUHUI_LOG_ROOT()) << "Config::LoadFromFile " << path
+            << " fail: " << e.what();
+        return false;
+    }
+    LoadFromYaml(root);
+    return true;
 }
 
 void Config::Visit(std::function<void(ConfigVarBase::ptr)> cb)
@@ -93,4 +141,129 @@ void Config::Visit(std::function<void(ConfigVarBase::ptr)> cb)
     }
 }
 
+ConfigWatcher::ConfigWatcher(const std::string& file, uint64_t delay_ms)
+    : m_file(file)
+    , m_delay(delay_ms)
+{
+    size_t pos = file.rfind('/');
+    if(pos == std::string::npos)
+    {
+        m_dir = ".";
+        m_name = file;
+    } else {
+        m_dir = pos == 0 ? "/" : file.substr(0, pos);
+        m_name = file.substr(pos + 1);
+    }
+}
+
+ConfigWatcher::~ConfigWatcher()
+{
+    stop();
+}
+
+bool ConfigWatcher::start()
+{
+    if(m_thread)
+    {
+        return true;
+    }
+    m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(m_inotifyFd < 0)
+    {
+        MUHUI_LOG_ERROR(MUHUI_LOG_ROOT()) << "ConfigWatcher inotify_init1 fail, errno="
+            << errno << " " << strerror(errno);
+        return false;
+    }
+    if(inotify_add_watch(m_inotifyFd, m_dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        MUHUI_LOG_ERROR(MUHUI_LOG_ROOT()) << "ConfigWatcher watch " << m_dir << " fail, errno="
+            << errno << " " << strerror(errno);
+        close(m_inotifyFd);
+        m_inotifyFd = -1;
+        return false;
+    }
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_thread.reset(new Thread(std::bind(&ConfigWatcher::run, this), "config_watch"));
+    return true;
+}
+
+void ConfigWatcher::stop()
+{
+    if(!m_thread)
+    {
+        return;
+    }
+    uint64_t v = 1;
+    if(write(m_wakeFd, &v, sizeof(v)) != sizeof(v))
+    {
+        MUHUI_LOG_ERROR(MUHUI_LOG_ROOT()) << "ConfigWatcher wake fail, errno=" << errno;
+    }
+    m_thread->join();
+    m_thread.reset();
+    close(m_inotifyFd);
+    close(m_wakeFd);
+    m_inotifyFd = -1;
+    m_wakeFd = -1;
+}
+
+bool ConfigWatcher::reload()
+{
+    if(Config::LoadFromFile(m_file))
+    {
+        ++m_reloadCount;
+        return true;
+    }
+    ++m_errorCount;
+    return false;
+}
+
+void ConfigWatcher::run()
+{
+    pollfd fds[2];
+    fds[0].fd = m_inotifyFd;
+    fds[0].events = POLLIN;
+    fds[1].fd = m_wakeFd;
+    fds[1].events = POLLIN;
+    //inotify_event后面跟着变长的文件名
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool pending = false;
+    while(true)
+    {
+        //有待加载的变化时, 等待delay毫秒没有新事件再加载
+        int rt = poll(fds, 2, pending ? (int)m_delay : -1);
+        if(rt < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            MUHUI_LOG_ERROR(MUHUI_LOG_ROOT()) << "ConfigWatcher poll fail, errno=" << errno;
+            break;
+        }
+        if(fds[1].revents)
+        {
+            break;
+        }
+        if(rt == 0)
+        {
+            pending = false;
+            reload();
+            continue;
+        }
+        ssize_t len;
+        while((len = read(m_inotifyFd, buf, sizeof(buf))) > 0)
+        {
+            for(char* p = buf; p < buf + len;)
+            {
+                struct inotify_event* e = (struct inotify_event*)p;
+                if(e->len && m_name == e->name)
+                {
+                    pending = true;
+                }
+                p += sizeof(struct inotify_event) + e->len;
+            }
+        }
+    }
+}
+
 }
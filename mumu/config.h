@@ -34,10 +34,38 @@
 namespace muhui
 {
 //配置变量的基类
-class ConfigVarBase
+class ConfigVarBase : public std::enable_shared_from_this<ConfigVarBase>
 {
 public:
     typedef std::shared_ptr<ConfigVarBase> ptr;
+
+    /**
+     * @brief 一个配置项待生效的修改
+     * @details 由diff生成. Config::Apply先对一批修改逐个apply, 全部写入后再逐个notify
+     */
+    class Change
+    {
+    public:
+        typedef std::shared_ptr<Change> ptr;
+        virtual ~Change() {}
+
+        /**
+         * @brief 写入新值, 不通知监听者
+         * @return 值是否真的变化了(diff之后可能已被setValue修改)
+         */
+        virtual bool apply() = 0;
+
+        /**
+         * @brief 用apply时的旧值和新值通知监听者
+         */
+        virtual void notify() = 0;
+
+        /**
+         * @brief 配置项名称
+         */
+        virtual std::string getName() const = 0;
+    };
+
     ConfigVarBase(const std::string& name, const std::string& description = "")
         : m_name(name)
         , m_description(description) {
@@ -58,6 +86,12 @@ public:
 
     //获取变量数据类型
     virtual std::string getTypeName() const = 0;
+
+    /**
+     * @brief 解析val并和当前值比较, 不修改当前值
+     * @return 值不同时返回待生效的修改, 相同或解析失败返回nullptr
+     */
+    virtual Change::ptr diff(const std::string& val) = 0;
 protected:
     ///配置参数的名称
     std::string m_name;
@@ -410,7 +444,8 @@ public:
               , const T& default_value
               , const std::string& description)
         : ConfigVarBase(name, description)
-        , m_val(default_value) {}
+        , m_val(default_value)
+        , m_cache(default_value) {}
 
     /**
      * @brief 将参数值转换成YAML String
@@ -444,9 +479,13 @@ public:
         }
         return false;
     }
+    /**
+     * @brief 获取参数值
+     * @details 不加锁, 读的是setValue同步更新的副本, 热路径上可以直接调用,
+     *          不需要再用监听回调维护一份静态缓存
+     */
     const T getValue() { 
-        RWMutexType::ReadLock lock(m_mutex);
-        return m_val; 
+        return m_cache.load();
     }
     void setValue(const T& v) { 
         { //该{}的作用是添加一个局部域，当该段代码执行结束，ReadLock自动析构解锁，防止死锁
@@ -460,8 +499,25 @@ public:
         }
         RWMutexType::WriteLock lock(m_mutex);
         m_val = v;
+        m_cache.store(v);
     }
     std::string getTypeName() const override { return typeid(T).name(); }
+
+    Change::ptr diff(const std::string& val) override
+    {
+        try{
+            T v = FromStr()(val);
+            if(v == getValue()){
+                return nullptr;
+            }
+            return std::make_shared<ValueChange>(
+                    std::static_pointer_cast<ConfigVar>(shared_from_this()), v);
+        }catch(std::exception& e){
+            MUHUI_LOG_ERROR(MUHUI_LOG_ROOT()) << "ConfigVar::diff exception"
+                << e.what() << "convert: string to" << typeid(m_val).name();
+        }
+        return nullptr;
+    }
     //添加监听
     uint64_t addListener(on_change_cb cb){
         static uint64_t s_fun_id = 0;
@@ -489,8 +545,57 @@ public:
         RWMutexType::WriteLock lock(m_mutex);
         m_cbs.clear();
     }
+private:
+    /**
+     * @brief ConfigVar待生效的修改
+     */
+    class ValueChange : public Change
+    {
+    public:
+        ValueChange(typename ConfigVar::ptr var, const T& v)
+            : m_var(var)
+            , m_new(v)
+            , m_old(v) {}
+
+        bool apply() override
+        {
+            RWMutexType::WriteLock lock(m_var->m_mutex);
+            if(m_var->m_val == m_new){
+                return false;
+            }
+            m_old = m_var->m_val;
+            m_var->m_val = m_new;
+            m_var->m_cache.store(m_new);
+            return true;
+        }
+
+        void notify() override { m_var->notify(m_old, m_new); }
+
+        std::string getName() const override { return m_var->getName(); }
+    private:
+        typename ConfigVar::ptr m_var;
+        T m_new;
+        T m_old;
+    };
+
+    /**
+     * @brief 通知监听者, 不持有锁, 回调里可以读写本配置项
+     */
+    void notify(const T& old_value, const T& new_value)
+    {
+        std::map<uint64_t, on_change_cb> cbs;
+        {
+            RWMutexType::ReadLock lock(m_mutex);
+            cbs = m_cbs;
+        }
+        for(auto& i : cbs){
+            i.second(old_value, new_value);
+        }
+    }
 private:
     T m_val;
+    //m_val的无锁副本, 在写锁内更新, 供getValue读取
+    LockFreeValue<T> m_cache;
     RWMutexType m_mutex;
     //变更回调函数组， uint64_t key, 要求唯一，一般可以用hash
     std::map<uint64_t, on_change_cb> m_cbs;
@@ -567,9 +672,30 @@ public:
     static ConfigVarBase::ptr LookupBase(const std::string& name);
     /**
      * @brief 使用YAML::Node初始化配置模块
+     * @details 等价于Apply(Diff(root)), 只有变化了的配置项会通知监听者
      */
     static void LoadFromYaml(const YAML::Node& root);
 
+    /**
+     * @brief 从YAML文件加载配置
+     * @return 文件读取或解析失败返回false, 此时配置不变
+     */
+    static bool LoadFromFile(const std::string& path);
+
+    /**
+     * @brief 计算root与当前配置的差异
+     * @details 只解析和比较, 不修改配置, 可以在任意线程执行. 没有注册的配置项被忽略
+     */
+    static std::vector<ConfigVarBase::Change::ptr> Diff(const YAML::Node& root);
+
+    /**
+     * @brief 把一批修改作为整体生效
+     * @details 先写入全部新值, 再按顺序通知监听者, 监听者读到的其它配置项已是同一批的新值.
+     *          多批修改互斥执行, 不会交错; 监听者里不能再调用Apply/LoadFromYaml
+     * @return 实际变化的配置项数量
+     */
+    static size_t Apply(const std::vector<ConfigVarBase::Change::ptr>& changes);
+
     /**
      * @brief 遍历配置模块里面所有配置项
      * @param[in] cb 配置项回调函数
@@ -595,6 +721,77 @@ private:
         static RWMutexType m_mutex;
         return m_mutex;
     }
+
+    /**
+     * @brief Apply的互斥量, 保证一批修改整体生效
+     */
+    static Mutex& GetApplyMutex() {
+        static Mutex s_mutex;
+        return s_mutex;
+    }
+};
+
+/**
+ * @brief 监视配置文件, 文件变化后重新加载
+ * @details 后台线程用inotify监视文件所在目录(编辑器通常写临时文件再rename替换原文件),
+ *          收到事件后等待delay_ms合并连续的写入, 然后在后台线程读取解析并计算差异,
+ *          只把变化了的配置项作为一批生效. 文件解析失败时保留原配置
+ */
+class ConfigWatcher : Noncopyable
+{
+public:
+    typedef std::shared_ptr<ConfigWatcher> ptr;
+
+    /**
+     * @brief 构造函数
+     * @param[in] file 配置文件路径
+     * @param[in] delay_ms 收到文件变化后等待多久再加载(毫秒)
+     */
+    ConfigWatcher(const std::string& file, uint64_t delay_ms = 100);
+    ~ConfigWatcher();
+
+    /**
+     * @brief 开始监视, 不会立即加载
+     * @return 目录不存在或inotify初始化失败返回false
+     */
+    bool start();
+
+    /**
+     * @brief 停止监视, 等待后台线程退出
+     */
+    void stop();
+
+    /**
+     * @brief 立即在当前线程加载一次
+     */
+    bool reload();
+
+    const std::string& getFile() const { return m_file; }
+    /// 成功加载的次数
+    uint64_t getReloadCount() const { return m_reloadCount; }
+    /// 加载失败的次数
+    uint64_t getErrorCount() const { return m_errorCount; }
+private:
+    /**
+     * @brief 后台线程, 等待文件变化
+     */
+    void run();
+private:
+    /// 配置文件路径
+    std::string m_file;
+    /// 所在目录
+    std::string m_dir;
+    /// 文件名
+    std::string m_name;
+    /// 合并写入的等待时间
+    uint64_t m_delay;
+    /// inotify句柄
+    int m_inotifyFd = -1;
+    /// 唤醒后台线程退出
+    int m_wakeFd = -1;
+    Thread::ptr m_thread;
+    std::atomic<uint64_t> m_reloadCount{0};
+    std::atomic<uint64_t> m_errorCount{0};
 };
 }
 
@@ -266,14 +266,16 @@ void Fiber::YieldToReady()
 }
 
 /**
- * @brief 将当前协程切换到后台,并设置为HOLD状态
- * @post getState() = HOLD
+ * @brief 将当前协程切换到后台, 等待被重新调度
+ * @details 切出时状态仍为EXEC, 由调度器(Scheduler::run)切回后设置为HOLD
+ * @post 返回调度器后 getState() = HOLD
  */
 void Fiber::YieldToHold()
 {
     Fiber::ptr cur = GetThis();
     MUHUI_ASSERT(cur->m_state == EXEC);
-    cur->m_state = HOLD;
+    //不能在这里设置HOLD: swapOut完成前其他线程看到非EXEC状态会把协程切入执行,
+    //两个线程同时使用同一个上下文. 由Scheduler::run在切回后设置HOLD
     cur->swapOut();
 }
 
@@ -124,8 +124,9 @@ public:
     static void YieldToReady();
 
     /**
-     * @brief 将当前协程切换到后台,并设置为HOLD状态
-     * @post getState() = HOLD
+     * @brief 将当前协程切换到后台, 等待被重新调度
+     * @details 切出时状态仍为EXEC, 由调度器(Scheduler::run)切回后设置为HOLD
+     * @post 返回调度器后 getState() = HOLD
      */
     static void YieldToHold();
 
@@ -49,16 +49,13 @@ void hook_init() {
 #undef XX
 }
 
-static uint64_t s_connect_timeout = -1;
 struct _HookIniter {
     _HookIniter() {
         hook_init();
-        s_connect_timeout = g_tcp_connect_timeout->getValue();
 
         g_tcp_connect_timeout->addListener([](const int& old_value, const int& new_value){
                 MUHUI_LOG_INFO(g_logger) << "tcp connect timeout changed from "
                                          << old_value << " to " << new_value;
-                s_connect_timeout = new_value;
         });
     }
 };
@@ -127,7 +124,7 @@ retry:
         int rt = iom->addEvent(fd, (muhui::IOManager::Event)(event));
         //MUHUI_LOG_DEBUG(g_logger) << rt;
         if(MUHUI_UNLIKELY(rt)) {
-            MUHUI_LOG_ERROR(g_logger) << hook_fun_name << " addEvent("
+            MUHUI_LOG_LIMIT_ERROR(g_logger, 10, 1000) << hook_fun_name << " addEvent("
                 << fd << ", " << event << ")";
             if(timer) {
                 timer->cancel();
@@ -281,7 +278,7 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
 }
 
 int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
-    return connect_with_timeout(sockfd, addr, addrlen, muhui::s_connect_timeout);
+    return connect_with_timeout(sockfd, addr, addrlen, muhui::g_tcp_connect_timeout->getValue());
 }
 
 int accept(int s, struct sockaddr *addr, socklen_t *addrlen) {
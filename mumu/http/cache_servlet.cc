@@ -0,0 +1,333 @@
+#include "cache_servlet.h"
+#include "log.h"
+#include "util.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace muhui {
+namespace http {
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_NAME("system");
+
+/**
+ * @brief 按','切分头部的值, 去掉两端空白
+ */
+template<class CB>
+static void ForEachToken(HttpHeaders::StringView value, CB cb) {
+    size_t pos = 0;
+    while(pos < value.size()) {
+        size_t end = value.find(',', pos);
+        if(end == HttpHeaders::StringView::npos) {
+            end = value.size();
+        }
+        size_t b = pos;
+        size_t e = end;
+        while(b < e && (value[b] == ' ' || value[b] == '\t')) {
+            ++b;
+        }
+        while(e > b && (value[e - 1] == ' ' || value[e - 1] == '\t')) {
+            --e;
+        }
+        if(e > b && !cb(value.substr(b, e - b))) {
+            return;
+        }
+        pos = end + 1;
+    }
+}
+
+/**
+ * @brief 解析响应的Cache-Control
+ * @param[in, out] ttl 缓存时间(毫秒), 有max-age时覆盖
+ * @return 是否可以缓存
+ */
+static bool ParseCacheControl(HttpHeaders::StringView value, uint64_t& ttl) {
+    bool cacheable = true;
+    uint64_t max_age = (uint64_t)-1;
+    uint64_t s_maxage = (uint64_t)-1;
+    ForEachToken(value, [&](HttpHeaders::StringView token){
+        if(HttpHeaders::EqualsIgnoreCase(token, "no-store")
+                || HttpHeaders::EqualsIgnoreCase(token, "no-cache")
+                || HttpHeaders::EqualsIgnoreCase(token, "private")) {
+            cacheable = false;
+            return false;
+        }
+        size_t pos = token.find('=');
+        if(pos == HttpHeaders::StringView::npos) {
+            return true;
+        }
+        HttpHeaders::StringView name = token.substr(0, pos);
+        uint64_t v = 0;
+        if(!HttpHeaders::ParseUint64(token.substr(pos + 1), v)) {
+            return true;
+        }
+        if(HttpHeaders::EqualsIgnoreCase(name, "max-age")) {
+            max_age = v;
+        } else if(HttpHeaders::EqualsIgnoreCase(name, "s-maxage")) {
+            s_maxage = v;
+        }
+        return true;
+    });
+    if(!cacheable) {
+        return false;
+    }
+    //共享缓存优先使用s-maxage; RFC9111 1.2.2: 超过2^31秒按2^31秒处理, 避免乘1000后溢出
+    static const uint64_t s_max_delta_seconds = 2147483648ull;
+    if(s_maxage != (uint64_t)-1) {
+        ttl = std::min(s_maxage, s_max_delta_seconds) * 1000;
+    } else if(max_age != (uint64_t)-1) {
+        ttl = std::min(max_age, s_max_delta_seconds) * 1000;
+    }
+    return ttl > 0;
+}
+
+/**
+ * @brief If-None-Match是否匹配ETag(弱比较)
+ */
+static bool MatchETag(HttpHeaders::StringView inm, const std::string& etag) {
+    HttpHeaders::StringView tag(etag);
+    if(tag.starts_with("W/")) {
+        tag.remove_prefix(2);
+    }
+    bool match = false;
+    ForEachToken(inm, [&](HttpHeaders::StringView token){
+        if(token.starts_with("W/")) {
+            token.remove_prefix(2);
+        }
+        if(token == "*" || token == tag) {
+            match = true;
+            return false;
+        }
+        return true;
+    });
+    return match;
+}
+
+CacheServlet::CacheServlet(Servlet::ptr servlet, uint64_t max_bytes
+                           , uint64_t default_ttl, uint32_t shards)
+    : Servlet("CacheServlet(" + servlet->getName() + ")")
+    , m_servlet(servlet)
+    , m_defaultTTL(default_ttl) {
+    if(shards == 0) {
+        shards = 1;
+    }
+    m_shardBytes = max_bytes / shards;
+    for(uint32_t i = 0; i < shards; ++i) {
+        m_shards.emplace_back(new Shard);
+    }
+}
+
+void CacheServlet::MakeKey(std::string& key, HttpMethod method, uint8_t version
+                           , const std::string& path, const std::string& query) {
+    key.reserve(path.size() + query.size() + 16);
+    key.append(HttpMethodToString(method)).append(" ").append(path);
+    if(!query.empty()) {
+        key.append("?").append(query);
+    }
+    //报文的状态行和Connection头部与请求的版本有关, 非HTTP/1.1单独缓存
+    if(version != 0x11) {
+        char buf[16];
+        int n = snprintf(buf, sizeof(buf), " HTTP/%d.%d", version >> 4, version & 0x0f);
+        key.append(buf, n);
+    }
+}
+
+void CacheServlet::AppendEncoding(std::string& key, HttpCompressor::Encoding enc) {
+    if(enc != HttpCompressor::IDENTITY) {
+        key.append(" ").append(HttpCompressor::EncodingToString(enc));
+    }
+}
+
+CacheServlet::Shard& CacheServlet::getShard(const std::string& key) {
+    return *m_shards[muhui::murmur3_hash(key.c_str(), key.size()) % m_shards.size()];
+}
+
+void CacheServlet::Erase(Shard& shard, std::list<Entry::ptr>::iterator it) {
+    shard.bytes -= (*it)->bytes;
+    shard.index.erase((*it)->key);
+    shard.lru.erase(it);
+}
+
+CacheServlet::Entry::ptr CacheServlet::get(const std::string& key, uint64_t now) {
+    Shard& shard = getShard(key);
+    MutexType::Lock lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if(it == shard.index.end()) {
+        return nullptr;
+    }
+    if((*it->second)->expire <= now) {
+        Erase(shard, it->second);
+        return nullptr;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    return *it->second;
+}
+
+void CacheServlet::put(Entry::ptr entry) {
+    if(entry->bytes > m_shardBytes) {
+        return;
+    }
+    Shard& shard = getShard(entry->key);
+    MutexType::Lock lock(shard.mutex);
+    auto it = shard.index.find(entry->key);
+    if(it != shard.index.end()) {
+        Erase(shard, it->second);
+    }
+    while(shard.bytes + entry->bytes > m_shardBytes && !shard.lru.empty()) {
+        Erase(shard, std::prev(shard.lru.end()));
+    }
+    shard.lru.push_front(entry);
+    shard.index[entry->key] = shard.lru.begin();
+    shard.bytes += entry->bytes;
+}
+
+void CacheServlet::invalidate(const std::string& path, const std::string& query) {
+    //各版本, 各编码的变体一起删除
+    static const uint8_t s_versions[] = {0x11, 0x10};
+    static const HttpCompressor::Encoding s_encodings[] = {
+        HttpCompressor::IDENTITY, HttpCompressor::GZIP, HttpCompressor::DEFLATE
+    };
+    for(auto ver : s_versions) {
+        std::string base;
+        MakeKey(base, HttpMethod::GET, ver, path, query);
+        for(auto enc : s_encodings) {
+            std::string key = base;
+            AppendEncoding(key, enc);
+            Shard& shard = getShard(key);
+            MutexType::Lock lock(shard.mutex);
+            auto it = shard.index.find(key);
+            if(it != shard.index.end()) {
+                Erase(shard, it->second);
+            }
+        }
+    }
+}
+
+void CacheServlet::clear() {
+    for(auto& i : m_shards) {
+        MutexType::Lock lock(i->mutex);
+        i->lru.clear();
+        i->index.clear();
+        i->bytes = 0;
+    }
+}
+
+uint64_t CacheServlet::getBytes() {
+    uint64_t v = 0;
+    for(auto& i : m_shards) {
+        MutexType::Lock lock(i->mutex);
+        v += i->bytes;
+    }
+    return v;
+}
+
+size_t CacheServlet::getCount() {
+    size_t v = 0;
+    for(auto& i : m_shards) {
+        MutexType::Lock lock(i->mutex);
+        v += i->lru.size();
+    }
+    return v;
+}
+
+void CacheServlet::SetNotModified(HttpResponce::ptr response, const std::string& etag) {
+    response->setStatus(HttpStatus::NOT_MODIFIED);
+    response->setReason("");
+    response->setBody("");
+    response->setHeader("ETag", etag);
+}
+
+int32_t CacheServlet::handle(HttpRequest::ptr request
+                             , HttpResponce::ptr response
+                             , HttpSession::ptr session) {
+    //缓存的是HTTP/1.1报文, HTTP/2(没有HttpSession)的请求不经过缓存
+    if(request->getMethod() != HttpMethod::GET || !session) {
+        return m_servlet->handle(request, response, session);
+    }
+    const HttpHeaders& headers = request->getHeaders();
+    bool found = false;
+    headers.get(HttpHeaderId::AUTHORIZATION, &found);
+    bool bypass = found || HttpHeaders::HasToken(headers.get(HttpHeaderId::CACHE_CONTROL), "no-cache");
+    HttpHeaders::StringView inm = headers.get(HttpHeaderId::IF_NONE_MATCH);
+
+    std::string key;
+    MakeKey(key, request->getMethod(), request->getVersion(), request->getPath(), request->getQuery());
+    //按协商的内容编码分别缓存
+    AppendEncoding(key, HttpCompressor::Negotiate(*request));
+    uint64_t now = muhui::GetCurrentMS();
+    if(!bypass) {
+        Entry::ptr entry = get(key, now);
+        if(entry) {
+            ++m_hits;
+            if(!inm.empty() && MatchETag(inm, entry->etag)) {
+                ++m_notModified;
+                SetNotModified(response, entry->etag);
+                return 0;
+            }
+            //直接发送缓存的报文, 还有流水线请求时与后续响应合并发送
+            session->queueRawResponse(response->isClose() ? entry->close : entry->keepalive);
+            if(!session->hasBufferedRequest()) {
+                session->flush();
+            }
+            return 0;
+        }
+    }
+    ++m_misses;
+    int32_t rt = m_servlet->handle(request, response, session);
+    if(session->isResponseSent() || response->getStatus() != HttpStatus::OK
+            || response->isChunked() || response->isWebsocket()
+            || !response->getCookies().empty()) {
+        return rt;
+    }
+    const HttpHeaders& rsp_headers = response->getHeadrs();
+    rsp_headers.get(HttpHeaderId::SET_COOKIE, &found);
+    if(found) {
+        return rt;
+    }
+    uint64_t ttl = m_defaultTTL;
+    if(!ParseCacheControl(rsp_headers.get(HttpHeaderId::CACHE_CONTROL), ttl)) {
+        return rt;
+    }
+
+    Entry::ptr entry = std::make_shared<Entry>();
+    entry->key.swap(key);
+    rsp_headers.get(HttpHeaderId::ETAG, &found);
+    if(!found) {
+        const std::string& body = response->getBody();
+        char buf[64];
+        int n = snprintf(buf, sizeof(buf), "\"%lx-%zx\""
+                    , (unsigned long)muhui::murmur3_hash64((const void*)body.c_str(), body.size())
+                    , body.size());
+        response->setHeader("ETag", std::string(buf, n));
+    }
+    //缓存压缩后的报文, 命中时不需要再压缩; 压缩后ETag带编码后缀
+    HttpCompressor::CompressResponse(*request, *response);
+    entry->etag = rsp_headers.get(HttpHeaderId::ETAG).to_string();
+    entry->expire = now + ttl;
+    //长连接和短连接各序列化一份, 命中时按请求选择; 响应的版本与请求相同, 已经包含在key里
+    bool close = response->isClose();
+    std::shared_ptr<std::string> data = std::make_shared<std::string>();
+    response->setClose(false);
+    response->serializeHeader(*data);
+    data->append(response->getBody());
+    entry->keepalive = data;
+    data = std::make_shared<std::string>();
+    response->setClose(true);
+    response->serializeHeader(*data);
+    data->append(response->getBody());
+    entry->close = data;
+    response->setClose(close);
+    entry->bytes = entry->key.size() + entry->etag.size()
+        + entry->keepalive->size() + entry->close->size();
+    put(entry);
+    MUHUI_LOG_DEBUG(g_logger) << "cache put key=" << entry->key << " bytes=" << entry->bytes
+        << " ttl=" << ttl;
+
+    if(!inm.empty() && MatchETag(inm, entry->etag)) {
+        ++m_notModified;
+        SetNotModified(response, entry->etag);
+    }
+    return rt;
+}
+
+} // namespace http
+} // namespace muhui
@@ -0,0 +1,160 @@
+/**
+ * @file cache_servlet.h
+ * @author muhui (2571579302@qq.com)
+ * @brief HTTP响应缓存servlet
+ * @version 0.1
+ * @date 2023-02-19
+ */
+#ifndef __MUHUI_HTTP_CACHE_SERVLET_H__
+#define __MUHUI_HTTP_CACHE_SERVLET_H__
+#include "http_compress.h"
+#include "servlet.h"
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace muhui {
+namespace http {
+
+/**
+ * @brief 响应缓存servlet, 包装任意servlet
+ * @details 以 method + path + query + 版本为key缓存GET请求的200响应, 缓存序列化后的完整报文,
+ *          命中时不调用被包装的servlet, 也不重新序列化, 直接交给HttpSession发送.
+ *          - 响应的Cache-Control: max-age=N 决定缓存时间, 没有时使用默认缓存时间(0表示不缓存);
+ *            no-store, no-cache, private 以及带Set-Cookie的响应不缓存
+ *          - 请求带Authorization或Cache-Control: no-cache时不使用缓存
+ *          - 响应没有ETag时按消息体生成, If-None-Match匹配时直接返回304
+ *          - 按key的哈希分片, 每个分片一把锁, 按字节数LRU淘汰
+ *          - 按Accept-Encoding协商的编码分别缓存压缩后的报文(见HttpCompressor)
+ *          不处理其他Vary, 被包装的servlet的响应不应依赖key以外的请求内容
+ */
+class CacheServlet : public Servlet {
+public:
+    typedef std::shared_ptr<CacheServlet> ptr;
+    typedef Mutex MutexType;
+
+    /**
+     * @brief 构造函数
+     * @param[in] servlet 被包装的servlet
+     * @param[in] max_bytes 缓存的最大字节数
+     * @param[in] default_ttl 响应没有max-age时的缓存时间(毫秒), 0表示不缓存
+     * @param[in] shards 分片数
+     */
+    CacheServlet(Servlet::ptr servlet, uint64_t max_bytes
+                 , uint64_t default_ttl = 0, uint32_t shards = 16);
+
+    virtual int32_t handle(HttpRequest::ptr request
+                        , HttpResponce::ptr response
+                        , HttpSession::ptr session) override;
+
+    /**
+     * @brief 删除key对应的缓存
+     * @param[in] path 请求路径
+     * @param[in] query 请求参数
+     */
+    void invalidate(const std::string& path, const std::string& query = "");
+
+    /**
+     * @brief 清空缓存
+     */
+    void clear();
+
+    /**
+     * @brief 返回缓存占用的字节数
+     */
+    uint64_t getBytes();
+
+    /**
+     * @brief 返回缓存的响应数
+     */
+    size_t getCount();
+
+    uint64_t getHits() const { return m_hits;}
+    uint64_t getMisses() const { return m_misses;}
+    uint64_t getNotModified() const { return m_notModified;}
+
+    Servlet::ptr getServlet() const { return m_servlet;}
+private:
+    /// 缓存的响应
+    struct Entry {
+        typedef std::shared_ptr<Entry> ptr;
+        /// key
+        std::string key;
+        /// ETag(含引号)
+        std::string etag;
+        /// 长连接的完整报文
+        std::shared_ptr<const std::string> keepalive;
+        /// 短连接的完整报文
+        std::shared_ptr<const std::string> close;
+        /// 过期时间(毫秒)
+        uint64_t expire;
+        /// 占用字节数
+        uint64_t bytes;
+    };
+
+    /// 缓存分片
+    struct Shard {
+        MutexType mutex;
+        /// LRU链表, 最近使用的在头部
+        std::list<Entry::ptr> lru;
+        /// key -> lru中的位置
+        std::unordered_map<std::string, std::list<Entry::ptr>::iterator> index;
+        /// 占用字节数
+        uint64_t bytes = 0;
+    };
+
+    /**
+     * @brief 在key后追加内容编码, 不压缩时不追加
+     */
+    static void AppendEncoding(std::string& key, HttpCompressor::Encoding enc);
+
+    /**
+     * @brief 生成缓存key
+     * @param[in] version 请求的HTTP版本, 不同版本的报文分别缓存
+     */
+    static void MakeKey(std::string& key, HttpMethod method, uint8_t version
+                        , const std::string& path, const std::string& query);
+
+    Shard& getShard(const std::string& key);
+
+    /**
+     * @brief 查找未过期的缓存, 命中时移到LRU头部
+     */
+    Entry::ptr get(const std::string& key, uint64_t now);
+
+    /**
+     * @brief 放入缓存, 超过字节预算时淘汰最久未使用的
+     */
+    void put(Entry::ptr entry);
+
+    /**
+     * @brief 从分片中删除, 需要持有分片的锁
+     */
+    static void Erase(Shard& shard, std::list<Entry::ptr>::iterator it);
+
+    /**
+     * @brief 设置304响应
+     */
+    static void SetNotModified(HttpResponce::ptr response, const std::string& etag);
+private:
+    /// 被包装的servlet
+    Servlet::ptr m_servlet;
+    /// 每个分片的最大字节数
+    uint64_t m_shardBytes;
+    /// 默认缓存时间
+    uint64_t m_defaultTTL;
+    /// 分片
+    std::vector<std::unique_ptr<Shard> > m_shards;
+    /// 命中次数
+    std::atomic<uint64_t> m_hits = {0};
+    /// 未命中次数
+    std::atomic<uint64_t> m_misses = {0};
+    /// 返回304的次数
+    std::atomic<uint64_t> m_notModified = {0};
+};
+
+} // namespace http
+} // namespace muhui
+#endif // !__MUHUI_HTTP_CACHE_SERVLET_H__
@@ -1,5 +1,6 @@
 #include "http.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
@@ -31,13 +32,61 @@ HttpMethod StringToHttpMethod(const std::string& m) {
  * @return HttpMethod
  */
 HttpMethod charsToHttpMethod(const char* m) {
-#define XX(num, name, string)                                                  \
-    if (strncmp(#string, m, strlen(#string)) == 0) {                           \
-        return HttpMethod::name;                                               \
+    return charsToHttpMethod(m, strlen(m));
+}
+
+namespace {
+/**
+ * @brief HTTP方法查找表, 按(长度, 首尾字符)散列, 冲突时线性探测
+ */
+struct MethodTable {
+    static const size_t SIZE = 128;
+    struct Slot {
+        /// 方法名, 为空表示空槽
+        std::string name;
+        HttpMethod method;
+    };
+    Slot slots[SIZE];
+
+    static size_t Hash(const char* m, size_t len) {
+        return (len * 31 + (uint8_t)m[0] * 7 + (uint8_t)m[len - 1]) & (SIZE - 1);
     }
-    HTTP_METHOD_MAP(XX);
+
+    MethodTable() {
+#define XX(num, name, string) add(HttpMethod::name, #string);
+        HTTP_METHOD_MAP(XX)
 #undef XX
-    return HttpMethod::INVALID_METHOD;
+    }
+
+    void add(HttpMethod method, std::string name) {
+        //M - SEARCH 字符串化后带空格
+        name.erase(std::remove(name.begin(), name.end(), ' '), name.end());
+        size_t i = Hash(name.c_str(), name.size());
+        while(!slots[i].name.empty()) {
+            i = (i + 1) & (SIZE - 1);
+        }
+        slots[i].name = name;
+        slots[i].method = method;
+    }
+
+    HttpMethod find(const char* m, size_t len) const {
+        if(len == 0) {
+            return HttpMethod::INVALID_METHOD;
+        }
+        for(size_t i = Hash(m, len); !slots[i].name.empty(); i = (i + 1) & (SIZE - 1)) {
+            if(slots[i].name.size() == len && memcmp(slots[i].name.c_str(), m, len) == 0) {
+                return slots[i].method;
+            }
+        }
+        return HttpMethod::INVALID_METHOD;
+    }
+};
+
+static const MethodTable s_method_table;
+}
+
+HttpMethod charsToHttpMethod(const char* m, size_t len) {
+    return s_method_table.find(m, len);
 }
 
 static const char* s_method_string[] = {
@@ -100,22 +149,57 @@ HttpRequest::HttpRequest(uint8_t version, bool close)
 
 std::string HttpRequest::getHeader(const std::string& key,
                                    const std::string& def) const {
-    auto it = m_headers.find(key);
-    return it == m_headers.end() ? def : it->second;
+    bool found = false;
+    HttpHeaders::StringView v = m_headers.get(key, &found);
+    return found ? v.to_string() : def;
 }
 std::string HttpRequest::getParam(const std::string& key,
                                   const std::string& def) const {
     auto it = m_params.find(key);
-    return it == m_headers.end() ? def : it->second;
+    return it == m_params.end() ? def : it->second;
 }
 std::string HttpRequest::getCookie(const std::string& key,
                                    const std::string& def) const {
     auto it = m_cookies.find(key);
-    return it == m_headers.end() ? def : it->second;
+    return it == m_cookies.end() ? def : it->second;
 }
 
 void HttpRequest::setHeader(const std::string& key, const std::string& val) {
-    m_headers[key] = val;
+    setHeader(key.c_str(), key.size(), val.c_str(), val.size());
+}
+void HttpRequest::setHeader(const char* key, size_t klen,
+                            const char* val, size_t vlen) {
+    HttpHeaderId id = m_headers.set(key, klen, val, vlen);
+    if(id != HttpHeaderId::UNKNOWN) {
+        decodeHeader(id, val, vlen);
+    }
+}
+void HttpRequest::decodeHeader(HttpHeaderId id, const char* val, size_t vlen) {
+    HttpHeaders::StringView v(val, vlen);
+    switch(id) {
+        case HttpHeaderId::CONTENT_LENGTH:
+            if(!HttpHeaders::ParseUint64(v, m_contentLength)) {
+                m_contentLength = 0;
+            }
+            break;
+        case HttpHeaderId::CONNECTION:
+            m_connection = 0;
+            if(HttpHeaders::HasToken(v, "close")) {
+                m_connection |= CONN_CLOSE;
+            }
+            if(HttpHeaders::HasToken(v, "keep-alive")) {
+                m_connection |= CONN_KEEPALIVE;
+            }
+            if(HttpHeaders::HasToken(v, "upgrade")) {
+                m_connection |= CONN_UPGRADE;
+            }
+            break;
+        case HttpHeaderId::TRANSFER_ENCODING:
+            m_chunked = HttpHeaders::HasToken(v, "chunked");
+            break;
+        default:
+            break;
+    }
 }
 void HttpRequest::setParam(const std::string& key, const std::string& val) {
     m_params[key] = val;
@@ -124,17 +208,38 @@ void HttpRequest::setCookie(const std::string& key, const std::string& val) {
     m_cookies[key] = val;
 }
 
-void HttpRequest::delHeader(const std::string& key) { m_headers.erase(key); }
+void HttpRequest::delHeader(const std::string& key) {
+    switch(m_headers.erase(key)) {
+        case HttpHeaderId::CONTENT_LENGTH:
+            m_contentLength = 0;
+            break;
+        case HttpHeaderId::CONNECTION:
+            m_connection = 0;
+            break;
+        case HttpHeaderId::TRANSFER_ENCODING:
+            m_chunked = false;
+            break;
+        default:
+            break;
+    }
+}
+void HttpRequest::clearHeaders() {
+    m_headers.clear();
+    m_contentLength = 0;
+    m_connection = 0;
+    m_chunked = false;
+}
 void HttpRequest::delParam(const std::string& key) { m_params.erase(key); }
 void HttpRequest::delCookie(const std::string& key) { m_cookies.erase(key); }
 
 bool HttpRequest::hasHeader(const std::string& key, std::string* val) {
-    auto it = m_headers.find(key);
-    if (it == m_headers.end()) {
+    bool found = false;
+    HttpHeaders::StringView v = m_headers.get(key, &found);
+    if (!found) {
         return false;
     }
     if (val) {
-        *val = it->second;
+        *val = v.to_string();
     }
     return true;
 }
@@ -177,31 +282,50 @@ std::ostream& HttpRequest::dump(std::ostream& os) const {
     if (!m_websocket) {
         os << "connection: " << (m_close ? "close" : "keep-alive") << "\r\n";
     }
-    for (auto& i : m_headers) {
-        if (!m_websocket && strcasecmp(i.first.c_str(), "connection") == 0) {
+    for (auto i : m_headers) {
+        if (!m_websocket && HttpHeaders::EqualsIgnoreCase(i.first, "connection")) {
+            continue;
+        }
+        if (!m_body.empty() && HttpHeaders::EqualsIgnoreCase(i.first, "content-length")) {
             continue;
         }
         os << i.first << ": " << i.second << "\r\n";
     }
     if (!m_body.empty()) {
-        os << "connect-length: " << m_body.size() << "\r\n\r\n" << m_body;
+        os << "content-length: " << m_body.size() << "\r\n\r\n" << m_body;
     } else {
         os << "\r\n";
     }
     return os;
 }
-#if 0
 void HttpRequest::init() {
-    std::string conn = getHeader("connection");
-    if(!conn.empty()) {
-        //忽略大小写
-        if(strcasecmp(conn.c_str(), "keep-alive") == 0) {
-            m_close = false;
-        } else {
-            m_close = true;
-        }
+    //connection选项在设置头部时已经解码, 可能带有多个选项, 如 "keep-alive, Upgrade"
+    if(m_connection & CONN_CLOSE) {
+        m_close = true;
+    } else if(m_connection & CONN_KEEPALIVE) {
+        m_close = false;
+    } else {
+        //HTTP/1.1默认长连接, HTTP/1.0默认短连接
+        m_close = m_version < 0x11;
     }
 }
+void HttpRequest::reset() {
+    m_method = HttpMethod::GET;
+    m_version = 0x11;
+    m_close = true;
+    m_websocket = false;
+    m_parserParamFlag = 0;
+    m_path = "/";
+    //clear保留字符串容量, 复用时减少分配
+    m_query.clear();
+    m_fragment.clear();
+    m_body.clear();
+    m_bodyStream.reset();
+    clearHeaders();
+    m_params.clear();
+    m_cookies.clear();
+}
+#if 0
 void HttpRequest::initParam() {
     initQueryParam();
     initBodyParam();
@@ -235,18 +359,25 @@ void HttpRequest::initCookies() {
 
 }
 #endif
-HttpResponce::HttpResponce(uint8_t version, bool close)
+HttpResponce::HttpResponce(uint8_t version, bool close, Arena::ptr arena)
     : m_status(HttpStatus::OK),
       m_version(version),
       m_close(close),
-      m_websocket(false) {}
+      m_websocket(false),
+      m_chunked(false),
+      m_headers(arena) {}
 std::string HttpResponce::getHeader(const std::string& key,
                                     const std::string& def) const {
-    auto it = m_headers.find(key);
-    return it == m_headers.end() ? def : it->second;
+    bool found = false;
+    HttpHeaders::StringView v = m_headers.get(key, &found);
+    return found ? v.to_string() : def;
 }
 void HttpResponce::setHeader(const std::string& key, const std::string& val) {
-    m_headers[key] = val;
+    m_headers.set(key, val);
+}
+void HttpResponce::setHeader(const char* key, size_t klen,
+                             const char* val, size_t vlen) {
+    m_headers.set(key, klen, val, vlen);
 }
 void HttpResponce::delHeader(const std::string& key) { m_headers.erase(key); }
 std::string HttpResponce::toString() const {
@@ -255,28 +386,56 @@ std::string HttpResponce::toString() const {
     return ss.str();
 }
 std::ostream& HttpResponce::dump(std::ostream& os) const {
-    os << "HTTP/" << ((uint32_t)m_version >> 4) << "."
-       << ((uint32_t)m_version & 0x0f) << " " << (uint32_t)m_status << " "
-       << (m_reason.empty() ? HttpstatusToString(m_status) : m_reason)
-       << "\r\n";
-    for (auto& i : m_headers) {
-        if (!m_websocket && strcasecmp(i.first.c_str(), "connection") == 0) {
+    std::string header;
+    serializeHeader(header);
+    os << header;
+    if (!m_chunked) {
+        os << m_body;
+    }
+    return os;
+}
+void HttpResponce::serializeHeader(std::string& out) const {
+    char buf[64];
+    int n = snprintf(buf, sizeof(buf), "HTTP/%u.%u %u ",
+                     (uint32_t)m_version >> 4, (uint32_t)m_version & 0x0f,
+                     (uint32_t)m_status);
+    out.append(buf, n);
+    if (m_reason.empty()) {
+        out.append(HttpstatusToString(m_status));
+    } else {
+        out.append(m_reason);
+    }
+    out.append("\r\n");
+    for (auto i : m_headers) {
+        if (!m_websocket && HttpHeaders::EqualsIgnoreCase(i.first, "connection")) {
             continue;
         }
-        os << i.first << ": " << i.second << "\r\n";
+        out.append(i.first.data(), i.first.size()).append(": ")
+           .append(i.second.data(), i.second.size()).append("\r\n");
     }
     for (auto& i : m_cookies) {
-        os << "Set-Cookie: " << i << "\r\n";
+        out.append("Set-Cookie: ").append(i).append("\r\n");
     }
     if (!m_websocket) {
-        os << "connection: " << (m_close ? "close" : "keep-alive") << "\r\n";
+        if (m_close) {
+            out.append("connection: close\r\n");
+        } else {
+            out.append("connection: keep-alive\r\n");
+        }
     }
-    if (!m_body.empty()) {
-        os << "content-length: " << m_body.size() << "\r\n\r\n" << m_body;
+    if (m_chunked) {
+        out.append("transfer-encoding: chunked\r\n\r\n");
+    } else if (!m_body.empty()) {
+        n = snprintf(buf, sizeof(buf), "content-length: %zu\r\n\r\n", m_body.size());
+        out.append(buf, n);
+    } else if (!m_close && !m_websocket && (uint32_t)m_status >= 200
+               && m_status != HttpStatus::NO_CONTENT
+               && m_status != HttpStatus::NOT_MODIFIED) {
+        //长连接下空消息体也要给出长度, 否则客户端会一直读到连接关闭
+        out.append("content-length: 0\r\n\r\n");
     } else {
-        os << "\r\n";
+        out.append("\r\n");
     }
-    return os;
 }
 void HttpResponce::setRedirect(const std::string& uri) {
     m_status = HttpStatus::FOUND;
@@ -8,6 +8,7 @@
 
 #ifndef __MUHUI_HTTP_HTTP_H__
 #define __MUHUI_HTTP_HTTP_H__
+#include "http_headers.h"
 #include <boost/lexical_cast.hpp>
 #include <cstdint>
 #include <iostream>
@@ -21,6 +22,7 @@
 #include <vector>
 
 namespace muhui {
+class Stream;
 namespace http {
 
 /* Request Methods */
@@ -164,6 +166,15 @@ HttpMethod StringToHttpMethod(const std::string& m);
  */
 HttpMethod charsToHttpMethod(const char* m);
 
+/**
+ * @brief 将指定长度的字符串转化为HTTP方法枚举
+ * @details 按(长度, 首尾字符)散列查表, 最多一次memcmp
+ * @param[in] m HTTP方法
+ * @param[in] len 长度
+ * @return HttpMethod
+ */
+HttpMethod charsToHttpMethod(const char* m, size_t len);
+
 /**
  * @brief 将HTTP方法转化为字符串
  *
@@ -242,6 +253,40 @@ T getAs(const MapType& m, const std::string& key, const T& def = T()) {
     return def;
 }
 
+/**
+ * @brief 获取HttpHeaders中的字段值,并转成对应类型,返回是否成功
+ * @details 直接从字段值内存转换, 不构造临时字符串
+ */
+template <class T>
+bool checkGetAs(const HttpHeaders& m,
+                const std::string& key,
+                T& val,
+                const T& def = T()) {
+    bool found = false;
+    HttpHeaders::StringView v = m.get(key, &found);
+    if (!found) {
+        val = def;
+        return false;
+    }
+    try {
+        val = boost::lexical_cast<T>(v.data(), v.size());
+        return true;
+    } catch (...) {
+        val = def;
+    }
+    return false;
+}
+
+/**
+ * @brief 获取HttpHeaders中的字段值,并转成对应类型
+ */
+template <class T>
+T getAs(const HttpHeaders& m, const std::string& key, const T& def = T()) {
+    T val;
+    checkGetAs(m, key, val, def);
+    return val;
+}
+
 /**
  * @brief HTTP请求结构
  */
@@ -284,9 +329,28 @@ class HttpRequest {
     const std::string& getBody() const { return m_body; }
 
     /**
-     * @brief 返回HTTP请求的消息头MAP
+     * @brief 返回HTTP请求的消息体流
+     * @details 消息体超过 http.request.stream.body.size 时不缓存到getBody(),
+     *          由servlet通过该流按需读取; 否则返回nullptr
      */
-    const MapType& getHeaders() const { return m_headers; }
+    std::shared_ptr<Stream> getBodyStream() const { return m_bodyStream; }
+
+    /**
+     * @brief 是否为流式消息体
+     */
+    bool isStreamBody() const { return !!m_bodyStream; }
+
+    /**
+     * @brief 返回HTTP请求的消息头
+     * @details 只读, 可以用for(auto& i : getHeaders())遍历, i.first/i.second为StringView;
+     *          修改请使用setHeader/delHeader/setHeaders
+     */
+    const HttpHeaders& getHeaders() const { return m_headers; }
+
+    /**
+     * @brief 返回消息头的MAP副本, 兼容原来返回MapType的getHeaders
+     */
+    MapType getHeaderMap() const { return m_headers.toMap<MapType>(); }
 
     /**
      * @brief 返回HTTP请求的参数MAP
@@ -334,6 +398,12 @@ class HttpRequest {
      */
     void setBody(const std::string& v) { m_body = v; }
 
+    /**
+     * @brief 设置HTTP请求的消息体流
+     * @param[in] v 消息体流
+     */
+    void setBodyStream(std::shared_ptr<Stream> v) { m_bodyStream = v; }
+
     /**
      * @brief 是否自动关闭
      */
@@ -358,7 +428,23 @@ class HttpRequest {
      * @brief 设置HTTP请求的头部MAP
      * @param[in] v map
      */
-    void setHeaders(const MapType& v) { m_headers = v; }
+    void setHeaders(const MapType& v) {
+        clearHeaders();
+        for(auto& i : v) {
+            setHeader(i.first, i.second);
+        }
+    }
+
+    /**
+     * @brief 返回content-length, 没有或格式错误时返回0
+     * @details 设置头部时解码, 不查找头部
+     */
+    uint64_t getContentLength() const { return m_contentLength; }
+
+    /**
+     * @brief 消息体是否为Transfer-Encoding: chunked
+     */
+    bool isChunked() const { return m_chunked; }
 
     /**
      * @brief 设置HTTP请求的参数MAP
@@ -380,6 +466,10 @@ class HttpRequest {
                           const std::string& def = "") const;
 
     void setHeader(const std::string& key, const std::string& val);
+    /**
+     * @brief 设置头部字段, 解析器直接从接收缓存写入, 不构造临时字符串
+     */
+    void setHeader(const char* key, size_t klen, const char* val, size_t vlen);
     void setParam(const std::string& key, const std::string& val);
     void setCookie(const std::string& key, const std::string& val);
 
@@ -481,14 +571,36 @@ class HttpRequest {
      */
     std::ostream& dump(std::ostream& os) const;
     /**
-     * @brief 初始化
+     * @brief 初始化, 协议头解析完成后根据connection头部确定是否长连接
      */
     void init();
+
+    /**
+     * @brief 清空头部和从头部解码的字段
+     */
+    void clearHeaders();
+
+    /**
+     * @brief 清空请求, 长连接复用HttpRequest对象
+     */
+    void reset();
     void initParam();
     void initQueryParam();
     void initBodyParam();
     void initCookies();
 
+  private:
+    /**
+     * @brief 设置头部后解码常用字段
+     */
+    void decodeHeader(HttpHeaderId id, const char* val, size_t vlen);
+
+    /// connection头部选项
+    enum ConnectionFlag {
+        CONN_CLOSE = 0x1,
+        CONN_KEEPALIVE = 0x2,
+        CONN_UPGRADE = 0x4
+    };
   private:
     /// HTTP方法
     HttpMethod m_method;
@@ -509,8 +621,16 @@ class HttpRequest {
     std::string m_fragment;
     /// 请求消息体
     std::string m_body;
-    /// 请求头部MAP
-    MapType m_headers;
+    /// 请求消息体流(大消息体)
+    std::shared_ptr<Stream> m_bodyStream;
+    /// 请求头部
+    HttpHeaders m_headers;
+    /// 从头部解码的content-length
+    uint64_t m_contentLength = 0;
+    /// 从头部解码的connection选项, ConnectionFlag
+    uint8_t m_connection = 0;
+    /// 是否为chunked消息体
+    bool m_chunked = false;
     /// 请求参数MAP
     MapType m_params;
     /// 请求Cookie MAP
@@ -525,27 +645,51 @@ class HttpResponce {
     typedef std::shared_ptr<HttpResponce> ptr;
     typedef std::map<std::string, std::string, CaseInsensitiveLess> MapType;
 
-    HttpResponce(uint8_t version = 0x11, bool close = true);
+    /**
+     * @brief 构造函数
+     * @param[in] version HTTP版本
+     * @param[in] close 是否关闭连接
+     * @param[in] arena 响应头存储使用的Arena, 为空时使用堆内存
+     */
+    HttpResponce(uint8_t version = 0x11, bool close = true, Arena::ptr arena = nullptr);
     HttpStatus getStatus() const { return m_status; }
     uint8_t getVersion() const { return m_version; }
-    const std::string getBody() const { return m_body; }
+    const std::string& getBody() const { return m_body; }
     const std::string getReason() const { return m_reason; }
-    const MapType& getHeadrs() const { return m_headers; }
+    /**
+     * @brief 返回响应的消息头, 只读, 修改请使用setHeader/delHeader/setHeaders
+     */
+    const HttpHeaders& getHeadrs() const { return m_headers; }
+    /**
+     * @brief 返回消息头的MAP副本, 兼容原来返回MapType的getHeadrs
+     */
+    MapType getHeaderMap() const { return m_headers.toMap<MapType>(); }
 
     void setStatus(HttpStatus v) { m_status = v; }
     void setVersion(uint8_t v) { m_version = v; }
     void setBody(const std::string& v) { m_body = v; }
     void setReason(const std::string& v) { m_reason = v; }
-    void setHeaders(const MapType& v) { m_headers = v; }
+    void setHeaders(const MapType& v) { m_headers.assign(v); }
 
     bool isClose() const { return m_close; }
     void setClose(bool v) { m_close = v; }
     bool isWebsocket() const { return m_websocket; }
     void setWebsocket(bool v) { m_websocket = v; }
+    /**
+     * @brief 返回setCookie设置的Set-Cookie值
+     */
+    const std::vector<std::string>& getCookies() const { return m_cookies; }
+    /**
+     * @brief 是否使用Transfer-Encoding: chunked发送消息体
+     * @details 为true时dump只输出响应头, 消息体由HttpSession::sendChunk发送
+     */
+    bool isChunked() const { return m_chunked; }
+    void setChunked(bool v) { m_chunked = v; }
 
     std::string getHeader(const std::string& key,
                           const std::string& def = "") const;
     void setHeader(const std::string& key, const std::string& val);
+    void setHeader(const char* key, size_t klen, const char* val, size_t vlen);
     void delHeader(const std::string& key);
 
     template <class T>
@@ -560,6 +704,13 @@ class HttpResponce {
     std::string toString() const;
     std::ostream& dump(std::ostream& os) const;
 
+    /**
+     * @brief 序列化状态行和响应头(含结尾空行), 不含消息体
+     * @details 直接追加到out, 不经过stringstream, out可以跨请求复用避免重复分配
+     * @param[out] out 输出缓存
+     */
+    void serializeHeader(std::string& out) const;
+
     /**
      * @brief 重定向uri
      *
@@ -582,12 +733,14 @@ class HttpResponce {
     bool m_close;
     /// 是否为Websocket
     bool m_websocket;
+    /// 是否分块发送
+    bool m_chunked;
     /// 响应消息体
     std::string m_body;
     /// 响应原因
     std::string m_reason;
-    /// 响应头部Map
-    MapType m_headers;
+    /// 响应头部
+    HttpHeaders m_headers;
 
     std::vector<std::string> m_cookies;
 };
@@ -0,0 +1,291 @@
+#include "http_body_stream.h"
+#include "log.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace muhui {
+namespace http {
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_NAME("system");
+
+/// chunk长度行/trailer行的最大长度
+static const size_t s_max_line_size = 4096;
+/// 补充缓存时每次从连接读取的长度
+static const size_t s_read_size = 4096;
+
+HttpBodyStream::HttpBodyStream(Stream::ptr stream, uint64_t length
+                               , const char* prefetch, size_t prefetch_len)
+    : HttpBodyStream(stream, false, length, prefetch, prefetch_len) {
+}
+
+HttpBodyStream::HttpBodyStream(Stream::ptr stream, bool chunked, uint64_t length
+                               , const char* prefetch, size_t prefetch_len)
+    : m_stream(stream)
+    , m_chunked(chunked)
+    , m_length(length)
+    , m_left(chunked ? 0 : length) {
+    if(chunked) {
+        m_state = CHUNK_SIZE;
+    } else {
+        m_state = length ? BODY : DONE;
+    }
+    if(prefetch && prefetch_len) {
+        m_buf.assign(prefetch, prefetch_len);
+    }
+}
+
+HttpBodyStream::ptr HttpBodyStream::CreateChunked(Stream::ptr stream, uint64_t max_length
+                                                  , const char* prefetch, size_t prefetch_len) {
+    return HttpBodyStream::ptr(new HttpBodyStream(stream, true, max_length
+                                                  , prefetch, prefetch_len));
+}
+
+int HttpBodyStream::read(void* buffer, size_t length) {
+    if(m_closed) {
+        return 0;
+    }
+    if(m_backPos < m_back.size()) {
+        size_t n = std::min(length, m_back.size() - m_backPos);
+        memcpy(buffer, &m_back[m_backPos], n);
+        m_backPos += n;
+        if(m_backPos == m_back.size()) {
+            std::string().swap(m_back);
+            m_backPos = 0;
+        }
+        return n;
+    }
+    return doRead(buffer, length);
+}
+
+int HttpBodyStream::rawRead(void* buffer, size_t length) {
+    if(m_bufPos < m_buf.size()) {
+        size_t n = std::min(length, m_buf.size() - m_bufPos);
+        memcpy(buffer, &m_buf[m_bufPos], n);
+        m_bufPos += n;
+        if(m_bufPos == m_buf.size()) {
+            m_buf.clear();
+            m_bufPos = 0;
+        }
+        return n;
+    }
+    int rt = m_stream->read(buffer, length);
+    if(rt <= 0) {
+        m_error = true;
+        return -1;
+    }
+    return rt;
+}
+
+bool HttpBodyStream::readLine(std::string& line) {
+    while(true) {
+        size_t pos = m_buf.find("\r\n", m_bufPos);
+        if(pos != std::string::npos) {
+            line.assign(m_buf, m_bufPos, pos - m_bufPos);
+            m_bufPos = pos + 2;
+            if(m_bufPos == m_buf.size()) {
+                m_buf.clear();
+                m_bufPos = 0;
+            }
+            return true;
+        }
+        if(m_buf.size() - m_bufPos > s_max_line_size) {
+            MUHUI_LOG_WARN(g_logger) << "http chunked body line too long";
+            m_error = true;
+            return false;
+        }
+        //chunked消息体没有总长度, 允许多读, 多读的数据通过takeRemain交还
+        m_buf.erase(0, m_bufPos);
+        m_bufPos = 0;
+        size_t old = m_buf.size();
+        m_buf.resize(old + s_read_size);
+        int rt = m_stream->read(&m_buf[old], s_read_size);
+        if(rt <= 0) {
+            m_buf.resize(old);
+            m_error = true;
+            return false;
+        }
+        m_buf.resize(old + rt);
+    }
+}
+
+bool HttpBodyStream::parseChunkSize(const std::string& line) {
+    uint64_t size = 0;
+    size_t i = 0;
+    for(; i < line.size(); ++i) {
+        char c = line[i];
+        int v = 0;
+        if(c >= '0' && c <= '9') {
+            v = c - '0';
+        } else if(c >= 'a' && c <= 'f') {
+            v = c - 'a' + 10;
+        } else if(c >= 'A' && c <= 'F') {
+            v = c - 'A' + 10;
+        } else {
+            break;
+        }
+        if(i >= 15) {
+            break;
+        }
+        size = (size << 4) | v;
+    }
+    //至少一位十六进制数字, 之后只允许chunk扩展
+    if(i == 0 || (i < line.size() && line[i] != ';'
+                && line[i] != ' ' && line[i] != '\t')) {
+        MUHUI_LOG_WARN(g_logger) << "invalid http chunk size line: " << line;
+        return false;
+    }
+    if(m_total + size > m_length) {
+        MUHUI_LOG_WARN(g_logger) << "http chunked body too large, max=" << m_length;
+        return false;
+    }
+    m_left = size;
+    return true;
+}
+
+int HttpBodyStream::doRead(void* buffer, size_t length) {
+    if(m_error) {
+        return -1;
+    }
+    if(length == 0) {
+        return 0;
+    }
+    std::string line;
+    while(true) {
+        switch(m_state) {
+            case BODY: {
+                //最多读取剩余消息体长度, 不会读到下一个请求的数据
+                int rt = rawRead(buffer, std::min<uint64_t>(length, m_left));
+                if(rt < 0) {
+                    return -1;
+                }
+                m_left -= rt;
+                if(m_left == 0) {
+                    m_state = DONE;
+                }
+                return rt;
+            }
+            case CHUNK_SIZE:
+                if(!readLine(line) || !parseChunkSize(line)) {
+                    m_error = true;
+                    return -1;
+                }
+                m_state = m_left ? CHUNK_DATA : CHUNK_TRAILER;
+                break;
+            case CHUNK_DATA: {
+                int rt = rawRead(buffer, std::min<uint64_t>(length, m_left));
+                if(rt < 0) {
+                    return -1;
+                }
+                m_left -= rt;
+                m_total += rt;
+                if(m_left == 0) {
+                    m_state = CHUNK_DATA_END;
+                }
+                return rt;
+            }
+            case CHUNK_DATA_END:
+                if(!readLine(line) || !line.empty()) {
+                    m_error = true;
+                    return -1;
+                }
+                m_state = CHUNK_SIZE;
+                break;
+            case CHUNK_TRAILER:
+                //trailer字段直接丢弃, 空行结束
+                if(!readLine(line)) {
+                    return -1;
+                }
+                if(line.empty()) {
+                    m_state = DONE;
+                }
+                break;
+            case DONE:
+                return 0;
+        }
+    }
+}
+
+int HttpBodyStream::read(ByteArray::ptr ba, size_t length) {
+    std::vector<iovec> iovs;
+    ba->getWriteBuffers(iovs, length);
+    size_t total = 0;
+    for(auto& i : iovs) {
+        int rt = read(i.iov_base, i.iov_len);
+        if(rt <= 0) {
+            if(total == 0) {
+                return rt;
+            }
+            break;
+        }
+        total += rt;
+        if(rt != (int)i.iov_len) {
+            break;
+        }
+    }
+    if(total > 0) {
+        ba->setPosition(ba->getPosition() + total);
+    }
+    return total;
+}
+
+int HttpBodyStream::write(const void* buffer, size_t length) {
+    return -1;
+}
+
+int HttpBodyStream::write(ByteArray::ptr ba, size_t length) {
+    return -1;
+}
+
+void HttpBodyStream::close() {
+    m_closed = true;
+}
+
+bool HttpBodyStream::readAll(std::string& body, size_t max_size) {
+    while(body.size() < max_size) {
+        size_t old = body.size();
+        size_t len = std::min(max_size - old, (size_t)(64 * 1024));
+        body.resize(old + len);
+        int rt = read(&body[old], len);
+        if(rt < 0) {
+            body.resize(old);
+            return false;
+        }
+        body.resize(old + rt);
+        if(rt == 0) {
+            break;
+        }
+    }
+    return true;
+}
+
+void HttpBodyStream::pushBack(const std::string& data) {
+    m_back = data + m_back.substr(m_backPos);
+    m_backPos = 0;
+}
+
+bool HttpBodyStream::drain() {
+    char buf[4096];
+    while(true) {
+        int rt = doRead(buf, sizeof(buf));
+        if(rt < 0) {
+            return false;
+        }
+        if(rt == 0) {
+            return m_state == DONE;
+        }
+    }
+}
+
+std::string HttpBodyStream::takeRemain() {
+    std::string rt;
+    if(m_bufPos < m_buf.size()) {
+        rt = m_buf.substr(m_bufPos);
+    }
+    m_buf.clear();
+    m_bufPos = 0;
+    return rt;
+}
+
+} // namespace http
+} // namespace muhui
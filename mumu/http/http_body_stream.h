@@ -0,0 +1,182 @@
+/**
+ * @file http_body_stream.h
+ * @author muhui (2571579302@qq.com)
+ * @brief HTTP消息体流, 大消息体按需从连接读取
+ * @version 0.1
+ * @date 2023-02-12
+ */
+#ifndef __MUHUI_HTTP_BODY_STREAM_H__
+#define __MUHUI_HTTP_BODY_STREAM_H__
+#include "stream.h"
+#include <memory>
+#include <string>
+
+namespace muhui {
+namespace http {
+
+/**
+ * @brief HTTP消息体流
+ * @details 消息体不整体读入内存, servlet每次read才从socket读取对应的数据,
+ *          servlet读得慢时内核接收缓冲区写满, TCP窗口关闭, 客户端自然被限速.
+ *          支持content-length和Transfer-Encoding: chunked两种消息体,
+ *          read返回的都是解码后的数据
+ */
+class HttpBodyStream : public Stream {
+public:
+    typedef std::shared_ptr<HttpBodyStream> ptr;
+
+    /**
+     * @brief 构造content-length消息体流
+     * @param[in] stream 底层连接流
+     * @param[in] length 消息体总长度(content-length)
+     * @param[in] prefetch 解析协议头时已经读入缓存的数据(可以超过消息体长度)
+     * @param[in] prefetch_len 已读入数据的长度
+     */
+    HttpBodyStream(Stream::ptr stream, uint64_t length
+                   , const char* prefetch = nullptr, size_t prefetch_len = 0);
+
+    /**
+     * @brief 构造chunked消息体流
+     * @param[in] stream 底层连接流
+     * @param[in] max_length 解码后消息体的最大长度, 超过后read返回-1
+     * @param[in] prefetch 解析协议头时已经读入缓存的数据
+     * @param[in] prefetch_len 已读入数据的长度
+     */
+    static HttpBodyStream::ptr CreateChunked(Stream::ptr stream, uint64_t max_length
+                   , const char* prefetch = nullptr, size_t prefetch_len = 0);
+
+    /**
+     * @brief 读取消息体
+     * @return
+     *      @retval >0 返回实际读取的数据长度
+     *      @retval =0 消息体已读完
+     *      @retval <0 连接错误或消息体格式错误
+     */
+    virtual int read(void* buffer, size_t length) override;
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+
+    /**
+     * @brief 消息体流只读, 写入返回-1
+     */
+    virtual int write(const void* buffer, size_t length) override;
+    virtual int write(ByteArray::ptr ba, size_t length) override;
+
+    /**
+     * @brief 关闭消息体流, 之后read返回0 (不关闭底层连接, 剩余数据由drain丢弃)
+     */
+    virtual void close() override;
+
+    /**
+     * @brief 是否为chunked消息体
+     */
+    bool isChunked() const { return m_chunked;}
+
+    /**
+     * @brief 返回消息体总长度, chunked消息体返回已解码的长度
+     */
+    uint64_t getLength() const { return m_chunked ? m_total : m_length;}
+
+    /**
+     * @brief 返回未读取的消息体长度, chunked消息体未知长度时返回当前块剩余长度
+     */
+    uint64_t getLeft() const { return m_left;}
+
+    /**
+     * @brief 消息体是否读取完成
+     */
+    bool isFinished() const { return m_state == DONE;}
+
+    /**
+     * @brief 读取全部消息体
+     * @param[out] body 解码后的消息体
+     * @param[in] max_size 最多读取的长度, 达到后停止(消息体可能未读完)
+     * @return 是否成功, 读取出错返回false
+     */
+    bool readAll(std::string& body, size_t max_size);
+
+    /**
+     * @brief 将已经读出的消息体放回流的头部, 之后的read先返回这部分数据
+     */
+    void pushBack(const std::string& data);
+
+    /**
+     * @brief 丢弃未读取的消息体, 保证长连接的下一个请求从正确的位置开始解析
+     * @return 是否成功读完
+     */
+    bool drain();
+
+    /**
+     * @brief 取出消息体之后多读的数据(属于下一个请求), 消息体读完后调用
+     */
+    std::string takeRemain();
+private:
+    /// 消息体解析状态
+    enum State {
+        /// content-length消息体
+        BODY = 0,
+        /// chunk长度行
+        CHUNK_SIZE,
+        /// chunk数据
+        CHUNK_DATA,
+        /// chunk数据后的CRLF
+        CHUNK_DATA_END,
+        /// 最后一个chunk之后的trailer
+        CHUNK_TRAILER,
+        /// 读取完成
+        DONE
+    };
+
+    HttpBodyStream(Stream::ptr stream, bool chunked, uint64_t length
+                   , const char* prefetch, size_t prefetch_len);
+
+    /**
+     * @brief 读取消息体(不检查是否已关闭)
+     */
+    int doRead(void* buffer, size_t length);
+
+    /**
+     * @brief 读取原始数据, 先消费缓存, 缓存为空时直接从连接读取
+     * @param[in] length 最多读取的长度, 调用方保证不超过消息体边界
+     */
+    int rawRead(void* buffer, size_t length);
+
+    /**
+     * @brief 从缓存中取出一行(不含CRLF), 缓存不足一行时从连接补充
+     * @return 是否成功
+     */
+    bool readLine(std::string& line);
+
+    /**
+     * @brief 解析chunk长度行
+     */
+    bool parseChunkSize(const std::string& line);
+private:
+    /// 底层连接流
+    Stream::ptr m_stream;
+    /// 是否为chunked
+    bool m_chunked;
+    /// content-length消息体总长度, chunked为最大长度
+    uint64_t m_length;
+    /// content-length未读取长度, chunked为当前块未读取长度
+    uint64_t m_left;
+    /// chunked已解码长度
+    uint64_t m_total = 0;
+    /// 解析状态
+    State m_state;
+    /// 已从连接读入但未消费的原始数据
+    std::string m_buf;
+    /// 原始数据读取位置
+    size_t m_bufPos = 0;
+    /// pushBack放回的数据
+    std::string m_back;
+    /// 放回数据读取位置
+    size_t m_backPos = 0;
+    /// 是否出错
+    bool m_error = false;
+    /// 是否被servlet关闭
+    bool m_closed = false;
+};
+
+} // namespace http
+} // namespace muhui
+#endif // !__MUHUI_HTTP_BODY_STREAM_H__
@@ -0,0 +1,329 @@
+#include "http_compress.h"
+#include "config.h"
+#include "log.h"
+#include "mutex.h"
+#include "util.h"
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace muhui {
+namespace http {
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_NAME("system");
+
+/// 是否开启响应压缩
+static muhui::ConfigVar<bool>::ptr g_http_compress_enable =
+    muhui::Config::Lookup("http.compress.enable", false, "http response compress enable");
+/// 压缩级别
+static muhui::ConfigVar<int>::ptr g_http_compress_level =
+    muhui::Config::Lookup("http.compress.level", (int)6, "http response compress level, 1~9");
+/// 小于该长度的消息体不压缩
+static muhui::ConfigVar<uint64_t>::ptr g_http_compress_min_size =
+    muhui::Config::Lookup("http.compress.min_size", (uint64_t)1024
+        , "http response compress min body size");
+/// 压缩结果缓存大小
+static muhui::ConfigVar<uint64_t>::ptr g_http_compress_cache_size =
+    muhui::Config::Lookup("http.compress.cache.size", (uint64_t)(8 * 1024 * 1024)
+        , "http compressed body cache size");
+
+namespace {
+/**
+ * @brief 压缩结果缓存
+ * @details key为 (消息体哈希, 长度, 编码), 命中时再比较原始内容, 不会因哈希冲突返回错误的数据.
+ *          消息体第二次出现时才放入缓存, 每次都不同的动态内容不会把静态内容挤出去
+ */
+class CompressCache {
+public:
+    typedef Mutex MutexType;
+
+    struct Key {
+        uint64_t hash;
+        size_t length;
+        int encoding;
+        bool operator==(const Key& o) const {
+            return hash == o.hash && length == o.length && encoding == o.encoding;
+        }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& k) const { return k.hash ^ (size_t)k.encoding;}
+    };
+    struct Entry {
+        Key key;
+        std::string body;
+        std::string compressed;
+    };
+
+    bool get(const Key& key, const std::string& body, std::string& out) {
+        MutexType::Lock lock(m_mutex);
+        auto it = m_index.find(key);
+        if(it == m_index.end() || it->second->body != body) {
+            return false;
+        }
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        out = it->second->compressed;
+        return true;
+    }
+
+    void put(const Key& key, const std::string& body, const std::string& compressed) {
+        uint64_t limit = g_http_compress_cache_size->getValue();
+        uint64_t bytes = body.size() + compressed.size();
+        //单个消息体最多占缓存的1/8
+        if(bytes > limit / 8) {
+            return;
+        }
+        MutexType::Lock lock(m_mutex);
+        if(m_index.count(key)) {
+            return;
+        }
+        //第一次出现只记录哈希
+        if(!m_seen.erase(key.hash)) {
+            if(m_seen.size() >= 4096) {
+                m_seen.clear();
+            }
+            m_seen.insert(key.hash);
+            return;
+        }
+        while(m_bytes + bytes > limit && !m_lru.empty()) {
+            Entry& e = m_lru.back();
+            m_bytes -= e.body.size() + e.compressed.size();
+            m_index.erase(e.key);
+            m_lru.pop_back();
+        }
+        m_lru.push_front(Entry{key, body, compressed});
+        m_index[key] = m_lru.begin();
+        m_bytes += bytes;
+    }
+private:
+    MutexType m_mutex;
+    std::list<Entry> m_lru;
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> m_index;
+    std::unordered_set<uint64_t> m_seen;
+    uint64_t m_bytes = 0;
+};
+}
+
+static CompressCache& GetCache() {
+    static CompressCache s_cache;
+    return s_cache;
+}
+
+/**
+ * @brief 解析Accept-Encoding中一项的q值, 没有时为1
+ */
+static bool IsAccepted(HttpHeaders::StringView item) {
+    size_t pos = item.find(';');
+    if(pos == HttpHeaders::StringView::npos) {
+        return true;
+    }
+    HttpHeaders::StringView params = item.substr(pos + 1);
+    pos = params.find("q=");
+    if(pos == HttpHeaders::StringView::npos) {
+        return true;
+    }
+    //q=0, q=0.0, q=0.000 表示不接受
+    HttpHeaders::StringView q = params.substr(pos + 2);
+    for(size_t i = 0; i < q.size() && q[i] != ',' && q[i] != ';' && q[i] != ' '; ++i) {
+        if(q[i] != '0' && q[i] != '.') {
+            return true;
+        }
+    }
+    return false;
+}
+
+HttpCompressor::Encoding HttpCompressor::Negotiate(HttpHeaders::StringView accept_encoding) {
+    int gzip = -1;
+    int deflate = -1;
+    int any = -1;
+    size_t pos = 0;
+    while(pos < accept_encoding.size()) {
+        size_t end = accept_encoding.find(',', pos);
+        if(end == HttpHeaders::StringView::npos) {
+            end = accept_encoding.size();
+        }
+        HttpHeaders::StringView item = accept_encoding.substr(pos, end - pos);
+        while(!item.empty() && (item.front() == ' ' || item.front() == '\t')) {
+            item.remove_prefix(1);
+        }
+        size_t n = item.find(';');
+        HttpHeaders::StringView name = item.substr(0, n);
+        while(!name.empty() && (name.back() == ' ' || name.back() == '\t')) {
+            name.remove_suffix(1);
+        }
+        int accepted = IsAccepted(item);
+        if(HttpHeaders::EqualsIgnoreCase(name, "gzip")
+                || HttpHeaders::EqualsIgnoreCase(name, "x-gzip")) {
+            gzip = accepted;
+        } else if(HttpHeaders::EqualsIgnoreCase(name, "deflate")) {
+            deflate = accepted;
+        } else if(name == "*") {
+            any = accepted;
+        }
+        pos = end + 1;
+    }
+    if(gzip == 1 || (gzip == -1 && any == 1)) {
+        return GZIP;
+    }
+    if(deflate == 1 || (deflate == -1 && any == 1)) {
+        return DEFLATE;
+    }
+    return IDENTITY;
+}
+
+HttpCompressor::Encoding HttpCompressor::Negotiate(const HttpRequest& req) {
+    if(!g_http_compress_enable->getValue() || req.getMethod() == HttpMethod::HEAD) {
+        return IDENTITY;
+    }
+    return Negotiate(req.getHeaders().get(HttpHeaderId::ACCEPT_ENCODING));
+}
+
+bool HttpCompressor::IsCompressible(HttpHeaders::StringView content_type) {
+    size_t n = content_type.find(';');
+    HttpHeaders::StringView type = content_type.substr(0, n);
+    while(!type.empty() && type.back() == ' ') {
+        type.remove_suffix(1);
+    }
+    //没有Content-Type的一般是文本
+    if(type.empty()) {
+        return true;
+    }
+    auto starts_with = [&type](const char* prefix) {
+        size_t len = strlen(prefix);
+        return type.size() >= len
+            && HttpHeaders::EqualsIgnoreCase(type.substr(0, len), prefix);
+    };
+    if(starts_with("text/")) {
+        return true;
+    }
+    if(starts_with("image/svg")) {
+        return true;
+    }
+    if(starts_with("image/") || starts_with("video/") || starts_with("audio/")
+            || starts_with("font/woff")) {
+        return false;
+    }
+    static const char* s_compressed[] = {
+        "application/zip", "application/gzip", "application/x-gzip",
+        "application/x-bzip2", "application/x-xz", "application/x-7z-compressed",
+        "application/x-rar-compressed", "application/zstd", "application/octet-stream",
+        "application/pdf", "application/vnd.ms-fontobject", "application/font-woff"
+    };
+    for(auto i : s_compressed) {
+        if(HttpHeaders::EqualsIgnoreCase(type, i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief 设置Vary: Accept-Encoding
+ */
+static void SetVary(HttpResponce& rsp) {
+    //同一个uri按编码有不同的响应, 告诉下游缓存
+    std::string vary = rsp.getHeader("vary");
+    if(vary.empty()) {
+        rsp.setHeader("Vary", "Accept-Encoding");
+    } else if(!HttpHeaders::HasToken(vary, "accept-encoding")) {
+        rsp.setHeader("Vary", vary + ", Accept-Encoding");
+    }
+}
+
+/**
+ * @brief 设置压缩后的响应头
+ */
+static void SetEncodingHeaders(HttpResponce& rsp, HttpCompressor::Encoding enc) {
+    rsp.setHeader("Content-Encoding", HttpCompressor::EncodingToString(enc));
+    SetVary(rsp);
+    //强ETag对应具体的字节, 压缩后加上编码后缀
+    std::string etag = rsp.getHeader("etag");
+    if(etag.size() >= 2 && etag[0] == '"' && etag.back() == '"') {
+        etag.insert(etag.size() - 1, std::string("-") + HttpCompressor::EncodingToString(enc));
+        rsp.setHeader("ETag", etag);
+    }
+}
+
+bool HttpCompressor::CompressResponse(const HttpRequest& req, HttpResponce& rsp) {
+    const std::string& body = rsp.getBody();
+    if(body.size() < g_http_compress_min_size->getValue() || rsp.isChunked() || rsp.isWebsocket()) {
+        return false;
+    }
+    const HttpHeaders& headers = rsp.getHeadrs();
+    bool found = false;
+    headers.get(HttpHeaderId::CONTENT_ENCODING, &found);
+    if(found || !IsCompressible(headers.get(HttpHeaderId::CONTENT_TYPE))) {
+        return false;
+    }
+    Encoding enc = Negotiate(req);
+    if(enc == IDENTITY) {
+        if(g_http_compress_enable->getValue()) {
+            SetVary(rsp);
+        }
+        return false;
+    }
+    CompressCache::Key key;
+    key.hash = muhui::murmur3_hash64((const void*)body.c_str(), body.size());
+    key.length = body.size();
+    key.encoding = enc;
+    std::string out;
+    if(!GetCache().get(key, body, out)) {
+        if(!ZlibStream::Compress(enc == GZIP ? ZlibStream::GZIP : ZlibStream::ZLIB
+                    , g_http_compress_level->getValue(), body.c_str(), body.size(), out)) {
+            MUHUI_LOG_ERROR(g_logger) << "compress http response fail, size=" << body.size();
+            return false;
+        }
+        GetCache().put(key, body, out);
+    }
+    //压缩后更大时(已经压缩过的内容)发送原始数据
+    if(out.size() >= body.size()) {
+        return false;
+    }
+    SetEncodingHeaders(rsp, enc);
+    rsp.setBody(out);
+    return true;
+}
+
+ZlibStream::ptr HttpCompressor::CreateChunkedStream(const HttpRequest& req, HttpResponce& rsp) {
+    const HttpHeaders& headers = rsp.getHeadrs();
+    bool found = false;
+    headers.get(HttpHeaderId::CONTENT_ENCODING, &found);
+    if(found || !IsCompressible(headers.get(HttpHeaderId::CONTENT_TYPE))) {
+        return nullptr;
+    }
+    Encoding enc = Negotiate(req);
+    if(enc == IDENTITY) {
+        return nullptr;
+    }
+    ZlibStream::ptr zs = ZlibStream::CreateCompress(
+                enc == GZIP ? ZlibStream::GZIP : ZlibStream::ZLIB, g_http_compress_level->getValue());
+    if(zs) {
+        SetEncodingHeaders(rsp, enc);
+    }
+    return zs;
+}
+
+const char* HttpCompressor::EncodingToString(Encoding enc) {
+    switch(enc) {
+        case GZIP:
+            return "gzip";
+        case DEFLATE:
+            return "deflate";
+        default:
+            return "identity";
+    }
+}
+
+bool HttpCompressor::IsEnabled() {
+    return g_http_compress_enable->getValue();
+}
+
+int HttpCompressor::GetLevel() {
+    return g_http_compress_level->getValue();
+}
+
+uint64_t HttpCompressor::GetMinSize() {
+    return g_http_compress_min_size->getValue();
+}
+
+} // namespace http
+} // namespace muhui
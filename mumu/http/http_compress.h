@@ -0,0 +1,87 @@
+/**
+ * @file http_compress.h
+ * @author muhui (2571579302@qq.com)
+ * @brief HTTP响应压缩(gzip/deflate)
+ * @version 0.1
+ * @date 2023-02-20
+ */
+#ifndef __MUHUI_HTTP_HTTP_COMPRESS_H__
+#define __MUHUI_HTTP_HTTP_COMPRESS_H__
+#include "http.h"
+#include "streams/zlib_stream.h"
+
+namespace muhui {
+namespace http {
+
+/**
+ * @brief HTTP响应压缩
+ * @details 根据请求的Accept-Encoding选择gzip或deflate(优先gzip, q=0表示不接受).
+ *          已经有Content-Encoding, 消息体小于http.compress.min_size,
+ *          以及图片/音视频/压缩包等本身已压缩的类型不压缩.
+ *          相同消息体的压缩结果缓存在按字节数淘汰的LRU中(第二次出现才放入),
+ *          静态内容不需要每次重新压缩.
+ *          配置: http.compress.enable(默认关闭), http.compress.level, http.compress.min_size,
+ *                http.compress.cache.size
+ */
+class HttpCompressor {
+public:
+    /// 内容编码
+    enum Encoding {
+        /// 不压缩
+        IDENTITY = 0,
+        /// gzip
+        GZIP,
+        /// deflate(zlib格式)
+        DEFLATE
+    };
+
+    /**
+     * @brief 根据Accept-Encoding选择编码
+     */
+    static Encoding Negotiate(HttpHeaders::StringView accept_encoding);
+
+    /**
+     * @brief 按配置和请求选择编码, 未开启压缩时返回IDENTITY
+     */
+    static Encoding Negotiate(const HttpRequest& req);
+
+    /**
+     * @brief Content-Type是否值得压缩
+     */
+    static bool IsCompressible(HttpHeaders::StringView content_type);
+
+    /**
+     * @brief 压缩响应消息体
+     * @details 设置Content-Encoding和Vary, 强ETag加上编码后缀
+     * @return 是否压缩
+     */
+    static bool CompressResponse(const HttpRequest& req, HttpResponce& rsp);
+
+    /**
+     * @brief 为分块发送的响应创建压缩流
+     * @details 需要压缩时设置Content-Encoding和Vary
+     * @return 不需要压缩时返回nullptr
+     */
+    static ZlibStream::ptr CreateChunkedStream(const HttpRequest& req, HttpResponce& rsp);
+
+    static const char* EncodingToString(Encoding enc);
+
+    /**
+     * @brief 是否开启压缩
+     */
+    static bool IsEnabled();
+
+    /**
+     * @brief 返回压缩级别
+     */
+    static int GetLevel();
+
+    /**
+     * @brief 返回压缩的最小消息体长度
+     */
+    static uint64_t GetMinSize();
+};
+
+} // namespace http
+} // namespace muhui
+#endif // !__MUHUI_HTTP_HTTP_COMPRESS_H__
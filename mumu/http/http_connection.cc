@@ -0,0 +1,458 @@
+#include "http_connection.h"
+#include "http_body_stream.h"
+#include "http_parser.h"
+#include "log.h"
+#include "util.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+namespace muhui {
+namespace http {
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_NAME("system");
+
+std::string HttpResult::toString() const {
+    std::stringstream ss;
+    ss << "[HttpResult result=" << result
+       << " error=" << error
+       << " response=" << (response ? response->toString() : "nullptr")
+       << "]";
+    return ss.str();
+}
+
+HttpConnection::HttpConnection(Socket::ptr sock, bool owner)
+    : SocketStream(sock, owner)
+    , m_createTime(muhui::GetCurrentMS()) {
+}
+
+HttpConnection::~HttpConnection() {
+    MUHUI_LOG_DEBUG(g_logger) << "HttpConnection::~HttpConnection requests=" << m_request;
+}
+
+HttpResponce::ptr HttpConnection::recvResponse(bool head) {
+    HttpResponceParser::ptr parser(new HttpResponceParser);
+    uint64_t buff_size = HttpResponceParser::GetHttpResponceBufferSize();
+    //Ragel解析器要求数据以'\0'结尾, 多留一个字节
+    if(m_buffer.size() != buff_size + 1) {
+        m_buffer.resize(buff_size + 1);
+    }
+    char* data = &m_buffer[0];
+    int offset = 0;
+    //先解析上次多读的数据(流水线的后续响应)
+    if(!m_remain.empty()) {
+        offset = std::min<uint64_t>(m_remain.size(), buff_size);
+        memcpy(data, m_remain.c_str(), offset);
+        m_remain.erase(0, offset);
+    }
+    bool need_read = offset == 0;
+    do {
+        int len = 0;
+        if(need_read) {
+            len = read(data + offset, buff_size - offset);
+            if(len <= 0) {
+                close();
+                return nullptr;
+            }
+        }
+        need_read = true;
+        len += offset;
+        data[len] = '\0';
+        size_t nparser = parser->execute(data, len, false);
+        if(parser->hasError()) {
+            close();
+            return nullptr;
+        }
+        offset = len - nparser;
+        if(offset == (int)buff_size) {
+            close();
+            return nullptr;
+        }
+        if(parser->isFinished()) {
+            break;
+        }
+        if(!m_remain.empty()) {
+            size_t n = std::min<uint64_t>(m_remain.size(), buff_size - offset);
+            memcpy(data + offset, m_remain.c_str(), n);
+            m_remain.erase(0, n);
+            offset += n;
+            need_read = false;
+        }
+    } while(true);
+    m_remain.insert(0, data, offset);
+    if(m_inflight > 0) {
+        --m_inflight;
+    }
+
+    HttpResponce::ptr rsp = parser->getData();
+    const HttpHeaders& headers = rsp->getHeadrs();
+    HttpHeaders::StringView connection = headers.get(HttpHeaderId::CONNECTION);
+    if(HttpHeaders::HasToken(connection, "close")) {
+        rsp->setClose(true);
+    } else if(HttpHeaders::HasToken(connection, "keep-alive")) {
+        rsp->setClose(false);
+    } else {
+        rsp->setClose(rsp->getVersion() < 0x11);
+    }
+    if(rsp->isClose()) {
+        m_reusable = false;
+    }
+
+    int status = (int)rsp->getStatus();
+    if(head || (status >= 100 && status < 200) || status == 204 || status == 304) {
+        return rsp;
+    }
+    uint64_t max_body = HttpResponceParser::GetHttpResponceMaxBodySize();
+    //Transfer-Encoding: chunked 优先于content-length
+    if(HttpHeaders::HasToken(headers.get(HttpHeaderId::TRANSFER_ENCODING), "chunked")) {
+        HttpBodyStream::ptr body = HttpBodyStream::CreateChunked(
+                    std::make_shared<SocketStream>(m_sock, false)
+                    , max_body, m_remain.c_str(), m_remain.size());
+        m_remain.clear();
+        std::string content;
+        if(!body->readAll(content, max_body) || !body->isFinished()) {
+            MUHUI_LOG_WARN(g_logger) << "recv chunked http responce body fail, max=" << max_body;
+            close();
+            return nullptr;
+        }
+        m_remain = body->takeRemain();
+        rsp->setBody(content);
+        return rsp;
+    }
+    bool found = false;
+    HttpHeaders::StringView cl = headers.get(HttpHeaderId::CONTENT_LENGTH, &found);
+    if(found) {
+        uint64_t length = 0;
+        if(!HttpHeaders::ParseUint64(cl, length) || length > max_body) {
+            MUHUI_LOG_WARN(g_logger) << "invalid http responce content-length="
+                << cl << ", max=" << max_body;
+            close();
+            return nullptr;
+        }
+        if(length > 0) {
+            std::string body;
+            body.resize(length);
+            size_t len = std::min<uint64_t>(length, m_remain.size());
+            memcpy(&body[0], m_remain.c_str(), len);
+            m_remain.erase(0, len);
+            if(length > len && readFixSize(&body[len], length - len) <= 0) {
+                close();
+                return nullptr;
+            }
+            rsp->setBody(body);
+        }
+        return rsp;
+    }
+    //没有长度的消息体以关闭连接结束
+    m_reusable = false;
+    std::string body;
+    body.swap(m_remain);
+    while(true) {
+        if(body.size() > max_body) {
+            close();
+            return nullptr;
+        }
+        size_t size = body.size();
+        body.resize(size + buff_size);
+        int len = read(&body[size], buff_size);
+        if(len < 0) {
+            close();
+            return nullptr;
+        }
+        body.resize(size + len);
+        if(len == 0) {
+            break;
+        }
+    }
+    rsp->setBody(body);
+    close();
+    return rsp;
+}
+
+int HttpConnection::sendRequest(HttpRequest::ptr req) {
+    m_sendBuf = req->toString();
+    ++m_request;
+    ++m_inflight;
+    return writeFixSize(m_sendBuf.c_str(), m_sendBuf.size());
+}
+
+int HttpConnection::sendRequests(const std::vector<HttpRequest::ptr>& reqs) {
+    if(reqs.empty()) {
+        return 1;
+    }
+    //全部请求序列化到同一块缓存, 一次发送
+    std::stringstream ss;
+    for(auto& i : reqs) {
+        i->dump(ss);
+    }
+    m_sendBuf = ss.str();
+    m_request += reqs.size();
+    m_inflight += reqs.size();
+    return writeFixSize(m_sendBuf.c_str(), m_sendBuf.size());
+}
+
+HttpConnectionPool::HttpConnectionPool(const std::string& host, const std::string& vhost
+                       , uint32_t port, uint32_t max_size, uint32_t max_idle
+                       , uint32_t max_idle_time, uint32_t max_alive_time
+                       , uint32_t max_request)
+    : m_host(host)
+    , m_vhost(vhost)
+    , m_port(port ? port : 80)
+    , m_maxSize(max_size)
+    , m_maxIdle(max_idle)
+    , m_maxIdleTime(max_idle_time)
+    , m_maxAliveTime(max_alive_time)
+    , m_maxRequest(max_request)
+    , m_sem(max_size) {
+}
+
+HttpConnectionPool::~HttpConnectionPool() {
+    MutexType::Lock lock(m_mutex);
+    for(auto i : m_conns) {
+        delete i;
+    }
+    m_conns.clear();
+}
+
+size_t HttpConnectionPool::getIdleCount() {
+    MutexType::Lock lock(m_mutex);
+    return m_conns.size();
+}
+
+bool HttpConnectionPool::isValid(HttpConnection* conn, uint64_t now) const {
+    return conn->isReusable()
+        && now < conn->m_createTime + m_maxAliveTime
+        && conn->m_request < m_maxRequest;
+}
+
+HttpConnection::ptr HttpConnectionPool::getConnection(uint64_t timeout_ms) {
+    if(!m_sem.waitFor(timeout_ms)) {
+        MUHUI_LOG_WARN(g_logger) << "wait http connection timeout, host=" << m_host
+            << ", max_size=" << m_maxSize;
+        return nullptr;
+    }
+    uint64_t now = muhui::GetCurrentMS();
+    HttpConnection* conn = nullptr;
+    std::vector<HttpConnection*> invalid;
+    {
+        MutexType::Lock lock(m_mutex);
+        //最近归还的连接最可能还被服务器保持着
+        while(!m_conns.empty()) {
+            HttpConnection* c = m_conns.back();
+            m_conns.pop_back();
+            if(isValid(c, now) && now < c->m_lastUseTime + m_maxIdleTime) {
+                conn = c;
+                break;
+            }
+            invalid.push_back(c);
+        }
+    }
+    m_total -= invalid.size();
+    for(auto i : invalid) {
+        delete i;
+    }
+    if(!conn) {
+        IPAddress::ptr addr = Address::LookupAnyIPAddress(m_host);
+        if(!addr) {
+            MUHUI_LOG_ERROR(g_logger) << "get addr fail: " << m_host;
+            m_sem.notify();
+            return nullptr;
+        }
+        addr->setPort(m_port);
+        Socket::ptr sock = Socket::CreateTCP(addr);
+        if(!sock) {
+            MUHUI_LOG_ERROR(g_logger) << "create sock fail: " << *addr;
+            m_sem.notify();
+            return nullptr;
+        }
+        if(!sock->connect(addr, timeout_ms)) {
+            MUHUI_LOG_ERROR(g_logger) << "sock connect fail: " << *addr;
+            m_sem.notify();
+            return nullptr;
+        }
+        conn = new HttpConnection(sock);
+        ++m_total;
+    }
+    std::weak_ptr<HttpConnectionPool> weak = shared_from_this();
+    return HttpConnection::ptr(conn, std::bind(&HttpConnectionPool::ReleasePtr
+                                               , std::placeholders::_1, weak));
+}
+
+void HttpConnectionPool::ReleasePtr(HttpConnection* ptr, std::weak_ptr<HttpConnectionPool> weak) {
+    HttpConnectionPool::ptr pool = weak.lock();
+    if(!pool) {
+        delete ptr;
+        return;
+    }
+    uint64_t now = muhui::GetCurrentMS();
+    ptr->m_lastUseTime = now;
+    std::vector<HttpConnection*> invalid;
+    if(!pool->isValid(ptr, now)) {
+        invalid.push_back(ptr);
+    } else {
+        MutexType::Lock lock(pool->m_mutex);
+        //最早归还的连接在头部, 顺便清理空闲太久的连接
+        while(!pool->m_conns.empty()
+                && now >= pool->m_conns.front()->m_lastUseTime + pool->m_maxIdleTime) {
+            invalid.push_back(pool->m_conns.front());
+            pool->m_conns.pop_front();
+        }
+        if(pool->m_conns.size() < pool->m_maxIdle) {
+            pool->m_conns.push_back(ptr);
+        } else {
+            invalid.push_back(ptr);
+        }
+    }
+    pool->m_total -= invalid.size();
+    for(auto i : invalid) {
+        delete i;
+    }
+    pool->m_sem.notify();
+}
+
+void HttpConnectionPool::prepareRequest(HttpRequest::ptr req) {
+    //根据connection头部决定长连接, 没有时HTTP/1.1默认长连接
+    req->init();
+    if(req->getHeader("host").empty()) {
+        std::string host = m_vhost.empty() ? m_host : m_vhost;
+        if(m_port != 80) {
+            host += ":" + std::to_string(m_port);
+        }
+        req->setHeader("Host", host);
+    }
+}
+
+HttpResult::ptr HttpConnectionPool::Request(HttpConnection::ptr conn, HttpRequest::ptr req) {
+    int rt = conn->sendRequest(req);
+    if(rt == 0) {
+        conn->m_reusable = false;
+        return std::make_shared<HttpResult>((int)HttpResult::Error::SEND_CLOSE_BY_PEER
+                , nullptr, "send request closed by peer: " + conn->getRemoteAddressString());
+    }
+    if(rt < 0) {
+        conn->m_reusable = false;
+        return std::make_shared<HttpResult>((int)HttpResult::Error::SEND_SOCKET_ERROR
+                , nullptr, "send request socket error errno=" + std::to_string(errno)
+                + " errstr=" + std::string(strerror(errno)));
+    }
+    HttpResponce::ptr rsp = conn->recvResponse(req->getMethod() == HttpMethod::HEAD);
+    if(!rsp) {
+        conn->m_reusable = false;
+        return std::make_shared<HttpResult>((int)HttpResult::Error::TIMEOUT
+                , nullptr, "recv response timeout: " + conn->getRemoteAddressString());
+    }
+    return std::make_shared<HttpResult>((int)HttpResult::Error::OK, rsp, "ok");
+}
+
+/**
+ * @brief 请求是否可以安全重试(幂等)
+ */
+static bool IsIdempotent(HttpMethod m) {
+    return m == HttpMethod::GET || m == HttpMethod::HEAD || m == HttpMethod::PUT
+        || m == HttpMethod::DELETE || m == HttpMethod::OPTIONS || m == HttpMethod::TRACE;
+}
+
+HttpResult::ptr HttpConnectionPool::doRequest(HttpRequest::ptr req, uint64_t timeout_ms) {
+    prepareRequest(req);
+    HttpResult::ptr result;
+    for(int i = 0; i < 2; ++i) {
+        HttpConnection::ptr conn = getConnection(timeout_ms);
+        if(!conn) {
+            return std::make_shared<HttpResult>((int)HttpResult::Error::POOL_GET_CONNECTION
+                    , nullptr, "pool host:" + m_host + " port:" + std::to_string(m_port));
+        }
+        bool reused = conn->m_request > 0;
+        conn->getSocket()->setRecvTimeout(timeout_ms);
+        conn->getSocket()->setSendTimeout(timeout_ms);
+        result = Request(conn, req);
+        //复用的连接可能在空闲期间被服务器关闭, 发送失败或幂等请求时换新连接重试
+        if(result->result == (int)HttpResult::Error::OK || !reused
+                || (result->result == (int)HttpResult::Error::TIMEOUT
+                    && !IsIdempotent(req->getMethod()))) {
+            break;
+        }
+    }
+    return result;
+}
+
+HttpResult::ptr HttpConnectionPool::doRequest(HttpMethod method, const std::string& path
+                        , uint64_t timeout_ms
+                        , const std::map<std::string, std::string>& headers
+                        , const std::string& body) {
+    HttpRequest::ptr req = std::make_shared<HttpRequest>();
+    req->setMethod(method);
+    std::string uri = path.empty() ? "/" : path;
+    size_t pos = uri.find('#');
+    if(pos != std::string::npos) {
+        req->setFragment(uri.substr(pos + 1));
+        uri.resize(pos);
+    }
+    pos = uri.find('?');
+    if(pos != std::string::npos) {
+        req->setQuery(uri.substr(pos + 1));
+        uri.resize(pos);
+    }
+    req->setPath(uri);
+    for(auto& i : headers) {
+        req->setHeader(i.first, i.second);
+    }
+    req->setBody(body);
+    return doRequest(req, timeout_ms);
+}
+
+HttpResult::ptr HttpConnectionPool::doGet(const std::string& path, uint64_t timeout_ms
+                          , const std::map<std::string, std::string>& headers
+                          , const std::string& body) {
+    return doRequest(HttpMethod::GET, path, timeout_ms, headers, body);
+}
+
+HttpResult::ptr HttpConnectionPool::doPost(const std::string& path, uint64_t timeout_ms
+                           , const std::map<std::string, std::string>& headers
+                           , const std::string& body) {
+    return doRequest(HttpMethod::POST, path, timeout_ms, headers, body);
+}
+
+std::vector<HttpResult::ptr> HttpConnectionPool::doRequests(
+                        const std::vector<HttpRequest::ptr>& reqs, uint64_t timeout_ms) {
+    std::vector<HttpResult::ptr> results;
+    if(reqs.empty()) {
+        return results;
+    }
+    for(auto& i : reqs) {
+        prepareRequest(i);
+    }
+    HttpConnection::ptr conn = getConnection(timeout_ms);
+    if(!conn) {
+        for(size_t i = 0; i < reqs.size(); ++i) {
+            results.push_back(std::make_shared<HttpResult>((int)HttpResult::Error::POOL_GET_CONNECTION
+                    , nullptr, "pool host:" + m_host + " port:" + std::to_string(m_port)));
+        }
+        return results;
+    }
+    conn->getSocket()->setRecvTimeout(timeout_ms);
+    conn->getSocket()->setSendTimeout(timeout_ms);
+    int rt = conn->sendRequests(reqs);
+    for(auto& i : reqs) {
+        if(rt <= 0) {
+            conn->m_reusable = false;
+            results.push_back(std::make_shared<HttpResult>(
+                    (int)(rt == 0 ? HttpResult::Error::SEND_CLOSE_BY_PEER
+                                  : HttpResult::Error::SEND_SOCKET_ERROR)
+                    , nullptr, "send pipelined requests fail: " + conn->getRemoteAddressString()));
+            continue;
+        }
+        HttpResponce::ptr rsp = conn->isConnected()
+                ? conn->recvResponse(i->getMethod() == HttpMethod::HEAD) : nullptr;
+        if(!rsp) {
+            conn->m_reusable = false;
+            results.push_back(std::make_shared<HttpResult>((int)HttpResult::Error::TIMEOUT
+                    , nullptr, "recv pipelined response fail: " + conn->getRemoteAddressString()));
+            continue;
+        }
+        results.push_back(std::make_shared<HttpResult>((int)HttpResult::Error::OK, rsp, "ok"));
+    }
+    return results;
+}
+
+} // namespace http
+} // namespace muhui
@@ -0,0 +1,269 @@
+/**
+ * @file http_connection.h
+ * @author muhui (2571579302@qq.com)
+ * @brief HTTP客户端连接及长连接池
+ * @version 0.1
+ * @date 2023-02-18
+ */
+#ifndef __MUHUI_HTTP_HTTP_CONNECTION_H__
+#define __MUHUI_HTTP_HTTP_CONNECTION_H__
+#include "http/http.h"
+#include "mutex.h"
+#include "streams/socket_stream.h"
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace muhui {
+namespace http {
+
+/**
+ * @brief HTTP请求结果
+ */
+struct HttpResult {
+    typedef std::shared_ptr<HttpResult> ptr;
+
+    /// 错误码
+    enum class Error {
+        /// 正常
+        OK = 0,
+        /// 非法HOST
+        INVALID_HOST = 1,
+        /// 连接失败
+        CONNECT_FAIL = 2,
+        /// 发送时连接被对端关闭
+        SEND_CLOSE_BY_PEER = 3,
+        /// 发送请求产生Socket错误
+        SEND_SOCKET_ERROR = 4,
+        /// 超时或接收响应失败
+        TIMEOUT = 5,
+        /// 创建Socket失败
+        CREATE_SOCKET_ERROR = 6,
+        /// 从连接池中取连接失败(等待超时)
+        POOL_GET_CONNECTION = 7,
+        /// 无效的连接
+        POOL_INVALID_CONNECTION = 8
+    };
+
+    HttpResult(int _result, HttpResponce::ptr _response, const std::string& _error)
+        : result(_result)
+        , response(_response)
+        , error(_error) {}
+
+    /// 错误码, Error
+    int result;
+    /// HTTP响应
+    HttpResponce::ptr response;
+    /// 错误描述
+    std::string error;
+
+    std::string toString() const;
+};
+
+class HttpConnectionPool;
+
+/**
+ * @brief HTTP客户端连接
+ * @details 一个连接同时只能由一个协程使用; 支持流水线: 连续发送多个请求后按顺序接收响应
+ */
+class HttpConnection : public SocketStream {
+friend class HttpConnectionPool;
+public:
+    typedef std::shared_ptr<HttpConnection> ptr;
+
+    /**
+     * @brief 构造函数
+     * @param[in] sock 已连接的Socket
+     * @param[in] owner 是否托管
+     */
+    HttpConnection(Socket::ptr sock, bool owner = true);
+    ~HttpConnection();
+
+    /**
+     * @brief 接收HTTP响应
+     * @details 支持content-length, Transfer-Encoding: chunked以及以关闭连接结束的消息体.
+     *          响应之后已读入的数据保留给下一个响应(流水线)
+     * @param[in] head 对应的请求是否为HEAD(响应没有消息体)
+     * @return 失败返回nullptr
+     */
+    HttpResponce::ptr recvResponse(bool head = false);
+
+    /**
+     * @brief 发送HTTP请求
+     * @return
+     *      @retval >0 发送成功
+     *      @retval =0 对方关闭
+     *      @retval <0 Socket异常
+     */
+    int sendRequest(HttpRequest::ptr req);
+
+    /**
+     * @brief 流水线发送多个HTTP请求, 一次聚集写
+     * @return 同sendRequest
+     */
+    int sendRequests(const std::vector<HttpRequest::ptr>& reqs);
+
+    /**
+     * @brief 连接是否还能用于下一个请求
+     * @details 对方要求关闭, 消息体以关闭连接结束, 接收出错或还有未接收的响应时不能复用
+     */
+    bool isReusable() const { return m_reusable && m_inflight == 0 && isConnected();}
+
+    /**
+     * @brief 返回创建时间(毫秒)
+     */
+    uint64_t getCreateTime() const { return m_createTime;}
+
+    /**
+     * @brief 返回已发送的请求数
+     */
+    uint64_t getRequestCount() const { return m_request;}
+private:
+    /// 创建时间
+    uint64_t m_createTime;
+    /// 最后放回连接池的时间
+    uint64_t m_lastUseTime = 0;
+    /// 已发送的请求数
+    uint64_t m_request = 0;
+    /// 已发送但未接收响应的请求数
+    uint32_t m_inflight = 0;
+    /// 是否可以复用
+    bool m_reusable = true;
+    /// 协议头解析缓存
+    std::vector<char> m_buffer;
+    /// 已读入但未解析的数据(属于下一个响应)
+    std::string m_remain;
+    /// 请求序列化缓存
+    std::string m_sendBuf;
+};
+
+/**
+ * @brief 同一个HOST的HTTP长连接池
+ * @details 使用完的长连接放回池中复用; 总连接数达到上限时,
+ *          取连接的协程让出执行权等待其它协程归还连接, 不阻塞线程.
+ *          空闲连接超过最大空闲时间, 或连接超过最大存活时间/请求数后不再复用.
+ *          需要在IOManager的协程中使用, 必须由shared_ptr(HttpConnectionPool::ptr)管理
+ */
+class HttpConnectionPool : public std::enable_shared_from_this<HttpConnectionPool> {
+public:
+    typedef std::shared_ptr<HttpConnectionPool> ptr;
+    typedef Mutex MutexType;
+
+    /**
+     * @brief 构造函数
+     * @param[in] host 服务器地址(域名或IP)
+     * @param[in] vhost 请求头中的host, 为空时使用host
+     * @param[in] port 端口
+     * @param[in] max_size 最多同时使用的连接数, 超过时取连接需要等待
+     * @param[in] max_idle 最多保留的空闲连接数
+     * @param[in] max_idle_time 空闲连接最长保留时间(毫秒)
+     * @param[in] max_alive_time 连接最长存活时间(毫秒)
+     * @param[in] max_request 每个连接最多发送的请求数
+     */
+    HttpConnectionPool(const std::string& host, const std::string& vhost
+                       , uint32_t port, uint32_t max_size, uint32_t max_idle
+                       , uint32_t max_idle_time, uint32_t max_alive_time
+                       , uint32_t max_request);
+    ~HttpConnectionPool();
+
+    /**
+     * @brief 取一个连接, 优先使用最近归还的空闲连接, 没有时新建
+     * @details 返回的连接释放时自动归还; 连接池已经析构时直接关闭连接
+     * @param[in] timeout_ms 连接数达到上限时最长等待时间, 也是新建连接的超时时间
+     * @return 超时或连接失败返回nullptr
+     */
+    HttpConnection::ptr getConnection(uint64_t timeout_ms = -1);
+
+    /**
+     * @brief 发送请求并接收响应
+     * @details 复用的空闲连接可能已被服务器关闭, 此时自动换一个新连接重试一次
+     * @param[in] req 请求, 没有host时自动设置, 默认使用长连接
+     * @param[in] timeout_ms 超时时间
+     */
+    HttpResult::ptr doRequest(HttpRequest::ptr req, uint64_t timeout_ms);
+
+    /**
+     * @brief 发送请求并接收响应
+     * @param[in] path 请求路径, 可以带query和fragment
+     */
+    HttpResult::ptr doRequest(HttpMethod method, const std::string& path, uint64_t timeout_ms
+                              , const std::map<std::string, std::string>& headers = {}
+                              , const std::string& body = "");
+
+    HttpResult::ptr doGet(const std::string& path, uint64_t timeout_ms
+                          , const std::map<std::string, std::string>& headers = {}
+                          , const std::string& body = "");
+
+    HttpResult::ptr doPost(const std::string& path, uint64_t timeout_ms
+                           , const std::map<std::string, std::string>& headers = {}
+                           , const std::string& body = "");
+
+    /**
+     * @brief 流水线请求, 在同一个连接上一次发送全部请求, 按顺序接收响应
+     * @details 连接中途关闭时, 未收到响应的请求返回错误, 由调用方决定是否重试
+     * @return 与reqs一一对应的结果
+     */
+    std::vector<HttpResult::ptr> doRequests(const std::vector<HttpRequest::ptr>& reqs
+                                            , uint64_t timeout_ms);
+
+    /**
+     * @brief 返回当前连接总数(含正在使用的和空闲的)
+     */
+    uint32_t getTotal() const { return m_total;}
+
+    /**
+     * @brief 返回空闲连接数
+     */
+    size_t getIdleCount();
+private:
+    /**
+     * @brief 连接的释放函数, 可以复用时放回空闲列表
+     */
+    static void ReleasePtr(HttpConnection* ptr, std::weak_ptr<HttpConnectionPool> weak);
+
+    /**
+     * @brief 连接是否可以继续复用
+     */
+    bool isValid(HttpConnection* conn, uint64_t now) const;
+
+    /**
+     * @brief 补全请求的host和长连接选项
+     */
+    void prepareRequest(HttpRequest::ptr req);
+
+    /**
+     * @brief 在连接上发送请求并接收响应
+     */
+    static HttpResult::ptr Request(HttpConnection::ptr conn, HttpRequest::ptr req);
+private:
+    /// 服务器地址
+    std::string m_host;
+    /// 请求头中的host
+    std::string m_vhost;
+    /// 端口
+    uint32_t m_port;
+    /// 最多同时使用的连接数
+    uint32_t m_maxSize;
+    /// 最多保留的空闲连接数
+    uint32_t m_maxIdle;
+    /// 空闲连接最长保留时间
+    uint32_t m_maxIdleTime;
+    /// 连接最长存活时间
+    uint32_t m_maxAliveTime;
+    /// 每个连接最多发送的请求数
+    uint32_t m_maxRequest;
+
+    MutexType m_mutex;
+    /// 空闲连接, 最近归还的在尾部
+    std::list<HttpConnection*> m_conns;
+    /// 连接总数
+    std::atomic<uint32_t> m_total = {0};
+    /// 还可以同时使用的连接数
+    FiberSemaphore m_sem;
+};
+
+} // namespace http
+} // namespace muhui
+#endif // !__MUHUI_HTTP_HTTP_CONNECTION_H__
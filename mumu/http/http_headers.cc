@@ -0,0 +1,232 @@
+#include "http_headers.h"
+#include <cstring>
+#include <strings.h>
+
+namespace muhui {
+namespace http {
+
+static inline char ToLower(char c) {
+    return (c >= 'A' && c <= 'Z') ? (c | 0x20) : c;
+}
+
+static const char* s_header_names[] = {
+    "",
+#define XX(num, name, string) #string,
+    HTTP_HEADER_MAP(XX)
+#undef XX
+};
+
+namespace {
+/**
+ * @brief 常用字段查找表, 按字段名Hash开放寻址
+ */
+struct HeaderIdTable {
+    static const size_t SIZE = 128;
+    struct Slot {
+        uint32_t hash;
+        HttpHeaderId id;
+    };
+    Slot slots[SIZE];
+
+    HeaderIdTable() {
+        memset(slots, 0, sizeof(slots));
+#define XX(num, name, string) add(HttpHeaderId::name, #string);
+        HTTP_HEADER_MAP(XX)
+#undef XX
+    }
+
+    void add(HttpHeaderId id, const char* name) {
+        uint32_t h = HttpHeaders::Hash(name, strlen(name));
+        size_t i = h & (SIZE - 1);
+        while(slots[i].id != HttpHeaderId::UNKNOWN) {
+            i = (i + 1) & (SIZE - 1);
+        }
+        slots[i].hash = h;
+        slots[i].id = id;
+    }
+
+    HttpHeaderId find(const char* key, size_t klen, uint32_t h) const {
+        for(size_t i = h & (SIZE - 1); slots[i].id != HttpHeaderId::UNKNOWN;
+                i = (i + 1) & (SIZE - 1)) {
+            if(slots[i].hash == h) {
+                const char* name = s_header_names[(size_t)slots[i].id];
+                if(strlen(name) == klen && strncasecmp(name, key, klen) == 0) {
+                    return slots[i].id;
+                }
+            }
+        }
+        return HttpHeaderId::UNKNOWN;
+    }
+};
+
+static const HeaderIdTable s_header_table;
+}
+
+HttpHeaderId HttpHeaders::LookupId(const char* key, size_t klen, uint32_t hash) {
+    return s_header_table.find(key, klen, hash);
+}
+
+const char* HttpHeaders::IdToString(HttpHeaderId id) {
+    size_t idx = (size_t)id;
+    if(idx >= sizeof(s_header_names) / sizeof(s_header_names[0])) {
+        return "";
+    }
+    return s_header_names[idx];
+}
+
+bool HttpHeaders::HasToken(StringView value, StringView token) {
+    size_t pos = 0;
+    while(pos < value.size()) {
+        size_t end = value.find(',', pos);
+        if(end == StringView::npos) {
+            end = value.size();
+        }
+        size_t b = pos;
+        size_t e = end;
+        while(b < e && (value[b] == ' ' || value[b] == '\t')) {
+            ++b;
+        }
+        while(e > b && (value[e - 1] == ' ' || value[e - 1] == '\t')) {
+            --e;
+        }
+        if(EqualsIgnoreCase(value.substr(b, e - b), token)) {
+            return true;
+        }
+        pos = end + 1;
+    }
+    return false;
+}
+
+bool HttpHeaders::ParseUint64(StringView value, uint64_t& v) {
+    size_t b = 0;
+    size_t e = value.size();
+    while(b < e && (value[b] == ' ' || value[b] == '\t')) {
+        ++b;
+    }
+    while(e > b && (value[e - 1] == ' ' || value[e - 1] == '\t')) {
+        --e;
+    }
+    if(b == e) {
+        return false;
+    }
+    uint64_t rt = 0;
+    for(size_t i = b; i < e; ++i) {
+        char c = value[i];
+        if(c < '0' || c > '9' || rt > (UINT64_MAX - 9) / 10) {
+            return false;
+        }
+        rt = rt * 10 + (c - '0');
+    }
+    v = rt;
+    return true;
+}
+
+uint32_t HttpHeaders::Hash(const char* str, size_t len) {
+    //FNV-1a
+    uint32_t h = 2166136261u;
+    for(size_t i = 0; i < len; ++i) {
+        h ^= (uint8_t)ToLower(str[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+bool HttpHeaders::EqualsIgnoreCase(StringView a, StringView b) {
+    return a.size() == b.size()
+        && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+int HttpHeaders::indexOf(const char* key, size_t klen, uint32_t h) const {
+    for(size_t i = 0; i < m_entries.size(); ++i) {
+        const Entry& e = m_entries[i];
+        if(e.hash == h && e.keyLength == klen
+                && strncasecmp(&m_data[e.keyOffset], key, klen) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+HttpHeaderId HttpHeaders::set(const char* key, size_t klen, const char* val, size_t vlen) {
+    uint32_t h = Hash(key, klen);
+    int idx = indexOf(key, klen, h);
+    if(idx >= 0) {
+        Entry& e = m_entries[idx];
+        //新值不长于旧值时原地覆盖
+        if(vlen <= e.valLength) {
+            m_data.replace(e.valOffset, vlen, val, vlen);
+        } else {
+            e.valOffset = m_data.size();
+            m_data.append(val, vlen);
+        }
+        e.valLength = vlen;
+        return e.id;
+    }
+    Entry e;
+    e.id = LookupId(key, klen, h);
+    e.hash = h;
+    e.keyOffset = m_data.size();
+    e.keyLength = klen;
+    m_data.append(key, klen);
+    e.valOffset = m_data.size();
+    e.valLength = vlen;
+    m_data.append(val, vlen);
+    m_entries.push_back(e);
+    return e.id;
+}
+
+HttpHeaders::const_iterator HttpHeaders::find(const char* key, size_t klen) const {
+    int idx = indexOf(key, klen, Hash(key, klen));
+    return idx < 0 ? end() : const_iterator(this, idx);
+}
+
+HttpHeaders::StringView HttpHeaders::get(const char* key, size_t klen, bool* found) const {
+    int idx = indexOf(key, klen, Hash(key, klen));
+    if(found) {
+        *found = idx >= 0;
+    }
+    if(idx < 0) {
+        return StringView();
+    }
+    const Entry& e = m_entries[idx];
+    return StringView(m_data.data() + e.valOffset, e.valLength);
+}
+
+HttpHeaders::StringView HttpHeaders::get(HttpHeaderId id, bool* found) const {
+    for(auto& e : m_entries) {
+        if(e.id == id && id != HttpHeaderId::UNKNOWN) {
+            if(found) {
+                *found = true;
+            }
+            return StringView(m_data.data() + e.valOffset, e.valLength);
+        }
+    }
+    if(found) {
+        *found = false;
+    }
+    return StringView();
+}
+
+HttpHeaderId HttpHeaders::erase(const std::string& key) {
+    int idx = indexOf(key.c_str(), key.size(), Hash(key.c_str(), key.size()));
+    if(idx < 0) {
+        return HttpHeaderId::UNKNOWN;
+    }
+    HttpHeaderId id = m_entries[idx].id;
+    m_entries.erase(m_entries.begin() + idx);
+    return id;
+}
+
+void HttpHeaders::clear() {
+    m_data.clear();
+    m_entries.clear();
+}
+
+HttpHeaders::value_type HttpHeaders::at(size_t idx) const {
+    const Entry& e = m_entries[idx];
+    return value_type(StringView(m_data.data() + e.keyOffset, e.keyLength)
+                    , StringView(m_data.data() + e.valOffset, e.valLength));
+}
+
+} // namespace http
+} // namespace muhui
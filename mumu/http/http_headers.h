@@ -0,0 +1,243 @@
+/**
+ * @file http_headers.h
+ * @author muhui (2571579302@qq.com)
+ * @brief HTTP头部容器, 扁平存储
+ * @version 0.1
+ * @date 2023-02-14
+ */
+#ifndef __MUHUI_HTTP_HTTP_HEADERS_H__
+#define __MUHUI_HTTP_HTTP_HEADERS_H__
+#include "arena.h"
+#include <boost/utility/string_view.hpp>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace muhui {
+namespace http {
+
+/* 常用头部字段, 名称为小写 */
+#define HTTP_HEADER_MAP(XX)                                                    \
+    XX(1, HOST, host)                                                          \
+    XX(2, CONNECTION, connection)                                              \
+    XX(3, CONTENT_LENGTH, content-length)                                      \
+    XX(4, CONTENT_TYPE, content-type)                                          \
+    XX(5, CONTENT_ENCODING, content-encoding)                                  \
+    XX(6, TRANSFER_ENCODING, transfer-encoding)                                \
+    XX(7, KEEP_ALIVE, keep-alive)                                              \
+    XX(8, UPGRADE, upgrade)                                                    \
+    XX(9, EXPECT, expect)                                                      \
+    XX(10, ACCEPT, accept)                                                     \
+    XX(11, ACCEPT_ENCODING, accept-encoding)                                   \
+    XX(12, ACCEPT_LANGUAGE, accept-language)                                   \
+    XX(13, USER_AGENT, user-agent)                                             \
+    XX(14, COOKIE, cookie)                                                     \
+    XX(15, SET_COOKIE, set-cookie)                                             \
+    XX(16, AUTHORIZATION, authorization)                                       \
+    XX(17, CACHE_CONTROL, cache-control)                                       \
+    XX(18, IF_NONE_MATCH, if-none-match)                                       \
+    XX(19, IF_MODIFIED_SINCE, if-modified-since)                               \
+    XX(20, ETAG, etag)                                                         \
+    XX(21, LAST_MODIFIED, last-modified)                                       \
+    XX(22, DATE, date)                                                         \
+    XX(23, SERVER, server)                                                     \
+    XX(24, LOCATION, location)                                                 \
+    XX(25, RANGE, range)                                                       \
+    XX(26, REFERER, referer)                                                   \
+    XX(27, ORIGIN, origin)                                                     \
+    XX(28, VARY, vary)                                                         \
+    XX(29, SEC_WEBSOCKET_KEY, sec-websocket-key)                               \
+    XX(30, SEC_WEBSOCKET_VERSION, sec-websocket-version)                       \
+    XX(31, X_FORWARDED_FOR, x-forwarded-for)
+
+/**
+ * @brief 常用头部字段编号
+ * @details 设置字段时查表确定一次编号, 之后按编号查找和判断, 不再比较字符串
+ */
+enum class HttpHeaderId : uint8_t {
+    /// 不在常用字段表中
+    UNKNOWN = 0,
+#define XX(num, name, string) name = num,
+    HTTP_HEADER_MAP(XX)
+#undef XX
+};
+
+/**
+ * @brief HTTP头部容器
+ * @details 所有字段名和值连续存放在一块内存中, 字段记录偏移和忽略大小写的hash,
+ *          查找时先比较hash再比较字符串. 头部一般只有十几个字段, 线性查找比树更快.
+ *          clear后保留容量, 长连接复用HttpRequest时解析头部不再分配内存.
+ *          修改已存在字段时新值追加到存储末尾, 旧值的空间直到clear才回收.
+ *          指定Arena时存储从Arena分配, 随Arena一起回收
+ */
+class HttpHeaders {
+public:
+    typedef boost::string_view StringView;
+    typedef std::pair<StringView, StringView> value_type;
+
+    /**
+     * @brief 构造函数
+     * @param[in] arena 存储使用的Arena, 为空时使用堆内存
+     */
+    explicit HttpHeaders(Arena::ptr arena = nullptr)
+        : m_data(ArenaAllocator<char>(arena))
+        , m_entries(ArenaAllocator<Entry>(arena)) {
+    }
+
+    /**
+     * @brief 只读迭代器, 解引用得到(字段名, 值)
+     */
+    class const_iterator : public std::iterator<std::forward_iterator_tag, value_type> {
+    public:
+        const_iterator(const HttpHeaders* headers = nullptr, size_t idx = 0)
+            : m_headers(headers), m_idx(idx) {}
+        value_type operator*() const { return m_headers->at(m_idx);}
+        const value_type* operator->() const {
+            m_cur = m_headers->at(m_idx);
+            return &m_cur;
+        }
+        const_iterator& operator++() { ++m_idx; return *this;}
+        const_iterator operator++(int) { const_iterator tmp(*this); ++m_idx; return tmp;}
+        bool operator==(const const_iterator& o) const { return m_idx == o.m_idx;}
+        bool operator!=(const const_iterator& o) const { return m_idx != o.m_idx;}
+        size_t index() const { return m_idx;}
+    private:
+        const HttpHeaders* m_headers;
+        size_t m_idx;
+        mutable value_type m_cur;
+    };
+    typedef const_iterator iterator;
+
+    /**
+     * @brief 设置字段, 已存在时覆盖
+     * @return 字段编号, 不是常用字段返回UNKNOWN
+     */
+    HttpHeaderId set(const char* key, size_t klen, const char* val, size_t vlen);
+    HttpHeaderId set(const std::string& key, const std::string& val) {
+        return set(key.c_str(), key.size(), val.c_str(), val.size());
+    }
+
+    /**
+     * @brief 查找字段
+     * @return 不存在返回end()
+     */
+    const_iterator find(const char* key, size_t klen) const;
+    const_iterator find(const std::string& key) const {
+        return find(key.c_str(), key.size());
+    }
+
+    /**
+     * @brief 获取字段值, 不存在返回空
+     * @param[out] found 是否存在
+     */
+    StringView get(const char* key, size_t klen, bool* found = nullptr) const;
+    StringView get(const std::string& key, bool* found = nullptr) const {
+        return get(key.c_str(), key.size(), found);
+    }
+
+    /**
+     * @brief 按编号获取常用字段的值, 不存在返回空
+     * @param[out] found 是否存在
+     */
+    StringView get(HttpHeaderId id, bool* found = nullptr) const;
+
+    /**
+     * @brief 删除字段
+     * @return 被删除字段的编号
+     */
+    HttpHeaderId erase(const std::string& key);
+
+    /**
+     * @brief 清空, 保留已分配的内存
+     */
+    void clear();
+
+    size_t size() const { return m_entries.size();}
+    bool empty() const { return m_entries.empty();}
+
+    /**
+     * @brief 返回第idx个字段
+     */
+    value_type at(size_t idx) const;
+
+    const_iterator begin() const { return const_iterator(this, 0);}
+    const_iterator end() const { return const_iterator(this, m_entries.size());}
+
+    /**
+     * @brief 从map构造/转换成map, 兼容旧接口
+     */
+    template<class MapType>
+    void assign(const MapType& m) {
+        clear();
+        for(auto& i : m) {
+            set(i.first, i.second);
+        }
+    }
+    template<class MapType>
+    MapType toMap() const {
+        MapType m;
+        for(auto i : *this) {
+            m[i.first.to_string()] = i.second.to_string();
+        }
+        return m;
+    }
+
+    /**
+     * @brief 忽略大小写的hash
+     */
+    static uint32_t Hash(const char* str, size_t len);
+
+    /**
+     * @brief 忽略大小写比较是否相等
+     */
+    static bool EqualsIgnoreCase(StringView a, StringView b);
+
+    /**
+     * @brief 查找常用字段编号
+     * @param[in] hash 字段名的Hash
+     */
+    static HttpHeaderId LookupId(const char* key, size_t klen, uint32_t hash);
+    static HttpHeaderId LookupId(const char* key, size_t klen) {
+        return LookupId(key, klen, Hash(key, klen));
+    }
+
+    /**
+     * @brief 返回常用字段的名称(小写)
+     */
+    static const char* IdToString(HttpHeaderId id);
+
+    /**
+     * @brief 是否包含逗号分隔的选项(忽略大小写), 如 connection: keep-alive, Upgrade
+     */
+    static bool HasToken(StringView value, StringView token);
+
+    /**
+     * @brief 解析十进制数字, 只允许首尾空白
+     * @return 格式错误或溢出返回false
+     */
+    static bool ParseUint64(StringView value, uint64_t& v);
+private:
+    /// 字段在m_data中的位置
+    struct Entry {
+        HttpHeaderId id;
+        uint32_t hash;
+        uint32_t keyOffset;
+        uint32_t keyLength;
+        uint32_t valOffset;
+        uint32_t valLength;
+    };
+
+    int indexOf(const char* key, size_t klen, uint32_t hash) const;
+private:
+    /// 字段名和值的连续存储
+    std::basic_string<char, std::char_traits<char>, ArenaAllocator<char> > m_data;
+    /// 字段列表, 按插入顺序
+    std::vector<Entry, ArenaAllocator<Entry> > m_entries;
+};
+
+} // namespace http
+} // namespace muhui
+#endif // !__MUHUI_HTTP_HTTP_HEADERS_H__
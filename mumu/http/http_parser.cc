@@ -20,6 +20,10 @@ static muhui::ConfigVar<uint64_t>::ptr g_http_request_buffer_size =
 static muhui::ConfigVar<uint64_t>::ptr g_http_request_max_body_size =
     muhui::Config::Lookup("http.request.max.body.size"
         , (uint64_t)(64 * 1024 * 1024ull), "http request max body size");
+/// request消息体超过该长度时不整体缓存, 以流的方式交给servlet
+static muhui::ConfigVar<uint64_t>::ptr g_http_request_stream_body_size =
+    muhui::Config::Lookup("http.request.stream.body.size"
+        , (uint64_t)(1 * 1024 * 1024), "http request stream body size");
 
 /// responce协议解析缓存大小
 static muhui::ConfigVar<uint64_t>::ptr g_http_responce_buffer_size =
@@ -30,42 +34,67 @@ static muhui::ConfigVar<uint64_t>::ptr g_http_responce_max_body_size =
     muhui::Config::Lookup("http.responce.max.body.size"
         , (uint64_t)(64 * 1024 * 1024ull), "http responce max body size");
 
-///初始化
-static uint64_t s_http_request_buffer_size = 0;
-static uint64_t s_http_request_max_body_size = 0;
-static uint64_t s_http_responce_buffer_size = 0;
-static uint64_t s_http_responce_max_body_size = 0;
+/// request请求头解析实现
+static muhui::ConfigVar<std::string>::ptr g_http_request_parser =
+    muhui::Config::Lookup("http.request.parser"
+        , std::string("ragel"), "http request parser: ragel, scalar, sse4.2, avx2, auto");
 
 /**
- * @brief 注册监听函数
+ * @brief 解析http.request.parser配置
  */
-namespace {
-struct _SizeIniter {
-    _SizeIniter() {
-        s_http_request_buffer_size = g_http_request_buffer_size->getValue();
-        s_http_request_max_body_size = g_http_request_max_body_size->getValue();
-        s_http_responce_buffer_size = g_http_responce_buffer_size->getValue();
-        s_http_responce_max_body_size = g_http_responce_max_body_size->getValue();
+static HttpRequestParser::Engine StringToEngine(const std::string& v) {
+    if(v == "scalar") {
+        return HttpRequestParser::SCALAR;
+    } else if(v == "sse4.2" || v == "sse42") {
+        return HttpRequestParser::SSE42;
+    } else if(v == "avx2") {
+        return HttpRequestParser::AVX2;
+    } else if(v == "auto") {
+        return (HttpRequestParser::Engine)(HttpRequestTokenizer::GetBestSimd() + 1);
+    } else if(v != "ragel") {
+        MUHUI_LOG_WARN(g_logger) << "unknown http.request.parser: " << v << ", use ragel";
+    }
+    return HttpRequestParser::RAGEL;
+}
 
+/// 由http.request.parser解析出的实现, 配置变化时更新
+static LockFreeValue<HttpRequestParser::Engine> s_http_request_parser(
+        StringToEngine(g_http_request_parser->getValue()));
+
+/**
+ * @brief 注册http.request.parser的监听函数, 配置变化时切换解析实现
+ */
+namespace {
+struct _ParserConfigIniter {
+    _ParserConfigIniter() {
         //注册监听回调
-        g_http_request_buffer_size->addListener([](const uint64_t& ov, const uint64_t& nv){
-            s_http_request_buffer_size = nv;
-        });
-        g_http_request_max_body_size->addListener([](const uint64_t& ov, const uint64_t& nv){
-            s_http_request_max_body_size = nv;
-        });
-        g_http_responce_buffer_size->addListener([](const uint64_t& ov, const uint64_t& nv){
-            s_http_responce_buffer_size = nv;
-        });
-        g_http_responce_max_body_size->addListener([](const uint64_t& ov, const uint64_t& nv){
-            s_http_responce_max_body_size = nv;
+        g_http_request_parser->addListener([](const std::string& ov, const std::string& nv){
+            s_http_request_parser.store(StringToEngine(nv));
         });
     }
 };
 }
 
 //初始化
-static _SizeIniter _init;
+static _ParserConfigIniter _init;
+
+/**
+ * @brief 解析HTTP版本
+ * @return 0x11/0x10, 不支持的版本返回0
+ */
+static uint8_t ParseHttpVersion(const char* at, size_t length) {
+    if(length != 8 || memcmp(at, "HTTP/1.", 7) != 0) {
+        return 0;
+    }
+    switch(at[7]) {
+        case '1':
+            return 0x11;
+        case '0':
+            return 0x10;
+        default:
+            return 0;
+    }
+}
 
 /**
  * @brief http_parser callback
@@ -76,7 +105,7 @@ static _SizeIniter _init;
  */
 void on_request_method (void *data, const char *at, size_t length) {
     HttpRequestParser* parser = static_cast<HttpRequestParser*>(data);
-    HttpMethod m = charsToHttpMethod(at);
+    HttpMethod m = charsToHttpMethod(at, length);
     if(m == HttpMethod::INVALID_METHOD) {
         MUHUI_LOG_WARN(g_logger) << "invalid http request method: " 
             << std::string(at, length);
@@ -102,12 +131,8 @@ void on_request_query (void *data, const char *at, size_t length) {
 }
 void on_request_version (void *data, const char *at, size_t length) {
     HttpRequestParser* parser = static_cast<HttpRequestParser*>(data);
-    uint8_t v = 0;
-    if(strncmp(at, "HTTP/1.1", length) == 0) {
-        v = 0x11;
-    } else if(strncmp(at, "HTTP/1.0", length) == 0) {
-        v = 0x10;
-    } else {
+    uint8_t v = ParseHttpVersion(at, length);
+    if(!v) {
         MUHUI_LOG_WARN(g_logger) << "invalid http request version: "
             << std::string(at, length);
         parser->setError(1001);
@@ -124,17 +149,26 @@ void on_request_http_field (void *data, const char *field, size_t flen, const ch
         MUHUI_LOG_ERROR(g_logger) << "invalid http request field length == 0";
         return;
     }
-    parser->getData()->setHeader(std::string(field, flen), std::string(value, vlen));
+    parser->getData()->setHeader(field, flen, value, vlen);
 }
 
 
 HttpRequestParser::HttpRequestParser() 
-    : m_error(0)
-{
+    : HttpRequestParser(s_http_request_parser.load()) {
+}
+
+HttpRequestParser::HttpRequestParser(Engine engine)
+    : m_tokenizer(engine == RAGEL ? HttpRequestTokenizer::SCALAR
+                    : (HttpRequestTokenizer::Simd)(engine - 1))
+    , m_fast(engine != RAGEL)
+    , m_error(0) {
     m_data.reset(new muhui::http::HttpRequest);
+    init();
+}
+
+void HttpRequestParser::init() {
     http_parser_init(&m_parser);
     m_parser.request_method = on_request_method;
-    m_parser.request_method = on_request_method;
     m_parser.request_uri    = on_request_uri;
     m_parser.fragment       = on_request_fragment;
     m_parser.request_path   = on_request_path;
@@ -146,30 +180,83 @@ HttpRequestParser::HttpRequestParser()
 }
 
 size_t HttpRequestParser::execute(char* data, size_t len) {
+    if(m_fast) {
+        //请求头完整后一次解析, 不完整时不消费数据
+        int rt = m_tokenizer.execute(&m_parser, data, len);
+        if(rt < 0) {
+            MUHUI_LOG_WARN(g_logger) << "invalid http request header";
+            m_error = 1002;
+            return 0;
+        }
+        if(rt > 0) {
+            memmove(data, data + rt, (len - rt));
+        }
+        return rt;
+    }
     size_t offset = http_parser_execute(&m_parser, data, len, 0);
     //将未处理的数据移到缓存的前面，将处理后的数据移走
     memmove(data, data + offset, (len - offset));
     return offset;
 }
 int HttpRequestParser::isFinished() {
+    if(m_fast) {
+        return m_tokenizer.isFinished();
+    }
     return http_parser_finish(&m_parser);
 }
+void HttpRequestParser::reset() {
+    if(m_fast) {
+        m_tokenizer.reset();
+    } else {
+        http_parser_init(&m_parser);
+    }
+    m_error = 0;
+    if(m_data.use_count() == 1) {
+        m_data->reset();
+    } else {
+        m_data.reset(new muhui::http::HttpRequest);
+    }
+}
 int HttpRequestParser::hasError() {
+    if(m_fast) {
+        return m_error || m_tokenizer.hasError();
+    }
     return m_error || http_parser_has_error(&m_parser);
 }
 
-uint64_t HttpRequestParser::getcontentLength() {
+HttpRequestParser::Engine HttpRequestParser::getEngine() const {
+    if(!m_fast) {
+        return RAGEL;
+    }
+    return (Engine)(m_tokenizer.getSimd() + 1);
+}
+
+HttpRequestParser::Engine HttpRequestParser::GetDefaultEngine() {
+    return s_http_request_parser.load();
+}
 
-     return m_data->getHeaderAs<uint64_t>("content-length", 0);
+const char* HttpRequestParser::EngineToString(Engine engine) {
+    if(engine == RAGEL) {
+        return "ragel";
+    }
+    return HttpRequestTokenizer::SimdToString((HttpRequestTokenizer::Simd)(engine - 1));
+}
+
+uint64_t HttpRequestParser::getcontentLength() {
+     return m_data->getContentLength();
 }
 
 uint64_t HttpRequestParser::GetHttpRequestBufferSize() {
 
-     return s_http_request_buffer_size;
+     return g_http_request_buffer_size->getValue();
 }
 
 uint64_t HttpRequestParser::GetHttpRequestMaxBodySize() {
-     return s_http_request_max_body_size;
+     return g_http_request_max_body_size->getValue();
+}
+
+uint64_t HttpRequestParser::GetHttpRequestStreamBodySize() {
+     return g_http_request_stream_body_size->getValue();
 }
 
 /**
@@ -192,12 +279,8 @@ void on_response_chunk (void *data, const char *at, size_t length) {
 }
 void on_response_version (void *data, const char *at, size_t length) {
     HttpResponceParser* parser = static_cast<HttpResponceParser*>(data);
-    uint8_t v = 0;
-    if(strncmp(at, "HTTP/1.1", length) == 0) {
-        v = 0x11;
-    } else if(strncmp(at, "HTTp/1.0", length) == 0) {
-        v = 0x10;
-    } else {
+    uint8_t v = ParseHttpVersion(at, length);
+    if(!v) {
         MUHUI_LOG_WARN(g_logger) << "invalid http responce version: " 
             << std::string(at, length);
         parser->setError(1001);
@@ -217,7 +300,7 @@ void on_response_http_field (void *data, const char *field, size_t flen, const c
         MUHUI_LOG_ERROR(g_logger) << "invalid http responce field length == 0";
         return;
     }
-    parser->getData()->setHeader(std::string(field, flen), std::string(value, vlen));
+    parser->getData()->setHeader(field, flen, value, vlen);
 }
 HttpResponceParser::HttpResponceParser() 
     : m_error(0)
@@ -250,14 +333,18 @@ int HttpResponceParser::hasError() {
     return m_error || httpclient_parser_has_error(&m_parser);
 }
 uint64_t HttpResponceParser::getcontentLength() {
-    return m_data->GetHeaderAs<uint64_t>("content-length", 0);
+    uint64_t v = 0;
+    if(!HttpHeaders::ParseUint64(m_data->getHeadrs().get(HttpHeaderId::CONTENT_LENGTH), v)) {
+        return 0;
+    }
+    return v;
 }
 uint64_t HttpResponceParser::GetHttpResponceBufferSize() {
-    return s_http_responce_buffer_size;
+    return g_http_responce_buffer_size->getValue();
 }
 
 uint64_t HttpResponceParser::GetHttpResponceMaxBodySize() {
-    return s_http_responce_max_body_size;
+    return g_http_responce_max_body_size->getValue();
 }
 } // namespace http
 } // namespace muhui
\ No newline at end of file
@@ -10,6 +10,7 @@
 #include "http.h"
 #include "httpclient_parser.h"
 #include "http11_parser.h"
+#include "http_tokenizer.h"
 #include <cstdint>
 #include <memory>
 
@@ -22,8 +23,30 @@ namespace http {
 class HttpRequestParser {
 public:
     typedef std::shared_ptr<HttpRequestParser> ptr;
+
+    /// 请求头解析实现
+    enum Engine {
+        /// Ragel状态机, 支持请求头分多次到达时增量解析
+        RAGEL = 0,
+        /// HttpRequestTokenizer 逐字节查表
+        SCALAR,
+        /// HttpRequestTokenizer SSE4.2
+        SSE42,
+        /// HttpRequestTokenizer AVX2
+        AVX2
+    };
+
+    /**
+     * @brief 构造函数, 使用配置http.request.parser指定的实现
+     */
     HttpRequestParser();
 
+    /**
+     * @brief 构造函数
+     * @param[in] engine 解析实现, CPU不支持的SIMD实现退回到支持的最好实现
+     */
+    explicit HttpRequestParser(Engine engine);
+
     /**
      * @brief 解析协议
      * 
@@ -35,6 +58,12 @@ public:
     int isFinished();
     int hasError();
 
+    /**
+     * @brief 重置解析器, 长连接的下一个请求复用解析器
+     * @details 上一个HttpRequest没有被servlet持有时原地清空复用, 否则重新分配
+     */
+    void reset();
+
     /**
      * @brief 返回HttpRequest结构体
      */
@@ -43,7 +72,20 @@ public:
     uint64_t getcontentLength();
     const http_parser& getParser() const { return m_parser;}
 
+    /**
+     * @brief 返回实际使用的解析实现
+     */
+    Engine getEngine() const;
+
 public:
+    /**
+     * @brief 返回配置http.request.parser对应的解析实现
+     * @details ragel(默认), scalar, sse4.2, avx2, auto(CPU支持的最好SIMD实现)
+     */
+    static Engine GetDefaultEngine();
+
+    static const char* EngineToString(Engine engine);
+
     /**
      * @brief 获取HttpRequest协议解析的缓存大小
      * 
@@ -58,11 +100,28 @@ public:
      */
     static uint64_t GetHttpRequestMaxBodySize();
 
+    /**
+     * @brief 返回HttpRequest流式消息体的阈值, 超过该长度的消息体不整体缓存
+     * 
+     * @return uint64_t 
+     */
+    static uint64_t GetHttpRequestStreamBodySize();
+
 private:
-    /// struct http_parser http11_parser.h
+    /**
+     * @brief 注册回调函数
+     */
+    void init();
+
+private:
+    /// struct http_parser http11_parser.h, 快速解析时只使用其中的回调
     http_parser m_parser;  
     /// HttpRequest 结构
     HttpRequest::ptr m_data;
+    /// 快速解析器
+    HttpRequestTokenizer m_tokenizer;
+    /// 是否使用快速解析器
+    bool m_fast;
 
     /// 错误码
     /// 1000: invalid method
@@ -1,7 +1,9 @@
 #include "http_server.h"
 #include "http/http.h"
+#include "http/http_compress.h"
 #include "http/servlet.h"
 #include "http_session.h"
+#include "http2/http2_session.h"
 #include "log.h"
 #include "tcp_server.h"
 #include <cstring>
@@ -16,8 +18,10 @@ HttpServer::HttpServer(bool isKeepalive
                     , IOManager* io_worker
                     , IOManager* acceptWorker)
     : TcpServer(worker, io_worker, acceptWorker)
-    , m_isKeepalive(isKeepalive) {
+    , m_isKeepalive(isKeepalive)
+    , m_http2(false) {
     m_dispatch.reset(new ServletDispatch);
+    m_wsDispatch.reset(new WSServletDispatch);
 }
 
 void HttpServer::setName(const std::string &v) {
@@ -27,6 +31,12 @@ void HttpServer::setName(const std::string &v) {
 
 void HttpServer::handleClient(Socket::ptr client) {
     MUHUI_LOG_DEBUG(g_logger) << "HttpServer handleClient: " << *client;
+    if(m_http2 && http2::Http2Session::PeekPreface(client)) {
+        //prior knowledge
+        http2::Http2Session::ptr h2 = std::make_shared<http2::Http2Session>(client);
+        h2->serve(m_dispatch, m_worker, getName());
+        return;
+    }
     HttpSession::ptr session(new HttpSession(client));
     do {
         //获取HTTP请求
@@ -37,18 +47,82 @@ void HttpServer::handleClient(Socket::ptr client) {
                 << ", client:" << *client << ", keep-alive" << m_isKeepalive;
             break;
         }
+        //WebSocket升级请求, 连接交给WSSession, 不再处理HTTP请求
+        if(WSSession::IsUpgradeRequest(*req)) {
+            ServletRouter::ParamList params;
+            WSServlet::ptr slt = m_wsDispatch->getWSServlet(req->getPath(), &params);
+            if(slt) {
+                for(auto& i : params) {
+                    req->setParam(i.first, i.second);
+                }
+                handleWebsocket(session, req, slt);
+                break;
+            }
+        }
+        //h2c升级, 当前请求作为流1处理
+        if(m_http2 && http2::Http2Session::IsUpgradeRequest(*req)) {
+            //流水线中前面请求的响应必须在101之前发出
+            if(session->hasPendingResponse() && session->flush() <= 0) {
+                break;
+            }
+            http2::Http2Session::ptr h2 = std::make_shared<http2::Http2Session>(client);
+            h2->setRemain(session->takeRemain());
+            h2->serve(m_dispatch, m_worker, getName(), req, req->getHeader("HTTP2-Settings"));
+            return;
+        }
         //响应请求
-        HttpResponce::ptr rsp(new HttpResponce(req->getVersion()
-                            , req->isClose() || !m_isKeepalive));
+        HttpResponce::ptr rsp = session->createResponse(req->getVersion()
+                            , req->isClose() || !m_isKeepalive);
         rsp->setHeader("Server", getName());
         //rsp->setBody("hello muhui");
         m_dispatch->handle(req, rsp, session);
-        session->sendResponse(rsp);
-        if(!m_isKeepalive || req->isClose()) {
+        if(session->isChunkedResponse()) {
+            //servlet开始分块发送后未结束
+            session->endChunkedResponse();
+        } else if(!session->isResponseSent()) {
+            HttpCompressor::CompressResponse(*req, *rsp);
+            bool close = !m_isKeepalive || req->isClose() || rsp->isClose();
+            if(!close && session->hasBufferedRequest()) {
+                //流水线: 缓存中还有后续请求, 响应合并到一次写
+                session->queueResponse(rsp);
+            } else {
+                session->sendResponse(rsp);
+            }
+        }
+        //servlet未读完的流式消息体在下次recvRequest时丢弃
+        if(!m_isKeepalive || req->isClose() || rsp->isClose()) {
             break;
         }
     }while (true);
     session->close();
 }
+
+void HttpServer::handleWebsocket(HttpSession::ptr session, HttpRequest::ptr req, WSServlet::ptr slt) {
+    HttpResponce::ptr rsp = session->createResponse(req->getVersion(), false);
+    rsp->setHeader("Server", getName());
+    WSSession::Handshake(*req, *rsp);
+    if(session->sendResponse(rsp) <= 0 || !rsp->isWebsocket()) {
+        return;
+    }
+    WSSession::ptr ws = std::make_shared<WSSession>(session->getSocket());
+    //客户端可能紧跟握手请求发送帧
+    ws->setRemain(session->takeRemain());
+    if(slt->onConnect(req, ws)) {
+        ws->close();
+        return;
+    }
+    ws->startKeepalive(WSSession::GetKeepaliveInterval());
+    while(true) {
+        WSFrameMessage::ptr msg = ws->recvMessage();
+        if(!msg) {
+            break;
+        }
+        if(slt->handle(req, msg, ws)) {
+            break;
+        }
+    }
+    slt->onClose(req, ws);
+    ws->close();
+}
 }
 }
@@ -11,6 +11,7 @@
 #include "tcp_server.h"
 #include "http_session.h"
 #include "servlet.h"
+#include "ws_servlet.h"
 
 namespace muhui {
 namespace http {
@@ -36,14 +37,35 @@ public:
             , IOManager* acceptWorker = IOManager::GetThis());
     ServletDispatch::ptr getServletDispatch() const {return m_dispatch;}
     void setServletDispatch(ServletDispatch::ptr v) {m_dispatch = v;}
+    /**
+     * @brief WebSocket servlet分发器, 匹配到WSServlet的升级请求在同一端口上握手
+     */
+    WSServletDispatch::ptr getWSServletDispatch() const {return m_wsDispatch;}
+    void setWSServletDispatch(WSServletDispatch::ptr v) {m_wsDispatch = v;}
+    /**
+     * @brief 是否支持HTTP/2(h2c)
+     * @details 开启后连接前言(prior knowledge)和 Upgrade: h2c 请求由Http2Session处理,
+     *          每个流在worker中独立调用ServletDispatch, HttpSession参数为nullptr
+     */
+    bool isHttp2() const {return m_http2;}
+    void setHttp2(bool v) {m_http2 = v;}
     virtual void setName(const std::string &v) override;
 protected:
     virtual void handleClient(Socket::ptr client) override;
+private:
+    /**
+     * @brief WebSocket握手并处理消息, 直到连接关闭
+     */
+    void handleWebsocket(HttpSession::ptr session, HttpRequest::ptr req, WSServlet::ptr slt);
 private:
     /// 是否支持长连接
     bool m_isKeepalive;
     /// servlet分发器
     ServletDispatch::ptr m_dispatch;
+    /// WebSocket servlet分发器
+    WSServletDispatch::ptr m_wsDispatch;
+    /// 是否支持HTTP/2
+    bool m_http2;
 };
 } // namespace http
 } // namespace muhui
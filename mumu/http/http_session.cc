@@ -1,8 +1,12 @@
 #include "http_session.h"
 #include "http/http.h"
+#include "http_body_stream.h"
+#include "http_compress.h"
 #include "http_parser.h"
+#include "log.h"
 #include "socket.h"
 #include "streams/socket_stream.h"
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
 #include <sstream>
@@ -10,27 +14,80 @@
 namespace muhui {
 namespace http {
 
+static muhui::Logger::ptr g_logger = MUHUI_LOG_NAME("system");
+
+/// 流水线最多缓存的响应数, 超过后立即发送
+static const size_t s_max_pending_responses = 64;
+/// 请求Arena的内存块大小
+static const size_t s_arena_block_size = 4096;
+
 HttpSession::HttpSession(Socket::ptr socket, bool owner)
-    : SocketStream(socket, owner) {}
+    : SocketStream(socket, owner)
+    , m_parser(new HttpRequestParser)
+    , m_arena(std::make_shared<Arena>(s_arena_block_size)) {
+}
+
+HttpResponce::ptr HttpSession::createResponse(uint8_t version, bool close) {
+    //对象和shared_ptr控制块一次从Arena分配, 控制块中的分配器持有Arena
+    return std::allocate_shared<HttpResponce>(ArenaAllocator<HttpResponce>(m_arena)
+                                              , version, close, m_arena);
+}
 
 HttpRequest::ptr HttpSession::recvRequest() {
-    HttpRequestParser::ptr parser(new HttpRequestParser);
+    m_rspSent = false;
+    m_chunkRsp.reset();
+    m_chunkZ.reset();
+    //上一个请求的对象全部释放后整体回收Arena;
+    //流水线响应未发送时继续在同一个Arena中分配, 发送后再回收;
+    //servlet在请求结束后仍持有其中的对象时换一个新的Arena
+    if(m_arena.use_count() == 1) {
+        m_arena->reset();
+    } else if(m_pending.empty()) {
+        m_arena = std::make_shared<Arena>(s_arena_block_size);
+    }
+    //上一个请求的流式消息体需要读完, 否则会从消息体中间开始解析
+    if(m_body) {
+        if(!m_body->drain()) {
+            close();
+            return nullptr;
+        }
+        m_remain = m_body->takeRemain();
+        m_body.reset();
+    }
+    //长连接复用解析器和HttpRequest
+    HttpRequestParser::ptr parser = m_parser;
+    parser->reset();
     //HTTP协议解析缓存大小
     uint64_t buff_size = HttpRequestParser::GetHttpRequestBufferSize();
-    //uint64_t buff_size = 100;
-    std::shared_ptr<char> buffer(new char[buff_size], [](char* ptr){
-        delete[] ptr;
-    });
-    char* data = buffer.get();
+    if(m_buffer.size() != buff_size) {
+        m_buffer.resize(buff_size);
+    }
+    char* data = &m_buffer[0];
     //偏移量
     int offset  = 0;
+    //先解析上次多读的数据
+    if(!m_remain.empty()) {
+        offset = std::min<uint64_t>(m_remain.size(), buff_size);
+        memcpy(data, m_remain.c_str(), offset);
+        m_remain.erase(0, offset);
+    }
+    bool need_read = offset == 0;
     //解析HTTP协议
     do {
-        int len = read(data + offset, buff_size - offset);
-        if(len < 0) {
-            close();
-            return nullptr;
+        int len = 0;
+        if(need_read) {
+            //阻塞读之前先发送缓存的流水线响应, 避免客户端等待响应时互相等待
+            if(flush() < 0) {
+                close();
+                return nullptr;
+            }
+            len = read(data + offset, buff_size - offset);
+            if(len <= 0) {
+                close();
+                return nullptr;
+            }
         }
+        need_read = true;
         //解析数据的长度
         len += offset;
         //实际解析数据长度
@@ -49,39 +106,255 @@ HttpRequest::ptr HttpSession::recvRequest() {
         if(parser->isFinished()) {
             break;
         }
-
+        //缓存未满时先补充上次多读的数据
+        if(!m_remain.empty()) {
+            size_t n = std::min<uint64_t>(m_remain.size(), buff_size - offset);
+            memcpy(data + offset, m_remain.c_str(), n);
+            m_remain.erase(0, n);
+            offset += n;
+            need_read = false;
+        }
     }while (true); 
+    //协议头之后已经读入的数据放在m_remain的前面
+    m_remain.insert(0, data, offset);
+
+    HttpRequest::ptr req = parser->getData();
+    req->init();
+    uint64_t max_body = HttpRequestParser::GetHttpRequestMaxBodySize();
+    uint64_t stream_body = HttpRequestParser::GetHttpRequestStreamBodySize();
+    //Transfer-Encoding: chunked 优先于content-length
+    if(req->isChunked()) {
+        if(flush() < 0) {
+            close();
+            return nullptr;
+        }
+        HttpBodyStream::ptr body = HttpBodyStream::CreateChunked(
+                    std::make_shared<SocketStream>(m_sock, false)
+                    , max_body, m_remain.c_str(), m_remain.size());
+        m_remain.clear();
+        //未超过阈值的消息体整体缓存, 否则以流的方式交给servlet
+        std::string content;
+        if(!body->readAll(content, stream_body)) {
+            close();
+            return nullptr;
+        }
+        if(body->isFinished()) {
+            req->setBody(content);
+            m_remain = body->takeRemain();
+        } else {
+            body->pushBack(content);
+            req->setBodyStream(body);
+            m_body = body;
+        }
+        return req;
+    }
     //解析content
-     int length = parser->getcontentLength();
-     if(length > 0) {
+     int64_t length = parser->getcontentLength();
+     if(length > (int64_t)max_body) {
+        MUHUI_LOG_WARN(g_logger) << "http request body too large, content-length="
+            << length << ", max=" << max_body;
+        close();
+        return nullptr;
+     }
+     if((int64_t)m_remain.size() < length && flush() < 0) {
+        close();
+        return nullptr;
+     }
+     if(length > (int64_t)stream_body) {
+        //大消息体不整体缓存, servlet通过消息体流按需读取
+        HttpBodyStream::ptr body(new HttpBodyStream(
+                    std::make_shared<SocketStream>(m_sock, false)
+                    , length, m_remain.c_str(), m_remain.size()));
+        m_remain.clear();
+        req->setBodyStream(body);
+        m_body = body;
+     } else if(length > 0) {
         std::string body;
         //预留空间
         body.resize(length);
-        int len = 0;
-        if(length >= offset) {
-            memcpy(&body[0], data, offset);
-            len = offset;
-        } else {
-            memcpy(&body[0], data, length);
-        }
+        int64_t len = std::min<int64_t>(length, m_remain.size());
+        memcpy(&body[0], m_remain.c_str(), len);
+        //消息体之后的数据属于下一个请求, 保留在m_remain
+        m_remain.erase(0, len);
         //未读取的数据
-        length -= offset;
+        length -= len;
         if(length > 0) {
             if(readFixSize(&body[len], length) <= 0) {
                 close();
                 return nullptr;
             }
         }
-        parser->getData()->setBody(body);
+        req->setBody(body);
      }
-     return parser->getData();
+     return req;
+}
+
+void HttpSession::close() {
+    flush();
+    SocketStream::close();
 }
 
 int HttpSession::sendResponse(HttpResponce::ptr rsp) {
-    std::stringstream ss;
-    ss << *rsp;
-    std::string data = ss.str();
-    return writeFixSize(data.c_str(), data.size());
+    int rt = queueResponse(rsp);
+    if(rt < 0) {
+        return rt;
+    }
+    return flush();
+}
+
+int HttpSession::queueResponse(HttpResponce::ptr rsp) {
+    m_rspSent = true;
+    //响应头写入复用的缓存, 消息体只保存引用, 发送时与响应头一起聚集写
+    PendingResponse pr;
+    pr.rsp = rsp;
+    pr.offset = m_sendBuf.size();
+    rsp->serializeHeader(m_sendBuf);
+    pr.length = m_sendBuf.size() - pr.offset;
+    m_pending.push_back(pr);
+    if(m_pending.size() >= s_max_pending_responses) {
+        return flush();
+    }
+    return 0;
+}
+
+int HttpSession::queueRawResponse(std::shared_ptr<const std::string> data) {
+    m_rspSent = true;
+    PendingResponse pr;
+    pr.raw = data;
+    pr.offset = 0;
+    pr.length = 0;
+    m_pending.push_back(pr);
+    if(m_pending.size() >= s_max_pending_responses) {
+        return flush();
+    }
+    return 0;
+}
+
+int HttpSession::flush() {
+    if(m_pending.empty()) {
+        return 0;
+    }
+    std::vector<iovec>& iovs = m_iovs;
+    iovs.clear();
+    for(auto& i : m_pending) {
+        iovec iov;
+        if(i.raw) {
+            iov.iov_base = (void*)i.raw->c_str();
+            iov.iov_len = i.raw->size();
+            iovs.push_back(iov);
+            continue;
+        }
+        iov.iov_base = (void*)(m_sendBuf.c_str() + i.offset);
+        iov.iov_len = i.length;
+        iovs.push_back(iov);
+        const std::string& body = i.rsp->getBody();
+        if(!body.empty() && !i.rsp->isChunked()) {
+            iov.iov_base = (void*)body.c_str();
+            iov.iov_len = body.size();
+            iovs.push_back(iov);
+        }
+    }
+    int rt = writeFixSize(&iovs[0], iovs.size());
+    iovs.clear();
+    m_pending.clear();
+    m_sendBuf.clear();
+    return rt;
+}
+
+int HttpSession::beginChunkedResponse(HttpResponce::ptr rsp) {
+    if(m_rspSent) {
+        return -1;
+    }
+    m_rspSent = true;
+    std::string body = rsp->getBody();
+    rsp->setBody("");
+    rsp->delHeader("content-length");
+    if(rsp->getVersion() >= 0x11) {
+        rsp->setChunked(true);
+    } else {
+        //HTTP/1.0以关闭连接表示消息体结束
+        rsp->setClose(true);
+    }
+    //按Accept-Encoding压缩, 每块单独flush, 不增加分块发送的延迟
+    m_chunkZ = HttpCompressor::CreateChunkedStream(*m_parser->getData(), *rsp);
+    m_chunkRsp = rsp;
+    //响应头与之前缓存的流水线响应一起发送
+    m_pending.push_back(PendingResponse());
+    m_pending.back().rsp = rsp;
+    m_pending.back().offset = m_sendBuf.size();
+    rsp->serializeHeader(m_sendBuf);
+    m_pending.back().length = m_sendBuf.size() - m_pending.back().offset;
+    int rt = flush();
+    if(rt <= 0 || body.empty()) {
+        return rt;
+    }
+    return sendChunk(body);
+}
+
+int HttpSession::sendChunk(const void* data, size_t length) {
+    if(!m_chunkRsp) {
+        return -1;
+    }
+    //长度为0的chunk表示结束, 不能发送
+    if(length == 0) {
+        return 1;
+    }
+    if(m_chunkZ) {
+        if(m_chunkZ->write(data, length) < 0 || !m_chunkZ->flush()) {
+            return -1;
+        }
+        std::string& out = m_chunkZ->getResult();
+        int rt = writeChunk(out.c_str(), out.size());
+        out.clear();
+        return rt;
+    }
+    return writeChunk(data, length);
+}
+
+int HttpSession::writeChunk(const void* data, size_t length) {
+    if(length == 0) {
+        return 1;
+    }
+    if(!m_chunkRsp->isChunked()) {
+        return writeFixSize(data, length);
+    }
+    char head[32];
+    int n = snprintf(head, sizeof(head), "%zx\r\n", length);
+    iovec iov[3];
+    iov[0].iov_base = head;
+    iov[0].iov_len = n;
+    iov[1].iov_base = (void*)data;
+    iov[1].iov_len = length;
+    iov[2].iov_base = (void*)"\r\n";
+    iov[2].iov_len = 2;
+    return writeFixSize(iov, 3);
+}
+
+int HttpSession::sendChunk(const std::string& data) {
+    return sendChunk(data.c_str(), data.size());
+}
+
+int HttpSession::endChunkedResponse() {
+    if(!m_chunkRsp) {
+        return -1;
+    }
+    if(m_chunkZ) {
+        //压缩流的结尾(gzip的crc和长度)作为最后一块
+        m_chunkZ->close();
+        std::string& out = m_chunkZ->getResult();
+        int rt = writeChunk(out.c_str(), out.size());
+        m_chunkZ.reset();
+        if(rt <= 0) {
+            m_chunkRsp.reset();
+            return rt;
+        }
+    }
+    HttpResponce::ptr rsp = m_chunkRsp;
+    m_chunkRsp.reset();
+    if(!rsp->isChunked()) {
+        return 1;
+    }
+    return writeFixSize("0\r\n\r\n", 5);
 }
 
 } // namespace muhui
@@ -7,11 +7,17 @@
  */
 #ifndef __MUHUI_HTTP_SESSION_H
 #define __MUHUI_HTTP_SESSION_H
+#include "arena.h"
 #include "http/http.h"
+#include "http_body_stream.h"
 #include "socket.h"
 #include "streams/socket_stream.h"
+#include "streams/zlib_stream.h"
+#include <vector>
 namespace muhui {
 namespace http {
+
+class HttpRequestParser;
 /**
  * @brief HttpSession 类 封装
  * 
@@ -32,6 +38,26 @@ public:
      * @return HttpRequest::ptr 
      */
     HttpRequest::ptr recvRequest();
+
+    /**
+     * @brief 创建当前请求的HTTP响应, 响应对象和响应头从请求Arena分配
+     * @param[in] version HTTP版本
+     * @param[in] close 是否关闭连接
+     */
+    HttpResponce::ptr createResponse(uint8_t version, bool close);
+
+    /**
+     * @brief 返回当前请求的Arena
+     * @details servlet可以用ArenaAllocator在其中分配请求内的临时对象,
+     *          请求结束后随下一次recvRequest一起回收.
+     *          在请求结束后仍持有其中对象时, Arena不会被复用
+     */
+    const Arena::ptr& getArena() const { return m_arena;}
+
+    /**
+     * @brief 关闭连接, 关闭前发送缓存的流水线响应
+     */
+    virtual void close() override;
     /**
      * @brief 发送HTTP响应
      * @param[in] rsp HTTP响应
@@ -40,6 +66,132 @@ public:
      *         <0 Socket异常
      */
     int sendResponse(HttpResponce::ptr rsp);
+
+    /**
+     * @brief 缓存HTTP响应, 与之后的响应合并发送(流水线)
+     * @details 缓存的响应达到上限时自动发送; 接收下一个请求需要阻塞读之前,
+     *          开始分块发送或sendResponse时, 缓存的响应会先发送
+     * @param[in] rsp HTTP响应
+     * @return >=0 成功
+     *         <0 Socket异常
+     */
+    int queueResponse(HttpResponce::ptr rsp);
+
+    /**
+     * @brief 缓存预先序列化的HTTP响应(状态行, 响应头和消息体), 与其它响应一起聚集写
+     * @details 用于响应缓存命中, 不经过HttpResponce序列化. 发送前保持对data的引用
+     * @param[in] data 完整的响应报文
+     * @return >=0 成功
+     *         <0 Socket异常
+     */
+    int queueRawResponse(std::shared_ptr<const std::string> data);
+
+    /**
+     * @brief 发送所有缓存的HTTP响应, 一次聚集写
+     * @return >0 发送成功
+     *         =0 没有缓存的响应或对方关闭
+     *         <0 Socket异常
+     */
+    int flush();
+
+    /**
+     * @brief 已读入的数据中是否还有后续请求(流水线)
+     */
+    bool hasBufferedRequest() const { return !m_remain.empty();}
+
+    /**
+     * @brief 是否还有缓存未发送的响应(流水线)
+     */
+    bool hasPendingResponse() const { return !m_pending.empty();}
+
+    /**
+     * @brief 取出已读入但未解析的数据, 协议升级后交给新的会话
+     */
+    std::string takeRemain() {
+        std::string rt;
+        rt.swap(m_remain);
+        return rt;
+    }
+
+    /**
+     * @brief 开始分块发送HTTP响应, 立即发送响应头
+     * @details HTTP/1.1使用Transfer-Encoding: chunked;
+     *          HTTP/1.0不支持chunked, 不带content-length发送, 响应结束后关闭连接.
+     *          客户端接受gzip/deflate时按HttpCompressor的规则压缩消息体.
+     *          rsp中已设置的消息体作为第一块发送
+     * @param[in] rsp HTTP响应
+     * @return >0 发送成功
+     *         =0 对方关闭
+     *         <0 Socket异常或响应已经发送过
+     */
+    int beginChunkedResponse(HttpResponce::ptr rsp);
+
+    /**
+     * @brief 发送一块响应消息体, 需要先调用beginChunkedResponse
+     * @param[in] data 数据
+     * @param[in] length 数据长度, 长度为0时不发送
+     * @return >0 发送成功
+     *         =0 对方关闭
+     *         <0 Socket异常
+     */
+    int sendChunk(const void* data, size_t length);
+    int sendChunk(const std::string& data);
+
+    /**
+     * @brief 结束分块发送的HTTP响应
+     * @return >0 发送成功
+     *         =0 对方关闭
+     *         <0 Socket异常或未开始分块发送
+     */
+    int endChunkedResponse();
+
+    /**
+     * @brief 是否正在分块发送响应
+     */
+    bool isChunkedResponse() const { return !!m_chunkRsp;}
+
+    /**
+     * @brief 当前请求的响应是否已经发送(或已开始分块发送)
+     */
+    bool isResponseSent() const { return m_rspSent;}
+private:
+    /**
+     * @brief 按chunked格式发送一块已编码的消息体
+     */
+    int writeChunk(const void* data, size_t length);
+private:
+    /// 请求解析器, 长连接的多个请求复用
+    std::shared_ptr<HttpRequestParser> m_parser;
+    /// 协议头解析缓存, 长连接的多个请求复用
+    std::vector<char> m_buffer;
+    /// 上一个请求的流式消息体, 下次接收请求前需要读完
+    HttpBodyStream::ptr m_body;
+    /// 已读入但未解析的数据(属于下一个请求), 流水线请求不会丢失
+    std::string m_remain;
+    /// 正在分块发送的响应
+    HttpResponce::ptr m_chunkRsp;
+    /// 分块发送响应的压缩流, 不压缩时为空
+    ZlibStream::ptr m_chunkZ;
+    /// 响应头序列化缓存, 跨请求复用
+    std::string m_sendBuf;
+    /// 待发送的响应
+    struct PendingResponse {
+        HttpResponce::ptr rsp;
+        /// 预先序列化的响应, 不为空时rsp为空
+        std::shared_ptr<const std::string> raw;
+        /// 响应头在m_sendBuf中的偏移
+        size_t offset;
+        /// 响应头长度
+        size_t length;
+    };
+    /// 缓存的流水线响应
+    std::vector<PendingResponse> m_pending;
+    /// 聚集写的iovec, 跨请求复用
+    std::vector<iovec> m_iovs;
+    /// 请求生命周期内对象的Arena
+    Arena::ptr m_arena;
+    /// 当前请求的响应是否已发送
+    bool m_rspSent = false;
 };
 
 } // http
@@ -0,0 +1,252 @@
+#include "http_tokenizer.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MUHUI_HTTP_TOKENIZER_X86 1
+#endif
+
+namespace muhui {
+namespace http {
+
+/// 请求目标的结束字符: 空格和控制字符 (补齐16字节, pcmpestri整块加载)
+alignas(16) static const char s_ranges_uri[16] = "\x00\x20\x7f\x7f";
+static const size_t s_ranges_uri_size = 4;
+/// 字段值的结束字符: 除HTAB之外的控制字符
+alignas(16) static const char s_ranges_value[16] = "\x00\x08\x0a\x1f\x7f\x7f";
+static const size_t s_ranges_value_size = 6;
+
+/**
+ * @brief RFC7230 tchar 查找表
+ */
+static const bool* TokenTable() {
+    static bool s_table[256];
+    static bool s_inited = false;
+    if(!s_inited) {
+        const char* extra = "!#$%&'*+-.^_`|~";
+        for(int c = 0; c < 256; ++c) {
+            s_table[c] = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z')
+                || (c >= 'A' && c <= 'Z') || (c && strchr(extra, c));
+        }
+        s_inited = true;
+    }
+    return s_table;
+}
+static const bool* s_token = TokenTable();
+
+static const char* FindRangesScalar(const char* p, const char* end
+                                    , const char* ranges, size_t nranges) {
+    for(; p < end; ++p) {
+        uint8_t c = *p;
+        for(size_t i = 0; i < nranges; i += 2) {
+            if(c >= (uint8_t)ranges[i] && c <= (uint8_t)ranges[i + 1]) {
+                return p;
+            }
+        }
+    }
+    return end;
+}
+
+#ifdef MUHUI_HTTP_TOKENIZER_X86
+__attribute__((target("sse4.2")))
+static const char* FindRangesSSE42(const char* p, const char* end
+                                   , const char* ranges, size_t nranges) {
+    //ranges需要可以读取16字节
+    __m128i r = _mm_loadu_si128((const __m128i*)ranges);
+    while(end - p >= 16) {
+        __m128i b = _mm_loadu_si128((const __m128i*)p);
+        int idx = _mm_cmpestri(r, nranges, b, 16
+                    , _SIDD_LEAST_SIGNIFICANT | _SIDD_CMP_RANGES | _SIDD_UBYTE_OPS);
+        if(idx != 16) {
+            return p + idx;
+        }
+        p += 16;
+    }
+    return FindRangesScalar(p, end, ranges, nranges);
+}
+
+__attribute__((target("avx2")))
+static const char* FindRangesAVX2(const char* p, const char* end
+                                  , const char* ranges, size_t nranges) {
+    while(end - p >= 32) {
+        __m256i b = _mm256_loadu_si256((const __m256i*)p);
+        __m256i hit = _mm256_setzero_si256();
+        for(size_t i = 0; i < nranges; i += 2) {
+            //lo <= c <= hi 即 max(c, lo) == c 且 min(c, hi) == c
+            __m256i lo = _mm256_set1_epi8(ranges[i]);
+            __m256i hi = _mm256_set1_epi8(ranges[i + 1]);
+            __m256i ge = _mm256_cmpeq_epi8(_mm256_max_epu8(b, lo), b);
+            __m256i le = _mm256_cmpeq_epi8(_mm256_min_epu8(b, hi), b);
+            hit = _mm256_or_si256(hit, _mm256_and_si256(ge, le));
+        }
+        uint32_t mask = _mm256_movemask_epi8(hit);
+        if(mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return FindRangesScalar(p, end, ranges, nranges);
+}
+#endif
+
+bool HttpRequestTokenizer::IsSupported(Simd simd) {
+    switch(simd) {
+        case SCALAR:
+            return true;
+#ifdef MUHUI_HTTP_TOKENIZER_X86
+        case SSE42:
+            return __builtin_cpu_supports("sse4.2");
+        case AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+HttpRequestTokenizer::Simd HttpRequestTokenizer::GetBestSimd() {
+    if(IsSupported(AVX2)) {
+        return AVX2;
+    }
+    if(IsSupported(SSE42)) {
+        return SSE42;
+    }
+    return SCALAR;
+}
+
+const char* HttpRequestTokenizer::SimdToString(Simd simd) {
+    switch(simd) {
+        case SCALAR:
+            return "scalar";
+        case SSE42:
+            return "sse4.2";
+        case AVX2:
+            return "avx2";
+        default:
+            return "unknown";
+    }
+}
+
+HttpRequestTokenizer::HttpRequestTokenizer(Simd simd)
+    : m_simd(IsSupported(simd) ? simd : GetBestSimd())
+    , m_state(HEADER)
+    , m_scanned(0) {
+}
+
+void HttpRequestTokenizer::reset() {
+    m_state = HEADER;
+    m_scanned = 0;
+}
+
+const char* HttpRequestTokenizer::findRanges(const char* p, const char* end
+                                , const char* ranges, size_t nranges) const {
+#ifdef MUHUI_HTTP_TOKENIZER_X86
+    switch(m_simd) {
+        case AVX2:
+            return FindRangesAVX2(p, end, ranges, nranges);
+        case SSE42:
+            return FindRangesSSE42(p, end, ranges, nranges);
+        default:
+            break;
+    }
+#endif
+    return FindRangesScalar(p, end, ranges, nranges);
+}
+
+int HttpRequestTokenizer::execute(http_parser* cb, const char* data, size_t len) {
+    if(m_state == ERROR) {
+        return -1;
+    }
+    //先确认请求头完整, 不完整时记录已查找的位置, 避免重复扫描
+    size_t start = m_scanned > 3 ? m_scanned - 3 : 0;
+    if(start >= len) {
+        return 0;
+    }
+    const char* eoh = (const char*)memmem(data + start, len - start, "\r\n\r\n", 4);
+    if(!eoh) {
+        m_scanned = len;
+        return 0;
+    }
+    const char* end = eoh + 4;
+    if(!parse(cb, data, end)) {
+        m_state = ERROR;
+        return -1;
+    }
+    m_state = DONE;
+    return end - data;
+}
+
+bool HttpRequestTokenizer::parse(http_parser* cb, const char* begin, const char* end) {
+    const char* p = begin;
+    //method SP
+    const char* m = p;
+    while(s_token[(uint8_t)*p]) {
+        ++p;
+    }
+    if(p == m || *p != ' ') {
+        return false;
+    }
+    cb->request_method(cb->data, m, p - m);
+    ++p;
+
+    //request-target SP
+    const char* uri = p;
+    p = findRanges(p, end, s_ranges_uri, s_ranges_uri_size);
+    if(p == uri || *p != ' ') {
+        return false;
+    }
+    const char* uri_end = p;
+    cb->request_uri(cb->data, uri, uri_end - uri);
+    const char* hash = (const char*)memchr(uri, '#', uri_end - uri);
+    const char* path_end = hash ? hash : uri_end;
+    const char* query = (const char*)memchr(uri, '?', path_end - uri);
+    cb->request_path(cb->data, uri, (query ? query : path_end) - uri);
+    if(query) {
+        cb->query_string(cb->data, query + 1, path_end - query - 1);
+    }
+    if(hash) {
+        cb->fragment(cb->data, hash + 1, uri_end - hash - 1);
+    }
+    ++p;
+
+    //HTTP-version CRLF
+    if(end - p < 10 || memcmp(p, "HTTP/", 5) != 0 || p[8] != '\r' || p[9] != '\n') {
+        return false;
+    }
+    cb->http_version(cb->data, p, 8);
+    p += 10;
+
+    //header-field CRLF, 以空行结束
+    while(*p != '\r') {
+        const char* name = p;
+        while(s_token[(uint8_t)*p]) {
+            ++p;
+        }
+        if(p == name || *p != ':') {
+            return false;
+        }
+        const char* name_end = p;
+        ++p;
+        while(*p == ' ' || *p == '\t') {
+            ++p;
+        }
+        const char* value = p;
+        p = findRanges(p, end, s_ranges_value, s_ranges_value_size);
+        if(p + 1 >= end || p[0] != '\r' || p[1] != '\n') {
+            return false;
+        }
+        const char* value_end = p;
+        while(value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+            --value_end;
+        }
+        cb->http_field(cb->data, name, name_end - name, value, value_end - value);
+        p += 2;
+    }
+    //结尾空行, 调用方已经确认存在
+    p += 2;
+    cb->header_done(cb->data, p, 0);
+    return true;
+}
+
+} // namespace http
+} // namespace muhui
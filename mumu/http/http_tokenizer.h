@@ -0,0 +1,119 @@
+/**
+ * @file http_tokenizer.h
+ * @author muhui (2571579302@qq.com)
+ * @brief HTTP/1.x请求头快速解析, SIMD按字符类扫描
+ * @version 0.1
+ * @date 2023-02-17
+ */
+#ifndef __MUHUI_HTTP_HTTP_TOKENIZER_H__
+#define __MUHUI_HTTP_HTTP_TOKENIZER_H__
+#include "http11_parser.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace muhui {
+namespace http {
+
+/**
+ * @brief HTTP/1.x请求行和请求头解析器
+ * @details 与picohttpparser相同的思路: 先确认请求头已经完整(找到空行),
+ *          再一次性切分请求行和各个字段, 按字符类扫描时一次比较16/32个字节.
+ *          解析结果通过http_parser中注册的回调(request_method, http_field...)输出,
+ *          与Ragel状态机的回调顺序一致.
+ *          请求头不完整时不消费任何数据, 调用方补充数据后重新调用
+ */
+class HttpRequestTokenizer {
+public:
+    /// 字符扫描实现
+    enum Simd {
+        /// 查表逐字节扫描
+        SCALAR = 0,
+        /// SSE4.2 pcmpestri
+        SSE42,
+        /// AVX2 32字节比较
+        AVX2
+    };
+
+    /**
+     * @brief 构造函数
+     * @param[in] simd 扫描实现, CPU不支持时退回到支持的最好实现
+     */
+    HttpRequestTokenizer(Simd simd = GetBestSimd());
+
+    /**
+     * @brief 重置, 解析下一个请求
+     */
+    void reset();
+
+    /**
+     * @brief 解析请求头
+     * @param[in] cb 回调函数及其data
+     * @param[in] data 已接收的数据
+     * @param[in] len 数据长度
+     * @return
+     *      @retval >0 请求头完整, 返回请求头长度(含结尾空行), 回调已经调用
+     *      @retval =0 请求头不完整, 需要更多数据
+     *      @retval <0 格式错误
+     */
+    int execute(http_parser* cb, const char* data, size_t len);
+
+    /**
+     * @brief 是否解析完成
+     */
+    bool isFinished() const { return m_state == DONE;}
+
+    /**
+     * @brief 是否格式错误
+     */
+    bool hasError() const { return m_state == ERROR;}
+
+    /**
+     * @brief 返回使用的扫描实现
+     */
+    Simd getSimd() const { return m_simd;}
+
+    /**
+     * @brief 当前CPU是否支持该实现
+     */
+    static bool IsSupported(Simd simd);
+
+    /**
+     * @brief 返回当前CPU支持的最好实现
+     */
+    static Simd GetBestSimd();
+
+    static const char* SimdToString(Simd simd);
+private:
+    /// 解析状态
+    enum State {
+        HEADER = 0,
+        DONE,
+        ERROR
+    };
+
+    /**
+     * @brief 已确认请求头完整后切分请求行和字段
+     * @return 是否成功
+     */
+    bool parse(http_parser* cb, const char* begin, const char* end);
+
+    /**
+     * @brief 查找第一个落在ranges中的字节
+     * @param[in] ranges 字节范围对[lo, hi], 最多8对, 需要可以读取16字节
+     * @param[in] nranges ranges的字节数(范围对数*2)
+     * @return 没有时返回end
+     */
+    const char* findRanges(const char* p, const char* end
+                           , const char* ranges, size_t nranges) const;
+private:
+    /// 扫描实现
+    Simd m_simd;
+    /// 解析状态
+    State m_state;
+    /// 已经确认不含空行的长度, 下次从这里继续查找
+    size_t m_scanned;
+};
+
+} // namespace http
+} // namespace muhui
+#endif // !__MUHUI_HTTP_HTTP_TOKENIZER_H__
@@ -1,8 +1,9 @@
 #include "servlet.h"
+#include "servlet_router.h"
 #include <memory>
 #include <utility>
-#include <fnmatch.h>
 #include "log.h"
+#include "mutex.h"
 namespace muhui {
 namespace http {
 static Logger::ptr g_logger = MUHUI_LOG_ROOT();
@@ -12,34 +13,95 @@ FunctionServlet::FunctionServlet(callback cb)
 int32_t FunctionServlet::handle(HttpRequest::ptr request
                                 , HttpResponce::ptr response
                                 , HttpSession::ptr session) {
-    std::cout << "function handle cb" << std::endl;
     return m_cb(request, response, session);
 }
 ServletDispatch::ServletDispatch() 
     : Servlet("ServletDispatch")
+    , m_router(nullptr)
 {
     m_default.reset(new NotFountServlet("muhui/1.0.0"));
 }
 
+ServletDispatch::~ServletDispatch() {
+    //析构时不会再有分发中的请求
+    delete m_router.load(std::memory_order_relaxed);
+    for(auto i : m_retired) {
+        delete i;
+    }
+}
+
 int32_t ServletDispatch::handle(HttpRequest::ptr request
                                 , HttpResponce::ptr response
                                 , HttpSession::ptr session) {
-    auto slt = getMatchedServlet(request->getPath());
-    MUHUI_LOG_DEBUG(g_logger) << "getMatchedServlet:" << slt->getName();
+    ServletRouter::ParamList params;
+    auto slt = getMatchedServlet(request->getPath(), &params);
     if(slt) {
+        MUHUI_LOG_DEBUG(g_logger) << "getMatchedServlet:" << slt->getName();
+        for(auto& i : params) {
+            request->setParam(i.first, i.second);
+        }
         return slt->handle(request, response, session);
     }
     return 0;
 }
+
+void ServletDispatch::SetDefault(Servlet::ptr slt) {
+    RWMutexType::WriteLock lock(m_mutex);
+    m_default = slt;
+    invalidate();
+    lock.unlock();
+    reclaim();
+}
+
+void ServletDispatch::invalidate() {
+    const ServletRouter* old = m_router.exchange(nullptr, std::memory_order_acq_rel);
+    if(old) {
+        m_retired.push_back(old);
+    }
+}
+
+void ServletDispatch::reclaim() {
+    std::vector<const ServletRouter*> retired;
+    {
+        RWMutexType::WriteLock lock(m_mutex);
+        retired.swap(m_retired);
+    }
+    if(retired.empty()) {
+        return;
+    }
+    //替换指针在invalidate中完成, 等待之前开始的查找全部结束
+    Rcu::Synchronize();
+    for(auto i : retired) {
+        delete i;
+    }
+}
+
+void ServletDispatch::rebuild() {
+    RWMutexType::WriteLock lock(m_mutex);
+    if(m_router.load(std::memory_order_acquire)) {
+        return;
+    }
+    IServletCreator::ptr def;
+    if(m_default) {
+        def = std::make_shared<HoldServletCreator>(m_default);
+    }
+    m_router.store(new ServletRouter(m_datas, m_globs, def), std::memory_order_release);
+}
 void ServletDispatch::addServlet(const std::string& uri, Servlet::ptr slt) {
     RWMutexType::WriteLock lock(m_mutex);
     m_datas[uri] = std::make_shared<HoldServletCreator>(slt);
+    invalidate();
+    lock.unlock();
+    reclaim();
 }
 
 void ServletDispatch::addServlet(const std::string& uir, FunctionServlet::callback cb) {
     RWMutexType::WriteLock lock(m_mutex);
     m_datas[uir] = std::make_shared<HoldServletCreator>(
                         std::make_shared<FunctionServlet>(cb));
+    invalidate();
+    lock.unlock();
+    reclaim();
 }
 
 void ServletDispatch::addGlobServlet(const std::string& uri, Servlet::ptr slt) {
@@ -52,6 +114,9 @@ void ServletDispatch::addGlobServlet(const std::string& uri, Servlet::ptr slt) {
         }
     }
     m_globs.push_back(std::make_pair(uri, std::make_shared<HoldServletCreator>(slt)));
+    invalidate();
+    lock.unlock();
+    reclaim();
 }
 
 
@@ -62,6 +127,9 @@ void ServletDispatch::addGlobServlet(const std::string& uri, FunctionServlet::ca
 void ServletDispatch::delServlet(const std::string& uri) {
     RWMutexType::WriteLock lock(m_mutex);
     m_datas.erase(uri);
+    invalidate();
+    lock.unlock();
+    reclaim();
 }
 void ServletDispatch::delGlobServlet(const std::string& uri) {
     RWMutexType::WriteLock lock(m_mutex);
@@ -72,6 +140,9 @@ void ServletDispatch::delGlobServlet(const std::string& uri) {
             break;
         }
     }
+    invalidate();
+    lock.unlock();
+    reclaim();
 }
 
 Servlet::ptr ServletDispatch::getServlet(const std::string& uri) {
@@ -90,40 +161,48 @@ Servlet::ptr ServletDispatch::getGlobServlet(const std::string& uri) {
     return nullptr;
 }
 Servlet::ptr ServletDispatch::getMatchedServlet(const std::string& uri) {
-    RWMutexType::ReadLock lock(m_mutex);
-    MUHUI_LOG_DEBUG(g_logger) << "getMatchedServlet uri : " << uri;
-#if 1
-    for(auto& i : m_datas) {
-        //if(i.first == uri) {
-            MUHUI_LOG_DEBUG(g_logger) << "m_datas[] " << i.first << " : " << i.second->getName();
-        //}
-    }
-#endif
-    auto it = m_datas.find(uri);
-    if (it != m_datas.end()) {
-        return it->second->get();
-    }
-    for(auto it = m_globs.begin();
-        it != m_globs.end(); ++it) {
-        if (!fnmatch(it->first.c_str(), uri.c_str(), 0)) {
-            return it->second->get();   
+    return getMatchedServlet(uri, nullptr);
+}
+
+Servlet::ptr ServletDispatch::getMatchedServlet(const std::string& uri
+                                                , ServletRouter::ParamList* params) {
+    //路由表只读, 不加锁; 读临界区保证查找期间路由表不被释放
+    IServletCreator::ptr creator;
+    while(true) {
+        {
+            Rcu::ReadLock lock;
+            const ServletRouter* router = m_router.load(std::memory_order_acquire);
+            if(router) {
+                creator = router->match(uri, params);
+                break;
+            }
         }
+        rebuild();
     }
-    return m_default;
+    //构造servlet可能较慢, 放在临界区外
+    return creator ? creator->get() : nullptr;
 }
 
 void ServletDispatch::addServletCreator(const std::string& uri, IServletCreator::ptr creator) {
     RWMutexType::WriteLock lock(m_mutex);
     m_datas[uri] = creator;
+    invalidate();
+    lock.unlock();
+    reclaim();
 }
 void ServletDispatch::addGlobServletCreator(const std::string& uri, IServletCreator::ptr creator) {
     RWMutexType::WriteLock lock(m_mutex);
     for(auto it = m_globs.begin();
             it != m_globs.end(); ++ it) {
-        m_globs.erase(it);
-        break;
+        if (it->first == uri) {
+            m_globs.erase(it);
+            break;
+        }
     }
     m_globs.push_back(std::make_pair(uri, creator));
+    invalidate();
+    lock.unlock();
+    reclaim();
 }
 void ServletDispatch::listAllServletCreator(std::map<std::string, IServletCreator::ptr>& infos) {
     RWMutexType::ReadLock lock(m_mutex);
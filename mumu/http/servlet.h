@@ -7,6 +7,7 @@
  */
 #ifndef __MUHUI_HTTP_SERVLET_H
 #define __MUHUI_HTTP_SERVLET_H
+#include <atomic>
 #include <memory>
 #include <functional>
 #include <unordered_map>
@@ -17,6 +18,7 @@
 #include "http_session.h"
 #include "http.h"
 #include "mutex.h"
+#include "servlet_router.h"
 #include "util.h"
 
 namespace muhui {
@@ -113,6 +115,9 @@ public:
 };
 /**
  * @brief Servlet分发器(管理类)
+ * @details 添加/删除servlet时加写锁修改路由, 并使编译后的路由表失效;
+ *          分发请求时在Rcu读临界区内使用只读的路由表快照, 不加锁. 路由表在失效后的第一次分发时重新编译.
+ *          旧的快照在修改路由的线程中Rcu::Synchronize之后释放, 所以不能在Rcu读临界区内修改路由
  */
 class ServletDispatch : public Servlet {
 public:
@@ -125,9 +130,15 @@ public:
      * @brief 构造函数
      */
      ServletDispatch();
+     ~ServletDispatch();
 
     /**
      * @brief 添加servlet
+     * @details uri中'/'之后的 :name 匹配一段, *name 匹配剩余部分(只能在最后),
+     *          匹配到的值通过HttpRequest::getParam(name)获取. 如 /user/:id 匹配 /user/42, 参数id=42.
+     *          注意: 段首(紧跟在'/'之后)的':'和'*'总是按参数解释, 不能再精准匹配字面的':'或'*'
+     *          (如 /a/:b 不再只匹配路径"/a/:b"); 其它位置的':'和'*'仍是字面字符.
+     *          addServlet的其它重载和addServletCreator相同
      * @param[in] uri 
      * @param[in] slt 
      */
@@ -151,7 +162,7 @@ public:
 
     Servlet::ptr getDefault() const {return m_default;}
 
-    void SetDefault(Servlet::ptr slt) {m_default = slt;}
+    void SetDefault(Servlet::ptr slt);
 
     Servlet::ptr getServlet(const std::string& uri);
     /**
@@ -168,6 +179,12 @@ public:
      */
     Servlet::ptr getMatchedServlet(const std::string& uri);
 
+    /**
+     * @brief 通过uri获取servlet, 同时输出带参数uri匹配到的参数
+     * @param[out] params 匹配到的参数, 可以为空
+     */
+    Servlet::ptr getMatchedServlet(const std::string& uri, ServletRouter::ParamList* params);
+
     /**
      * @brief 添加servlet构造器
      * @param uri 
@@ -187,6 +204,21 @@ public:
      */
     void listAllServletCreator(std::map<std::string, IServletCreator::ptr>& infos);
     void listAllGlobServletCreator(std::map<std::string, IServletCreator::ptr>& infos);
+private:
+    /**
+     * @brief 路由修改后使路由表失效, 需要持有写锁; 旧路由表放入m_retired, 解锁后由reclaim释放
+     */
+    void invalidate();
+
+    /**
+     * @brief 等待读者离开后释放失效的路由表, 不能持有m_mutex, 也不能在Rcu读临界区内
+     */
+    void reclaim();
+
+    /**
+     * @brief 路由表失效时重新编译, 不能在Rcu读临界区内调用
+     */
+    void rebuild();
 private:
     RWMutexType m_mutex;
     /// 精准匹配servlet MAP
@@ -197,6 +229,10 @@ private:
     std::vector<std::pair<std::string, IServletCreator::ptr>> m_globs;
     /// 默认servlet ，所有路径都没有匹配到的时候使用
     Servlet::ptr m_default;
+    /// 当前路由表快照, 为空表示需要重新编译
+    std::atomic<const ServletRouter*> m_router;
+    /// 已失效, 等待释放的路由表
+    std::vector<const ServletRouter*> m_retired;
 };
 
 /**
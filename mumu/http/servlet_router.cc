@@ -0,0 +1,257 @@
+#include "servlet_router.h"
+#include "log.h"
+#include <cstring>
+#include <fnmatch.h>
+
+namespace muhui {
+namespace http {
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_NAME("system");
+
+/**
+ * @brief 精准匹配uri是否带参数
+ */
+static bool IsParamPattern(const std::string& uri) {
+    return uri.find("/:") != std::string::npos
+        || uri.find("/*") != std::string::npos;
+}
+
+/**
+ * @brief 模糊匹配uri是否只需要前缀匹配: 没有通配符, 或只有末尾一个'*'
+ */
+static bool IsPrefixGlob(const std::string& pattern) {
+    size_t pos = pattern.find_first_of("*?[\\");
+    return pos == std::string::npos
+        || (pos + 1 == pattern.size() && pattern[pos] == '*');
+}
+
+ServletRouter::ServletRouter(const std::unordered_map<std::string, CreatorPtr>& datas
+                             , const std::vector<std::pair<std::string, CreatorPtr> >& globs
+                             , CreatorPtr def)
+    : m_default(def) {
+    for(auto& i : datas) {
+        std::unique_ptr<Route> route(new Route);
+        route->creator = i.second;
+        if(!IsParamPattern(i.first)) {
+            m_statics[i.first] = route.get();
+        } else if(!Insert(&m_root, i.first, route.get(), true)) {
+            MUHUI_LOG_WARN(g_logger) << "invalid or conflicting servlet uri: " << i.first;
+            continue;
+        }
+        m_routes.push_back(std::move(route));
+    }
+    for(size_t i = 0; i < globs.size(); ++i) {
+        std::unique_ptr<Route> route(new Route);
+        route->creator = globs[i].second;
+        route->index = i;
+        const std::string& pattern = globs[i].first;
+        if(!IsPrefixGlob(pattern)) {
+            //挂在第一个通配符之前的字面前缀上
+            route->pattern = pattern;
+            size_t pos = pattern.find_first_of("*?[\\");
+            InsertStatic(&m_globRoot, pattern.c_str(), pos)->globs.push_back(route.get());
+        } else if(!Insert(&m_globRoot, pattern, route.get(), false)) {
+            //相同前缀已有添加顺序更早的模式, 永远不会命中
+            continue;
+        }
+        m_routes.push_back(std::move(route));
+    }
+}
+
+ServletRouter::~ServletRouter() {
+}
+
+ServletRouter::Node* ServletRouter::InsertStatic(Node* node, const char* str, size_t len) {
+    while(len > 0) {
+        size_t pos = node->indices.find(str[0]);
+        if(pos == std::string::npos) {
+            std::unique_ptr<Node> child(new Node);
+            child->label.assign(str, len);
+            node->indices.push_back(str[0]);
+            node->children.push_back(std::move(child));
+            return node->children.back().get();
+        }
+        Node* child = node->children[pos].get();
+        size_t n = 0;
+        while(n < len && n < child->label.size() && child->label[n] == str[n]) {
+            ++n;
+        }
+        if(n < child->label.size()) {
+            //公共前缀拆成新节点, 原节点挂在它下面
+            std::unique_ptr<Node> mid(new Node);
+            mid->label = child->label.substr(0, n);
+            child->label.erase(0, n);
+            mid->indices.push_back(child->label[0]);
+            mid->children.push_back(std::move(node->children[pos]));
+            node->children[pos] = std::move(mid);
+            child = node->children[pos].get();
+        }
+        node = child;
+        str += n;
+        len -= n;
+    }
+    return node;
+}
+
+bool ServletRouter::Insert(Node* root, const std::string& pattern
+                           , Route* route, bool allow_param) {
+    Node* node = root;
+    size_t i = 0;
+    while(i < pattern.size()) {
+        //找到下一个参数/通配符的位置
+        size_t j = i;
+        for(; j < pattern.size(); ++j) {
+            char c = pattern[j];
+            if(allow_param) {
+                if((c == ':' || c == '*') && j > 0 && pattern[j - 1] == '/') {
+                    break;
+                }
+            } else if(c == '*' && j + 1 == pattern.size()) {
+                break;
+            }
+        }
+        node = InsertStatic(node, &pattern[i], j - i);
+        i = j;
+        if(i == pattern.size()) {
+            break;
+        }
+        if(pattern[i] == ':') {
+            size_t end = pattern.find('/', i);
+            if(end == std::string::npos) {
+                end = pattern.size();
+            }
+            if(end == i + 1) {
+                return false;
+            }
+            route->params.push_back(pattern.substr(i + 1, end - i - 1));
+            if(!node->param) {
+                node->param.reset(new Node);
+            }
+            node = node->param.get();
+            i = end;
+        } else {
+            //*name 匹配剩余全部内容, 必须在最后
+            std::string name = pattern.substr(i + 1);
+            if(name.find('/') != std::string::npos || node->wildcard) {
+                return false;
+            }
+            if(allow_param) {
+                route->params.push_back(name);
+            }
+            node->wildcard = route;
+            return true;
+        }
+    }
+    if(node->route) {
+        return false;
+    }
+    node->route = route;
+    return true;
+}
+
+const ServletRouter::Route* ServletRouter::Match(const Node* node, const char* str, size_t len
+                        , std::vector<std::pair<const char*, size_t> >& values) {
+    if(len == 0 && node->route) {
+        return node->route;
+    }
+    if(len > 0) {
+        //静态段优先
+        size_t pos = node->indices.find(str[0]);
+        if(pos != std::string::npos) {
+            const Node* child = node->children[pos].get();
+            size_t n = child->label.size();
+            if(n <= len && memcmp(child->label.c_str(), str, n) == 0) {
+                const Route* rt = Match(child, str + n, len - n, values);
+                if(rt) {
+                    return rt;
+                }
+            }
+        }
+        //:name 匹配到下一个'/'
+        if(node->param) {
+            const char* slash = (const char*)memchr(str, '/', len);
+            size_t n = slash ? slash - str : len;
+            if(n > 0) {
+                values.push_back(std::make_pair(str, n));
+                const Route* rt = Match(node->param.get(), str + n, len - n, values);
+                if(rt) {
+                    return rt;
+                }
+                values.pop_back();
+            }
+        }
+    }
+    if(node->wildcard) {
+        values.push_back(std::make_pair(str, len));
+        return node->wildcard;
+    }
+    return nullptr;
+}
+
+const ServletRouter::Route* ServletRouter::matchGlob(const std::string& uri) const {
+    const Node* node = &m_globRoot;
+    const char* str = uri.c_str();
+    size_t len = uri.size();
+    const Route* best = nullptr;
+    //沿路径经过的节点上的模式都是候选, 取匹配的模式中添加顺序最早的
+    while(true) {
+        if(node->wildcard && (!best || node->wildcard->index < best->index)) {
+            best = node->wildcard;
+        }
+        for(auto i : node->globs) {
+            if(best && i->index > best->index) {
+                break;
+            }
+            if(!fnmatch(i->pattern.c_str(), uri.c_str(), 0)) {
+                best = i;
+                break;
+            }
+        }
+        if(len == 0) {
+            if(node->route && (!best || node->route->index < best->index)) {
+                best = node->route;
+            }
+            break;
+        }
+        size_t pos = node->indices.find(str[0]);
+        if(pos == std::string::npos) {
+            break;
+        }
+        const Node* child = node->children[pos].get();
+        size_t n = child->label.size();
+        if(n > len || memcmp(child->label.c_str(), str, n) != 0) {
+            break;
+        }
+        node = child;
+        str += n;
+        len -= n;
+    }
+    return best;
+}
+
+ServletRouter::CreatorPtr ServletRouter::match(const std::string& uri, ParamList* params) const {
+    auto it = m_statics.find(uri);
+    if(it != m_statics.end()) {
+        return it->second->creator;
+    }
+    if(m_root.route || m_root.param || m_root.wildcard || !m_root.children.empty()) {
+        std::vector<std::pair<const char*, size_t> > values;
+        const Route* rt = Match(&m_root, uri.c_str(), uri.size(), values);
+        if(rt) {
+            if(params) {
+                for(size_t i = 0; i < values.size() && i < rt->params.size(); ++i) {
+                    if(!rt->params[i].empty()) {
+                        params->push_back(std::make_pair(rt->params[i]
+                                    , std::string(values[i].first, values[i].second)));
+                    }
+                }
+            }
+            return rt->creator;
+        }
+    }
+    const Route* rt = matchGlob(uri);
+    return rt ? rt->creator : m_default;
+}
+
+} // namespace http
+} // namespace muhui
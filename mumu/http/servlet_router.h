@@ -0,0 +1,129 @@
+/**
+ * @file servlet_router.h
+ * @author muhui (2571579302@qq.com)
+ * @brief Servlet路由表, 基数树匹配uri
+ * @version 0.1
+ * @date 2023-02-16
+ */
+#ifndef __MUHUI_HTTP_SERVLET_ROUTER_H
+#define __MUHUI_HTTP_SERVLET_ROUTER_H
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace muhui {
+namespace http {
+
+class IServletCreator;
+
+/**
+ * @brief 编译后的只读路由表
+ * @details 由ServletDispatch在路由变化后重新生成, 生成后不再修改, 多线程查找不需要加锁.
+ *          精准匹配uri(/muhui/xxx)优先, 其次是带参数的uri, 最后是模糊匹配uri.
+ *          精准匹配uri中以'/'开头的段可以是:
+ *              :name  匹配一段(不含'/'), 取值作为请求参数name
+ *              *name  只能在最后, 匹配剩余的全部内容(可以为空), 取值作为请求参数name
+ *          同一位置静态段优先于:name, :name优先于*name, 匹配失败会回溯.
+ *          模糊匹配uri使用fnmatch语义, 按添加顺序取第一个匹配的;
+ *          模糊匹配uri按第一个通配符之前的字面前缀放进前缀树,
+ *          只在末尾有一个'*'的模式直接前缀匹配, 其它模式只对前缀相同的uri调用fnmatch
+ */
+class ServletRouter {
+public:
+    typedef std::shared_ptr<ServletRouter> ptr;
+    typedef std::shared_ptr<IServletCreator> CreatorPtr;
+    /// 匹配得到的参数(名称, 值)
+    typedef std::vector<std::pair<std::string, std::string> > ParamList;
+
+    /**
+     * @brief 编译路由表
+     * @param[in] datas 精准匹配uri(可以带参数)
+     * @param[in] globs 模糊匹配uri, 按添加顺序
+     * @param[in] def 都没有匹配时使用的默认servlet
+     */
+    ServletRouter(const std::unordered_map<std::string, CreatorPtr>& datas
+                  , const std::vector<std::pair<std::string, CreatorPtr> >& globs
+                  , CreatorPtr def = nullptr);
+    ~ServletRouter();
+
+    /**
+     * @brief 匹配uri
+     * @param[in] uri 请求路径
+     * @param[out] params 匹配到带参数的uri时输出参数, 可以为空
+     * @return 没有匹配时返回默认servlet
+     */
+    CreatorPtr match(const std::string& uri, ParamList* params = nullptr) const;
+private:
+    /// 路由
+    struct Route {
+        /// servlet构造器
+        CreatorPtr creator;
+        /// 参数名称, 按在uri中出现的顺序
+        std::vector<std::string> params;
+        /// 模糊匹配uri的添加顺序
+        size_t index = 0;
+        /// 模糊匹配uri(需要fnmatch时)
+        std::string pattern;
+    };
+
+    /// 基数树节点
+    struct Node {
+        /// 压缩的静态字符
+        std::string label;
+        /// 静态子节点的首字符, 与children一一对应
+        std::string indices;
+        /// 静态子节点
+        std::vector<std::unique_ptr<Node> > children;
+        /// :name 子节点
+        std::unique_ptr<Node> param;
+        /// 到此结束的路由
+        const Route* route = nullptr;
+        /// 在此位置的*name路由
+        const Route* wildcard = nullptr;
+        /// 字面前缀到此结束, 需要fnmatch的模糊匹配uri, 按添加顺序
+        std::vector<const Route*> globs;
+    };
+
+    /**
+     * @brief 插入路由
+     * @param[in] allow_param 是否解析:name(模糊匹配前缀树不解析)
+     * @return 模式不合法或与已有路由冲突时返回false
+     */
+    static bool Insert(Node* root, const std::string& pattern
+                       , Route* route, bool allow_param);
+
+    /**
+     * @brief 沿静态字符插入, 必要时拆分节点
+     * @return 静态字符结束处的节点
+     */
+    static Node* InsertStatic(Node* node, const char* str, size_t len);
+
+    /**
+     * @brief 回溯匹配精准/参数路由
+     * @param[in, out] values 已捕获的参数值
+     */
+    static const Route* Match(const Node* node, const char* str, size_t len
+                              , std::vector<std::pair<const char*, size_t> >& values);
+
+    /**
+     * @brief 匹配模糊匹配前缀树, 返回添加顺序最小的路由
+     */
+    const Route* matchGlob(const std::string& uri) const;
+private:
+    /// 全部路由
+    std::vector<std::unique_ptr<Route> > m_routes;
+    /// 不带参数的精准匹配uri
+    std::unordered_map<std::string, const Route*> m_statics;
+    /// 带参数的uri基数树
+    Node m_root;
+    /// 模糊匹配前缀树
+    Node m_globRoot;
+    /// 默认servlet
+    CreatorPtr m_default;
+};
+
+} // namespace http
+} // namespace muhui
+#endif // !__MUHUI_HTTP_SERVLET_ROUTER_H
@@ -0,0 +1,71 @@
+#include "ws_servlet.h"
+
+namespace muhui {
+namespace http {
+
+FunctionWSServlet::FunctionWSServlet(callback cb
+                                     , on_connect_cb connect_cb
+                                     , on_close_cb close_cb)
+    : WSServlet("FunctionWSServlet")
+    , m_callback(cb)
+    , m_onConnect(connect_cb)
+    , m_onClose(close_cb) {
+}
+
+int32_t FunctionWSServlet::onConnect(HttpRequest::ptr header, WSSession::ptr session) {
+    if(m_onConnect) {
+        return m_onConnect(header, session);
+    }
+    return 0;
+}
+
+int32_t FunctionWSServlet::onClose(HttpRequest::ptr header, WSSession::ptr session) {
+    if(m_onClose) {
+        return m_onClose(header, session);
+    }
+    return 0;
+}
+
+int32_t FunctionWSServlet::handle(HttpRequest::ptr header
+                                  , WSFrameMessage::ptr msg
+                                  , WSSession::ptr session) {
+    if(m_callback) {
+        return m_callback(header, msg, session);
+    }
+    return 0;
+}
+
+WSServletDispatch::WSServletDispatch() {
+    //没有匹配时不握手
+    SetDefault(nullptr);
+}
+
+void WSServletDispatch::addServlet(const std::string& uri
+                                   , FunctionWSServlet::callback cb
+                                   , FunctionWSServlet::on_connect_cb connect_cb
+                                   , FunctionWSServlet::on_close_cb close_cb) {
+    ServletDispatch::addServlet(uri, std::make_shared<FunctionWSServlet>(cb, connect_cb, close_cb));
+}
+
+void WSServletDispatch::addServlet(const std::string& uri, WSServlet::ptr slt) {
+    ServletDispatch::addServlet(uri, slt);
+}
+
+void WSServletDispatch::addGlobServlet(const std::string& uri
+                                       , FunctionWSServlet::callback cb
+                                       , FunctionWSServlet::on_connect_cb connect_cb
+                                       , FunctionWSServlet::on_close_cb close_cb) {
+    ServletDispatch::addGlobServlet(uri, std::make_shared<FunctionWSServlet>(cb, connect_cb, close_cb));
+}
+
+void WSServletDispatch::addGlobServlet(const std::string& uri, WSServlet::ptr slt) {
+    ServletDispatch::addGlobServlet(uri, slt);
+}
+
+WSServlet::ptr WSServletDispatch::getWSServlet(const std::string& uri
+                                               , ServletRouter::ParamList* params) {
+    return std::dynamic_pointer_cast<WSServlet>(getMatchedServlet(uri, params));
+}
+
+} // namespace http
+} // namespace muhui
@@ -0,0 +1,141 @@
+/**
+ * @file ws_servlet.h
+ * @author muhui (2571579302@qq.com)
+ * @brief WebSocket Servlet封装
+ * @version 0.1
+ * @date 2023-02-22
+ */
+#ifndef __MUHUI_HTTP_WS_SERVLET_H__
+#define __MUHUI_HTTP_WS_SERVLET_H__
+#include "servlet.h"
+#include "ws_session.h"
+
+namespace muhui {
+namespace http {
+
+/**
+ * @brief WebSocket Servlet
+ * @details 握手成功后调用onConnect, 之后每收到一个完整消息调用handle,
+ *          连接关闭时调用onClose. 返回非0时关闭连接
+ */
+class WSServlet : public Servlet {
+public:
+    typedef std::shared_ptr<WSServlet> ptr;
+    WSServlet(const std::string& name)
+        : Servlet(name) {}
+    virtual ~WSServlet() {}
+
+    /**
+     * @brief 普通HTTP请求不会分发到WSServlet
+     */
+    virtual int32_t handle(HttpRequest::ptr request
+                           , HttpResponce::ptr response
+                           , HttpSession::ptr session) override {
+        return 0;
+    }
+
+    /**
+     * @brief 握手成功
+     * @param[in] header 握手请求
+     * @param[in] session WebSocket连接
+     * @return 非0时关闭连接
+     */
+    virtual int32_t onConnect(HttpRequest::ptr header, WSSession::ptr session) = 0;
+
+    /**
+     * @brief 连接关闭
+     */
+    virtual int32_t onClose(HttpRequest::ptr header, WSSession::ptr session) = 0;
+
+    /**
+     * @brief 处理消息
+     * @param[in] header 握手请求
+     * @param[in] msg 完整消息(分片已合并)
+     * @param[in] session WebSocket连接
+     * @return 非0时关闭连接
+     */
+    virtual int32_t handle(HttpRequest::ptr header
+                           , WSFrameMessage::ptr msg
+                           , WSSession::ptr session) = 0;
+};
+
+/**
+ * @brief 函数式WebSocket Servlet
+ */
+class FunctionWSServlet : public WSServlet {
+public:
+    typedef std::shared_ptr<FunctionWSServlet> ptr;
+    typedef std::function<int32_t(HttpRequest::ptr header
+                                  , WSSession::ptr session)> on_connect_cb;
+    typedef std::function<int32_t(HttpRequest::ptr header
+                                  , WSSession::ptr session)> on_close_cb;
+    typedef std::function<int32_t(HttpRequest::ptr header
+                                  , WSFrameMessage::ptr msg
+                                  , WSSession::ptr session)> callback;
+
+    /**
+     * @brief 构造函数
+     * @param[in] cb 消息回调
+     * @param[in] connect_cb 握手成功回调, 可以为空
+     * @param[in] close_cb 连接关闭回调, 可以为空
+     */
+    FunctionWSServlet(callback cb
+                      , on_connect_cb connect_cb = nullptr
+                      , on_close_cb close_cb = nullptr);
+
+    using WSServlet::handle;
+    virtual int32_t onConnect(HttpRequest::ptr header, WSSession::ptr session) override;
+    virtual int32_t onClose(HttpRequest::ptr header, WSSession::ptr session) override;
+    virtual int32_t handle(HttpRequest::ptr header
+                           , WSFrameMessage::ptr msg
+                           , WSSession::ptr session) override;
+private:
+    /// 消息回调
+    callback m_callback;
+    /// 握手成功回调
+    on_connect_cb m_onConnect;
+    /// 连接关闭回调
+    on_close_cb m_onClose;
+};
+
+/**
+ * @brief WebSocket Servlet分发器
+ * @details 与ServletDispatch使用相同的路由规则(精准, 带参数, 模糊匹配),
+ *          只有匹配到WSServlet的升级请求才会握手
+ */
+class WSServletDispatch : public ServletDispatch {
+public:
+    typedef std::shared_ptr<WSServletDispatch> ptr;
+
+    WSServletDispatch();
+
+    /**
+     * @brief 添加WebSocket servlet
+     */
+    void addServlet(const std::string& uri
+                    , FunctionWSServlet::callback cb
+                    , FunctionWSServlet::on_connect_cb connect_cb = nullptr
+                    , FunctionWSServlet::on_close_cb close_cb = nullptr);
+    void addServlet(const std::string& uri, WSServlet::ptr slt);
+
+    /**
+     * @brief 添加模糊匹配的WebSocket servlet
+     */
+    void addGlobServlet(const std::string& uri
+                        , FunctionWSServlet::callback cb
+                        , FunctionWSServlet::on_connect_cb connect_cb = nullptr
+                        , FunctionWSServlet::on_close_cb close_cb = nullptr);
+    void addGlobServlet(const std::string& uri, WSServlet::ptr slt);
+
+    /**
+     * @brief 通过uri获取WebSocket servlet
+     * @param[out] params 带参数uri匹配到的参数, 可以为空
+     * @return 没有匹配时返回nullptr
+     */
+    WSServlet::ptr getWSServlet(const std::string& uri
+                                , ServletRouter::ParamList* params = nullptr);
+};
+
+} // namespace http
+} // namespace muhui
+#endif // !__MUHUI_HTTP_WS_SERVLET_H__
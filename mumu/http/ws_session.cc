@@ -0,0 +1,529 @@
+#include "ws_session.h"
+#include "config.h"
+#include "endian.hh"
+#include "fd_manager.h"
+#include "http_parser.h"
+#include "iomanager.h"
+#include "log.h"
+#include "util.h"
+#include "util/hash_util.h"
+#include <cstring>
+#include <openssl/rand.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MUHUI_WS_MASK_X86 1
+#endif
+
+namespace muhui {
+namespace http {
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_NAME("system");
+
+/// 消息最大长度(分片合并后)
+static muhui::ConfigVar<uint64_t>::ptr g_websocket_message_max_size =
+    muhui::Config::Lookup("websocket.message.max_size", (uint64_t)(32 * 1024 * 1024)
+        , "websocket message max size");
+/// 心跳间隔(毫秒), 0表示不发送
+static muhui::ConfigVar<uint64_t>::ptr g_websocket_keepalive_interval =
+    muhui::Config::Lookup("websocket.keepalive.interval", (uint64_t)(30 * 1000)
+        , "websocket ping interval in ms, 0 disable");
+
+/// RFC6455 握手使用的GUID
+static const char* s_ws_guid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+static void MaskScalar(uint8_t* p, size_t length, const uint8_t key[4]) {
+    //8字节一组, 掩码按内存顺序重复两次
+    uint64_t k64;
+    memcpy(&k64, key, 4);
+    memcpy((uint8_t*)&k64 + 4, key, 4);
+    size_t i = 0;
+    for(; i + 8 <= length; i += 8) {
+        uint64_t v;
+        memcpy(&v, p + i, 8);
+        v ^= k64;
+        memcpy(p + i, &v, 8);
+    }
+    for(; i < length; ++i) {
+        p[i] ^= key[i & 3];
+    }
+}
+
+#ifdef MUHUI_WS_MASK_X86
+__attribute__((target("sse2")))
+static size_t MaskSSE2(uint8_t* p, size_t length, const uint8_t key[4]) {
+    int32_t k32;
+    memcpy(&k32, key, 4);
+    __m128i k = _mm_set1_epi32(k32);
+    size_t i = 0;
+    for(; i + 64 <= length; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(p + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(p + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i*)(p + i + 48));
+        _mm_storeu_si128((__m128i*)(p + i), _mm_xor_si128(a, k));
+        _mm_storeu_si128((__m128i*)(p + i + 16), _mm_xor_si128(b, k));
+        _mm_storeu_si128((__m128i*)(p + i + 32), _mm_xor_si128(c, k));
+        _mm_storeu_si128((__m128i*)(p + i + 48), _mm_xor_si128(d, k));
+    }
+    for(; i + 16 <= length; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(p + i));
+        _mm_storeu_si128((__m128i*)(p + i), _mm_xor_si128(a, k));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t MaskAVX2(uint8_t* p, size_t length, const uint8_t key[4]) {
+    int32_t k32;
+    memcpy(&k32, key, 4);
+    __m256i k = _mm256_set1_epi32(k32);
+    size_t i = 0;
+    for(; i + 64 <= length; i += 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(p + i + 32));
+        _mm256_storeu_si256((__m256i*)(p + i), _mm256_xor_si256(a, k));
+        _mm256_storeu_si256((__m256i*)(p + i + 32), _mm256_xor_si256(b, k));
+    }
+    for(; i + 32 <= length; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(p + i));
+        _mm256_storeu_si256((__m256i*)(p + i), _mm256_xor_si256(a, k));
+    }
+    return i;
+}
+
+static bool s_has_avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+void WSSession::Mask(void* data, size_t length, const uint8_t key[4]) {
+    uint8_t* p = (uint8_t*)data;
+#ifdef MUHUI_WS_MASK_X86
+    //每次处理的长度是4的倍数, 剩余部分的掩码从key[0]开始
+    size_t n = 0;
+    if(length >= 32 && s_has_avx2) {
+        n = MaskAVX2(p, length, key);
+    } else if(length >= 16) {
+        n = MaskSSE2(p, length, key);
+    }
+    p += n;
+    length -= n;
+#endif
+    MaskScalar(p, length, key);
+}
+
+bool WSSession::IsValidUtf8(const void* data, size_t length) {
+    const uint8_t* p = (const uint8_t*)data;
+    size_t i = 0;
+    while(i < length) {
+        //ASCII 8字节一组快速跳过
+        if(i + 8 <= length) {
+            uint64_t v;
+            memcpy(&v, p + i, 8);
+            if(!(v & 0x8080808080808080ull)) {
+                i += 8;
+                continue;
+            }
+        }
+        uint8_t c = p[i];
+        if(c < 0x80) {
+            ++i;
+            continue;
+        }
+        //按RFC3629的表检查第二个字节的范围, 排除过长编码, 代理区和超出范围的码点
+        size_t n;
+        uint8_t lo = 0x80, hi = 0xbf;
+        if(c >= 0xc2 && c <= 0xdf) {
+            n = 1;
+        } else if(c >= 0xe0 && c <= 0xef) {
+            n = 2;
+            if(c == 0xe0) {
+                lo = 0xa0;
+            } else if(c == 0xed) {
+                hi = 0x9f;
+            }
+        } else if(c >= 0xf0 && c <= 0xf4) {
+            n = 3;
+            if(c == 0xf0) {
+                lo = 0x90;
+            } else if(c == 0xf4) {
+                hi = 0x8f;
+            }
+        } else {
+            return false;
+        }
+        if(i + n >= length) {
+            return false;
+        }
+        if(p[i + 1] < lo || p[i + 1] > hi) {
+            return false;
+        }
+        for(size_t j = 2; j <= n; ++j) {
+            if((p[i + j] & 0xc0) != 0x80) {
+                return false;
+            }
+        }
+        i += n + 1;
+    }
+    return true;
+}
+
+WSSession::WSSession(Socket::ptr sock, bool client)
+    : SocketStream(sock)
+    , m_client(client)
+    , m_closeSent(false)
+    , m_lastRecv(muhui::GetCurrentMS())
+    , m_sendMutex(1) {
+}
+
+WSSession::~WSSession() {
+    if(m_timer) {
+        m_timer->cancel();
+    }
+}
+
+int WSSession::read(void* buffer, size_t length) {
+    if(!m_remain.empty()) {
+        size_t n = std::min(length, m_remain.size());
+        memcpy(buffer, m_remain.c_str(), n);
+        m_remain.erase(0, n);
+        return n;
+    }
+    return SocketStream::read(buffer, length);
+}
+
+WSFrameMessage::ptr WSSession::recvMessage() {
+    WSFrameMessage::ptr msg;
+    while(true) {
+        uint8_t head[2];
+        if(readFixSize(head, 2) <= 0) {
+            break;
+        }
+        bool fin = head[0] & 0x80;
+        WSOpcode opcode = (WSOpcode)(head[0] & 0x0f);
+        bool mask = head[1] & 0x80;
+        uint64_t length = head[1] & 0x7f;
+        //没有协商扩展, RSV必须为0; 客户端发送的帧必须有掩码, 服务端发送的帧不能有掩码
+        if((head[0] & 0x70) || mask == m_client) {
+            MUHUI_LOG_INFO(g_logger) << "websocket protocol error, head=" << (int)head[0]
+                << " " << (int)head[1] << " client=" << m_client;
+            close(WSCloseCode::PROTOCOL_ERROR);
+            break;
+        }
+        if(length == 126) {
+            uint16_t len16;
+            if(readFixSize(&len16, sizeof(len16)) <= 0) {
+                break;
+            }
+            length = byteswapOnLittleEndian(len16);
+        } else if(length == 127) {
+            uint64_t len64;
+            if(readFixSize(&len64, sizeof(len64)) <= 0) {
+                break;
+            }
+            length = byteswapOnLittleEndian(len64);
+        }
+        uint8_t key[4] = {0};
+        if(mask && readFixSize(key, sizeof(key)) <= 0) {
+            break;
+        }
+        m_lastRecv = muhui::GetCurrentMS();
+
+        bool control = (uint8_t)opcode & 0x08;
+        if(control) {
+            //控制帧不能分片, 长度不超过125, 可以夹在数据帧的分片之间
+            if(!fin || length > 125) {
+                close(WSCloseCode::PROTOCOL_ERROR);
+                break;
+            }
+            char payload[125];
+            if(length && readFixSize(payload, length) <= 0) {
+                break;
+            }
+            if(mask) {
+                Mask(payload, length, key);
+            }
+            if(opcode == WSOpcode::PING) {
+                if(pong(std::string(payload, length)) <= 0) {
+                    break;
+                }
+            } else if(opcode == WSOpcode::CLOSE) {
+                uint16_t code = (uint16_t)WSCloseCode::NORMAL;
+                if(length >= 2) {
+                    memcpy(&code, payload, 2);
+                    code = byteswapOnLittleEndian(code);
+                }
+                //关闭原因必须是UTF-8
+                if(length > 2 && !IsValidUtf8(payload + 2, length - 2)) {
+                    close(WSCloseCode::INVALID_PAYLOAD);
+                    break;
+                }
+                MUHUI_LOG_DEBUG(g_logger) << "websocket recv close, code=" << code;
+                close((WSCloseCode)code);
+                break;
+            } else if(opcode != WSOpcode::PONG) {
+                close(WSCloseCode::PROTOCOL_ERROR);
+                break;
+            }
+            continue;
+        }
+
+        if(opcode == WSOpcode::CONTINUE) {
+            if(!msg) {
+                close(WSCloseCode::PROTOCOL_ERROR);
+                break;
+            }
+        } else if(opcode == WSOpcode::TEXT_FRAME || opcode == WSOpcode::BIN_FRAME) {
+            if(msg) {
+                close(WSCloseCode::PROTOCOL_ERROR);
+                break;
+            }
+            msg = std::make_shared<WSFrameMessage>(opcode);
+        } else {
+            close(WSCloseCode::PROTOCOL_ERROR);
+            break;
+        }
+        std::string& data = msg->getData();
+        if(data.size() + length > g_websocket_message_max_size->getValue()) {
+            MUHUI_LOG_INFO(g_logger) << "websocket message too big, size=" << data.size() + length
+                << " max=" << g_websocket_message_max_size->getValue();
+            close(WSCloseCode::MESSAGE_TOO_BIG);
+            break;
+        }
+        //直接读入消息缓存并原地去掉掩码
+        size_t offset = data.size();
+        data.resize(offset + length);
+        if(length && readFixSize(&data[offset], length) <= 0) {
+            break;
+        }
+        if(mask) {
+            Mask(&data[offset], length, key);
+        }
+        if(fin) {
+            if(msg->getOpcode() == WSOpcode::TEXT_FRAME && !IsValidUtf8(data.c_str(), data.size())) {
+                MUHUI_LOG_INFO(g_logger) << "websocket text message is not utf-8, size=" << data.size();
+                close(WSCloseCode::INVALID_PAYLOAD);
+                break;
+            }
+            return msg;
+        }
+    }
+    return nullptr;
+}
+
+int WSSession::sendFrame(WSOpcode opcode, const void* data, size_t length, bool fin) {
+    uint8_t head[14];
+    size_t n = 2;
+    head[0] = (fin ? 0x80 : 0) | ((uint8_t)opcode & 0x0f);
+    head[1] = m_client ? 0x80 : 0;
+    if(length < 126) {
+        head[1] |= length;
+    } else if(length < 65536) {
+        head[1] |= 126;
+        uint16_t len16 = byteswapOnLittleEndian((uint16_t)length);
+        memcpy(head + n, &len16, 2);
+        n += 2;
+    } else {
+        head[1] |= 127;
+        uint64_t len64 = byteswapOnLittleEndian((uint64_t)length);
+        memcpy(head + n, &len64, 8);
+        n += 8;
+    }
+    iovec iovs[2];
+    iovs[0].iov_base = head;
+    iovs[1].iov_base = (void*)data;
+    iovs[1].iov_len = length;
+    //客户端需要加掩码, 不修改调用方的数据, 拷贝后异或
+    std::string masked;
+    if(m_client) {
+        //RFC6455 5.3: 掩码必须不可预测
+        uint8_t* key = head + n;
+        if(RAND_bytes(key, 4) != 1) {
+            MUHUI_LOG_ERROR(g_logger) << "websocket RAND_bytes for mask key failed";
+            return -1;
+        }
+        n += 4;
+        if(length) {
+            masked.assign((const char*)data, length);
+            Mask(&masked[0], length, key);
+            iovs[1].iov_base = &masked[0];
+        }
+    }
+    iovs[0].iov_len = n;
+    m_sendMutex.wait();
+    int rt = writeFixSize(iovs, length ? 2 : 1);
+    m_sendMutex.notify();
+    return rt;
+}
+
+int WSSession::sendMessage(WSFrameMessage::ptr msg, bool fin) {
+    return sendMessage(msg->getData(), msg->getOpcode(), fin);
+}
+
+int WSSession::sendMessage(const std::string& msg, WSOpcode opcode, bool fin) {
+    return sendFrame(opcode, msg.c_str(), msg.size(), fin);
+}
+
+int WSSession::ping() {
+    return sendFrame(WSOpcode::PING, nullptr, 0);
+}
+
+int WSSession::pong(const std::string& data) {
+    return sendFrame(WSOpcode::PONG, data.c_str(), data.size());
+}
+
+void WSSession::close(WSCloseCode code) {
+    if(m_timer) {
+        m_timer->cancel();
+        m_timer.reset();
+    }
+    if(isConnected() && !m_closeSent.exchange(true)) {
+        uint16_t c = byteswapOnLittleEndian((uint16_t)code);
+        sendFrame(WSOpcode::CLOSE, &c, sizeof(c));
+    }
+    SocketStream::close();
+}
+
+void WSSession::close() {
+    close(WSCloseCode::NORMAL);
+}
+
+void WSSession::startKeepalive(uint64_t interval_ms) {
+    IOManager* iom = IOManager::GetThis();
+    if(!interval_ms || !iom) {
+        return;
+    }
+    if(m_timer) {
+        m_timer->cancel();
+    }
+    std::weak_ptr<WSSession> weak = shared_from_this();
+    m_timer = iom->addConditionTimer(interval_ms, [weak, interval_ms](){
+        WSSession::ptr self = weak.lock();
+        if(self) {
+            self->onKeepalive(interval_ms);
+        }
+    }, weak, true);
+}
+
+void WSSession::onKeepalive(uint64_t interval_ms) {
+    //在定时器所在线程执行, 和连接的协程并发; 连接已经关闭时什么都不做, 定时器由close取消
+    if(m_closeSent) {
+        return;
+    }
+    uint64_t idle = muhui::GetCurrentMS() - m_lastRecv;
+    if(idle >= interval_ms * 2) {
+        //两个周期没有收到任何帧(包括PONG), 关闭连接, 阻塞在recvMessage中的协程返回
+        MUHUI_LOG_INFO(g_logger) << "websocket keepalive timeout, idle=" << idle
+            << "ms remote=" << getRemoteAddressString();
+        //不能直接close: 被唤醒的读协程可能在fd关闭前重新注册读事件, 之后永远等不到;
+        //shutdown后读协程读到EOF返回, 由handleWebsocket关闭连接, 不再发送CLOSE帧
+        if(!m_closeSent.exchange(true)) {
+            ::shutdown(m_sock->getSocket(), SHUT_RDWR);
+        }
+    } else if(idle >= interval_ms) {
+        ping();
+    }
+}
+
+bool WSSession::IsUpgradeRequest(const HttpRequest& req) {
+    const HttpHeaders& headers = req.getHeaders();
+    return HttpHeaders::HasToken(headers.get(HttpHeaderId::UPGRADE), "websocket")
+        && HttpHeaders::HasToken(headers.get(HttpHeaderId::CONNECTION), "upgrade");
+}
+
+std::string WSSession::AcceptKey(const std::string& key) {
+    return muhui::base64encode(muhui::sha1sum(key + s_ws_guid));
+}
+
+void WSSession::Handshake(const HttpRequest& req, HttpResponce& rsp) {
+    const HttpHeaders& headers = req.getHeaders();
+    if(req.getMethod() != HttpMethod::GET || req.getVersion() < 0x11
+            || !IsUpgradeRequest(req)) {
+        rsp.setStatus(HttpStatus::BAD_REQUEST);
+        rsp.setClose(true);
+        return;
+    }
+    if(headers.get(HttpHeaderId::SEC_WEBSOCKET_VERSION) != "13") {
+        rsp.setStatus(HttpStatus::UPGRADE_REQUIRED);
+        rsp.setHeader("Sec-WebSocket-Version", "13");
+        rsp.setClose(true);
+        return;
+    }
+    HttpHeaders::StringView key = headers.get(HttpHeaderId::SEC_WEBSOCKET_KEY);
+    if(key.empty()) {
+        rsp.setStatus(HttpStatus::BAD_REQUEST);
+        rsp.setClose(true);
+        return;
+    }
+    rsp.setStatus(HttpStatus::SWITCHING_PROTOCOLS);
+    rsp.setWebsocket(true);
+    rsp.setHeader("Upgrade", "websocket");
+    rsp.setHeader("Connection", "Upgrade");
+    rsp.setHeader("Sec-WebSocket-Accept", AcceptKey(key.to_string()));
+}
+
+WSSession::ptr WSSession::Connect(Address::ptr addr, const std::string& path
+                                  , const std::string& host, uint64_t timeout_ms) {
+    Socket::ptr sock = Socket::CreateTCP(addr);
+    if(!sock->connect(addr, timeout_ms)) {
+        MUHUI_LOG_ERROR(g_logger) << "websocket connect fail: " << *addr;
+        return nullptr;
+    }
+    sock->setRecvTimeout(timeout_ms);
+
+    char nonce[16];
+    uint64_t seed = muhui::GetCurrentUS() ^ (uint64_t)(uintptr_t)sock.get();
+    for(size_t i = 0; i < sizeof(nonce); ++i) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        nonce[i] = seed >> 56;
+    }
+    std::string key = muhui::base64encode(nonce, sizeof(nonce));
+    std::string req = "GET " + path + " HTTP/1.1\r\nHost: " + host
+        + "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Version: 13"
+        + "\r\nSec-WebSocket-Key: " + key + "\r\n\r\n";
+    if(sock->send(req.c_str(), req.size()) != (int)req.size()) {
+        return nullptr;
+    }
+
+    //读到响应头结束, 之后的数据属于WebSocket帧
+    std::string buf;
+    size_t end = std::string::npos;
+    while(end == std::string::npos) {
+        char tmp[1024];
+        int rt = sock->recv(tmp, sizeof(tmp));
+        if(rt <= 0 || buf.size() > 8192) {
+            MUHUI_LOG_ERROR(g_logger) << "websocket handshake recv fail, rt=" << rt;
+            return nullptr;
+        }
+        buf.append(tmp, rt);
+        end = buf.find("\r\n\r\n");
+    }
+    std::string header = buf.substr(0, end + 4);
+    HttpResponceParser parser;
+    parser.execute(&header[0], header.size(), false);
+    HttpResponce::ptr rsp = parser.getData();
+    if(parser.hasError() || !parser.isFinished()
+            || rsp->getStatus() != HttpStatus::SWITCHING_PROTOCOLS
+            || rsp->getHeader("sec-websocket-accept") != AcceptKey(key)) {
+        MUHUI_LOG_ERROR(g_logger) << "websocket handshake fail: " << header;
+        return nullptr;
+    }
+    //握手完成后恢复为不超时
+    FdCtx::ptr ctx = FdMgr::GetInstance()->get(sock->getSocket());
+    if(ctx) {
+        ctx->setTimeout(SO_RCVTIMEO, (uint64_t)-1);
+    }
+    WSSession::ptr session = std::make_shared<WSSession>(sock, true);
+    session->setRemain(buf.substr(end + 4));
+    return session;
+}
+
+uint64_t WSSession::GetMaxMessageSize() {
+    return g_websocket_message_max_size->getValue();
+}
+
+uint64_t WSSession::GetKeepaliveInterval() {
+    return g_websocket_keepalive_interval->getValue();
+}
+
+} // namespace http
+} // namespace muhui
@@ -0,0 +1,229 @@
+/**
+ * @file ws_session.h
+ * @author muhui (2571579302@qq.com)
+ * @brief WebSocket连接(RFC6455)
+ * @version 0.1
+ * @date 2023-02-22
+ */
+#ifndef __MUHUI_HTTP_WS_SESSION_H__
+#define __MUHUI_HTTP_WS_SESSION_H__
+#include "http/http.h"
+#include "mutex.h"
+#include "streams/socket_stream.h"
+#include "timer.h"
+#include <atomic>
+
+namespace muhui {
+namespace http {
+
+/**
+ * @brief WebSocket帧操作码
+ */
+enum class WSOpcode : uint8_t {
+    /// 分片的后续帧
+    CONTINUE = 0,
+    /// 文本帧
+    TEXT_FRAME = 1,
+    /// 二进制帧
+    BIN_FRAME = 2,
+    /// 关闭连接
+    CLOSE = 8,
+    /// PING
+    PING = 9,
+    /// PONG
+    PONG = 0xA
+};
+
+/**
+ * @brief WebSocket关闭状态码
+ */
+enum class WSCloseCode : uint16_t {
+    /// 正常关闭
+    NORMAL = 1000,
+    /// 端点离开(服务器关闭, 心跳超时)
+    GOING_AWAY = 1001,
+    /// 协议错误
+    PROTOCOL_ERROR = 1002,
+    /// 数据与消息类型不符(文本不是合法的UTF-8)
+    INVALID_PAYLOAD = 1007,
+    /// 消息过大
+    MESSAGE_TOO_BIG = 1009
+};
+
+/**
+ * @brief WebSocket消息
+ */
+class WSFrameMessage {
+public:
+    typedef std::shared_ptr<WSFrameMessage> ptr;
+
+    WSFrameMessage(WSOpcode opcode = WSOpcode::TEXT_FRAME, const std::string& data = "")
+        : m_opcode(opcode)
+        , m_data(data) {}
+
+    WSOpcode getOpcode() const { return m_opcode;}
+    void setOpcode(WSOpcode v) { m_opcode = v;}
+
+    const std::string& getData() const { return m_data;}
+    std::string& getData() { return m_data;}
+    void setData(const std::string& v) { m_data = v;}
+private:
+    /// 操作码, TEXT_FRAME或BIN_FRAME
+    WSOpcode m_opcode;
+    /// 消息内容(分片已合并)
+    std::string m_data;
+};
+
+/**
+ * @brief WebSocket连接
+ * @details 握手之后的帧收发:
+ *          - recvMessage合并分片帧, 自动回复PING, 收到CLOSE时回复CLOSE并返回nullptr
+ *          - 掩码在接收缓存上原地异或(SSE2/AVX2), 服务端发送的帧不加掩码, 帧头和数据聚集写, 不拷贝
+ *          - startKeepalive用定时器定期发送PING, 超过两个周期没有收到任何帧时关闭连接
+ *          配置: websocket.message.max_size, websocket.keepalive.interval
+ */
+class WSSession : public SocketStream, public std::enable_shared_from_this<WSSession> {
+public:
+    typedef std::shared_ptr<WSSession> ptr;
+    /// 发送锁, 心跳定时器与业务协程可能同时发送
+    typedef FiberSemaphore MutexType;
+
+    /**
+     * @brief 构造函数
+     * @param[in] sock 已完成握手的Socket
+     * @param[in] client 是否客户端, 客户端发送的帧需要加掩码
+     */
+    WSSession(Socket::ptr sock, bool client = false);
+    ~WSSession();
+
+    /**
+     * @brief 设置握手时多读取的数据, 在读取Socket之前先解析
+     */
+    void setRemain(const std::string& v) { m_remain = v;}
+
+    /**
+     * @brief 接收一个完整的消息
+     * @return 连接关闭, 收到CLOSE或协议错误时返回nullptr
+     */
+    WSFrameMessage::ptr recvMessage();
+
+    /**
+     * @brief 发送消息
+     * @param[in] fin 是否最后一个分片, 分片发送时后续分片的操作码为CONTINUE
+     * @return >0 发送成功, <=0 失败
+     */
+    int sendMessage(WSFrameMessage::ptr msg, bool fin = true);
+    int sendMessage(const std::string& msg, WSOpcode opcode = WSOpcode::TEXT_FRAME, bool fin = true);
+
+    /**
+     * @brief 发送一帧
+     * @param[in] opcode 操作码
+     * @param[in] data 数据
+     * @param[in] length 数据长度
+     * @param[in] fin 是否最后一个分片
+     */
+    int sendFrame(WSOpcode opcode, const void* data, size_t length, bool fin = true);
+
+    int ping();
+    int pong(const std::string& data = "");
+
+    /**
+     * @brief 发送CLOSE帧(只发送一次)并关闭连接
+     */
+    void close(WSCloseCode code);
+    virtual void close() override;
+
+    /**
+     * @brief 开始心跳
+     * @param[in] interval_ms 心跳间隔, 0表示不发送
+     */
+    void startKeepalive(uint64_t interval_ms);
+
+    /**
+     * @brief 最后一次收到帧的时间(毫秒)
+     */
+    uint64_t getLastRecvTime() const { return m_lastRecv;}
+
+    /**
+     * @brief 是否客户端
+     */
+    bool isClient() const { return m_client;}
+
+    /**
+     * @brief 对数据异或掩码, 掩码的第一个字节对应data[0]
+     * @param[in,out] data 数据
+     * @param[in] length 数据长度
+     * @param[in] key 掩码, 按内存中的字节顺序
+     */
+    static void Mask(void* data, size_t length, const uint8_t key[4]);
+
+    /**
+     * @brief 是否合法的UTF-8(不允许过长编码, 代理区和超过U+10FFFF的码点)
+     */
+    static bool IsValidUtf8(const void* data, size_t length);
+
+    /**
+     * @brief 是否WebSocket升级请求
+     */
+    static bool IsUpgradeRequest(const HttpRequest& req);
+
+    /**
+     * @brief 计算Sec-WebSocket-Accept
+     */
+    static std::string AcceptKey(const std::string& key);
+
+    /**
+     * @brief 生成握手响应
+     * @details 请求合法时返回101响应, 否则返回400, 版本不支持时返回426
+     */
+    static void Handshake(const HttpRequest& req, HttpResponce& rsp);
+
+    /**
+     * @brief 连接WebSocket服务器并完成握手
+     * @param[in] addr 服务器地址
+     * @param[in] path 请求路径
+     * @param[in] host Host头
+     * @param[in] timeout_ms 连接和握手超时时间
+     * @return 失败返回nullptr
+     */
+    static WSSession::ptr Connect(Address::ptr addr, const std::string& path
+                                  , const std::string& host, uint64_t timeout_ms);
+
+    /**
+     * @brief 返回消息的最大长度
+     */
+    static uint64_t GetMaxMessageSize();
+
+    /**
+     * @brief 返回配置的心跳间隔
+     */
+    static uint64_t GetKeepaliveInterval();
+
+    /**
+     * @brief 读取数据, 先读取握手时多读的数据
+     */
+    virtual int read(void* buffer, size_t length) override;
+    using SocketStream::read;
+private:
+    /**
+     * @brief 心跳定时器回调
+     */
+    void onKeepalive(uint64_t interval_ms);
+private:
+    /// 是否客户端
+    bool m_client;
+    /// CLOSE帧是否已经发送(或心跳超时已关闭连接), 心跳回调在其它线程修改
+    std::atomic<bool> m_closeSent;
+    /// 握手时多读取的数据
+    std::string m_remain;
+    /// 最后一次收到帧的时间
+    std::atomic<uint64_t> m_lastRecv;
+    /// 心跳定时器, 只在连接所在协程中修改, 定时器回调不访问
+    Timer::ptr m_timer;
+    /// 发送锁
+    MutexType m_sendMutex;
+};
+
+} // namespace http
+} // namespace muhui
+#endif // !__MUHUI_HTTP_WS_SESSION_H__
@@ -0,0 +1,215 @@
+#include "frame.h"
+#include <sstream>
+
+namespace muhui {
+namespace http2 {
+
+const char* const CLIENT_PREFACE = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+const uint32_t DEFAULT_WINDOW_SIZE = 65535;
+const uint32_t DEFAULT_MAX_FRAME_SIZE = 16384;
+const uint32_t MAX_WINDOW_SIZE = 0x7fffffff;
+
+/// 一次writev最多的帧数, 每帧最多两个iovec, 不超过IOV_MAX
+static const size_t s_max_batch_frames = 256;
+
+const char* FrameTypeToString(FrameType type) {
+    switch(type) {
+#define XX(name) \
+        case FrameType::name: \
+            return #name;
+        XX(DATA);
+        XX(HEADERS);
+        XX(PRIORITY);
+        XX(RST_STREAM);
+        XX(SETTINGS);
+        XX(PUSH_PROMISE);
+        XX(PING);
+        XX(GOAWAY);
+        XX(WINDOW_UPDATE);
+        XX(CONTINUATION);
+#undef XX
+        default:
+            return "UNKNOWN";
+    }
+}
+
+const char* Http2ErrorToString(Http2Error err) {
+    switch(err) {
+#define XX(name) \
+        case Http2Error::name: \
+            return #name;
+        XX(NO_ERROR);
+        XX(PROTOCOL_ERROR);
+        XX(INTERNAL_ERROR);
+        XX(FLOW_CONTROL_ERROR);
+        XX(SETTINGS_TIMEOUT);
+        XX(STREAM_CLOSED);
+        XX(FRAME_SIZE_ERROR);
+        XX(REFUSED_STREAM);
+        XX(CANCEL);
+        XX(COMPRESSION_ERROR);
+        XX(CONNECT_ERROR);
+        XX(ENHANCE_YOUR_CALM);
+        XX(INADEQUATE_SECURITY);
+        XX(HTTP_1_1_REQUIRED);
+#undef XX
+        default:
+            return "UNKNOWN";
+    }
+}
+
+void FrameHeader::encode(uint8_t* out) const {
+    out[0] = length >> 16;
+    out[1] = length >> 8;
+    out[2] = length;
+    out[3] = (uint8_t)type;
+    out[4] = flags;
+    out[5] = (streamId >> 24) & 0x7f;
+    out[6] = streamId >> 16;
+    out[7] = streamId >> 8;
+    out[8] = streamId;
+}
+
+void FrameHeader::decode(const uint8_t* in) {
+    length = ((uint32_t)in[0] << 16) | ((uint32_t)in[1] << 8) | in[2];
+    type = (FrameType)in[3];
+    flags = in[4];
+    //最高位保留, 忽略
+    streamId = ((uint32_t)(in[5] & 0x7f) << 24) | ((uint32_t)in[6] << 16)
+        | ((uint32_t)in[7] << 8) | in[8];
+}
+
+std::string FrameHeader::toString() const {
+    std::stringstream ss;
+    ss << "[FrameHeader type=" << FrameTypeToString(type)
+       << " length=" << length
+       << " flags=0x" << std::hex << (uint32_t)flags << std::dec
+       << " stream=" << streamId << "]";
+    return ss.str();
+}
+
+int ReadFrame(Stream* stream, Frame& frame, uint32_t max_frame_size) {
+    uint8_t head[FrameHeader::SIZE];
+    int rt = stream->readFixSize(head, sizeof(head));
+    if(rt <= 0) {
+        return rt < 0 ? -1 : 0;
+    }
+    frame.header.decode(head);
+    if(frame.header.length > max_frame_size) {
+        return -2;
+    }
+    frame.payload.resize(frame.header.length);
+    if(frame.header.length) {
+        rt = stream->readFixSize(&frame.payload[0], frame.header.length);
+        if(rt <= 0) {
+            return rt < 0 ? -1 : 0;
+        }
+    }
+    return 1;
+}
+
+FrameWriter::FrameWriter(SocketStream* stream)
+    : m_stream(stream)
+    , m_writing(false)
+    , m_error(false)
+    , m_writes(0)
+    , m_frames(0) {
+}
+
+void FrameWriter::enqueue(FrameType type, uint8_t flags, uint32_t stream_id
+                          , const void* payload, size_t length) {
+    Chunk chunk;
+    chunk.head.resize(FrameHeader::SIZE + length);
+    FrameHeader h;
+    h.length = length;
+    h.type = type;
+    h.flags = flags;
+    h.streamId = stream_id;
+    h.encode((uint8_t*)&chunk.head[0]);
+    if(length) {
+        memcpy(&chunk.head[FrameHeader::SIZE], payload, length);
+    }
+    MutexType::Lock lock(m_mutex);
+    m_queue.push_back(std::move(chunk));
+}
+
+void FrameWriter::enqueueData(uint8_t flags, uint32_t stream_id
+                              , std::shared_ptr<const std::string> body, size_t offset, size_t length) {
+    Chunk chunk;
+    chunk.head.resize(FrameHeader::SIZE);
+    FrameHeader h;
+    h.length = length;
+    h.type = FrameType::DATA;
+    h.flags = flags;
+    h.streamId = stream_id;
+    h.encode((uint8_t*)&chunk.head[0]);
+    chunk.body = body;
+    chunk.offset = offset;
+    chunk.length = length;
+    MutexType::Lock lock(m_mutex);
+    m_queue.push_back(std::move(chunk));
+}
+
+void FrameWriter::enqueueRaw(std::string&& frames) {
+    Chunk chunk;
+    chunk.head.swap(frames);
+    MutexType::Lock lock(m_mutex);
+    m_queue.push_back(std::move(chunk));
+}
+
+int FrameWriter::flush() {
+    {
+        MutexType::Lock lock(m_mutex);
+        if(m_error) {
+            return -1;
+        }
+        if(m_writing) {
+            return 1;
+        }
+        m_writing = true;
+    }
+    std::vector<Chunk> chunks;
+    std::vector<iovec> iovs;
+    while(true) {
+        chunks.clear();
+        {
+            MutexType::Lock lock(m_mutex);
+            if(m_queue.empty()) {
+                m_writing = false;
+                return 1;
+            }
+            if(m_queue.size() <= s_max_batch_frames) {
+                chunks.swap(m_queue);
+            } else {
+                chunks.assign(std::make_move_iterator(m_queue.begin())
+                              , std::make_move_iterator(m_queue.begin() + s_max_batch_frames));
+                m_queue.erase(m_queue.begin(), m_queue.begin() + s_max_batch_frames);
+            }
+        }
+        iovs.clear();
+        for(auto& i : chunks) {
+            iovec iov;
+            iov.iov_base = &i.head[0];
+            iov.iov_len = i.head.size();
+            iovs.push_back(iov);
+            if(i.length) {
+                iov.iov_base = (void*)(i.body->c_str() + i.offset);
+                iov.iov_len = i.length;
+                iovs.push_back(iov);
+            }
+        }
+        int rt = m_stream->writeFixSize(&iovs[0], iovs.size());
+        ++m_writes;
+        m_frames += chunks.size();
+        if(rt <= 0) {
+            MutexType::Lock lock(m_mutex);
+            m_error = true;
+            m_writing = false;
+            m_queue.clear();
+            return rt;
+        }
+    }
+}
+
+} // namespace http2
+} // namespace muhui
@@ -0,0 +1,203 @@
+/**
+ * @file frame.h
+ * @author muhui (2571579302@qq.com)
+ * @brief HTTP/2帧(RFC7540)
+ * @version 0.1
+ * @date 2023-02-24
+ */
+#ifndef __MUHUI_HTTP2_FRAME_H__
+#define __MUHUI_HTTP2_FRAME_H__
+#include "mutex.h"
+#include "streams/socket_stream.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace muhui {
+namespace http2 {
+
+/// 客户端连接前言
+extern const char* const CLIENT_PREFACE;
+enum {
+    /// 客户端连接前言长度
+    CLIENT_PREFACE_SIZE = 24
+};
+
+/**
+ * @brief 帧类型
+ */
+enum class FrameType : uint8_t {
+    DATA = 0x0,
+    HEADERS = 0x1,
+    PRIORITY = 0x2,
+    RST_STREAM = 0x3,
+    SETTINGS = 0x4,
+    PUSH_PROMISE = 0x5,
+    PING = 0x6,
+    GOAWAY = 0x7,
+    WINDOW_UPDATE = 0x8,
+    CONTINUATION = 0x9
+};
+
+/**
+ * @brief 帧标志
+ */
+enum FrameFlag {
+    /// DATA, HEADERS: 流的最后一帧
+    END_STREAM = 0x1,
+    /// SETTINGS, PING: 确认
+    ACK = 0x1,
+    /// HEADERS, CONTINUATION: 头部块结束
+    END_HEADERS = 0x4,
+    /// DATA, HEADERS: 有填充
+    PADDED = 0x8,
+    /// HEADERS: 有优先级字段
+    PRIORITY = 0x20
+};
+
+/**
+ * @brief 错误码
+ */
+enum class Http2Error : uint32_t {
+    NO_ERROR = 0x0,
+    PROTOCOL_ERROR = 0x1,
+    INTERNAL_ERROR = 0x2,
+    FLOW_CONTROL_ERROR = 0x3,
+    SETTINGS_TIMEOUT = 0x4,
+    STREAM_CLOSED = 0x5,
+    FRAME_SIZE_ERROR = 0x6,
+    REFUSED_STREAM = 0x7,
+    CANCEL = 0x8,
+    COMPRESSION_ERROR = 0x9,
+    CONNECT_ERROR = 0xa,
+    ENHANCE_YOUR_CALM = 0xb,
+    INADEQUATE_SECURITY = 0xc,
+    HTTP_1_1_REQUIRED = 0xd
+};
+
+/**
+ * @brief SETTINGS参数
+ */
+enum class SettingsId : uint16_t {
+    HEADER_TABLE_SIZE = 0x1,
+    ENABLE_PUSH = 0x2,
+    MAX_CONCURRENT_STREAMS = 0x3,
+    INITIAL_WINDOW_SIZE = 0x4,
+    MAX_FRAME_SIZE = 0x5,
+    MAX_HEADER_LIST_SIZE = 0x6
+};
+
+/// 默认窗口大小(65535)
+extern const uint32_t DEFAULT_WINDOW_SIZE;
+/// 默认最大帧长度(16384)
+extern const uint32_t DEFAULT_MAX_FRAME_SIZE;
+/// 窗口大小上限(2^31 - 1)
+extern const uint32_t MAX_WINDOW_SIZE;
+
+const char* FrameTypeToString(FrameType type);
+const char* Http2ErrorToString(Http2Error err);
+
+/**
+ * @brief 帧头, 9字节
+ */
+struct FrameHeader {
+    static const size_t SIZE = 9;
+
+    /// 负载长度(24位)
+    uint32_t length = 0;
+    FrameType type = FrameType::DATA;
+    uint8_t flags = 0;
+    /// 流ID(31位)
+    uint32_t streamId = 0;
+
+    void encode(uint8_t* out) const;
+    void decode(const uint8_t* in);
+    std::string toString() const;
+};
+
+/**
+ * @brief 帧
+ */
+struct Frame {
+    FrameHeader header;
+    std::string payload;
+
+    bool hasFlag(uint8_t flag) const { return header.flags & flag;}
+};
+
+/**
+ * @brief 读取一帧
+ * @param[in] max_frame_size 本端通告的最大帧长度
+ * @return >0 成功
+ *         =0 对方关闭
+ *         -1 Socket错误
+ *         -2 帧长度超过max_frame_size
+ */
+int ReadFrame(Stream* stream, Frame& frame, uint32_t max_frame_size);
+
+/**
+ * @brief 帧发送器
+ * @details 多个流的协程把帧放入队列, 当前没有协程在发送时由放入的协程负责发送:
+ *          取出队列中的全部帧一次writev, 发送期间其它协程放入的帧在下一轮一起发送.
+ *          DATA帧的负载引用调用方的缓存(shared_ptr), 不拷贝
+ */
+class FrameWriter {
+public:
+    typedef std::shared_ptr<FrameWriter> ptr;
+    typedef Mutex MutexType;
+
+    FrameWriter(SocketStream* stream);
+
+    /**
+     * @brief 放入一帧, 负载拷贝到帧头之后
+     */
+    void enqueue(FrameType type, uint8_t flags, uint32_t stream_id
+                 , const void* payload = nullptr, size_t length = 0);
+
+    /**
+     * @brief 放入DATA帧, 负载引用body中的[offset, offset + length)
+     */
+    void enqueueData(uint8_t flags, uint32_t stream_id
+                     , std::shared_ptr<const std::string> body, size_t offset, size_t length);
+
+    /**
+     * @brief 放入已编码的多帧(如HEADERS + CONTINUATION), 保证连续发送
+     */
+    void enqueueRaw(std::string&& frames);
+
+    /**
+     * @brief 发送队列中的帧, 其它协程正在发送时直接返回
+     * @return >0 成功或由其它协程发送, <=0 Socket错误
+     */
+    int flush();
+
+    bool isError() const { return m_error;}
+
+    /**
+     * @brief 已发送的writev次数和帧数
+     */
+    uint64_t getWrites() const { return m_writes;}
+    uint64_t getFrames() const { return m_frames;}
+private:
+    struct Chunk {
+        /// 帧头(非DATA帧包含负载)
+        std::string head;
+        /// DATA帧引用的负载
+        std::shared_ptr<const std::string> body;
+        size_t offset = 0;
+        size_t length = 0;
+    };
+private:
+    SocketStream* m_stream;
+    MutexType m_mutex;
+    std::vector<Chunk> m_queue;
+    /// 是否有协程正在发送
+    bool m_writing;
+    bool m_error;
+    std::atomic<uint64_t> m_writes;
+    std::atomic<uint64_t> m_frames;
+};
+
+} // namespace http2
+} // namespace muhui
+#endif // !__MUHUI_HTTP2_FRAME_H__
@@ -0,0 +1,568 @@
+#include "hpack.h"
+#include <memory>
+
+namespace muhui {
+namespace http2 {
+
+/**
+ * @brief Huffman码表(RFC7541 附录B), 码字右对齐
+ */
+static const uint32_t s_huffman_codes[256] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+    0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+    0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+    0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+    0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+    0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+    0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+    0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+    0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+    0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+    0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+    0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+    0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+    0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+    0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+    0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+    0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+    0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+    0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+    0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+};
+
+static const uint8_t s_huffman_lens[256] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+};
+
+/// EOS之外的最长码字为30位, 解码时8位一级查表
+struct HuffmanNode {
+    /// 内部节点的子节点, 叶子节点为空
+    std::unique_ptr<std::unique_ptr<HuffmanNode>[]> children;
+    /// 叶子节点对应的字节
+    uint8_t sym = 0;
+    /// 叶子节点在最后一级中占用的位数
+    uint8_t codeLen = 0;
+};
+
+static HuffmanNode* NewInternalNode() {
+    HuffmanNode* node = new HuffmanNode;
+    node->children.reset(new std::unique_ptr<HuffmanNode>[256]);
+    return node;
+}
+
+/**
+ * @brief 构建解码树, 每一级按8位索引, 码字在最后一级不足8位时占用所有后缀
+ */
+static HuffmanNode* BuildHuffmanTree() {
+    HuffmanNode* root = NewInternalNode();
+    for(int sym = 0; sym < 256; ++sym) {
+        uint32_t code = s_huffman_codes[sym];
+        uint8_t len = s_huffman_lens[sym];
+        HuffmanNode* cur = root;
+        while(len > 8) {
+            len -= 8;
+            uint8_t i = code >> len;
+            if(!cur->children[i]) {
+                cur->children[i].reset(NewInternalNode());
+            }
+            cur = cur->children[i].get();
+        }
+        uint8_t shift = 8 - len;
+        int start = (uint8_t)(code << shift);
+        int end = start + (1 << shift);
+        for(int i = start; i < end; ++i) {
+            HuffmanNode* leaf = new HuffmanNode;
+            leaf->sym = sym;
+            leaf->codeLen = len;
+            cur->children[i].reset(leaf);
+        }
+    }
+    return root;
+}
+
+static const HuffmanNode* GetHuffmanTree() {
+    static std::unique_ptr<HuffmanNode> s_root(BuildHuffmanTree());
+    return s_root.get();
+}
+
+size_t Huffman::EncodedLength(const std::string& str) {
+    uint64_t bits = 0;
+    for(unsigned char c : str) {
+        bits += s_huffman_lens[c];
+    }
+    return (bits + 7) / 8;
+}
+
+void Huffman::Encode(const std::string& str, std::string& out) {
+    uint64_t cur = 0;
+    uint32_t nbits = 0;
+    for(unsigned char c : str) {
+        cur = (cur << s_huffman_lens[c]) | s_huffman_codes[c];
+        nbits += s_huffman_lens[c];
+        while(nbits >= 8) {
+            nbits -= 8;
+            out.push_back((char)(cur >> nbits));
+        }
+    }
+    //不足一个字节时用EOS的前缀(全1)填充
+    if(nbits > 0) {
+        cur = (cur << (8 - nbits)) | (0xff >> nbits);
+        out.push_back((char)cur);
+    }
+}
+
+bool Huffman::Decode(const uint8_t* data, size_t length, std::string& out) {
+    const HuffmanNode* root = GetHuffmanTree();
+    const HuffmanNode* n = root;
+    //cur: 未处理的位, cbits: 未处理的位数, sbits: 当前码字已读入的位数
+    uint64_t cur = 0;
+    uint32_t cbits = 0;
+    uint32_t sbits = 0;
+    for(size_t k = 0; k < length; ++k) {
+        cur = (cur << 8) | data[k];
+        cbits += 8;
+        sbits += 8;
+        while(cbits >= 8) {
+            uint8_t idx = cur >> (cbits - 8);
+            n = n->children[idx].get();
+            if(!n) {
+                return false;
+            }
+            if(!n->children) {
+                out.push_back((char)n->sym);
+                cbits -= n->codeLen;
+                n = root;
+                sbits = cbits;
+            } else {
+                cbits -= 8;
+            }
+        }
+        cur &= (1ull << cbits) - 1;
+    }
+    while(cbits > 0) {
+        n = n->children[(uint8_t)(cur << (8 - cbits))].get();
+        if(!n) {
+            return false;
+        }
+        if(n->children || n->codeLen > cbits) {
+            break;
+        }
+        out.push_back((char)n->sym);
+        cbits -= n->codeLen;
+        n = root;
+        sbits = cbits;
+    }
+    //填充不能超过7位, 并且必须是EOS的前缀(全1)
+    if(sbits > 7) {
+        return false;
+    }
+    uint64_t mask = (1ull << cbits) - 1;
+    return (cur & mask) == mask;
+}
+
+/**
+ * @brief 静态表(RFC7541 附录A), 索引从1开始
+ */
+static const HeaderField s_static_table[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""}
+};
+static const size_t s_static_table_size = sizeof(s_static_table) / sizeof(s_static_table[0]);
+
+/**
+ * @brief 静态表的查找索引
+ */
+struct StaticIndex {
+    /// name + '\0' + value -> 索引
+    std::unordered_map<std::string, size_t> fields;
+    /// name -> 第一个索引
+    std::unordered_map<std::string, size_t> names;
+
+    StaticIndex() {
+        for(size_t i = 0; i < s_static_table_size; ++i) {
+            const HeaderField& f = s_static_table[i];
+            fields.emplace(f.first + '\0' + f.second, i + 1);
+            names.emplace(f.first, i + 1);
+        }
+    }
+};
+
+static const StaticIndex& GetStaticIndex() {
+    static StaticIndex s_index;
+    return s_index;
+}
+
+void HPackEncodeInteger(uint64_t v, uint8_t prefix, uint8_t flags, std::string& out) {
+    uint64_t max = (1u << prefix) - 1;
+    if(v < max) {
+        out.push_back((char)(flags | v));
+        return;
+    }
+    out.push_back((char)(flags | max));
+    v -= max;
+    while(v >= 128) {
+        out.push_back((char)(0x80 | (v & 0x7f)));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+bool HPackDecodeInteger(const uint8_t*& p, const uint8_t* end, uint8_t prefix, uint64_t& v) {
+    if(p >= end) {
+        return false;
+    }
+    uint64_t max = (1u << prefix) - 1;
+    v = *p++ & max;
+    if(v < max) {
+        return true;
+    }
+    uint32_t shift = 0;
+    while(p < end) {
+        uint8_t b = *p++;
+        v += (uint64_t)(b & 0x7f) << shift;
+        if(!(b & 0x80)) {
+            return true;
+        }
+        shift += 7;
+        //超过 2^56 的整数视为错误
+        if(shift > 56) {
+            return false;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief 解码字符串字面量
+ */
+static bool DecodeString(const uint8_t*& p, const uint8_t* end, std::string& out) {
+    if(p >= end) {
+        return false;
+    }
+    bool huffman = *p & 0x80;
+    uint64_t len = 0;
+    if(!HPackDecodeInteger(p, end, 7, len) || len > (uint64_t)(end - p)) {
+        return false;
+    }
+    if(huffman) {
+        if(!Huffman::Decode(p, len, out)) {
+            return false;
+        }
+    } else {
+        out.assign((const char*)p, len);
+    }
+    p += len;
+    return true;
+}
+
+/**
+ * @brief 编码字符串字面量, Huffman编码更短时使用Huffman编码
+ */
+static void EncodeString(const std::string& str, std::string& out) {
+    size_t hlen = Huffman::EncodedLength(str);
+    if(hlen < str.size()) {
+        HPackEncodeInteger(hlen, 7, 0x80, out);
+        Huffman::Encode(str, out);
+    } else {
+        HPackEncodeInteger(str.size(), 7, 0, out);
+        out.append(str);
+    }
+}
+
+HPackDynamicTable::HPackDynamicTable(uint32_t max_size)
+    : m_size(0)
+    , m_maxSize(max_size)
+    , m_inserted(0) {
+}
+
+void HPackDynamicTable::add(const std::string& name, const std::string& value) {
+    uint32_t size = name.size() + value.size() + 32;
+    //比整个表还大的字段清空动态表, 不加入
+    if(size > m_maxSize) {
+        evict(0);
+        return;
+    }
+    evict(m_maxSize - size);
+    m_fields.emplace_front(name, value);
+    m_size += size;
+    m_fieldIndex[name + '\0' + value] = m_inserted;
+    m_nameIndex[name] = m_inserted;
+    ++m_inserted;
+}
+
+const HeaderField* HPackDynamicTable::get(size_t idx) const {
+    if(idx >= m_fields.size()) {
+        return nullptr;
+    }
+    return &m_fields[idx];
+}
+
+void HPackDynamicTable::setMaxSize(uint32_t v) {
+    m_maxSize = v;
+    evict(v);
+}
+
+void HPackDynamicTable::evict(uint32_t max_size) {
+    while(m_size > max_size && !m_fields.empty()) {
+        const HeaderField& f = m_fields.back();
+        uint64_t seq = m_inserted - m_fields.size();
+        auto it = m_fieldIndex.find(f.first + '\0' + f.second);
+        if(it != m_fieldIndex.end() && it->second == seq) {
+            m_fieldIndex.erase(it);
+        }
+        it = m_nameIndex.find(f.first);
+        if(it != m_nameIndex.end() && it->second == seq) {
+            m_nameIndex.erase(it);
+        }
+        m_size -= f.first.size() + f.second.size() + 32;
+        m_fields.pop_back();
+    }
+}
+
+size_t HPackDynamicTable::toIndex(uint64_t seq) const {
+    return s_static_table_size + 1 + (m_inserted - 1 - seq);
+}
+
+size_t HPackDynamicTable::find(const std::string& name, const std::string& value
+                               , size_t& name_only) const {
+    name_only = 0;
+    auto it = m_fieldIndex.find(name + '\0' + value);
+    if(it != m_fieldIndex.end()) {
+        return toIndex(it->second);
+    }
+    it = m_nameIndex.find(name);
+    if(it != m_nameIndex.end()) {
+        name_only = toIndex(it->second);
+    }
+    return 0;
+}
+
+HPackDecoder::HPackDecoder(uint32_t max_table_size)
+    : m_table(max_table_size)
+    , m_maxTableSize(max_table_size) {
+}
+
+const HeaderField* HPackDecoder::lookup(uint64_t idx) const {
+    if(idx == 0) {
+        return nullptr;
+    }
+    if(idx <= s_static_table_size) {
+        return &s_static_table[idx - 1];
+    }
+    return m_table.get(idx - s_static_table_size - 1);
+}
+
+int HPackDecoder::decode(const uint8_t* data, size_t length, HeaderList& headers) {
+    const uint8_t* p = data;
+    const uint8_t* end = data + length;
+    while(p < end) {
+        uint8_t b = *p;
+        uint64_t idx = 0;
+        if(b & 0x80) {
+            //索引字段
+            if(!HPackDecodeInteger(p, end, 7, idx)) {
+                return -1;
+            }
+            const HeaderField* f = lookup(idx);
+            if(!f) {
+                return -1;
+            }
+            headers.push_back(*f);
+            continue;
+        }
+        if((b & 0xe0) == 0x20) {
+            //动态表大小更新
+            if(!HPackDecodeInteger(p, end, 5, idx) || idx > m_maxTableSize) {
+                return -1;
+            }
+            m_table.setMaxSize(idx);
+            continue;
+        }
+        //字面量: 01 加入动态表, 0000 不加入, 0001 永不加入
+        bool indexing = (b & 0xc0) == 0x40;
+        if(!HPackDecodeInteger(p, end, indexing ? 6 : 4, idx)) {
+            return -1;
+        }
+        HeaderField field;
+        if(idx) {
+            const HeaderField* f = lookup(idx);
+            if(!f) {
+                return -1;
+            }
+            field.first = f->first;
+        } else if(!DecodeString(p, end, field.first)) {
+            return -1;
+        }
+        if(!DecodeString(p, end, field.second)) {
+            return -1;
+        }
+        if(indexing) {
+            m_table.add(field.first, field.second);
+        }
+        headers.push_back(std::move(field));
+    }
+    return 0;
+}
+
+HPackEncoder::HPackEncoder(uint32_t max_table_size)
+    : m_table(max_table_size)
+    , m_sizeUpdate(false) {
+}
+
+void HPackEncoder::setMaxTableSize(uint32_t v) {
+    if(v != m_table.getMaxSize()) {
+        m_table.setMaxSize(v);
+        m_sizeUpdate = true;
+    }
+}
+
+/**
+ * @brief 不加入动态表的字段
+ */
+static bool IsNoIndexing(const std::string& name) {
+    return name == "content-length" || name == "date" || name == ":path"
+        || name == "etag" || name == "last-modified" || name == "age";
+}
+
+/**
+ * @brief 敏感字段, 中间节点也不能加入动态表
+ */
+static bool IsNeverIndexed(const std::string& name) {
+    return name == "authorization" || name == "proxy-authorization"
+        || name == "cookie" || name == "set-cookie";
+}
+
+void HPackEncoder::encodeField(const std::string& name, const std::string& value, std::string& out) {
+    const StaticIndex& sindex = GetStaticIndex();
+    std::string key = name + '\0' + value;
+    auto it = sindex.fields.find(key);
+    if(it != sindex.fields.end()) {
+        HPackEncodeInteger(it->second, 7, 0x80, out);
+        return;
+    }
+    size_t name_idx = 0;
+    bool never = IsNeverIndexed(name);
+    if(!never) {
+        size_t idx = m_table.find(name, value, name_idx);
+        if(idx) {
+            HPackEncodeInteger(idx, 7, 0x80, out);
+            return;
+        }
+    }
+    auto nit = sindex.names.find(name);
+    if(nit != sindex.names.end()) {
+        name_idx = nit->second;
+    }
+    bool indexing = !never && !IsNoIndexing(name);
+    if(indexing) {
+        HPackEncodeInteger(name_idx, 6, 0x40, out);
+    } else {
+        HPackEncodeInteger(name_idx, 4, never ? 0x10 : 0, out);
+    }
+    if(!name_idx) {
+        EncodeString(name, out);
+    }
+    EncodeString(value, out);
+    if(indexing) {
+        m_table.add(name, value);
+    }
+}
+
+void HPackEncoder::encode(const HeaderList& headers, std::string& out) {
+    if(m_sizeUpdate) {
+        HPackEncodeInteger(m_table.getMaxSize(), 5, 0x20, out);
+        m_sizeUpdate = false;
+    }
+    for(auto& i : headers) {
+        encodeField(i.first, i.second, out);
+    }
+}
+
+} // namespace http2
+} // namespace muhui
@@ -0,0 +1,171 @@
+/**
+ * @file hpack.h
+ * @author muhui (2571579302@qq.com)
+ * @brief HPACK头部压缩(RFC7541)
+ * @version 0.1
+ * @date 2023-02-24
+ */
+#ifndef __MUHUI_HTTP2_HPACK_H__
+#define __MUHUI_HTTP2_HPACK_H__
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace muhui {
+namespace http2 {
+
+/// 头部字段
+typedef std::pair<std::string, std::string> HeaderField;
+/// 头部字段列表, 保持顺序
+typedef std::vector<HeaderField> HeaderList;
+
+/**
+ * @brief Huffman编码
+ */
+class Huffman {
+public:
+    /**
+     * @brief 编码后的长度(字节)
+     */
+    static size_t EncodedLength(const std::string& str);
+
+    /**
+     * @brief 编码, 结果追加到out
+     */
+    static void Encode(const std::string& str, std::string& out);
+
+    /**
+     * @brief 解码, 结果追加到out
+     * @return 编码错误(非法码字, 填充超过7位或不全为1)时返回false
+     */
+    static bool Decode(const uint8_t* data, size_t length, std::string& out);
+};
+
+/**
+ * @brief HPACK动态表
+ * @details 新加入的字段索引最小(紧跟静态表之后, 62开始), 超过最大大小时从最旧的开始淘汰.
+ *          字段大小为 name + value + 32
+ */
+class HPackDynamicTable {
+public:
+    HPackDynamicTable(uint32_t max_size = 4096);
+
+    /**
+     * @brief 加入字段, 超过最大大小时淘汰旧的字段
+     */
+    void add(const std::string& name, const std::string& value);
+
+    /**
+     * @brief 按动态表内的索引(0为最新)获取字段
+     */
+    const HeaderField* get(size_t idx) const;
+
+    /**
+     * @brief 设置最大大小并淘汰
+     */
+    void setMaxSize(uint32_t v);
+    uint32_t getMaxSize() const { return m_maxSize;}
+    uint32_t getSize() const { return m_size;}
+    size_t getCount() const { return m_fields.size();}
+
+    /**
+     * @brief 查找字段, 用于编码
+     * @param[out] name_only 只有名称匹配时的索引(HPACK索引), 没有时为0
+     * @return 名称和值都匹配时的HPACK索引, 没有时返回0
+     */
+    size_t find(const std::string& name, const std::string& value, size_t& name_only) const;
+private:
+    void evict(uint32_t max_size);
+    size_t toIndex(uint64_t seq) const;
+private:
+    /// 字段, 最新的在前
+    std::deque<HeaderField> m_fields;
+    /// 当前大小
+    uint32_t m_size;
+    /// 最大大小
+    uint32_t m_maxSize;
+    /// 已加入的字段总数, 用于计算索引
+    uint64_t m_inserted;
+    /// name + '\0' + value -> 加入序号
+    std::unordered_map<std::string, uint64_t> m_fieldIndex;
+    /// name -> 加入序号
+    std::unordered_map<std::string, uint64_t> m_nameIndex;
+};
+
+/**
+ * @brief HPACK解码器, 每个连接一个, 头部块需要按收到的顺序解码
+ */
+class HPackDecoder {
+public:
+    HPackDecoder(uint32_t max_table_size = 4096);
+
+    /**
+     * @brief 解码一个完整的头部块
+     * @param[out] headers 解码结果追加到末尾
+     * @return 成功返回0, 压缩错误返回-1
+     */
+    int decode(const uint8_t* data, size_t length, HeaderList& headers);
+
+    /**
+     * @brief 设置本端通告的最大动态表大小(SETTINGS_HEADER_TABLE_SIZE)
+     */
+    void setMaxTableSize(uint32_t v) { m_maxTableSize = v;}
+
+    const HPackDynamicTable& getTable() const { return m_table;}
+private:
+    const HeaderField* lookup(uint64_t idx) const;
+private:
+    HPackDynamicTable m_table;
+    /// 动态表大小更新的上限
+    uint32_t m_maxTableSize;
+};
+
+/**
+ * @brief HPACK编码器, 每个连接一个, 头部块需要按编码的顺序发送
+ * @details 静态表/动态表完全匹配时使用索引, 否则使用字面量并加入动态表;
+ *          content-length, set-cookie, authorization 等变化大或敏感的字段不加入动态表.
+ *          字符串在Huffman编码更短时使用Huffman编码
+ */
+class HPackEncoder {
+public:
+    HPackEncoder(uint32_t max_table_size = 4096);
+
+    /**
+     * @brief 编码头部块, 结果追加到out
+     */
+    void encode(const HeaderList& headers, std::string& out);
+
+    /**
+     * @brief 对端通告的SETTINGS_HEADER_TABLE_SIZE, 下一个头部块开头发送动态表大小更新
+     */
+    void setMaxTableSize(uint32_t v);
+
+    const HPackDynamicTable& getTable() const { return m_table;}
+private:
+    void encodeField(const std::string& name, const std::string& value, std::string& out);
+private:
+    HPackDynamicTable m_table;
+    /// 是否需要发送动态表大小更新
+    bool m_sizeUpdate;
+};
+
+/**
+ * @brief 编码HPACK整数
+ * @param[in] prefix 前缀位数(1~8)
+ * @param[in] flags 首字节中前缀之外的高位
+ */
+void HPackEncodeInteger(uint64_t v, uint8_t prefix, uint8_t flags, std::string& out);
+
+/**
+ * @brief 解码HPACK整数
+ * @param[in,out] p 当前位置, 成功后移动到整数之后
+ * @return 是否成功
+ */
+bool HPackDecodeInteger(const uint8_t*& p, const uint8_t* end, uint8_t prefix, uint64_t& v);
+
+} // namespace http2
+} // namespace muhui
+#endif // !__MUHUI_HTTP2_HPACK_H__
@@ -0,0 +1,978 @@
+#include "http2_session.h"
+#include "config.h"
+#include "http/http_compress.h"
+#include "http/http_parser.h"
+#include "iomanager.h"
+#include "log.h"
+#include "util/hash_util.h"
+#include <algorithm>
+#include <cstring>
+#include <sys/socket.h>
+
+namespace muhui {
+namespace http2 {
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_NAME("system");
+
+/// 每个连接最多同时打开的流
+static muhui::ConfigVar<uint32_t>::ptr g_http2_max_concurrent_streams =
+    muhui::Config::Lookup("http2.max_concurrent_streams", (uint32_t)128
+        , "http2 max concurrent streams per connection");
+/// 本端通告的流初始窗口, 同时作为连接窗口
+static muhui::ConfigVar<uint32_t>::ptr g_http2_initial_window_size =
+    muhui::Config::Lookup("http2.initial_window_size", (uint32_t)(1024 * 1024)
+        , "http2 initial window size");
+/// 本端通告的最大帧长度
+static muhui::ConfigVar<uint32_t>::ptr g_http2_max_frame_size =
+    muhui::Config::Lookup("http2.max_frame_size", (uint32_t)DEFAULT_MAX_FRAME_SIZE
+        , "http2 max frame size");
+
+/// 读缓存大小
+static const size_t s_read_buffer_size = 16 * 1024;
+/// 头部块(HEADERS + CONTINUATION)最大长度
+static const size_t s_max_header_block_size = 256 * 1024;
+/// 最大帧长度上限(2^24 - 1)
+static const uint32_t s_max_frame_size_limit = 0xffffff;
+
+static uint32_t ReadUint32(const char* p) {
+    const uint8_t* u = (const uint8_t*)p;
+    return ((uint32_t)u[0] << 24) | ((uint32_t)u[1] << 16) | ((uint32_t)u[2] << 8) | u[3];
+}
+
+static void AppendUint32(std::string& out, uint32_t v) {
+    out.push_back((char)(v >> 24));
+    out.push_back((char)(v >> 16));
+    out.push_back((char)(v >> 8));
+    out.push_back((char)v);
+}
+
+static void AppendSetting(std::string& out, SettingsId id, uint32_t v) {
+    out.push_back((char)((uint16_t)id >> 8));
+    out.push_back((char)id);
+    AppendUint32(out, v);
+}
+
+static std::string ToLower(http::HttpHeaders::StringView v) {
+    std::string rt(v.data(), v.size());
+    std::transform(rt.begin(), rt.end(), rt.begin(), ::tolower);
+    return rt;
+}
+
+/**
+ * @brief HTTP/2中禁止出现的连接相关头部(RFC7540 8.1.2.2)
+ */
+static bool IsConnectionHeader(const std::string& name) {
+    switch(http::HttpHeaders::LookupId(name.c_str(), name.size())) {
+        case http::HttpHeaderId::CONNECTION:
+        case http::HttpHeaderId::KEEP_ALIVE:
+        case http::HttpHeaderId::TRANSFER_ENCODING:
+        case http::HttpHeaderId::UPGRADE:
+            return true;
+        default:
+            return name == "proxy-connection" || name == "http2-settings";
+    }
+}
+
+/**
+ * @brief base64url(无填充)解码
+ */
+static std::string Base64UrlDecode(const std::string& v) {
+    std::string s = v;
+    for(auto& c : s) {
+        if(c == '-') {
+            c = '+';
+        } else if(c == '_') {
+            c = '/';
+        }
+    }
+    while(s.size() % 4) {
+        s.push_back('=');
+    }
+    return muhui::base64decode(s);
+}
+
+Http2Session::Http2Session(Socket::ptr sock, bool client)
+    : SocketStream(sock)
+    , m_client(client)
+    , m_closed(false)
+    , m_goawaySent(false)
+    , m_remainPos(0)
+    , m_peerClosed(false)
+    , m_reading(false)
+    , m_writer(this)
+    , m_sendWindow(DEFAULT_WINDOW_SIZE)
+    , m_windowWaiting(0)
+    , m_recvUnacked(0)
+    , m_peerInitialWindow(DEFAULT_WINDOW_SIZE)
+    , m_peerMaxFrameSize(DEFAULT_MAX_FRAME_SIZE)
+    , m_peerMaxConcurrentStreams((uint32_t)-1)
+    , m_headerStreamId(0)
+    , m_headerEndStream(false)
+    , m_lastStreamId(0)
+    , m_nextStreamId(1)
+    , m_worker(nullptr) {
+    //对端确认SETTINGS之前按默认值发送, 所以窗口和帧长度不小于默认值
+    m_localInitialWindow = std::min(std::max(g_http2_initial_window_size->getValue(), DEFAULT_WINDOW_SIZE)
+                                    , MAX_WINDOW_SIZE);
+    m_localMaxFrameSize = std::min(std::max(g_http2_max_frame_size->getValue(), DEFAULT_MAX_FRAME_SIZE)
+                                   , s_max_frame_size_limit);
+    m_localConnWindow = m_localInitialWindow;
+    m_recvWindow = m_localConnWindow;
+}
+
+Http2Session::~Http2Session() {
+}
+
+int Http2Session::read(void* buffer, size_t length) {
+    if(m_remainPos >= m_remain.size()) {
+        if(length >= s_read_buffer_size) {
+            return SocketStream::read(buffer, length);
+        }
+        m_remain.resize(s_read_buffer_size);
+        m_remainPos = 0;
+        int rt = SocketStream::read(&m_remain[0], m_remain.size());
+        if(rt <= 0) {
+            m_remain.clear();
+            return rt;
+        }
+        m_remain.resize(rt);
+    }
+    size_t n = std::min(length, m_remain.size() - m_remainPos);
+    memcpy(buffer, m_remain.c_str() + m_remainPos, n);
+    m_remainPos += n;
+    return n;
+}
+
+bool Http2Session::IsUpgradeRequest(const http::HttpRequest& req) {
+    const http::HttpHeaders& headers = req.getHeaders();
+    bool found = false;
+    headers.get("HTTP2-Settings", &found);
+    return found && !req.isStreamBody()
+        && http::HttpHeaders::HasToken(headers.get(http::HttpHeaderId::UPGRADE), "h2c")
+        && http::HttpHeaders::HasToken(headers.get(http::HttpHeaderId::CONNECTION), "upgrade");
+}
+
+bool Http2Session::PeekPreface(Socket::ptr sock) {
+    char buf[CLIENT_PREFACE_SIZE];
+    //"PRI"不是HTTP/1.x的方法, 收到前3个字节即可判断
+    for(int i = 0; i < 100; ++i) {
+        int rt = sock->recv(buf, sizeof(buf), MSG_PEEK);
+        if(rt <= 0 || memcmp(buf, CLIENT_PREFACE, rt)) {
+            return false;
+        }
+        if(rt >= 3) {
+            return true;
+        }
+        usleep(1000);
+    }
+    return false;
+}
+
+uint32_t Http2Session::GetMaxConcurrentStreams() {
+    return g_http2_max_concurrent_streams->getValue();
+}
+
+uint32_t Http2Session::GetInitialWindowSize() {
+    return g_http2_initial_window_size->getValue();
+}
+
+uint32_t Http2Session::GetMaxFrameSize() {
+    return g_http2_max_frame_size->getValue();
+}
+
+size_t Http2Session::getStreamCount() {
+    MutexType::Lock lock(m_mutex);
+    return m_streams.size();
+}
+
+void Http2Session::sendPreface() {
+    std::string payload;
+    if(m_client) {
+        AppendSetting(payload, SettingsId::ENABLE_PUSH, 0);
+    } else {
+        AppendSetting(payload, SettingsId::MAX_CONCURRENT_STREAMS, g_http2_max_concurrent_streams->getValue());
+    }
+    AppendSetting(payload, SettingsId::INITIAL_WINDOW_SIZE, m_localInitialWindow);
+    AppendSetting(payload, SettingsId::MAX_FRAME_SIZE, m_localMaxFrameSize);
+    m_writer.enqueue(FrameType::SETTINGS, 0, 0, payload.c_str(), payload.size());
+    if(m_localConnWindow > DEFAULT_WINDOW_SIZE) {
+        sendWindowUpdate(0, m_localConnWindow - DEFAULT_WINDOW_SIZE);
+    }
+}
+
+void Http2Session::serve(http::ServletDispatch::ptr dispatch, Scheduler* worker
+                         , const std::string& server_name
+                         , http::HttpRequest::ptr upgrade
+                         , const std::string& settings) {
+    m_dispatch = dispatch;
+    m_worker = worker;
+    m_serverName = server_name;
+
+    Http2Stream::ptr upgrade_stream;
+    if(upgrade) {
+        static const char s_switching[] = "HTTP/1.1 101 Switching Protocols\r\n"
+            "Connection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+        if(applySettings(Base64UrlDecode(settings)) != Http2Error::NO_ERROR
+                || writeFixSize(s_switching, sizeof(s_switching) - 1) <= 0) {
+            SocketStream::close();
+            return;
+        }
+        //升级请求作为流1, 请求已完整接收
+        upgrade_stream = std::make_shared<Http2Stream>(1, m_peerInitialWindow, m_localInitialWindow);
+        upgrade_stream->state = Http2Stream::HALF_CLOSED_REMOTE;
+        upgrade_stream->headersDone = true;
+        m_streams[1] = upgrade_stream;
+        m_lastStreamId = 1;
+        upgrade->setVersion(0x20);
+        upgrade->delHeader("Upgrade");
+        upgrade->delHeader("HTTP2-Settings");
+        upgrade->delHeader("Connection");
+    }
+    sendPreface();
+    if(m_writer.flush() <= 0) {
+        SocketStream::close();
+        return;
+    }
+    if(upgrade_stream) {
+        m_worker->schedule(std::bind(&Http2Session::handleRequest
+                    , shared_from_this(), upgrade_stream, upgrade));
+    }
+
+    char preface[CLIENT_PREFACE_SIZE];
+    if(readFixSize(preface, sizeof(preface)) <= 0
+            || memcmp(preface, CLIENT_PREFACE, sizeof(preface))) {
+        MUHUI_LOG_INFO(g_logger) << "http2 invalid client preface, client: "
+            << *getSocket();
+        m_peerClosed = true;
+        close();
+        return;
+    }
+    readLoop();
+}
+
+Http2Session::ptr Http2Session::Connect(Address::ptr addr, uint64_t timeout_ms) {
+    Socket::ptr sock = Socket::CreateTCP(addr);
+    if(!sock->connect(addr, timeout_ms)) {
+        MUHUI_LOG_ERROR(g_logger) << "http2 connect fail: " << *addr;
+        return nullptr;
+    }
+    Http2Session::ptr session = std::make_shared<Http2Session>(sock, true);
+    session->m_writer.enqueueRaw(std::string(CLIENT_PREFACE, CLIENT_PREFACE_SIZE));
+    session->sendPreface();
+    if(session->m_writer.flush() <= 0) {
+        return nullptr;
+    }
+    IOManager::GetThis()->schedule(std::bind(&Http2Session::readLoop, session));
+    return session;
+}
+
+void Http2Session::readLoop() {
+    m_reading = true;
+    Frame frame;
+    while(!m_closed) {
+        int rt = ReadFrame(this, frame, m_localMaxFrameSize);
+        if(rt == -2) {
+            sendGoaway(Http2Error::FRAME_SIZE_ERROR);
+            break;
+        }
+        if(rt <= 0) {
+            m_peerClosed = true;
+            break;
+        }
+        Http2Error err = handleFrame(frame);
+        if(err != Http2Error::NO_ERROR) {
+            MUHUI_LOG_INFO(g_logger) << "http2 connection error: " << Http2ErrorToString(err)
+                << " " << frame.header.toString();
+            sendGoaway(err);
+            break;
+        }
+        if(frame.header.type == FrameType::GOAWAY) {
+            m_peerClosed = true;
+            break;
+        }
+        //SETTINGS ACK, PING ACK, WINDOW_UPDATE等控制帧
+        m_writer.flush();
+    }
+    m_reading = false;
+    close();
+    SocketStream::close();
+}
+
+Http2Error Http2Session::handleFrame(Frame& frame) {
+    const FrameHeader& h = frame.header;
+    if(m_headerStreamId && (h.type != FrameType::CONTINUATION
+                || h.streamId != m_headerStreamId)) {
+        //头部块必须连续
+        return Http2Error::PROTOCOL_ERROR;
+    }
+    switch(h.type) {
+        case FrameType::DATA:
+            return onData(frame);
+        case FrameType::HEADERS:
+            return onHeaders(frame);
+        case FrameType::PRIORITY:
+            return h.streamId ? Http2Error::NO_ERROR : Http2Error::PROTOCOL_ERROR;
+        case FrameType::RST_STREAM:
+            return onRstStream(frame);
+        case FrameType::SETTINGS:
+            return onSettings(frame);
+        case FrameType::PUSH_PROMISE:
+            //客户端禁用了推送, 服务端不接受推送
+            return Http2Error::PROTOCOL_ERROR;
+        case FrameType::PING:
+            if(h.streamId) {
+                return Http2Error::PROTOCOL_ERROR;
+            }
+            if(h.length != 8) {
+                return Http2Error::FRAME_SIZE_ERROR;
+            }
+            if(!frame.hasFlag(ACK)) {
+                m_writer.enqueue(FrameType::PING, ACK, 0, frame.payload.c_str(), 8);
+            }
+            return Http2Error::NO_ERROR;
+        case FrameType::GOAWAY:
+            if(h.streamId) {
+                return Http2Error::PROTOCOL_ERROR;
+            }
+            if(h.length >= 8) {
+                MUHUI_LOG_DEBUG(g_logger) << "http2 recv goaway, last_stream="
+                    << (ReadUint32(&frame.payload[0]) & 0x7fffffff) << " error="
+                    << Http2ErrorToString((Http2Error)ReadUint32(&frame.payload[4]));
+            }
+            return Http2Error::NO_ERROR;
+        case FrameType::WINDOW_UPDATE:
+            return onWindowUpdate(frame);
+        case FrameType::CONTINUATION:
+            if(!m_headerStreamId) {
+                return Http2Error::PROTOCOL_ERROR;
+            }
+            m_headerBlock.append(frame.payload);
+            if(m_headerBlock.size() > s_max_header_block_size) {
+                return Http2Error::ENHANCE_YOUR_CALM;
+            }
+            if(frame.hasFlag(END_HEADERS)) {
+                return onHeaderBlock(h.streamId, m_headerEndStream);
+            }
+            return Http2Error::NO_ERROR;
+        default:
+            //忽略未知类型的帧
+            return Http2Error::NO_ERROR;
+    }
+}
+
+Http2Error Http2Session::onHeaders(Frame& frame) {
+    if(!frame.header.streamId) {
+        return Http2Error::PROTOCOL_ERROR;
+    }
+    size_t pos = 0;
+    size_t end = frame.payload.size();
+    if(frame.hasFlag(PADDED)) {
+        if(end < 1) {
+            return Http2Error::PROTOCOL_ERROR;
+        }
+        size_t pad = (uint8_t)frame.payload[0];
+        pos = 1;
+        if(pad > end - pos) {
+            return Http2Error::PROTOCOL_ERROR;
+        }
+        end -= pad;
+    }
+    if(frame.hasFlag(PRIORITY)) {
+        if(end - pos < 5) {
+            return Http2Error::PROTOCOL_ERROR;
+        }
+        pos += 5;
+    }
+    m_headerBlock.assign(frame.payload, pos, end - pos);
+    m_headerStreamId = frame.header.streamId;
+    m_headerEndStream = frame.hasFlag(END_STREAM);
+    if(frame.hasFlag(END_HEADERS)) {
+        return onHeaderBlock(m_headerStreamId, m_headerEndStream);
+    }
+    return Http2Error::NO_ERROR;
+}
+
+Http2Error Http2Session::onHeaderBlock(uint32_t stream_id, bool end_stream) {
+    m_headerStreamId = 0;
+    //头部块总是解码, 保持动态表与对端一致
+    HeaderList headers;
+    if(m_decoder.decode((const uint8_t*)m_headerBlock.c_str(), m_headerBlock.size(), headers)) {
+        return Http2Error::COMPRESSION_ERROR;
+    }
+    m_headerBlock.clear();
+
+    Http2Stream::ptr stream = getStream(stream_id);
+    if(!m_client) {
+        if(!stream) {
+            if(!(stream_id & 1) || stream_id <= m_lastStreamId) {
+                return Http2Error::PROTOCOL_ERROR;
+            }
+            m_lastStreamId = stream_id;
+            MutexType::Lock lock(m_mutex);
+            if(m_streams.size() >= g_http2_max_concurrent_streams->getValue()) {
+                lock.unlock();
+                sendRstStream(stream_id, Http2Error::REFUSED_STREAM);
+                return Http2Error::NO_ERROR;
+            }
+            stream = std::make_shared<Http2Stream>(stream_id, m_peerInitialWindow, m_localInitialWindow);
+            m_streams[stream_id] = stream;
+        }
+        if(!stream->headersDone) {
+            stream->headers.swap(headers);
+            stream->headersDone = true;
+        } else if(!end_stream || stream->state != Http2Stream::OPEN) {
+            //trailer必须结束流
+            sendRstStream(stream_id, Http2Error::PROTOCOL_ERROR);
+            eraseStream(stream_id);
+            return Http2Error::NO_ERROR;
+        }
+    } else {
+        if(!stream) {
+            //已取消的请求
+            return Http2Error::NO_ERROR;
+        }
+        if(!stream->headersDone) {
+            if(!headers.empty() && headers[0].first == ":status"
+                    && headers[0].second.size() == 3 && headers[0].second[0] == '1') {
+                //1xx 信息响应, 之后还有最终响应
+                return Http2Error::NO_ERROR;
+            }
+            stream->headers.swap(headers);
+            stream->headersDone = true;
+        }
+    }
+    if(end_stream) {
+        onRemoteEnd(stream);
+    }
+    return Http2Error::NO_ERROR;
+}
+
+Http2Error Http2Session::onData(Frame& frame) {
+    uint32_t id = frame.header.streamId;
+    if(!id) {
+        return Http2Error::PROTOCOL_ERROR;
+    }
+    size_t pos = 0;
+    size_t end = frame.payload.size();
+    if(frame.hasFlag(PADDED)) {
+        if(end < 1) {
+            return Http2Error::PROTOCOL_ERROR;
+        }
+        size_t pad = (uint8_t)frame.payload[0];
+        pos = 1;
+        if(pad > end - pos) {
+            return Http2Error::PROTOCOL_ERROR;
+        }
+        end -= pad;
+    }
+
+    //流量控制按整个负载(包括填充)计算
+    uint32_t length = frame.header.length;
+    m_recvWindow -= length;
+    if(m_recvWindow < 0) {
+        return Http2Error::FLOW_CONTROL_ERROR;
+    }
+    m_recvUnacked += length;
+    if(m_recvUnacked >= m_localConnWindow / 2) {
+        sendWindowUpdate(0, m_recvUnacked);
+        m_recvWindow += m_recvUnacked;
+        m_recvUnacked = 0;
+    }
+
+    Http2Stream::ptr stream = getStream(id);
+    if(!stream) {
+        if(!m_client && id > m_lastStreamId) {
+            //未打开的流
+            return Http2Error::PROTOCOL_ERROR;
+        }
+        //已关闭或已重置的流, 丢弃
+        return Http2Error::NO_ERROR;
+    }
+    if(stream->state == Http2Stream::HALF_CLOSED_REMOTE || stream->state == Http2Stream::CLOSED) {
+        sendRstStream(id, Http2Error::STREAM_CLOSED);
+        eraseStream(id);
+        return Http2Error::NO_ERROR;
+    }
+    stream->recvWindow -= length;
+    if(stream->recvWindow < 0) {
+        sendRstStream(id, Http2Error::FLOW_CONTROL_ERROR);
+        eraseStream(id);
+        return Http2Error::NO_ERROR;
+    }
+    stream->body.append(frame.payload, pos, end - pos);
+    if(!m_client && stream->body.size() > http::HttpRequestParser::GetHttpRequestMaxBodySize()) {
+        MUHUI_LOG_INFO(g_logger) << "http2 request body too large, stream=" << id
+            << " size=" << stream->body.size();
+        sendRstStream(id, Http2Error::CANCEL);
+        eraseStream(id);
+        return Http2Error::NO_ERROR;
+    }
+    if(frame.hasFlag(END_STREAM)) {
+        onRemoteEnd(stream);
+        return Http2Error::NO_ERROR;
+    }
+    stream->recvUnacked += length;
+    if(stream->recvUnacked >= m_localInitialWindow / 2) {
+        sendWindowUpdate(id, stream->recvUnacked);
+        stream->recvWindow += stream->recvUnacked;
+        stream->recvUnacked = 0;
+    }
+    return Http2Error::NO_ERROR;
+}
+
+Http2Error Http2Session::onSettings(Frame& frame) {
+    if(frame.header.streamId) {
+        return Http2Error::PROTOCOL_ERROR;
+    }
+    if(frame.hasFlag(ACK)) {
+        return frame.header.length ? Http2Error::FRAME_SIZE_ERROR : Http2Error::NO_ERROR;
+    }
+    if(frame.header.length % 6) {
+        return Http2Error::FRAME_SIZE_ERROR;
+    }
+    Http2Error err = applySettings(frame.payload);
+    if(err != Http2Error::NO_ERROR) {
+        return err;
+    }
+    m_writer.enqueue(FrameType::SETTINGS, ACK, 0);
+    return Http2Error::NO_ERROR;
+}
+
+Http2Error Http2Session::applySettings(const std::string& payload) {
+    if(payload.size() % 6) {
+        return Http2Error::FRAME_SIZE_ERROR;
+    }
+    for(size_t i = 0; i < payload.size(); i += 6) {
+        SettingsId id = (SettingsId)(((uint8_t)payload[i] << 8) | (uint8_t)payload[i + 1]);
+        uint32_t v = ReadUint32(&payload[i + 2]);
+        switch(id) {
+            case SettingsId::HEADER_TABLE_SIZE: {
+                MutexType::Lock lock(m_encodeMutex);
+                m_encoder.setMaxTableSize(std::min(v, (uint32_t)4096));
+                break;
+            }
+            case SettingsId::ENABLE_PUSH:
+                if(v > 1) {
+                    return Http2Error::PROTOCOL_ERROR;
+                }
+                break;
+            case SettingsId::MAX_CONCURRENT_STREAMS:
+                m_peerMaxConcurrentStreams = v;
+                break;
+            case SettingsId::INITIAL_WINDOW_SIZE: {
+                if(v > MAX_WINDOW_SIZE) {
+                    return Http2Error::FLOW_CONTROL_ERROR;
+                }
+                //已打开的流按差值调整窗口
+                MutexType::Lock lock(m_mutex);
+                int64_t delta = (int64_t)v - m_peerInitialWindow;
+                for(auto& s : m_streams) {
+                    s.second->sendWindow += delta;
+                    if(s.second->sendWindow > MAX_WINDOW_SIZE) {
+                        return Http2Error::FLOW_CONTROL_ERROR;
+                    }
+                }
+                m_peerInitialWindow = v;
+                notifyWindow();
+                break;
+            }
+            case SettingsId::MAX_FRAME_SIZE:
+                if(v < DEFAULT_MAX_FRAME_SIZE || v > s_max_frame_size_limit) {
+                    return Http2Error::PROTOCOL_ERROR;
+                }
+                m_peerMaxFrameSize = v;
+                break;
+            default:
+                break;
+        }
+    }
+    return Http2Error::NO_ERROR;
+}
+
+Http2Error Http2Session::onWindowUpdate(Frame& frame) {
+    if(frame.header.length != 4) {
+        return Http2Error::FRAME_SIZE_ERROR;
+    }
+    uint32_t id = frame.header.streamId;
+    uint32_t inc = ReadUint32(&frame.payload[0]) & 0x7fffffff;
+    if(!inc) {
+        if(!id) {
+            return Http2Error::PROTOCOL_ERROR;
+        }
+        sendRstStream(id, Http2Error::PROTOCOL_ERROR);
+        eraseStream(id);
+        return Http2Error::NO_ERROR;
+    }
+    MutexType::Lock lock(m_mutex);
+    if(!id) {
+        m_sendWindow += inc;
+        if(m_sendWindow > MAX_WINDOW_SIZE) {
+            return Http2Error::FLOW_CONTROL_ERROR;
+        }
+    } else {
+        auto it = m_streams.find(id);
+        if(it == m_streams.end()) {
+            return Http2Error::NO_ERROR;
+        }
+        it->second->sendWindow += inc;
+        if(it->second->sendWindow > MAX_WINDOW_SIZE) {
+            it->second->reset = true;
+            m_streams.erase(it);
+            notifyWindow();
+            lock.unlock();
+            sendRstStream(id, Http2Error::FLOW_CONTROL_ERROR);
+            return Http2Error::NO_ERROR;
+        }
+    }
+    notifyWindow();
+    return Http2Error::NO_ERROR;
+}
+
+Http2Error Http2Session::onRstStream(Frame& frame) {
+    if(frame.header.length != 4) {
+        return Http2Error::FRAME_SIZE_ERROR;
+    }
+    if(!frame.header.streamId) {
+        return Http2Error::PROTOCOL_ERROR;
+    }
+    Http2Stream::ptr stream = getStream(frame.header.streamId);
+    if(!stream) {
+        return Http2Error::NO_ERROR;
+    }
+    MUHUI_LOG_DEBUG(g_logger) << "http2 stream " << stream->id << " reset by peer: "
+        << Http2ErrorToString((Http2Error)ReadUint32(&frame.payload[0]));
+    eraseStream(stream->id);
+    if(stream->done) {
+        stream->done->notify();
+    }
+    return Http2Error::NO_ERROR;
+}
+
+void Http2Session::onRemoteEnd(Http2Stream::ptr stream) {
+    {
+        MutexType::Lock lock(m_mutex);
+        if(stream->state == Http2Stream::HALF_CLOSED_LOCAL) {
+            stream->state = Http2Stream::CLOSED;
+            m_streams.erase(stream->id);
+        } else {
+            stream->state = Http2Stream::HALF_CLOSED_REMOTE;
+        }
+    }
+    if(m_client) {
+        stream->done->notify();
+        return;
+    }
+
+    http::HttpRequest::ptr req = std::make_shared<http::HttpRequest>(0x20, false);
+    std::string cookie;
+    for(auto& i : stream->headers) {
+        const std::string& name = i.first;
+        const std::string& value = i.second;
+        if(name.empty()) {
+            continue;
+        }
+        if(name[0] != ':') {
+            if(name == "cookie") {
+                //cookie可以拆分为多个字段(RFC7540 8.1.2.5)
+                if(!cookie.empty()) {
+                    cookie += "; ";
+                }
+                cookie += value;
+            } else {
+                req->setHeader(name, value);
+            }
+        } else if(name == ":method") {
+            req->setMethod(http::StringToHttpMethod(value));
+        } else if(name == ":path") {
+            size_t end = value.find('#');
+            if(end != std::string::npos) {
+                req->setFragment(value.substr(end + 1));
+            } else {
+                end = value.size();
+            }
+            size_t q = value.find('?');
+            if(q < end) {
+                req->setQuery(value.substr(q + 1, end - q - 1));
+                end = q;
+            }
+            req->setPath(value.substr(0, end));
+        } else if(name == ":authority") {
+            req->setHeader("Host", value);
+        }
+    }
+    if(!cookie.empty()) {
+        req->setHeader("Cookie", cookie);
+    }
+    req->setBody(stream->body);
+    std::string().swap(stream->body);
+    if(req->getMethod() == http::HttpMethod::INVALID_METHOD || req->getPath().empty()) {
+        sendRstStream(stream->id, Http2Error::PROTOCOL_ERROR);
+        eraseStream(stream->id);
+        return;
+    }
+    m_worker->schedule(std::bind(&Http2Session::handleRequest
+                , shared_from_this(), stream, req));
+}
+
+void Http2Session::handleRequest(Http2Stream::ptr stream, http::HttpRequest::ptr req) {
+    http::HttpResponce::ptr rsp = std::make_shared<http::HttpResponce>(0x20, false);
+    rsp->setHeader("Server", m_serverName);
+    m_dispatch->handle(req, rsp, nullptr);
+    if(stream->reset || m_closed) {
+        return;
+    }
+    http::HttpCompressor::CompressResponse(*req, *rsp);
+    sendResponse(stream, rsp, req->getMethod() == http::HttpMethod::HEAD);
+}
+
+void Http2Session::sendResponse(Http2Stream::ptr stream, http::HttpResponce::ptr rsp, bool head) {
+    HeaderList headers;
+    headers.emplace_back(":status", std::to_string((uint32_t)rsp->getStatus()));
+    for(auto i : rsp->getHeadrs()) {
+        std::string name = ToLower(i.first);
+        if(IsConnectionHeader(name) || name == "content-length") {
+            continue;
+        }
+        headers.emplace_back(std::move(name), i.second.to_string());
+    }
+    for(auto& i : rsp->getCookies()) {
+        headers.emplace_back("set-cookie", i);
+    }
+    const std::string& body = rsp->getBody();
+    headers.emplace_back("content-length", std::to_string(body.size()));
+    bool has_body = !head && !body.empty();
+    {
+        MutexType::Lock lock(m_encodeMutex);
+        encodeHeaders(stream->id, headers, !has_body);
+    }
+    if(has_body) {
+        //DATA帧直接引用响应的消息体
+        sendData(stream, std::shared_ptr<const std::string>(rsp, &body), true);
+    }
+    m_writer.flush();
+    onLocalEnd(stream);
+}
+
+void Http2Session::encodeHeaders(uint32_t stream_id, const HeaderList& headers, bool end_stream) {
+    std::string block;
+    m_encoder.encode(headers, block);
+    size_t max_frame_size = m_peerMaxFrameSize;
+    std::string out;
+    out.reserve(block.size() + FrameHeader::SIZE * (block.size() / max_frame_size + 1));
+    size_t off = 0;
+    do {
+        size_t n = std::min(max_frame_size, block.size() - off);
+        FrameHeader h;
+        h.length = n;
+        h.type = off ? FrameType::CONTINUATION : FrameType::HEADERS;
+        h.flags = (off + n == block.size() ? END_HEADERS : 0)
+            | (!off && end_stream ? END_STREAM : 0);
+        h.streamId = stream_id;
+        size_t pos = out.size();
+        out.resize(pos + FrameHeader::SIZE);
+        h.encode((uint8_t*)&out[pos]);
+        out.append(block, off, n);
+        off += n;
+    } while(off < block.size());
+    m_writer.enqueueRaw(std::move(out));
+}
+
+bool Http2Session::sendData(Http2Stream::ptr stream, std::shared_ptr<const std::string> body, bool end_stream) {
+    size_t total = body->size();
+    size_t off = 0;
+    while(off < total) {
+        size_t n = 0;
+        {
+            MutexType::Lock lock(m_mutex);
+            while(true) {
+                if(m_closed || stream->reset) {
+                    return false;
+                }
+                int64_t avail = std::min(m_sendWindow, stream->sendWindow);
+                if(avail > 0) {
+                    n = std::min((size_t)avail, std::min(total - off, (size_t)m_peerMaxFrameSize));
+                    m_sendWindow -= n;
+                    stream->sendWindow -= n;
+                    break;
+                }
+                //窗口用完, 先发出已放入的帧再等待WINDOW_UPDATE
+                ++m_windowWaiting;
+                lock.unlock();
+                m_writer.flush();
+                m_windowSem.wait();
+                lock.lock();
+            }
+        }
+        m_writer.enqueueData(off + n == total && end_stream ? END_STREAM : 0
+                             , stream->id, body, off, n);
+        off += n;
+    }
+    return true;
+}
+
+void Http2Session::sendRstStream(uint32_t stream_id, Http2Error err) {
+    std::string payload;
+    AppendUint32(payload, (uint32_t)err);
+    m_writer.enqueue(FrameType::RST_STREAM, 0, stream_id, payload.c_str(), payload.size());
+}
+
+void Http2Session::sendGoaway(Http2Error err) {
+    if(m_goawaySent.exchange(true)) {
+        return;
+    }
+    std::string payload;
+    AppendUint32(payload, m_lastStreamId);
+    AppendUint32(payload, (uint32_t)err);
+    m_writer.enqueue(FrameType::GOAWAY, 0, 0, payload.c_str(), payload.size());
+    m_writer.flush();
+}
+
+void Http2Session::sendWindowUpdate(uint32_t stream_id, uint32_t increment) {
+    std::string payload;
+    AppendUint32(payload, increment);
+    m_writer.enqueue(FrameType::WINDOW_UPDATE, 0, stream_id, payload.c_str(), payload.size());
+}
+
+void Http2Session::onLocalEnd(Http2Stream::ptr stream) {
+    MutexType::Lock lock(m_mutex);
+    if(stream->state == Http2Stream::HALF_CLOSED_REMOTE) {
+        stream->state = Http2Stream::CLOSED;
+        m_streams.erase(stream->id);
+    } else if(stream->state == Http2Stream::OPEN) {
+        stream->state = Http2Stream::HALF_CLOSED_LOCAL;
+    }
+}
+
+Http2Stream::ptr Http2Session::getStream(uint32_t id) {
+    MutexType::Lock lock(m_mutex);
+    auto it = m_streams.find(id);
+    return it == m_streams.end() ? nullptr : it->second;
+}
+
+void Http2Session::eraseStream(uint32_t id) {
+    MutexType::Lock lock(m_mutex);
+    auto it = m_streams.find(id);
+    if(it != m_streams.end()) {
+        it->second->reset = true;
+        it->second->state = Http2Stream::CLOSED;
+        m_streams.erase(it);
+        notifyWindow();
+    }
+}
+
+void Http2Session::notifyWindow() {
+    for(; m_windowWaiting; --m_windowWaiting) {
+        m_windowSem.notify();
+    }
+}
+
+http::HttpResult::ptr Http2Session::request(http::HttpRequest::ptr req, uint64_t timeout_ms) {
+    typedef http::HttpResult::Error Error;
+    if(m_closed || m_writer.isError()) {
+        return std::make_shared<http::HttpResult>((int)Error::SEND_CLOSE_BY_PEER
+                , nullptr, "http2 connection closed");
+    }
+    std::string path = req->getPath().empty() ? "/" : req->getPath();
+    if(!req->getQuery().empty()) {
+        path += "?" + req->getQuery();
+    }
+    HeaderList headers;
+    headers.emplace_back(":method", http::HttpMethodToString(req->getMethod()));
+    headers.emplace_back(":scheme", "http");
+    headers.emplace_back(":authority", req->getHeader("Host"));
+    headers.emplace_back(":path", path);
+    for(auto i : req->getHeaders()) {
+        std::string name = ToLower(i.first);
+        if(IsConnectionHeader(name) || name == "host" || name == "content-length") {
+            continue;
+        }
+        headers.emplace_back(std::move(name), i.second.to_string());
+    }
+    const std::string& body = req->getBody();
+    if(!body.empty()) {
+        headers.emplace_back("content-length", std::to_string(body.size()));
+    }
+
+    Http2Stream::ptr stream;
+    {
+        //流ID按HEADERS的发送顺序递增
+        MutexType::Lock lock(m_encodeMutex);
+        {
+            MutexType::Lock lock2(m_mutex);
+            stream = std::make_shared<Http2Stream>(m_nextStreamId, m_peerInitialWindow
+                                                   , m_localInitialWindow);
+            stream->done = std::make_shared<FiberSemaphore>();
+            m_streams[m_nextStreamId] = stream;
+            m_nextStreamId += 2;
+        }
+        encodeHeaders(stream->id, headers, body.empty());
+    }
+    if(!body.empty()) {
+        sendData(stream, std::shared_ptr<const std::string>(req, &body), true);
+    }
+    onLocalEnd(stream);
+    if(m_writer.flush() <= 0) {
+        eraseStream(stream->id);
+        return std::make_shared<http::HttpResult>((int)Error::SEND_SOCKET_ERROR
+                , nullptr, "http2 send request fail");
+    }
+
+    if(!stream->done->waitFor(timeout_ms)) {
+        if(getStream(stream->id)) {
+            eraseStream(stream->id);
+            sendRstStream(stream->id, Http2Error::CANCEL);
+            m_writer.flush();
+        }
+        return std::make_shared<http::HttpResult>((int)Error::TIMEOUT
+                , nullptr, "http2 recv response timeout");
+    }
+    if(stream->reset || !stream->headersDone) {
+        return std::make_shared<http::HttpResult>((int)Error::TIMEOUT
+                , nullptr, "http2 stream reset");
+    }
+
+    http::HttpResponce::ptr rsp = std::make_shared<http::HttpResponce>(0x20, false);
+    for(auto& i : stream->headers) {
+        if(i.first == ":status") {
+            rsp->setStatus((http::HttpStatus)atoi(i.second.c_str()));
+        } else if(!i.first.empty() && i.first[0] != ':') {
+            rsp->setHeader(i.first, i.second);
+        }
+    }
+    rsp->setBody(stream->body);
+    return std::make_shared<http::HttpResult>((int)Error::OK, rsp, "ok");
+}
+
+void Http2Session::close() {
+    bool expected = false;
+    if(!m_closed.compare_exchange_strong(expected, true)) {
+        return;
+    }
+    if(!m_peerClosed) {
+        sendGoaway(Http2Error::NO_ERROR);
+    }
+    std::unordered_map<uint32_t, Http2Stream::ptr> streams;
+    {
+        MutexType::Lock lock(m_mutex);
+        streams.swap(m_streams);
+        for(auto& i : streams) {
+            i.second->reset = true;
+        }
+        notifyWindow();
+    }
+    for(auto& i : streams) {
+        if(i.second->done) {
+            i.second->done->notify();
+        }
+    }
+    if(m_reading) {
+        //读协程可能在其它线程中重试recv, 这里直接close后fd可能被复用;
+        //只shutdown, 由读协程读到EOF后关闭
+        ::shutdown(getSocket()->getSocket(), SHUT_RDWR);
+    } else {
+        SocketStream::close();
+    }
+}
+
+} // namespace http2
+} // namespace muhui
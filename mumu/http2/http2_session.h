@@ -0,0 +1,292 @@
+/**
+ * @file http2_session.h
+ * @author muhui (2571579302@qq.com)
+ * @brief HTTP/2连接(h2c), 服务端和客户端共用
+ * @version 0.1
+ * @date 2023-02-24
+ */
+#ifndef __MUHUI_HTTP2_HTTP2_SESSION_H__
+#define __MUHUI_HTTP2_HTTP2_SESSION_H__
+#include "frame.h"
+#include "hpack.h"
+#include "http/http_connection.h"
+#include "http/servlet.h"
+#include "mutex.h"
+#include "scheduler.h"
+#include "streams/socket_stream.h"
+#include <atomic>
+#include <unordered_map>
+
+namespace muhui {
+namespace http2 {
+
+/**
+ * @brief HTTP/2流
+ */
+struct Http2Stream {
+    typedef std::shared_ptr<Http2Stream> ptr;
+
+    /// 流状态(RFC7540 5.1), 只记录打开之后的状态
+    enum State {
+        OPEN,
+        /// 对端已发送END_STREAM
+        HALF_CLOSED_REMOTE,
+        /// 本端已发送END_STREAM
+        HALF_CLOSED_LOCAL,
+        CLOSED
+    };
+
+    Http2Stream(uint32_t _id, int64_t send_window, int64_t recv_window)
+        : id(_id)
+        , sendWindow(send_window)
+        , recvWindow(recv_window) {}
+
+    uint32_t id;
+    State state = OPEN;
+    /// 收到的头部(客户端为响应头)
+    HeaderList headers;
+    /// 是否已收到头部, 之后的HEADERS为trailer
+    bool headersDone = false;
+    /// 收到的消息体
+    std::string body;
+    /// 本端可以发送的字节数(对端的窗口)
+    int64_t sendWindow;
+    /// 对端还可以发送的字节数(本端的窗口)
+    int64_t recvWindow;
+    /// 已接收但未通过WINDOW_UPDATE归还的字节数
+    uint32_t recvUnacked = 0;
+    /// 是否被RST_STREAM重置
+    bool reset = false;
+    /// 客户端: 响应接收完成或连接关闭时通知
+    std::shared_ptr<FiberSemaphore> done;
+};
+
+/**
+ * @brief HTTP/2连接
+ * @details 一个连接上的多个流复用:
+ *          - 读协程解析帧, 维护HPACK解码表、流状态和流量控制窗口
+ *          - 服务端每个请求流接收完成后在worker中用独立的协程调用ServletDispatch, HttpSession参数为nullptr
+ *          - 响应的HEADERS在编码锁内编码并放入FrameWriter, 保证头部块的发送顺序与HPACK编码顺序一致;
+ *            DATA按连接和流的窗口分帧, 窗口用完时等待WINDOW_UPDATE
+ *          - 多个流的帧由FrameWriter合并到一次writev
+ *          支持 prior knowledge(直接发送连接前言)和 HTTP/1.1 Upgrade: h2c 两种方式, 不支持服务端推送.
+ *          配置: http2.max_concurrent_streams, http2.initial_window_size, http2.max_frame_size
+ */
+class Http2Session : public SocketStream, public std::enable_shared_from_this<Http2Session> {
+public:
+    typedef std::shared_ptr<Http2Session> ptr;
+    typedef Mutex MutexType;
+
+    /**
+     * @brief 构造函数
+     * @param[in] sock Socket
+     * @param[in] client 是否客户端
+     */
+    Http2Session(Socket::ptr sock, bool client = false);
+    ~Http2Session();
+
+    /**
+     * @brief 服务端处理连接, 直到连接关闭
+     * @param[in] dispatch servlet分发器
+     * @param[in] worker 执行请求的调度器
+     * @param[in] server_name 响应的Server头
+     * @param[in] upgrade 从HTTP/1.1升级时的请求, 作为流1处理
+     * @param[in] settings 升级请求的HTTP2-Settings(base64url)
+     */
+    void serve(http::ServletDispatch::ptr dispatch, Scheduler* worker
+               , const std::string& server_name
+               , http::HttpRequest::ptr upgrade = nullptr
+               , const std::string& settings = "");
+
+    /**
+     * @brief 客户端以prior knowledge方式连接
+     * @details 发送连接前言和SETTINGS, 在当前IOManager中启动读协程.
+     *          读协程持有连接, 使用完需要调用close
+     * @return 失败返回nullptr
+     */
+    static Http2Session::ptr Connect(Address::ptr addr, uint64_t timeout_ms);
+
+    /**
+     * @brief 客户端发送请求并等待响应, 可以在多个协程中并发调用
+     * @param[in] req 请求, Host头作为:authority
+     * @param[in] timeout_ms 超时时间, 超时后发送RST_STREAM(CANCEL)
+     */
+    http::HttpResult::ptr request(http::HttpRequest::ptr req, uint64_t timeout_ms);
+
+    /**
+     * @brief 发送GOAWAY并关闭连接
+     */
+    virtual void close() override;
+
+    /**
+     * @brief 设置已读入的数据(协议升级前多读取的部分)
+     */
+    void setRemain(const std::string& v) { m_remain = v; m_remainPos = 0;}
+
+    /**
+     * @brief 读取数据, 先读取setRemain设置的数据
+     * @details 带读缓存, 帧头和小帧不会各自产生一次recv
+     */
+    virtual int read(void* buffer, size_t length) override;
+    using SocketStream::read;
+
+    bool isClient() const { return m_client;}
+    bool isClosed() const { return m_closed;}
+
+    /**
+     * @brief 当前打开的流数量
+     */
+    size_t getStreamCount();
+
+    const FrameWriter& getFrameWriter() const { return m_writer;}
+
+    /**
+     * @brief 是否h2c升级请求(Upgrade: h2c 并且带HTTP2-Settings)
+     */
+    static bool IsUpgradeRequest(const http::HttpRequest& req);
+
+    /**
+     * @brief 连接上已收到的数据是否以连接前言开头, 不读出数据
+     */
+    static bool PeekPreface(Socket::ptr sock);
+
+    static uint32_t GetMaxConcurrentStreams();
+    static uint32_t GetInitialWindowSize();
+    static uint32_t GetMaxFrameSize();
+private:
+    /**
+     * @brief 发送本端SETTINGS和连接窗口更新
+     */
+    void sendPreface();
+
+    /**
+     * @brief 读取并处理帧, 直到连接关闭或连接错误
+     */
+    void readLoop();
+
+    /**
+     * @brief 处理一帧
+     * @return 连接错误时返回错误码, 否则返回NO_ERROR
+     */
+    Http2Error handleFrame(Frame& frame);
+    Http2Error onHeaders(Frame& frame);
+    Http2Error onHeaderBlock(uint32_t stream_id, bool end_stream);
+    Http2Error onData(Frame& frame);
+    Http2Error onSettings(Frame& frame);
+    Http2Error onWindowUpdate(Frame& frame);
+    Http2Error onRstStream(Frame& frame);
+
+    /**
+     * @brief 应用SETTINGS负载
+     */
+    Http2Error applySettings(const std::string& payload);
+
+    /**
+     * @brief 对端发送END_STREAM
+     */
+    void onRemoteEnd(Http2Stream::ptr stream);
+
+    /**
+     * @brief 服务端处理请求(在worker协程中)
+     */
+    void handleRequest(Http2Stream::ptr stream, http::HttpRequest::ptr req);
+
+    /**
+     * @brief 发送响应
+     */
+    void sendResponse(Http2Stream::ptr stream, http::HttpResponce::ptr rsp, bool head);
+
+    /**
+     * @brief 编码头部块并放入发送队列, 超过最大帧长度时拆分为CONTINUATION, 需要持有编码锁
+     */
+    void encodeHeaders(uint32_t stream_id, const HeaderList& headers, bool end_stream);
+
+    /**
+     * @brief 按流量控制窗口发送消息体
+     * @return 是否全部发送
+     */
+    bool sendData(Http2Stream::ptr stream, std::shared_ptr<const std::string> body, bool end_stream);
+
+    void sendRstStream(uint32_t stream_id, Http2Error err);
+    void sendGoaway(Http2Error err);
+    void sendWindowUpdate(uint32_t stream_id, uint32_t increment);
+
+    /**
+     * @brief 本端发送完成, 对端也已结束时删除流
+     */
+    void onLocalEnd(Http2Stream::ptr stream);
+
+    Http2Stream::ptr getStream(uint32_t id);
+    void eraseStream(uint32_t id);
+
+    /**
+     * @brief 唤醒等待窗口的协程
+     */
+    void notifyWindow();
+private:
+    /// 是否客户端
+    bool m_client;
+    /// 是否已关闭
+    std::atomic<bool> m_closed;
+    /// 是否已发送GOAWAY
+    std::atomic<bool> m_goawaySent;
+    /// 读缓存(包括协议升级前多读取的数据)
+    std::string m_remain;
+    size_t m_remainPos;
+    /// 对端已关闭或发送了GOAWAY, 关闭时不再发送GOAWAY
+    bool m_peerClosed;
+    /// 读协程是否在运行
+    std::atomic<bool> m_reading;
+    /// 帧发送器
+    FrameWriter m_writer;
+
+    /// HPACK解码器, 只在读协程中使用
+    HPackDecoder m_decoder;
+    /// HPACK编码器, 持有m_encodeMutex时使用
+    HPackEncoder m_encoder;
+    MutexType m_encodeMutex;
+
+    /// 流, 窗口和等待窗口的协程数
+    MutexType m_mutex;
+    std::unordered_map<uint32_t, Http2Stream::ptr> m_streams;
+    /// 连接级别本端可以发送的字节数
+    int64_t m_sendWindow;
+    /// 等待窗口的协程数
+    uint32_t m_windowWaiting;
+    FiberSemaphore m_windowSem;
+
+    /// 连接级别对端还可以发送的字节数
+    int64_t m_recvWindow;
+    /// 连接级别已接收未归还的字节数
+    uint32_t m_recvUnacked;
+    /// 本端通告的连接窗口
+    uint32_t m_localConnWindow;
+    /// 本端通告的流初始窗口
+    uint32_t m_localInitialWindow;
+    /// 本端通告的最大帧长度
+    uint32_t m_localMaxFrameSize;
+
+    /// 对端SETTINGS
+    uint32_t m_peerInitialWindow;
+    uint32_t m_peerMaxFrameSize;
+    uint32_t m_peerMaxConcurrentStreams;
+
+    /// 正在接收的头部块(等待CONTINUATION)
+    uint32_t m_headerStreamId;
+    bool m_headerEndStream;
+    std::string m_headerBlock;
+
+    /// 服务端: 最后一个对端发起的流ID
+    uint32_t m_lastStreamId;
+    /// 客户端: 下一个流ID
+    uint32_t m_nextStreamId;
+
+    /// 服务端参数
+    http::ServletDispatch::ptr m_dispatch;
+    Scheduler* m_worker;
+    std::string m_serverName;
+};
+
+} // namespace http2
+} // namespace muhui
+#endif // !__MUHUI_HTTP2_HTTP2_SESSION_H__
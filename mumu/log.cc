@@ -11,13 +11,31 @@
 #include <functional>
 #include <array>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sched.h>
+#include <sys/stat.h>
 
 #include "config.h"
 #include "util.h"
 #include "log.h"
+#include "binlog.h"
 
 namespace muhui
 {
+//AsyncLogAppender后台线程空闲时最长休眠时间(毫秒)
+static const uint64_t s_async_log_idle_ms = 100;
+//AsyncLogAppender一次写出少于这么多字节时, 等待一会再收集下一批
+static const size_t s_async_log_batch_bytes = 64 * 1024;
+static const uint64_t s_async_log_batch_wait_us = 1000;
+//FileLogAppender后台定时器的检查间隔(毫秒)
+static const uint64_t s_log_file_tick_ms = 100;
+
+//LogLimiter汇总丢弃条数的间隔(毫秒)
+static ConfigVar<uint64_t>::ptr g_log_limit_report_interval =
+    Config::Lookup("log.limit_report_interval", (uint64_t)10000, "log limiter suppressed summary interval ms");
+
 LogEventWrap::LogEventWrap(LogEvent::ptr e)
     : m_event(e)
 {}
@@ -25,7 +43,7 @@ LogEventWrap::~LogEventWrap()
 {
     m_event->getLogger()->log(m_event->getLevel(), m_event);
 }
-std::stringstream& LogEventWrap::getss()
+LogStream& LogEventWrap::getss()
 {
     return m_event->getSS();
 }
@@ -73,13 +91,46 @@ LogLevel::Level LogLevel::FromString(const std::string& str)
     return LogLevel::UNKONW;
 #undef XX
 }
+//FormatItem直接写入streambuf, 不构造sentry
+static inline void Write(std::ostream& os, const char* data, size_t len)
+{
+    os.rdbuf()->sputn(data, len);
+}
+
+static inline void Write(std::ostream& os, const char* str)
+{
+    Write(os, str, strlen(str));
+}
+
+static inline void Write(std::ostream& os, const std::string& str)
+{
+    Write(os, str.c_str(), str.size());
+}
+
+//输出整数, 不经过locale的num_put
+static void WriteInt(std::ostream& os, int64_t v)
+{
+    char buf[24];
+    char* end = buf + sizeof(buf);
+    char* p = end;
+    uint64_t u = v < 0 ? -(uint64_t)v : v;
+    do {
+        *--p = '0' + u % 10;
+        u /= 10;
+    } while(u);
+    if(v < 0) {
+        *--p = '-';
+    }
+    Write(os, p, end - p);
+}
+
 class MessageFormatItem : public LogFormatter::FormatItem
 {
 public:
     MessageFormatItem(const std::string& str = ""){}
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override
+    void format(std::ostream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override
     {
-        os << event->getContent();
+        Write(os, event->getSS().data(), event->getSS().size());
     }
 };
 
@@ -87,9 +138,9 @@ class LevelFormatItem : public LogFormatter::FormatItem
 {
 public:
     LevelFormatItem(const std::string& str = ""){}
-    void format(std::ostream& os, std::shared_ptr<Logger> logger,LogLevel::Level level, LogEvent::ptr event) override
+    void format(std::ostream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override
     {
-        os << LogLevel::ToString(level);
+        Write(os, LogLevel::ToString(level));
     }
 };
 
@@ -98,9 +149,9 @@ class NameFormatItem : public LogFormatter::FormatItem
 {
 public:
     NameFormatItem(const std::string& str = ""){}
-    void format(std::ostream& os, std::shared_ptr<Logger> logger,LogLevel::Level level, LogEvent::ptr event) override
+    void format(std::ostream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override
     {
-        os << event->getLogger()->getName();
+        Write(os, event->getLogger()->getName());
     }
 };
 
@@ -108,9 +159,9 @@ class ElapseFormatItem : public LogFormatter::FormatItem
 {
 public:
     ElapseFormatItem(const std::string& str = ""){}
-    void format(std::ostream& os, std::shared_ptr<Logger> logger,LogLevel::Level level, LogEvent::ptr event) override
+    void format(std::ostream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override
     {
-        os << event->getElapse();
+        WriteInt(os, event->getElapse());
     }
 };
 
@@ -118,9 +169,9 @@ class ThreadIdFormatItem : public LogFormatter::FormatItem
 {
 public:
     ThreadIdFormatItem(const std::string& str = ""){}
-    void format(std::ostream& os, std::shared_ptr<Logger> logger,LogLevel::Level level, LogEvent::ptr event) override
+    void format(std::ostream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override
     {
-        os << event->getThreadId();
+        WriteInt(os, event->getThreadId());
     }
 };
 
@@ -128,9 +179,9 @@ class FiberIdFormatItem : public LogFormatter::FormatItem
 {
 public:
     FiberIdFormatItem(const std::string& str = ""){}
-    void format(std::ostream& os, std::shared_ptr<Logger> logger,LogLevel::Level level, LogEvent::ptr event) override
+    void format(std::ostream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override
     {
-        os << event->getFiberId();
+        WriteInt(os, event->getFiberId());
     }
 };
 
@@ -138,9 +189,9 @@ class ThreadNameFormatItem : public LogFormatter::FormatItem
 {
 public:
     ThreadNameFormatItem(const std::string& str = ""){}
-    void format(std::ostream& os, std::shared_ptr<Logger> logger,LogLevel::Level level, LogEvent::ptr event) override
+    void format(std::ostream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override
     {
-        os << event->getThreadName();
+        Write(os, event->getThreadName());
     }
 };
 class DateTimeFormatItem : public LogFormatter::FormatItem
@@ -154,26 +205,43 @@ public:
             m_format = "%Y-%m-%d  %H:%M:%S";
         }
     }
-    void format(std::ostream& os, std::shared_ptr<Logger> logger,LogLevel::Level level, LogEvent::ptr event) override
+    void format(std::ostream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override
     {
-        struct tm tm;
+        //同一秒内复用上次格式化的结果, 每个线程缓存一个
+        static thread_local Cache t_cache;
+        Cache& c = t_cache;
         time_t time = event->getTime();
-        localtime_r(&time, &tm);
-        char buf[64];
-        strftime(buf, sizeof(buf), m_format.c_str(), &tm);
-        os << buf;
+        if(c.id != m_id || c.time != time) {
+            struct tm tm;
+            localtime_r(&time, &tm);
+            c.len = strftime(c.buf, sizeof(c.buf), m_format.c_str(), &tm);
+            c.id = m_id;
+            c.time = time;
+        }
+        Write(os, c.buf, c.len);
     }
+private:
+    struct Cache {
+        uint64_t id = 0;
+        time_t time = 0;
+        char buf[64];
+        size_t len = 0;
+    };
 private:
     std::string m_format;
+    //区分不同的格式, 不使用this避免对象释放后地址被复用
+    uint64_t m_id = ++s_id;
+    static std::atomic<uint64_t> s_id;
 };
+std::atomic<uint64_t> DateTimeFormatItem::s_id(0);
 
 class FilenameFormatItem : public LogFormatter::FormatItem
 {
 public:
     FilenameFormatItem(const std::string& str = ""){}
-    void format(std::ostream& os, std::shared_ptr<Logger> logger,LogLevel::Level level, LogEvent::ptr event) override
+    void format(std::ostream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override
     {
-        os << event->getFilename();
+        Write(os, event->getFilename());
     }
 };
 
@@ -181,9 +249,9 @@ class LineFormatItem : public LogFormatter::FormatItem
 {
 public:
     LineFormatItem(const std::string& str = ""){}
-    void format(std::ostream& os, std::shared_ptr<Logger> logger,LogLevel::Level level, LogEvent::ptr event) override
+    void format(std::ostream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override
     {
-        os << event->getLine();
+        WriteInt(os, event->getLine());
     }
 };
 
@@ -191,9 +259,9 @@ class NewLineFormatItem : public LogFormatter::FormatItem
 {
 public:
     NewLineFormatItem(const std::string& str = ""){}
-    void format(std::ostream& os, std::shared_ptr<Logger> logger,LogLevel::Level level, LogEvent::ptr event) override
+    void format(std::ostream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override
     {
-        os << std::endl;
+        Write(os, "\n", 1);
     }
 };
 
@@ -202,9 +270,9 @@ class StringFormatItem : public LogFormatter::FormatItem
 public:
     StringFormatItem(const std::string& str)
         : m_string(str) {} 
-    void format(std::ostream& os, std::shared_ptr<Logger> logger,LogLevel::Level level, LogEvent::ptr event) override
+    void format(std::ostream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override
     {
-        os << m_string;
+        Write(os, m_string);
     }
 private:
     std::string m_string;
@@ -214,9 +282,9 @@ class TabFormatItem : public LogFormatter::FormatItem
 public:
     TabFormatItem(const std::string& str)
         : m_string(str) {} 
-    void format(std::ostream& os, std::shared_ptr<Logger> logger,LogLevel::Level level, LogEvent::ptr event) override
+    void format(std::ostream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override
     {
-        os << "\t";
+        Write(os, "\t", 1);
     }
 private:
     std::string m_string;
@@ -237,6 +305,46 @@ LogEvent::LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level,
     , m_level(level)
 {}
 
+LogEvent::ptr LogEvent::Create(const std::shared_ptr<Logger>& logger, LogLevel::Level level,
+                               const char* file, int32_t line, uint32_t elapse,
+                               uint32_t thread_id, uint32_t fiber_id, uint64_t time)
+{
+    static thread_local LogEvent::ptr t_event;
+    if(t_event && t_event.use_count() == 1) {
+        t_event->reset(logger, level, file, line, elapse, thread_id, fiber_id, time);
+        return t_event;
+    }
+    LogEvent::ptr event = std::make_shared<LogEvent>(logger, level, file, line, elapse
+                                , thread_id, fiber_id, time, Thread::GetName());
+    if(!t_event) {
+        t_event = event;
+    }
+    return event;
+}
+
+void LogEvent::reset(const std::shared_ptr<Logger>& logger, LogLevel::Level level,
+                     const char* file, int32_t line, uint32_t elapse,
+                     uint32_t thread_id, uint32_t fiber_id, uint64_t time)
+{
+    m_filename = file;
+    m_line = line;
+    m_elapse = elapse;
+    m_threadId = thread_id;
+    //线程名不变时不拷贝
+    const std::string& name = Thread::GetName();
+    if(m_threadName != name) {
+        m_threadName = name;
+    }
+    m_fiberId = fiber_id;
+    m_time = time;
+    //同一个日志器不重新赋值, 避免多线程修改同一个引用计数
+    if(m_logger != logger) {
+        m_logger = logger;
+    }
+    m_level = level;
+    m_ss.reset();
+}
+
 //格式化写入日志内容
 void LogEvent::format(const char* fmt, ...)
 {
@@ -249,36 +357,99 @@ void LogEvent::format(const char* fmt, ...)
 //格式化写入日志内容
 void LogEvent::format(const char* fmt, va_list al)
 {
+    //先写到栈上, 放不下再分配
+    char sbuf[LogStreamBuf::INLINE_SIZE];
+    va_list ap;
+    va_copy(ap, al);
+    int len = vsnprintf(sbuf, sizeof(sbuf), fmt, ap);
+    va_end(ap);
+    if(len < 0) {
+        return;
+    }
+    if((size_t)len < sizeof(sbuf)) {
+        m_ss.write(sbuf, len);
+        return;
+    }
     char* buf = nullptr;
-    int len = vasprintf(&buf, fmt, al);
+    len = vasprintf(&buf, fmt, al);
     if(len != -1)
     {
-        m_ss << std::string(buf, len);
+        m_ss.write(buf, len);
         free(buf);
     }
 }
 
+/*=============LogStream==============*/
+void LogStreamBuf::reset()
+{
+    m_onHeap = false;
+    setp(m_inline, m_inline + sizeof(m_inline));
+}
+
+void LogStreamBuf::grow(size_t n)
+{
+    size_t used = size();
+    size_t cap = std::max(used + n, (size_t)(epptr() - pbase()) * 2);
+    if(m_heap.size() < cap) {
+        m_heap.resize(cap);
+    }
+    if(!m_onHeap) {
+        memcpy(&m_heap[0], m_inline, used);
+        m_onHeap = true;
+    }
+    char* base = &m_heap[0];
+    setp(base, base + m_heap.size());
+    pbump(used);
+}
+
+LogStreamBuf::int_type LogStreamBuf::overflow(int_type c)
+{
+    if(traits_type::eq_int_type(c, traits_type::eof())) {
+        return traits_type::not_eof(c);
+    }
+    if(pptr() == epptr()) {
+        grow(1);
+    }
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+    return c;
+}
+
+std::streamsize LogStreamBuf::xsputn(const char* s, std::streamsize n)
+{
+    if(epptr() - pptr() < n) {
+        grow(n);
+    }
+    memcpy(pptr(), s, n);
+    pbump(n);
+    return n;
+}
+
 
 /*=============Logger==============*/
 Logger::Logger(const std::string& name)
-    : m_name(name), m_level(LogLevel::DEBUG)
+    : m_name(name), m_level(LogLevel::DEBUG), m_appenders(new AppenderList)
 {
     //%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n
    m_formatter.reset(new LogFormatter("%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n")); 
 }
-void Logger::log(LogLevel::Level level, LogEvent::ptr event)
+Logger::~Logger()
 {
-    MutexType::Lock lock(m_mutex);
-    if(level >= m_level)
+    delete m_appenders.load();
+}
+void Logger::log(LogLevel::Level level, const LogEvent::ptr& event)
+{
+    if(level >= getLevel())
     {
-        //返回Logger对象的智能指针
-        auto self = shared_from_this();
+        //快照在读临界区内不会被释放
+        Rcu::ReadLock lock;
+        const AppenderList* appenders = m_appenders.load(std::memory_order_acquire);
         //遍历日志输出地集合log
-        if(!m_appenders.empty())
+        if(!appenders->empty())
         {
-            for(auto& i : m_appenders)
+            for(auto& i : *appenders)
             {
-                i->log(self, level, event);
+                i->log(event->getLogger(), level, event);
             } 
         } else if (m_root){ //如果为空， 使用m_root输出日志
             m_root->log(level, event);
@@ -286,6 +457,37 @@ void Logger::log(LogLevel::Level level, LogEvent::ptr event)
     }
 }
 
+void Logger::logBinary(const Logger::ptr& logger, const BinLogFormat& format, const char* data, size_t len)
+{
+    if(format.getLevel() >= getLevel())
+    {
+        Rcu::ReadLock lock;
+        const AppenderList* appenders = m_appenders.load(std::memory_order_acquire);
+        if(!appenders->empty())
+        {
+            for(auto& i : *appenders)
+            {
+                i->logBinary(logger, format, data, len);
+            }
+        } else if (m_root){
+            m_root->logBinary(logger, format, data, len);
+        }
+    }
+}
+
+void Logger::updateAppenders(const std::function<void(AppenderList&)>& cb)
+{
+    const AppenderList* old = nullptr;
+    {
+        MutexType::Lock lock(m_mutex);
+        AppenderList* appenders = new AppenderList(*m_appenders.load());
+        cb(*appenders);
+        old = m_appenders.exchange(appenders);
+    }
+    //等待还在遍历旧集合的线程退出, 旧集合中被移除的Appender在这里析构
+    Rcu::Synchronize();
+    delete old;
+}
 
 //设置日志器
 void Logger::setFormatter(LogFormatter::ptr val)
@@ -293,8 +495,8 @@ void Logger::setFormatter(LogFormatter::ptr val)
     MutexType::Lock lock(m_mutex);
     m_formatter = val;
 
-    for(auto& i : m_appenders){
-        MutexType::Lock _lock(i->m_mutex);
+    for(auto& i : *m_appenders.load()){
+        LogAppender::MutexType::Lock _lock(i->m_mutex);
         if(!i->m_hasFormatter){
             i->m_formatter = m_formatter;
         }
@@ -330,7 +532,7 @@ std::string Logger::toYamlString()
     if(m_formatter){
         node["formatter"] = m_formatter->getPattern();
     }
-    for(auto & i : m_appenders)
+    for(auto & i : *m_appenders.load())
     {
         //std::cout << "m_appenders = " << m_appenders.size() << std::endl;
         node["appenders"].push_back(YAML::Load(i->toYamlString()));
@@ -365,31 +567,48 @@ void Logger::fatal(LogEvent::ptr event)
 //添加删除日志输出地
 void Logger::addAppender(LogAppender::ptr appender)
 {
-    MutexType::Lock lock(m_mutex);
-    if(!appender->getFormatter())
-    {
-        MutexType::Lock _lock(appender->m_mutex);
-        appender->m_formatter = m_formatter;
-    }
-    m_appenders.push_back(appender);
+    updateAppenders([this, appender](AppenderList& appenders){
+        if(!appender->getFormatter())
+        {
+            LogAppender::MutexType::Lock _lock(appender->m_mutex);
+            appender->m_formatter = m_formatter;
+        }
+        appenders.push_back(appender);
+    });
 }
 void Logger::delAppender(LogAppender::ptr appender)
 {
-    MutexType::Lock lock(m_mutex);
-    for(auto it = m_appenders.begin(); it != m_appenders.end(); it++)
-    {
-        if(*it == appender)
+    updateAppenders([appender](AppenderList& appenders){
+        for(auto it = appenders.begin(); it != appenders.end(); it++)
         {
-            m_appenders.erase(it);
-            break;
+            if(*it == appender)
+            {
+                appenders.erase(it);
+                break;
+            }
         }
-    }
+    });
 }
 //清空日志输出地
 void Logger::clearAppender()
 {
-    MutexType::Lock lock(m_mutex);
-    m_appenders.clear();
+    updateAppenders([](AppenderList& appenders){
+        appenders.clear();
+    });
+}
+void Logger::setAppenders(const AppenderList& val)
+{
+    updateAppenders([this, &val](AppenderList& appenders){
+        for(auto& i : val)
+        {
+            if(!i->getFormatter())
+            {
+                LogAppender::MutexType::Lock _lock(i->m_mutex);
+                i->m_formatter = m_formatter;
+            }
+        }
+        appenders = val;
+    });
 }
 
 LogFormatter::ptr LogAppender::getFormatter()
@@ -407,31 +626,374 @@ void LogAppender::setFormatter(LogFormatter::ptr val)
         m_hasFormatter = false;
     }
 }
-FileLogAppender::FileLogAppender(const std::string& filename)
+namespace {
+
+/**
+ * @brief 日志的后台定时器, 共用一个线程: FileLogAppender的刷新和轮转, LogLimiter的定期汇总
+ * @details 进程退出时不析构, 避免静态对象析构顺序问题
+ */
+class LogTimer {
+public:
+    static LogTimer* GetInstance() {
+        static LogTimer* s_instance = new LogTimer;
+        return s_instance;
+    }
+
+    void add(FileLogAppender* appender) {
+        Mutex::Lock lock(m_mutex);
+        m_appenders.insert(appender);
+    }
+
+    void del(FileLogAppender* appender) {
+        Mutex::Lock lock(m_mutex);
+        m_appenders.erase(appender);
+    }
+
+    /**
+     * @brief 提前唤醒定时器线程
+     */
+    void wakeup() {
+        m_sem.notify();
+    }
+private:
+    LogTimer()
+        : m_lastReport(GetCurrentMS())
+    {
+        m_thread.reset(new Thread(std::bind(&LogTimer::run, this), "log_timer"));
+    }
+
+    void run() {
+        while(true) {
+            m_sem.waitFor(s_log_file_tick_ms);
+            uint64_t now = GetCurrentMS();
+            {
+                Mutex::Lock lock(m_mutex);
+                for(auto& i : m_appenders) {
+                    i->onTimer(now);
+                }
+            }
+            if(now - m_lastReport >= g_log_limit_report_interval->getValue()) {
+                m_lastReport = now;
+                std::string report = LogLimiter::Report();
+                if(!report.empty()) {
+                    MUHUI_LOG_WARN(MUHUI_LOG_NAME("system")) << report;
+                }
+            }
+        }
+    }
+private:
+    Mutex m_mutex;
+    std::set<FileLogAppender*> m_appenders;
+    uint64_t m_lastReport;
+    Semaphore m_sem;
+    Thread::ptr m_thread;
+};
+
+}
+
+/*=============LogLimiter==============*/
+namespace
+{
+//所有调用点的LogLimiter, 进程退出时不析构
+struct LogLimiterRegistry
+{
+    Mutex mutex;
+    std::vector<LogLimiter*> limiters;
+};
+
+LogLimiterRegistry& GetLogLimiterRegistry()
+{
+    static LogLimiterRegistry* s_registry = new LogLimiterRegistry;
+    return *s_registry;
+}
+
+//限流窗口用的粗粒度时钟(毫秒), 精度为几毫秒, 比gettimeofday开销小
+uint64_t GetCoarseMS()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+}
+}
+
+LogLimiter::LogLimiter(const char* file, int32_t line)
+    : m_file(file)
+    , m_line(line)
+    , m_windowStart(GetCoarseMS())
+    , m_count(0)
+    , m_suppressed(0)
+    , m_reported(0)
+{
+    LogLimiterRegistry& r = GetLogLimiterRegistry();
+    {
+        Mutex::Lock lock(r.mutex);
+        r.limiters.push_back(this);
+    }
+    //启动后台定时器
+    LogTimer::GetInstance();
+}
+
+bool LogLimiter::allow(uint64_t count, uint64_t interval_ms)
+{
+    uint64_t now = GetCoarseMS();
+    uint64_t start = m_windowStart.load(std::memory_order_relaxed);
+    if(now - start >= interval_ms
+            && m_windowStart.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+        //只有一个线程开始新窗口, 和其它线程的计数有竞争, 窗口边界处允许少量误差
+        m_count.store(0, std::memory_order_relaxed);
+    }
+    if(m_count.fetch_add(1, std::memory_order_relaxed) < count) {
+        return true;
+    }
+    m_suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+bool LogLimiter::sample(uint32_t n)
+{
+    if(n <= 1) {
+        return true;
+    }
+    //每个线程一个xorshift随机数, 不共享状态
+    static thread_local uint64_t t_seed = 0;
+    if(t_seed == 0) {
+        t_seed = (GetCurrentUS() << 16) ^ (uint64_t)GetThreadId() ^ 0x9e3779b97f4a7c15ull;
+    }
+    t_seed ^= t_seed << 13;
+    t_seed ^= t_seed >> 7;
+    t_seed ^= t_seed << 17;
+    if(t_seed % n == 0) {
+        return true;
+    }
+    m_suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+std::string LogLimiter::Report()
+{
+    LogLimiterRegistry& r = GetLogLimiterRegistry();
+    std::stringstream ss;
+    uint64_t total = 0;
+    Mutex::Lock lock(r.mutex);
+    for(auto i : r.limiters) {
+        uint64_t suppressed = i->m_suppressed.load(std::memory_order_relaxed);
+        uint64_t n = suppressed - i->m_reported;
+        if(n == 0) {
+            continue;
+        }
+        i->m_reported = suppressed;
+        ss << (total ? ", " : "") << i->m_file << ":" << i->m_line << "=" << n;
+        total += n;
+    }
+    if(total == 0) {
+        return "";
+    }
+    return "log limiter suppressed " + std::to_string(total) + " lines: " + ss.str();
+}
+
+FileLogAppender::RotateType FileLogAppender::RotateFromString(const std::string& v)
+{
+    if(strcasecmp(v.c_str(), "hourly") == 0) {
+        return ROTATE_HOURLY;
+    }
+    if(strcasecmp(v.c_str(), "daily") == 0) {
+        return ROTATE_DAILY;
+    }
+    return ROTATE_NONE;
+}
+
+const char* FileLogAppender::RotateToString(RotateType v)
+{
+    switch(v) {
+        case ROTATE_HOURLY:
+            return "hourly";
+        case ROTATE_DAILY:
+            return "daily";
+        default:
+            return "none";
+    }
+}
+
+FileLogAppender::FileLogAppender(const std::string& filename, size_t buffer_size
+                                 , uint64_t flush_interval, uint64_t max_size
+                                 , RotateType rotate)
     : m_filename(filename)
+    , m_fd(-1)
+    , m_dev(0)
+    , m_ino(0)
+    , m_fileSize(0)
+    , m_bufferSize(buffer_size)
+    , m_flushInterval(flush_interval)
+    , m_maxSize(max_size)
+    , m_rotate(rotate)
+    , m_lastFlush(GetCurrentMS())
+    , m_flushRequested(false)
 {
-    reopen();
+    m_buffer.reserve(m_bufferSize);
+    m_period = getPeriod(time(0));
+    openFile();
+    LogTimer::GetInstance()->add(this);
 }
-void FileLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) 
+
+FileLogAppender::~FileLogAppender()
 {
-    if(level >= m_level) {
-    uint64_t now = event->getTime();
-    if(now >= (m_lastTime + 3)) {
-        reopen();
-        m_lastTime = now;
+    LogTimer::GetInstance()->del(this);
+    flush();
+    if(m_fd >= 0) {
+        ::close(m_fd);
     }
-    MutexType::Lock lock(m_mutex);
-    if(!m_formatter->format(m_filestream, logger, level, event)) {
-        std::cout << "error" << std::endl;
+}
+
+void FileLogAppender::log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) 
+{
+    if(level < m_level) {
+        return;
+    }
+    LogFormatter::ptr fmt;
+    {
+        MutexType::Lock lock(m_mutex);
+        fmt = m_formatter;
+    }
+    if(!fmt) {
+        return;
+    }
+    LogStream& str = fmt->formatLocal(logger, level, event);
+    bool full = false;
+    {
+        MutexType::Lock lock(m_mutex);
+        m_buffer.append(str.data(), str.size());
+        full = m_buffer.size() >= m_bufferSize;
+    }
+    if(full) {
+        flush();
+    } else if(level >= LogLevel::ERROR && !m_flushRequested.exchange(true)) {
+        //ERROR及以上尽快写出(进程随后可能异常退出), 由定时器线程写文件, 不阻塞调用线程
+        LogTimer::GetInstance()->wakeup();
+    }
+}
+
+void FileLogAppender::flush()
+{
+    Mutex::Lock lock(m_fileMutex);
+    flushFile();
+}
+
+void FileLogAppender::flushFile()
+{
+    {
+        MutexType::Lock lock(m_mutex);
+        m_writeBuffer.swap(m_buffer);
+    }
+    if(m_writeBuffer.empty()) {
+        return;
+    }
+    size_t offset = 0;
+    while(m_fd >= 0 && offset < m_writeBuffer.size()) {
+        ssize_t rt = ::write(m_fd, m_writeBuffer.c_str() + offset, m_writeBuffer.size() - offset);
+        if(rt < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            std::cout << "FileLogAppender write file=" << m_filename << " errno=" << errno
+                      << " errstr=" << strerror(errno) << std::endl;
+            break;
         }
+        offset += rt;
+    }
+    m_fileSize += offset;
+    m_writeBuffer.clear();
+    if(m_maxSize && m_fileSize >= m_maxSize) {
+        rotateFile(Time2Str(time(0), "%Y%m%d-%H%M%S"));
+    }
+}
+
+bool FileLogAppender::openFile()
+{
+    if(m_fd >= 0) {
+        ::close(m_fd);
+    }
+    m_fd = ::open(m_filename.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    struct stat st;
+    if(m_fd < 0 || fstat(m_fd, &st)) {
+        std::cout << "FileLogAppender open file=" << m_filename << " errno=" << errno
+                  << " errstr=" << strerror(errno) << std::endl;
+        m_dev = m_ino = 0;
+        m_fileSize = 0;
+        return false;
+    }
+    m_dev = st.st_dev;
+    m_ino = st.st_ino;
+    m_fileSize = st.st_size;
+    return true;
+}
+
+void FileLogAppender::rotateFile(const std::string& suffix)
+{
+    std::string name = m_filename + "." + suffix;
+    for(int i = 1; access(name.c_str(), F_OK) == 0; ++i) {
+        name = m_filename + "." + suffix + "." + std::to_string(i);
+    }
+    if(rename(m_filename.c_str(), name.c_str())) {
+        std::cout << "FileLogAppender rename file=" << m_filename << " to=" << name
+                  << " errno=" << errno << " errstr=" << strerror(errno) << std::endl;
+    }
+    openFile();
+}
+
+std::string FileLogAppender::getPeriod(time_t now) const
+{
+    switch(m_rotate) {
+        case ROTATE_HOURLY:
+            return Time2Str(now, "%Y%m%d%H");
+        case ROTATE_DAILY:
+            return Time2Str(now, "%Y%m%d");
+        default:
+            return "";
     }
 }
+
+void FileLogAppender::onTimer(uint64_t now_ms)
+{
+    Mutex::Lock lock(m_fileMutex);
+    bool requested = m_flushRequested.exchange(false);
+    std::string period = getPeriod(now_ms / 1000);
+    if(period != m_period) {
+        //进入新的周期, 旧文件以上一个周期命名
+        flushFile();
+        rotateFile(m_period);
+        m_period = period;
+        m_lastFlush = now_ms;
+        return;
+    }
+    //文件被删除或被移走(外部轮转)时, 先把缓冲区写入旧文件再打开新文件
+    struct stat st;
+    if(stat(m_filename.c_str(), &st) || (uint64_t)st.st_ino != m_ino
+            || (uint64_t)st.st_dev != m_dev) {
+        flushFile();
+        openFile();
+        m_lastFlush = now_ms;
+        return;
+    }
+    if(requested || now_ms >= m_lastFlush + m_flushInterval) {
+        flushFile();
+        m_lastFlush = now_ms;
+    }
+}
+
 std::string FileLogAppender::toYamlString()
 {
     MutexType::Lock lock(m_mutex);
     YAML::Node node;
     node["type"] = "FileLogAppender";
     node["file"] = m_filename;
+    node["buffer_size"] = m_bufferSize;
+    node["flush_interval"] = m_flushInterval;
+    if(m_maxSize) {
+        node["max_size"] = m_maxSize;
+    }
+    if(m_rotate != ROTATE_NONE) {
+        node["rotate"] = RotateToString(m_rotate);
+    }
     if(m_level != LogLevel::UNKONW){
         node["level"] = LogLevel::ToString(m_level);
     }
@@ -445,21 +1007,18 @@ std::string FileLogAppender::toYamlString()
 
 bool FileLogAppender::reopen()
 {
-    MutexType::Lock lock(m_mutex);
-    if(m_filestream)
-    {
-        m_filestream.close();
-    }
-    m_filestream.open(m_filename, std::ios::app);
-        return !!m_filestream;
+    Mutex::Lock lock(m_fileMutex);
+    flushFile();
+    return openFile();
 }
-void StdoutLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) 
+void StdoutLogAppender::log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) 
 {
     if(level >= m_level)
     {
         MutexType::Lock lock(m_mutex);
-        //std::string str = m_formatter->format(logger, level, event);
-        m_formatter->format(std::cout, logger, level, event);
+        LogStream& str = m_formatter->formatLocal(logger, level, event);
+        std::cout.write(str.data(), str.size());
+        std::cout.flush();
     }
 }
 
@@ -479,6 +1038,448 @@ std::string StdoutLogAppender::toYamlString()
     ss << node;
     return ss.str();
 }
+/*=============AsyncLogAppender==============*/
+LogRingBuffer::LogRingBuffer(size_t capacity)
+    : m_head(0)
+    , m_cachedTail(0)
+    , m_tail(0)
+    , m_closed(false)
+    , m_hasLarge(false)
+{
+    size_t cap = 64;
+    while(cap < capacity) {
+        cap <<= 1;
+    }
+    m_data = (char*)malloc(cap);
+    m_mask = cap - 1;
+}
+
+LogRingBuffer::~LogRingBuffer()
+{
+    free(m_data);
+}
+
+bool LogRingBuffer::push(const char* data, size_t len)
+{
+    uint64_t head = m_head.load(std::memory_order_relaxed);
+    size_t cap = m_mask + 1;
+    if(head + len - m_cachedTail > cap) {
+        m_cachedTail = m_tail.load(std::memory_order_acquire);
+        if(head + len - m_cachedTail > cap) {
+            return false;
+        }
+    }
+    size_t pos = head & m_mask;
+    size_t first = std::min(len, cap - pos);
+    memcpy(m_data + pos, data, first);
+    if(first < len) {
+        memcpy(m_data, data + first, len - first);
+    }
+    m_head.store(head + len, std::memory_order_release);
+    return true;
+}
+
+bool LogRingBuffer::pushLarge(const char* data, size_t len)
+{
+    //前一行还未写出, 或者缓冲区中还有之前的数据
+    if(m_hasLarge.load(std::memory_order_acquire)
+            || m_tail.load(std::memory_order_acquire) != m_head.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    m_large.assign(data, len);
+    m_hasLarge.store(true, std::memory_order_release);
+    return true;
+}
+
+const std::string* LogRingBuffer::peekLarge() const
+{
+    //在peek之后读取: 看到pushLarge之后写入的数据时一定能看到m_hasLarge,
+    //这时缓冲区中的数据都在这一行之后
+    return m_hasLarge.load(std::memory_order_acquire) ? &m_large : nullptr;
+}
+
+size_t LogRingBuffer::peek(struct iovec* iov, int& count)
+{
+    uint64_t tail = m_tail.load(std::memory_order_relaxed);
+    uint64_t head = m_head.load(std::memory_order_acquire);
+    size_t len = head - tail;
+    count = 0;
+    if(len == 0) {
+        return 0;
+    }
+    size_t pos = tail & m_mask;
+    size_t first = std::min(len, m_mask + 1 - pos);
+    iov[0].iov_base = m_data + pos;
+    iov[0].iov_len = first;
+    count = 1;
+    if(first < len) {
+        iov[1].iov_base = m_data;
+        iov[1].iov_len = len - first;
+        count = 2;
+    }
+    return len;
+}
+
+void LogRingBuffer::consume(size_t len)
+{
+    m_tail.store(m_tail.load(std::memory_order_relaxed) + len, std::memory_order_release);
+}
+
+void LogRingBuffer::consumeLarge()
+{
+    //释放内存, 避免一直占用最长一行的大小
+    std::string().swap(m_large);
+    m_hasLarge.store(false, std::memory_order_release);
+}
+
+namespace {
+
+//当前线程在各个AsyncLogAppender中的缓冲区, 线程退出时标记关闭, 由后台线程写完后释放
+struct AsyncLogRings {
+    std::vector<std::pair<uint64_t, LogRingBuffer::ptr> > rings;
+
+    ~AsyncLogRings() {
+        for(auto& i : rings) {
+            i.second->close();
+        }
+    }
+};
+
+static thread_local AsyncLogRings t_async_rings;
+static std::atomic<uint64_t> s_async_appender_id(0);
+
+}
+
+AsyncLogAppender::OverflowPolicy AsyncLogAppender::OverflowFromString(const std::string& v)
+{
+    if(strcasecmp(v.c_str(), "drop") == 0) {
+        return DROP;
+    }
+    if(strcasecmp(v.c_str(), "drop_count") == 0) {
+        return DROP_COUNT;
+    }
+    return BLOCK;
+}
+
+const char* AsyncLogAppender::OverflowToString(OverflowPolicy v)
+{
+    switch(v) {
+        case DROP:
+            return "drop";
+        case DROP_COUNT:
+            return "drop_count";
+        default:
+            return "block";
+    }
+}
+
+AsyncLogAppender::AsyncLogAppender(const std::string& filename, size_t buffer_size
+                                   , OverflowPolicy overflow)
+    : AsyncLogAppender(filename, buffer_size, overflow, true)
+{
+}
+
+AsyncLogAppender::AsyncLogAppender(const std::string& filename, size_t buffer_size
+                                   , OverflowPolicy overflow, bool start_thread)
+    : m_filename(filename)
+    , m_bufferSize(std::max(buffer_size, (size_t)4096))
+    , m_overflow(overflow)
+    , m_id(++s_async_appender_id)
+    , m_ringVersion(0)
+    , m_stop(false)
+    , m_sleeping(false)
+    , m_dropped(0)
+    , m_droppedReported(0)
+    , m_writes(0)
+{
+    m_fd = ::open(m_filename.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if(m_fd < 0) {
+        std::cout << "AsyncLogAppender open file=" << m_filename << " errno=" << errno
+                  << " errstr=" << strerror(errno) << std::endl;
+    }
+    if(start_thread) {
+        start();
+    }
+}
+
+AsyncLogAppender::~AsyncLogAppender()
+{
+    stop();
+    {
+        Mutex::Lock lock(m_ringMutex);
+        for(auto& i : m_rings) {
+            i->close();
+        }
+    }
+    if(m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+void AsyncLogAppender::start()
+{
+    m_thread.reset(new Thread(std::bind(&AsyncLogAppender::run, this), "log_async"));
+}
+
+void AsyncLogAppender::stop()
+{
+    if(!m_thread) {
+        return;
+    }
+    m_stop = true;
+    m_sem.notify();
+    m_thread->join();
+    m_thread.reset();
+}
+
+LogRingBuffer* AsyncLogAppender::getRing()
+{
+    auto& rings = t_async_rings.rings;
+    for(auto& i : rings) {
+        if(i.first == m_id) {
+            return i.second.get();
+        }
+    }
+    //清理已析构的Appender留下的缓冲区
+    for(auto it = rings.begin(); it != rings.end();) {
+        if(it->second->isClosed()) {
+            it = rings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    LogRingBuffer::ptr ring(new LogRingBuffer(m_bufferSize));
+    {
+        Mutex::Lock lock(m_ringMutex);
+        m_rings.push_back(ring);
+        ++m_ringVersion;
+    }
+    rings.push_back(std::make_pair(m_id, ring));
+    return ring.get();
+}
+
+void AsyncLogAppender::wakeup()
+{
+    if(m_sleeping.load(std::memory_order_relaxed) && m_sleeping.exchange(false)) {
+        m_sem.notify();
+    }
+}
+
+void AsyncLogAppender::log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event)
+{
+    if(level < m_level) {
+        return;
+    }
+    LogFormatter::ptr fmt;
+    {
+        MutexType::Lock lock(m_mutex);
+        fmt = m_formatter;
+    }
+    if(!fmt) {
+        return;
+    }
+    LogStream& str = fmt->formatLocal(logger, level, event);
+    if(str.size() == 0) {
+        return;
+    }
+    push(str.data(), str.size());
+}
+
+bool AsyncLogAppender::push(const char* data, size_t len)
+{
+    LogRingBuffer* ring = getRing();
+    //缓冲区放不下的行等缓冲区写空后整行交给后台线程, 不在调用线程写文件
+    bool large = len > m_bufferSize / 2;
+    while(!(large ? ring->pushLarge(data, len) : ring->push(data, len))) {
+        if(m_overflow != BLOCK) {
+            ++m_dropped;
+            return false;
+        }
+        //不能用usleep: hook后会切换协程, 可能换到其它线程继续写这个线程的缓冲区
+        wakeup();
+        sched_yield();
+    }
+    wakeup();
+    return true;
+}
+
+void AsyncLogAppender::onWrite(std::string& head, uint64_t dropped)
+{
+    if(dropped) {
+        head = "AsyncLogAppender dropped " + std::to_string(dropped) + " log lines\n";
+    }
+}
+
+void AsyncLogAppender::flush()
+{
+    while(true) {
+        //丢弃计数也要写出
+        bool empty = m_overflow != DROP_COUNT || m_droppedReported == m_dropped;
+        if(empty) {
+            Mutex::Lock lock(m_ringMutex);
+            for(auto& i : m_rings) {
+                if(!i->empty()) {
+                    empty = false;
+                    break;
+                }
+            }
+        }
+        if(empty) {
+            return;
+        }
+        wakeup();
+        sched_yield();
+    }
+}
+
+void AsyncLogAppender::writeAll(struct iovec* iov, int count)
+{
+    if(m_fd < 0) {
+        return;
+    }
+    while(count > 0) {
+        ssize_t rt = ::writev(m_fd, iov, count);
+        if(rt < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            std::cout << "AsyncLogAppender writev file=" << m_filename << " errno=" << errno
+                      << " errstr=" << strerror(errno) << std::endl;
+            return;
+        }
+        size_t n = rt;
+        while(count > 0 && n >= iov->iov_len) {
+            n -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if(count > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+}
+
+void AsyncLogAppender::run()
+{
+    std::vector<LogRingBuffer::ptr> rings;
+    std::vector<size_t> sizes;
+    std::vector<char> larges;
+    std::vector<iovec> iovs;
+    uint64_t version = (uint64_t)-1;
+    std::string head;
+    while(true) {
+        //先读取停止标记, 之后收集到的数据为空时才能退出
+        bool stop = m_stop;
+        if(m_ringVersion != version) {
+            Mutex::Lock lock(m_ringMutex);
+            version = m_ringVersion;
+            //移除线程已退出并且已写完的缓冲区
+            for(auto it = m_rings.begin(); it != m_rings.end();) {
+                if((*it)->isClosed() && (*it)->empty()) {
+                    it = m_rings.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            rings = m_rings;
+        }
+
+        iovs.clear();
+        sizes.assign(rings.size(), 0);
+        larges.assign(rings.size(), 0);
+        bool has_closed = false;
+        uint64_t dropped = m_dropped;
+        uint64_t new_dropped = m_overflow == DROP_COUNT ? dropped - m_droppedReported : 0;
+        //预留头部的位置
+        iovs.resize(1);
+        for(size_t i = 0; i < rings.size(); ++i) {
+            iovec iov[2];
+            int cnt = 0;
+            sizes[i] = rings[i]->peek(iov, cnt);
+            //缓冲区中的数据都在这一行之后写入
+            const std::string* large = rings[i]->peekLarge();
+            if(large) {
+                larges[i] = 1;
+                iovec liov;
+                liov.iov_base = (void*)large->data();
+                liov.iov_len = large->size();
+                iovs.push_back(liov);
+            }
+            iovs.insert(iovs.end(), iov, iov + cnt);
+            if(rings[i]->isClosed()) {
+                has_closed = true;
+            }
+        }
+
+        if(iovs.size() == 1 && new_dropped == 0) {
+            if(stop) {
+                break;
+            }
+            if(has_closed) {
+                //下一轮清理
+                ++m_ringVersion;
+            }
+            m_sleeping = true;
+            //设置休眠标记后再检查一次, 避免生产者在检查之前写入而没有唤醒
+            bool ready = m_stop || m_ringVersion != version;
+            for(size_t i = 0; !ready && i < rings.size(); ++i) {
+                ready = !rings[i]->empty();
+            }
+            if(!ready) {
+                //定时醒来兜底, 避免丢失唤醒时长时间不写出
+                m_sem.waitFor(s_async_log_idle_ms);
+            }
+            m_sleeping = false;
+            continue;
+        }
+
+        head.clear();
+        onWrite(head, new_dropped);
+        iovs[0].iov_base = &head[0];
+        iovs[0].iov_len = head.size();
+        size_t begin = head.empty() ? 1 : 0;
+        for(size_t i = begin; i < iovs.size(); i += IOV_MAX) {
+            writeAll(&iovs[i], std::min(iovs.size() - i, (size_t)IOV_MAX));
+        }
+        ++m_writes;
+        m_droppedReported = dropped;
+        size_t total = 0;
+        for(size_t i = 0; i < rings.size(); ++i) {
+            if(sizes[i]) {
+                rings[i]->consume(sizes[i]);
+                total += sizes[i];
+            }
+            if(larges[i]) {
+                total += rings[i]->peekLarge()->size();
+                rings[i]->consumeLarge();
+            }
+        }
+        if(total < std::min(s_async_log_batch_bytes, m_bufferSize / 4) && !stop) {
+            //批次很小时稍等再收集, 避免和生产者争抢缓冲区所在的缓存行; 缓冲区快满时不等待
+            usleep(s_async_log_batch_wait_us);
+        }
+    }
+}
+
+std::string AsyncLogAppender::toYamlString()
+{
+    MutexType::Lock lock(m_mutex);
+    YAML::Node node;
+    node["type"] = "AsyncLogAppender";
+    node["file"] = m_filename;
+    node["buffer_size"] = m_bufferSize;
+    node["overflow"] = OverflowToString(m_overflow);
+    if(m_level != LogLevel::UNKONW){
+        node["level"] = LogLevel::ToString(m_level);
+    }
+    if(m_hasFormatter && m_formatter) {
+        node["formatter"] = m_formatter->getPattern(); 
+    }
+    std::stringstream ss;
+    ss << node;
+    return ss.str();
+}
 /*=============LogFormatter==============*/
 LogFormatter::LogFormatter(const std::string& pattern)
     : m_pattern(pattern)
@@ -494,18 +1495,21 @@ LogFormatter::LogFormatter(const std::string& pattern)
 *  %d   输出日志时间点的日期或时间,默认格式为ISO8601,也可以在其后指定格式，比如：%d{yyy MMM dd HH:mm:ss,SSS}，输出类似：2018年6月15日  22 ： 10 ： 28 ， 921  
 *  %l   输出日志事件的发生位置，包括类目名、发生的线程，以及在代码中的行数。
 */
-std::string LogFormatter::format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+std::string LogFormatter::format(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event)
 {
-    //stringstream是C++提供的串流（stream）物件,作用就是从string对象读取字符或字符串
-    std::stringstream ss;
+    return formatLocal(logger, level, event).str();
+}
+LogStream& LogFormatter::formatLocal(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event)
+{
+    static thread_local LogStream t_stream;
+    t_stream.reset();
     for(auto& i : m_items)
     {
-        i->format(ss, logger, level, event);
+        i->format(t_stream, logger, level, event);
     }
-    //str()清空流的内存缓冲，重复使用内存消耗不再增加
-    return ss.str();
+    return t_stream;
 }
-std::ostream& LogFormatter::format(std::ostream& ofs, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+std::ostream& LogFormatter::format(std::ostream& ofs, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event)
 {
     for(auto& i : m_items)
     {
@@ -705,18 +1709,33 @@ std::string LoggerManager::toYamlString()
 //日志appender配置格式
 struct LogAppenderDefine
 {
-    //1 File, 2 Stdout
+    //1 File, 2 Stdout, 3 Async, 4 BinLog
     int type = 0;
     LogLevel::Level level = LogLevel::UNKONW;
     std::string formatter;
     std::string file;
+    //File, Async: 缓冲区大小, 0使用默认值
+    size_t bufferSize = 0;
+    //Async: 缓冲区满时的处理方式
+    AsyncLogAppender::OverflowPolicy overflow = AsyncLogAppender::BLOCK;
+    //File: 定时写出间隔(毫秒)
+    uint64_t flushInterval = 1000;
+    //File: 按大小轮转, 0不轮转
+    uint64_t maxSize = 0;
+    //File: 按时间轮转
+    FileLogAppender::RotateType rotate = FileLogAppender::ROTATE_NONE;
 
     bool operator==(const LogAppenderDefine& oth) const
     {
         return type == oth.type
             && level == oth.level
             && formatter == oth.formatter
-            && file == oth.file;
+            && file == oth.file
+            && bufferSize == oth.bufferSize
+            && overflow == oth.overflow
+            && flushInterval == oth.flushInterval
+            && maxSize == oth.maxSize
+            && rotate == oth.rotate;
     }
 
 };
@@ -779,6 +1798,35 @@ public:
                         continue;
                     }
                     lad.file = a["file"].as<std::string>();
+                    if(a["buffer_size"].IsDefined()) {
+                        lad.bufferSize = a["buffer_size"].as<size_t>();
+                    }
+                    if(a["flush_interval"].IsDefined()) {
+                        lad.flushInterval = a["flush_interval"].as<uint64_t>();
+                    }
+                    if(a["max_size"].IsDefined()) {
+                        lad.maxSize = a["max_size"].as<uint64_t>();
+                    }
+                    if(a["rotate"].IsDefined()) {
+                        lad.rotate = FileLogAppender::RotateFromString(a["rotate"].as<std::string>());
+                    }
+                    if(a["formatter"].IsDefined()) {
+                        lad.formatter = a["formatter"].as<std::string>();
+                    }
+                } else if(type == "AsyncLogAppender" || type == "BinLogAppender") {
+                    lad.type = type == "AsyncLogAppender" ? 3 : 4;
+                    if(!a["file"].IsDefined()) {
+                        std::cout << "log config error: " << type << " file is null, " << a
+                              << std::endl;
+                        continue;
+                    }
+                    lad.file = a["file"].as<std::string>();
+                    if(a["buffer_size"].IsDefined()) {
+                        lad.bufferSize = a["buffer_size"].as<size_t>();
+                    }
+                    if(a["overflow"].IsDefined()) {
+                        lad.overflow = AsyncLogAppender::OverflowFromString(a["overflow"].as<std::string>());
+                    }
                     if(a["formatter"].IsDefined()) {
                         lad.formatter = a["formatter"].as<std::string>();
                     }
@@ -818,8 +1866,25 @@ public:
             if(a.type == 1) {
                 na["type"] = "FileLogAppender";
                 na["file"] = a.file;
+                if(a.bufferSize) {
+                    na["buffer_size"] = a.bufferSize;
+                }
+                na["flush_interval"] = a.flushInterval;
+                if(a.maxSize) {
+                    na["max_size"] = a.maxSize;
+                }
+                if(a.rotate != FileLogAppender::ROTATE_NONE) {
+                    na["rotate"] = FileLogAppender::RotateToString(a.rotate);
+                }
             } else if(a.type == 2) {
                 na["type"] = "StdoutLogAppender";
+            } else if(a.type == 3 || a.type == 4) {
+                na["type"] = a.type == 3 ? "AsyncLogAppender" : "BinLogAppender";
+                na["file"] = a.file;
+                if(a.bufferSize) {
+                    na["buffer_size"] = a.bufferSize;
+                }
+                na["overflow"] = AsyncLogAppender::OverflowToString(a.overflow);
             }
             if(a.level != LogLevel::UNKONW) {
                 na["level"] = LogLevel::ToString(a.level);
@@ -866,13 +1931,21 @@ struct LogIniter {
                     logger->setFormatter(i.formatter);
                 }
 
-                logger->clearAppender();
+                //新的Appender全部创建后一次替换, 写日志的线程不会看到空的集合
+                Logger::AppenderList appenders;
                 for(auto& a : i.appenders) {
                     muhui::LogAppender::ptr ap;
                     if(a.type == 1) {
-                        ap.reset(new FileLogAppender(a.file));
+                        ap.reset(new FileLogAppender(a.file, a.bufferSize ? a.bufferSize : 64 * 1024
+                                    , a.flushInterval, a.maxSize, a.rotate));
                     } else if(a.type == 2){ 
                             ap.reset(new StdoutLogAppender);
+                    } else if(a.type == 3) {
+                        ap.reset(new AsyncLogAppender(a.file, a.bufferSize ? a.bufferSize : 1024 * 1024
+                                    , a.overflow));
+                    } else if(a.type == 4) {
+                        ap.reset(new BinLogAppender(a.file, a.bufferSize ? a.bufferSize : 1024 * 1024
+                                    , a.overflow));
                     } else {
                         continue;
                     }
@@ -886,8 +1959,9 @@ struct LogIniter {
                                       << " formatter=" << a.formatter << " is invalid" << std::endl;
                         }
                     }
-                    logger->addAppender(ap);
+                    appenders.push_back(ap);
                 }
+                logger->setAppenders(appenders);
             }
 
             for(auto& i : old_value) {
@@ -24,6 +24,9 @@
 #include <stdarg.h>
 #include <map>
 #include <unordered_map>
+#include <atomic>
+#include <functional>
+#include <sys/uio.h>
 
 #include "singleton.h"
 #include "thread.h"
@@ -33,9 +36,9 @@
  */
 #define MUHUI_LOG_LEVEL(logger, level) \
     if(logger->getLevel() <= level) \
-        muhui::LogEventWrap(muhui::LogEvent::ptr(new muhui::LogEvent(logger, level, \
+        muhui::LogEventWrap(muhui::LogEvent::Create(logger, level, \
                         __FILE__, __LINE__, 0, muhui::GetThreadId(), \
-                    muhui::GetFiberId(), time(0), muhui::Thread::GetName()))).getss()
+                    muhui::GetFiberId(), time(0))).getss()
 
 #define MUHUI_LOG_DEBUG(logger) MUHUI_LOG_LEVEL(logger, muhui::LogLevel::DEBUG)
 #define MUHUI_LOG_INFO(logger) MUHUI_LOG_LEVEL(logger, muhui::LogLevel::INFO)
@@ -45,9 +48,9 @@
 
 #define MUHUI_LOG_FMT_LEVEL(logger, level, fmt, ...) \
     if(logger->getLevel() <= level) \
-        muhui::LogEventWrap(muhui::LogEvent::ptr(new muhui::LogEvent(logger, level, \
+        muhui::LogEventWrap(muhui::LogEvent::Create(logger, level, \
                         __FILE__, __LINE__, 0, muhui::GetThreadId(), \
-                    muhui::GetFiberId(), time(0), muhui::Thread::GetName()))).getEvent()->format(fmt, __VA_ARGS__)
+                    muhui::GetFiberId(), time(0))).getEvent()->format(fmt, __VA_ARGS__)
 
 #define MUHUI_LOG_FMT_DEBUG(logger, fmt, ...) MUHUI_LOG_FMT_LEVEL(logger, muhui::LogLevel::DEBUG, fmt, __VA_ARGS__)
 #define MUHUI_LOG_FMT_INFO(logger, fmt, ...) MUHUI_LOG_FMT_LEVEL(logger, muhui::LogLevel::INFO, fmt, __VA_ARGS__)
@@ -55,12 +58,53 @@
 #define MUHUI_LOG_FMT_ERROR(logger, fmt, ...) MUHUI_LOG_FMT_LEVEL(logger, muhui::LogLevel::ERROR, fmt, __VA_ARGS__)
 #define MUHUI_LOG_FMT_FATAL(logger, fmt, ...) MUHUI_LOG_FMT_LEVEL(logger, muhui::LogLevel::FATAL, fmt, __VA_ARGS__)
 
+/**
+ * @brief 当前调用点的LogLimiter(每个调用点一个静态对象)
+ */
+#define MUHUI_LOG_LIMITER() \
+    ([]() -> muhui::LogLimiter* { \
+        static muhui::LogLimiter s_muhui_log_limiter(__FILE__, __LINE__); \
+        return &s_muhui_log_limiter; \
+    }())
+
+/**
+ * @brief 限流的日志: 每个调用点每interval_ms毫秒最多输出count条, 其余的丢弃并计数
+ * @details 用于可能被高频触发的错误日志, 如accept失败. 丢弃的条数由后台定时器定期汇总输出
+ */
+#define MUHUI_LOG_LIMIT_LEVEL(logger, level, count, interval_ms) \
+    if(logger->getLevel() <= level && MUHUI_LOG_LIMITER()->allow(count, interval_ms)) \
+        muhui::LogEventWrap(muhui::LogEvent::Create(logger, level, \
+                        __FILE__, __LINE__, 0, muhui::GetThreadId(), \
+                    muhui::GetFiberId(), time(0))).getss()
+
+#define MUHUI_LOG_LIMIT_DEBUG(logger, count, interval_ms) MUHUI_LOG_LIMIT_LEVEL(logger, muhui::LogLevel::DEBUG, count, interval_ms)
+#define MUHUI_LOG_LIMIT_INFO(logger, count, interval_ms) MUHUI_LOG_LIMIT_LEVEL(logger, muhui::LogLevel::INFO, count, interval_ms)
+#define MUHUI_LOG_LIMIT_WARN(logger, count, interval_ms) MUHUI_LOG_LIMIT_LEVEL(logger, muhui::LogLevel::WARN, count, interval_ms)
+#define MUHUI_LOG_LIMIT_ERROR(logger, count, interval_ms) MUHUI_LOG_LIMIT_LEVEL(logger, muhui::LogLevel::ERROR, count, interval_ms)
+#define MUHUI_LOG_LIMIT_FATAL(logger, count, interval_ms) MUHUI_LOG_LIMIT_LEVEL(logger, muhui::LogLevel::FATAL, count, interval_ms)
+
+/**
+ * @brief 采样的日志: 每次以1/n的概率输出, 其余的丢弃并计数
+ */
+#define MUHUI_LOG_SAMPLE_LEVEL(logger, level, n) \
+    if(logger->getLevel() <= level && MUHUI_LOG_LIMITER()->sample(n)) \
+        muhui::LogEventWrap(muhui::LogEvent::Create(logger, level, \
+                        __FILE__, __LINE__, 0, muhui::GetThreadId(), \
+                    muhui::GetFiberId(), time(0))).getss()
+
+#define MUHUI_LOG_SAMPLE_DEBUG(logger, n) MUHUI_LOG_SAMPLE_LEVEL(logger, muhui::LogLevel::DEBUG, n)
+#define MUHUI_LOG_SAMPLE_INFO(logger, n) MUHUI_LOG_SAMPLE_LEVEL(logger, muhui::LogLevel::INFO, n)
+#define MUHUI_LOG_SAMPLE_WARN(logger, n) MUHUI_LOG_SAMPLE_LEVEL(logger, muhui::LogLevel::WARN, n)
+#define MUHUI_LOG_SAMPLE_ERROR(logger, n) MUHUI_LOG_SAMPLE_LEVEL(logger, muhui::LogLevel::ERROR, n)
+#define MUHUI_LOG_SAMPLE_FATAL(logger, n) MUHUI_LOG_SAMPLE_LEVEL(logger, muhui::LogLevel::FATAL, n)
+
 #define MUHUI_LOG_ROOT() muhui::LoggerMgr::GetInstance()->getRoot()
 #define MUHUI_LOG_NAME(name) muhui::LoggerMgr::GetInstance()->getLogger(name)
 namespace muhui
 {
 class Logger;
 class LoggerManager;
+class BinLogFormat;
 //日志级别
 class LogLevel
 {
@@ -80,6 +124,50 @@ public:
 };
 
 
+/**
+ * @brief 日志流缓冲区
+ * @details 先写入对象内的定长数组, 写满后转到堆上的std::string, 
+ *          reset后重新使用定长数组, 堆上的空间保留给下次使用
+ */
+class LogStreamBuf : public std::streambuf
+{
+public:
+    enum {
+        //定长数组大小
+        INLINE_SIZE = 512
+    };
+    LogStreamBuf() { reset(); }
+    void reset();
+    const char* data() const { return pbase(); }
+    size_t size() const { return pptr() - pbase(); }
+protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char* s, std::streamsize n) override;
+private:
+    //扩容到至少能再写入n字节
+    void grow(size_t n);
+private:
+    char m_inline[INLINE_SIZE];
+    std::string m_heap;
+    bool m_onHeap;
+};
+
+/**
+ * @brief 写入LogStreamBuf的输出流, 替代std::stringstream, 重复使用时不分配内存
+ */
+class LogStream : public std::ostream
+{
+public:
+    LogStream() : std::ostream(nullptr) { rdbuf(&m_buf); }
+    //清空内容和流状态
+    void reset() { m_buf.reset(); clear(); }
+    const char* data() const { return m_buf.data(); }
+    size_t size() const { return m_buf.size(); }
+    std::string str() const { return std::string(data(), size()); }
+private:
+    LogStreamBuf m_buf;
+};
+
 //日志事件
 class LogEvent{
 public:
@@ -89,6 +177,15 @@ public:
             uint32_t thread_id, uint32_t fiber_id, uint64_t time,
             const std::string& thread_name);
 
+    /**
+     * @brief 获取日志事件, 优先复用当前线程缓存的事件对象
+     * @details 缓存的事件没有被其它地方引用时(引用计数为1)重置后返回, 
+     *          否则(如输出日志内容时又写日志)新建一个
+     */
+    static LogEvent::ptr Create(const std::shared_ptr<Logger>& logger, LogLevel::Level level,
+                                const char* file, int32_t line, uint32_t elapse,
+                                uint32_t thread_id, uint32_t fiber_id, uint64_t time);
+
     const char* getFilename() const { return m_filename; }
     
     int32_t getLine() const { return m_line; }
@@ -97,7 +194,7 @@ public:
     
     int32_t getThreadId() const { return m_threadId; }
 
-    std::string getThreadName() { return m_threadName; }
+    const std::string& getThreadName() const { return m_threadName; }
 
     int32_t getFiberId() const { return m_fiberId; }
 
@@ -105,9 +202,9 @@ public:
 
     std::string getContent() const { return m_ss.str(); }
 
-    std::stringstream& getSS() { return m_ss; }
+    LogStream& getSS() { return m_ss; }
 
-    std::shared_ptr<Logger> getLogger() const { return m_logger; }
+    const std::shared_ptr<Logger>& getLogger() const { return m_logger; }
 
     LogLevel::Level getLevel() const { return m_level; }
 
@@ -116,6 +213,11 @@ public:
 
     //格式化写入日志内容
     void format(const char* fmt, va_list al);
+private:
+    //重置为新的日志事件, 保留已分配的空间
+    void reset(const std::shared_ptr<Logger>& logger, LogLevel::Level level,
+               const char* file, int32_t line, uint32_t elapse,
+               uint32_t thread_id, uint32_t fiber_id, uint64_t time);
 private:
     const char* m_filename = nullptr; //文件名
     int32_t m_line = 0;           //行号
@@ -124,7 +226,7 @@ private:
     std::string m_threadName;    //线程名
     int32_t m_fiberId = 0;        //协程id
     int64_t m_time = 0;           //时间戳
-    std::stringstream m_ss;       //日志内容流
+    LogStream m_ss;               //日志内容流
     std::shared_ptr<Logger> m_logger;  //日志器
     LogLevel::Level m_level;
 
@@ -136,18 +238,65 @@ public:
     LogEventWrap(LogEvent::ptr e);
     ~LogEventWrap();
     LogEvent::ptr getEvent() const { return m_event; }
-    std::stringstream& getss();
+    LogStream& getss();
 private:
     LogEvent::ptr m_event;
 };
+/**
+ * @brief 调用点的日志限流/采样计数(MUHUI_LOG_LIMIT_*, MUHUI_LOG_SAMPLE_*)
+ * @details 对象是调用点的静态变量, 构造时注册, 不析构. 计数都是原子变量, 不加锁.
+ *          后台定时器每log.limit_report_interval毫秒把各调用点丢弃的条数汇总为一行,
+ *          输出到system日志
+ */
+class LogLimiter
+{
+public:
+    LogLimiter(const char* file, int32_t line);
+
+    /**
+     * @brief 是否输出: 每interval_ms毫秒最多count条
+     */
+    bool allow(uint64_t count, uint64_t interval_ms);
+
+    /**
+     * @brief 是否输出: 概率为1/n, n<=1时总是输出
+     */
+    bool sample(uint32_t n);
+
+    const char* getFile() const { return m_file; }
+    int32_t getLine() const { return m_line; }
+    //累计丢弃的条数
+    uint64_t getSuppressed() const { return m_suppressed; }
+
+    /**
+     * @brief 输出各调用点上次汇总以来丢弃的条数, 没有丢弃时不输出
+     * @return 输出的汇总行, 没有丢弃时为空
+     */
+    static std::string Report();
+private:
+    const char* m_file;
+    int32_t m_line;
+    //当前时间窗口的开始时间(毫秒)和窗口内的条数
+    std::atomic<uint64_t> m_windowStart;
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_suppressed;
+    //上次汇总时的m_suppressed
+    uint64_t m_reported;
+};
+
 //日志格式器
 class LogFormatter
 {
 public:
     typedef std::shared_ptr<LogFormatter> ptr;
     LogFormatter(const std::string& pattern);
-    std::string format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
-    std::ostream& format(std::ostream& ofs, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
+    std::string format(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event);
+    std::ostream& format(std::ostream& ofs, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event);
+    /**
+     * @brief 格式化到当前线程复用的LogStream, 不分配内存
+     * @return 当前线程的LogStream, 本线程下一次调用前有效
+     */
+    LogStream& formatLocal(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event);
     void init();
     const std::string getPattern() const { return m_pattern; }
 public:
@@ -157,7 +306,7 @@ public:
         typedef std::shared_ptr<FormatItem> ptr;
         //防止对子类的析构
         virtual ~FormatItem(){}
-        virtual void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) = 0;
+        virtual void format(std::ostream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) = 0;
     };
 
     bool isError() { return m_error; }
@@ -177,7 +326,17 @@ public:
     typedef Spinlock MutexType;
     typedef std::shared_ptr<LogAppender> ptr;
     virtual ~LogAppender() {};
-    virtual void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) = 0;
+    virtual void log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) = 0;
+
+    /**
+     * @brief 写二进制日志(MUHUI_BINLOG_*)
+     * @details 默认按格式转成文本后调用log, BinLogAppender直接写入记录
+     * @param[in] format 格式描述
+     * @param[in] data binlog::LOG记录
+     * @param[in] len 记录长度
+     */
+    virtual void logBinary(const std::shared_ptr<Logger>& logger, const BinLogFormat& format
+                           , const char* data, size_t len);
 
     virtual std::string toYamlString() = 0;
 
@@ -193,19 +352,35 @@ protected:
     bool m_hasFormatter = false;
 };
 //日志器
+/**
+ * @brief 日志器
+ * @details 写日志的路径不加锁: Appender集合是不可修改的快照, 修改时拷贝一份新的原子替换,
+ *          通过Rcu等待正在使用旧快照的线程退出后再释放
+ */
 class Logger : public std::enable_shared_from_this<Logger>
 {
 friend class LoggerManager;
 public:
-    typedef Spinlock MutexType;
+    typedef Mutex MutexType;
     typedef std::shared_ptr<Logger> ptr;
+    typedef std::vector<LogAppender::ptr> AppenderList;
     Logger(const std::string& name = "root");
+    ~Logger();
     /**
     * @brief 写日志
     * @param[in] level 日志级别
-    * @param[in] event 日志事件
+    * @param[in] event 日志事件, 传给Appender的日志器为event->getLogger()
     */
-    void log(LogLevel::Level level, LogEvent::ptr event);
+    void log(LogLevel::Level level, const LogEvent::ptr& event);
+
+    /**
+    * @brief 写二进制日志
+    * @param[in] logger 写日志的日志器(没有Appender时委托给root, 仍传原来的日志器), 传给Appender
+    * @param[in] format 格式描述
+    * @param[in] data 编码后的记录
+    * @param[in] len 记录长度
+    */
+    void logBinary(const Logger::ptr& logger, const BinLogFormat& format, const char* data, size_t len);
 
     void debug(LogEvent::ptr event);                   
     void info(LogEvent::ptr event);                   
@@ -218,8 +393,10 @@ public:
     void delAppender(LogAppender::ptr appender);
     //清空日志输出地
     void clearAppender();
+    //一次替换全部日志输出地, 写日志的线程不会看到中间状态
+    void setAppenders(const AppenderList& appenders);
     //获取日志级别
-    LogLevel::Level getLevel() const {return m_level;}
+    LogLevel::Level getLevel() const {return m_level.load(std::memory_order_relaxed);}
     //设置日志级别
     void setLevel(LogLevel::Level level) {m_level = level;}
 
@@ -236,12 +413,18 @@ public:
     LogFormatter::ptr getFormatter();
 
     std::string toYamlString();
+private:
+    /**
+    * @brief 拷贝当前的Appender集合, 由cb修改后替换, 旧集合在没有线程使用后释放
+    */
+    void updateAppenders(const std::function<void(AppenderList&)>& cb);
 private:
     std::string m_name;                      //日志名称
-    LogLevel::Level m_level;                 //日记级别
-    std::list<LogAppender::ptr> m_appenders; //Append集合
+    std::atomic<LogLevel::Level> m_level;    //日记级别
+    std::atomic<const AppenderList*> m_appenders; //Append集合的快照
     LogFormatter::ptr m_formatter;
     Logger::ptr m_root;
+    //修改Appender集合和格式器时加锁
     MutexType m_mutex;
 };
 
@@ -250,24 +433,317 @@ class StdoutLogAppender : public LogAppender
 {
 public:
     typedef std::shared_ptr<StdoutLogAppender> ptr;
-    void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override;
+    void log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override;
     std::string toYamlString() override;
 };
 
-//定义输出到文件的Appender
+/**
+ * @brief 输出到文件的Appender
+ * @details 日志先写入内存缓冲区, 以下情况写出到文件:
+ *          - 缓冲区满
+ *          - ERROR及以上级别的日志: 唤醒后台定时器线程立即写出
+ *          - 后台定时器每flush_interval毫秒一次
+ *          后台定时器同时检查文件的inode, 文件被删除或被外部工具轮转后重新打开;
+ *          并按大小(max_size)和时间(rotate: hourly/daily)轮转文件,
+ *          旧文件重命名为 文件名.时间后缀. 写日志的线程除写出缓冲区外没有文件相关的系统调用
+ */
 class FileLogAppender : public LogAppender
 {
 public:
     typedef std::shared_ptr<FileLogAppender> ptr;
-    FileLogAppender(const std::string& filename);
-    void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override;
+
+    //按时间轮转
+    enum RotateType {
+        ROTATE_NONE = 0,
+        ROTATE_HOURLY = 1,
+        ROTATE_DAILY = 2
+    };
+
+    static RotateType RotateFromString(const std::string& v);
+    static const char* RotateToString(RotateType v);
+
+    /**
+     * @brief 构造函数
+     * @param[in] filename 文件名
+     * @param[in] buffer_size 缓冲区大小
+     * @param[in] flush_interval 定时写出的间隔(毫秒)
+     * @param[in] max_size 文件超过该大小时轮转, 0不按大小轮转
+     * @param[in] rotate 按时间轮转
+     */
+    FileLogAppender(const std::string& filename, size_t buffer_size = 64 * 1024
+                    , uint64_t flush_interval = 1000, uint64_t max_size = 0
+                    , RotateType rotate = ROTATE_NONE);
+    /**
+     * @brief 析构函数, 写出缓冲区
+     */
+    ~FileLogAppender();
+    void log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override;
     std::string toYamlString() override;
     //重新打开文件
     bool reopen();
+    //写出缓冲区
+    void flush();
+
+    /**
+     * @brief 后台定时器调用: 定时写出或者按请求写出, 检查inode和轮转
+     * @param[in] now_ms 当前时间(毫秒)
+     */
+    void onTimer(uint64_t now_ms);
+
+    const std::string& getFilename() const { return m_filename; }
+    //当前文件大小
+    uint64_t getFileSize() const { return m_fileSize; }
+private:
+    /**
+     * @brief 写出缓冲区, 需要持有m_fileMutex
+     */
+    void flushFile();
+
+    /**
+     * @brief 打开文件, 需要持有m_fileMutex
+     */
+    bool openFile();
+
+    /**
+     * @brief 将当前文件重命名为 文件名.suffix 后打开新文件, 需要持有m_fileMutex
+     */
+    void rotateFile(const std::string& suffix);
+
+    /**
+     * @brief 当前时间所在的轮转周期
+     */
+    std::string getPeriod(time_t now) const;
 private:
     std::string m_filename; //文件名
-    std::ofstream m_filestream; //文件输出流
-    uint64_t m_lastTime = 0;
+    int m_fd;
+    //当前文件的设备号和inode
+    uint64_t m_dev;
+    uint64_t m_ino;
+    std::atomic<uint64_t> m_fileSize;
+    //日志缓冲区, 持有m_mutex访问
+    std::string m_buffer;
+    //正在写出的缓冲区, 持有m_fileMutex访问
+    std::string m_writeBuffer;
+    size_t m_bufferSize;
+    uint64_t m_flushInterval;
+    uint64_t m_maxSize;
+    RotateType m_rotate;
+    //上次定时写出的时间
+    uint64_t m_lastFlush;
+    //有ERROR日志等待定时器线程写出
+    std::atomic<bool> m_flushRequested;
+    //当前轮转周期
+    std::string m_period;
+    //文件操作锁, 保证写出和轮转的顺序
+    Mutex m_fileMutex;
+};
+
+/**
+ * @brief 单生产者单消费者的字节环形缓冲区
+ * @details 容量为2的幂, 读写位置单调递增, 只用原子变量同步, 不加锁.
+ *          一行日志连续存放, 回绕时由peek拆成两段
+ */
+class LogRingBuffer : Noncopyable
+{
+public:
+    typedef std::shared_ptr<LogRingBuffer> ptr;
+    /**
+     * @brief 构造函数
+     * @param[in] capacity 容量, 向上取整为2的幂
+     */
+    LogRingBuffer(size_t capacity);
+    ~LogRingBuffer();
+
+    /**
+     * @brief 写入数据(生产者线程)
+     * @return 剩余空间不足时返回false, 不写入
+     */
+    bool push(const char* data, size_t len);
+
+    /**
+     * @brief 写入放不进缓冲区的整行数据(生产者线程)
+     * @details 缓冲区写空后才能写入, 保证在之前写入的数据之后写出
+     * @return 缓冲区不为空或者上一行还未写出时返回false, 不写入
+     */
+    bool pushLarge(const char* data, size_t len);
+
+    /**
+     * @brief 获取pushLarge写入的数据(消费者线程), 需要在peek之后调用
+     * @return 没有时返回nullptr
+     */
+    const std::string* peekLarge() const;
+
+    /**
+     * @brief 获取全部可读数据(消费者线程), 不移动读位置
+     * @param[out] iov 数据段, 回绕时为两段
+     * @param[out] count 数据段数
+     * @return 可读字节数
+     */
+    size_t peek(struct iovec* iov, int& count);
+
+    /**
+     * @brief 释放已写出的数据(消费者线程)
+     */
+    void consume(size_t len);
+
+    /**
+     * @brief 释放已写出的pushLarge数据(消费者线程)
+     */
+    void consumeLarge();
+
+    bool empty() const { return !m_hasLarge.load(std::memory_order_acquire)
+                            && m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire); }
+    size_t getCapacity() const { return m_mask + 1; }
+
+    /**
+     * @brief 生产者线程退出或消费者不再读取
+     */
+    void close() { m_closed = true; }
+    bool isClosed() const { return m_closed; }
+private:
+    char* m_data;
+    size_t m_mask;
+    //读写位置分开放在不同的缓存行, 避免伪共享
+    char m_pad0[64];
+    //写位置, 生产者修改
+    std::atomic<uint64_t> m_head;
+    //生产者缓存的读位置, 空间足够时不读取m_tail
+    uint64_t m_cachedTail;
+    char m_pad1[64];
+    //读位置, 消费者修改
+    std::atomic<uint64_t> m_tail;
+    char m_pad2[64];
+    std::atomic<bool> m_closed;
+    //pushLarge写入的数据, m_hasLarge为true时归消费者
+    std::string m_large;
+    std::atomic<bool> m_hasLarge;
+};
+
+/**
+ * @brief 异步写文件的Appender
+ * @details 调用线程格式化日志后写入本线程的LogRingBuffer(每个线程每个Appender一个), 
+ *          后台线程收集所有缓冲区的数据, 用writev批量写入文件, 不在调用线程做文件IO.
+ *          同一线程的日志保持顺序, 不同线程之间不保证顺序.
+ *          超过缓冲区一半大小的日志等本线程的缓冲区写空后整行交给后台线程写出, 
+ *          期间按OverflowPolicy等待或者丢弃.
+ *          缓冲区满时的处理方式见OverflowPolicy
+ */
+class AsyncLogAppender : public LogAppender
+{
+public:
+    typedef std::shared_ptr<AsyncLogAppender> ptr;
+
+    //缓冲区满时的处理方式
+    enum OverflowPolicy {
+        //等待后台线程写出
+        BLOCK = 0,
+        //丢弃
+        DROP = 1,
+        //丢弃并计数, 后台线程写出丢弃的行数
+        DROP_COUNT = 2
+    };
+
+    static OverflowPolicy OverflowFromString(const std::string& v);
+    static const char* OverflowToString(OverflowPolicy v);
+
+    /**
+     * @brief 构造函数, 打开文件并启动后台线程
+     * @param[in] filename 文件名
+     * @param[in] buffer_size 每个线程的缓冲区大小
+     * @param[in] overflow 缓冲区满时的处理方式
+     */
+    AsyncLogAppender(const std::string& filename, size_t buffer_size = 1024 * 1024
+                     , OverflowPolicy overflow = BLOCK);
+    /**
+     * @brief 析构函数, 写出缓冲区中剩余的日志后停止后台线程
+     */
+    ~AsyncLogAppender();
+
+    void log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override;
+    std::string toYamlString() override;
+
+    /**
+     * @brief 等待已写入缓冲区的日志全部写出
+     */
+    void flush();
+
+    const std::string& getFilename() const { return m_filename; }
+    size_t getBufferSize() const { return m_bufferSize; }
+    OverflowPolicy getOverflow() const { return m_overflow; }
+    //丢弃的行数
+    uint64_t getDropped() const { return m_dropped; }
+    //writev次数
+    uint64_t getWrites() const { return m_writes; }
+protected:
+    /**
+     * @brief 构造函数, start为false时由子类构造完成后调用start
+     */
+    AsyncLogAppender(const std::string& filename, size_t buffer_size
+                     , OverflowPolicy overflow, bool start);
+
+    /**
+     * @brief 启动后台线程
+     */
+    void start();
+
+    /**
+     * @brief 写出缓冲区中剩余的数据后停止后台线程, 子类析构时需要先调用
+     */
+    void stop();
+
+    /**
+     * @brief 写入当前线程的缓冲区, 缓冲区满时按OverflowPolicy处理
+     * @return 是否写入, 丢弃时返回false
+     */
+    bool push(const char* data, size_t len);
+
+    /**
+     * @brief 后台线程每次写出前调用, 在后台线程中执行
+     * @param[out] head 写在本批数据之前的内容
+     * @param[in] dropped 上次调用以来丢弃的行数(DROP_COUNT)
+     */
+    virtual void onWrite(std::string& head, uint64_t dropped);
+private:
+    /**
+     * @brief 获取当前线程的缓冲区, 没有则创建
+     */
+    LogRingBuffer* getRing();
+
+    /**
+     * @brief 唤醒休眠的后台线程
+     */
+    void wakeup();
+
+    /**
+     * @brief 后台线程
+     */
+    void run();
+
+    /**
+     * @brief 写出全部数据, 处理部分写入
+     */
+    void writeAll(struct iovec* iov, int count);
+private:
+    std::string m_filename;
+    int m_fd;
+    size_t m_bufferSize;
+    OverflowPolicy m_overflow;
+    //唯一ID, 线程缓存中区分Appender
+    uint64_t m_id;
+    //所有线程的缓冲区
+    Mutex m_ringMutex;
+    std::vector<LogRingBuffer::ptr> m_rings;
+    //m_rings变化时加一, 后台线程据此更新快照
+    std::atomic<uint64_t> m_ringVersion;
+    std::atomic<bool> m_stop;
+    //后台线程是否在休眠
+    std::atomic<bool> m_sleeping;
+    Semaphore m_sem;
+    std::atomic<uint64_t> m_dropped;
+    //已写出丢弃计数的行数
+    std::atomic<uint64_t> m_droppedReported;
+    std::atomic<uint64_t> m_writes;
+    Thread::ptr m_thread;
 };
 
 //日志管理
@@ -1,7 +1,84 @@
 #include "mutex.h"
+#include "iomanager.h"
+#include "macro.h"
+#include "scheduler.h"
 
 namespace muhui {
 
+thread_local Rcu::Slot* Rcu::t_slot = nullptr;
+thread_local Rcu::Slot Rcu::t_exitedSlot;
+std::atomic<uint64_t> Rcu::s_epoch(1);
+
+struct Rcu::Registry {
+    Mutex mutex;
+    std::vector<Slot*> slots;
+};
+
+struct Rcu::SlotReleaser {
+    ~SlotReleaser() {
+        Slot* slot = t_slot;
+        //之后其它thread_local析构时还可能打日志, 不能再分配槽(不会有人释放),
+        //改用不登记的槽, 视为始终不在临界区内
+        t_exitedSlot.epoch.store(0, std::memory_order_relaxed);
+        t_exitedSlot.depth = 0;
+        t_exitedSlot.used = true;
+        t_slot = &t_exitedSlot;
+        if(slot) {
+            Registry& r = GetRegistry();
+            Mutex::Lock lock(r.mutex);
+            slot->used = false;
+        }
+    }
+};
+
+Rcu::Registry& Rcu::GetRegistry() {
+    //不析构, 其它静态对象析构时可能还在使用
+    static Registry* s_registry = new Registry;
+    return *s_registry;
+}
+
+Rcu::Slot* Rcu::GetSlot() {
+    static thread_local SlotReleaser s_releaser;
+    (void)s_releaser;
+    Registry& r = GetRegistry();
+    Mutex::Lock lock(r.mutex);
+    Slot* slot = nullptr;
+    for(auto i : r.slots) {
+        if(!i->used) {
+            slot = i;
+            break;
+        }
+    }
+    if(!slot) {
+        slot = new Slot;
+        slot->epoch = 0;
+        r.slots.push_back(slot);
+    }
+    slot->depth = 0;
+    slot->used = true;
+    t_slot = slot;
+    return slot;
+}
+
+void Rcu::Synchronize() {
+    MUHUI_ASSERT2(!t_slot || t_slot->depth == 0, "Rcu::Synchronize in read lock");
+    //替换指针在前, 之后进入临界区的读者看到的纪元不小于e, 只会读到新的指针
+    uint64_t e = ++s_epoch;
+    //和ReadLockEnter里的fence配对, 单独的seq_cst写入不能阻止后面的读取提前
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    Registry& r = GetRegistry();
+    Mutex::Lock lock(r.mutex);
+    for(auto i : r.slots) {
+        while(true) {
+            uint64_t v = i->epoch.load(std::memory_order_acquire);
+            if(v == 0 || v >= e) {
+                break;
+            }
+            sched_yield();
+        }
+    }
+}
+
 Semaphore::Semaphore(uint32_t count) {
     if(sem_init(&m_semaphore, 0, count)) {
         throw std::logic_error("sem_init error");
@@ -18,23 +95,42 @@ void Semaphore::wait() {
     }
 }
 
+bool Semaphore::waitFor(uint64_t timeout_ms) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (timeout_ms % 1000) * 1000000;
+    if(ts.tv_nsec >= 1000000000) {
+        ++ts.tv_sec;
+        ts.tv_nsec -= 1000000000;
+    }
+    while(sem_timedwait(&m_semaphore, &ts)) {
+        if(errno == ETIMEDOUT) {
+            return false;
+        }
+        if(errno != EINTR) {
+            throw std::logic_error("sem_timedwait error");
+        }
+    }
+    return true;
+}
+
 void Semaphore::notify() {
     if(sem_post(&m_semaphore)) {
         throw std::logic_error("sem_post error");
     }
 }
 
-#if 0
 FiberSemaphore::FiberSemaphore(size_t initial_concurrency)
     :m_concurrency(initial_concurrency) {
 }
 
 FiberSemaphore::~FiberSemaphore() {
-    SYLAR_ASSERT(m_waiters.empty());
+    MUHUI_ASSERT(m_waiters.empty());
 }
 
 bool FiberSemaphore::tryWait() {
-    SYLAR_ASSERT(Scheduler::GetThis());
+    MUHUI_ASSERT(Scheduler::GetThis());
     {
         MutexType::Lock lock(m_mutex);
         if(m_concurrency > 0u) {
@@ -46,16 +142,57 @@ bool FiberSemaphore::tryWait() {
 }
 
 void FiberSemaphore::wait() {
-    SYLAR_ASSERT(Scheduler::GetThis());
+    MUHUI_ASSERT(Scheduler::GetThis());
     {
         MutexType::Lock lock(m_mutex);
         if(m_concurrency > 0u) {
             --m_concurrency;
             return;
         }
-        m_waiters.push_back(std::make_pair(Scheduler::GetThis(), Fiber::GetThis()));
+        std::shared_ptr<Waiter> w(new Waiter);
+        w->scheduler = Scheduler::GetThis();
+        w->fiber = Fiber::GetThis();
+        m_waiters.push_back(w);
+    }
+    Fiber::YieldToHold();
+}
+
+bool FiberSemaphore::waitFor(uint64_t timeout_ms) {
+    IOManager* iom = IOManager::GetThis();
+    if(!iom || timeout_ms == (uint64_t)-1) {
+        wait();
+        return true;
+    }
+    std::shared_ptr<Waiter> w(new Waiter);
+    {
+        MutexType::Lock lock(m_mutex);
+        if(m_concurrency > 0u) {
+            --m_concurrency;
+            return true;
+        }
+        if(timeout_ms == 0) {
+            return false;
+        }
+        w->scheduler = iom;
+        w->fiber = Fiber::GetThis();
+        m_waiters.push_back(w);
     }
+    //超时与notify在锁内竞争, 只有从队列中取出waiter的一方负责唤醒
+    Timer::ptr timer = iom->addTimer(timeout_ms, [this, w](){
+        MutexType::Lock lock(m_mutex);
+        for(auto it = m_waiters.begin(); it != m_waiters.end(); ++it) {
+            if(*it == w) {
+                m_waiters.erase(it);
+                w->timeout = true;
+                w->scheduler->schedule(w->fiber);
+                return;
+            }
+        }
+    });
     Fiber::YieldToHold();
+    timer->cancel();
+    w->fiber.reset();
+    return !w->timeout;
 }
 
 void FiberSemaphore::notify() {
@@ -63,10 +200,9 @@ void FiberSemaphore::notify() {
     if(!m_waiters.empty()) {
         auto next = m_waiters.front();
         m_waiters.pop_front();
-        next.first->schedule(next.second);
+        next->scheduler->schedule(next->fiber);
     } else {
         ++m_concurrency;
     }
 }
-#endif
 }
@@ -18,6 +18,9 @@
 #include <atomic>
 #include <semaphore.h>
 #include <list>
+#include <type_traits>
+#include <string.h>
+#include <sched.h>
 
 #include "noncopyable.h"
 #include "fiber.h"
@@ -45,6 +48,12 @@ public:
      */
     void wait();
 
+    /**
+     * @brief 获取信号量, 最多等待timeout_ms毫秒
+     * @return 是否获取成功, 超时返回false
+     */
+    bool waitFor(uint64_t timeout_ms);
+
     /**
      * @brief 释放信号量
      */
@@ -431,26 +440,261 @@ private:
     /// 原子状态
     volatile std::atomic_flag m_mutex;
 };
-/* 
+/**
+ * @brief 读侧无锁的RCU(Read-Copy-Update)
+ * @details 读者用ReadLock标记临界区, 只写当前线程的槽, 没有锁也没有共享的引用计数;
+ *          写者原子地替换指针后调用Synchronize, 等待替换之前进入临界区的读者全部退出,
+ *          之后才能释放旧数据. 临界区可以嵌套; 临界区内不能让出协程(可能换到其它线程继续执行),
+ *          也不能调用Synchronize
+ */
+class Rcu : Noncopyable {
+public:
+    /**
+     * @brief 局部读临界区
+     */
+    struct ReadLock : Noncopyable {
+        ReadLock() {
+            Rcu::ReadLockEnter();
+        }
+
+        ~ReadLock() {
+            Rcu::ReadLockLeave();
+        }
+    };
+
+    /**
+     * @brief 进入读临界区
+     */
+    static void ReadLockEnter() {
+        Slot* slot = t_slot ? t_slot : GetSlot();
+        if(slot->depth++ == 0) {
+            slot->epoch.store(s_epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+            //和Synchronize里的fence配对(store->load): 要么写者扫描时看到这个纪元,
+            //要么这里之后读取的指针已经是写者替换后的新指针
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    /**
+     * @brief 退出读临界区
+     */
+    static void ReadLockLeave() {
+        Slot* slot = t_slot;
+        if(--slot->depth == 0) {
+            slot->epoch.store(0, std::memory_order_release);
+        }
+    }
+
+    /**
+     * @brief 等待当前所有读临界区退出
+     */
+    static void Synchronize();
+private:
+    /**
+     * @brief 每个线程一个, 线程退出后留给新线程复用
+     */
+    struct Slot {
+        /// 进入临界区时的全局纪元, 0表示不在临界区内
+        std::atomic<uint64_t> epoch;
+        uint32_t depth;
+        bool used;
+        /// 避免和其它线程的槽共享缓存行
+        char pad[64];
+    };
+
+    /// 所有线程的槽
+    struct Registry;
+    /// 线程退出时释放槽
+    struct SlotReleaser;
+    /// 线程退出(thread_local析构)之后使用的槽, 不在Registry里, 写者不会等待它
+    static thread_local Slot t_exitedSlot;
+
+    static Registry& GetRegistry();
+
+    /**
+     * @brief 获取当前线程的槽, 没有则分配
+     */
+    static Slot* GetSlot();
+private:
+    static thread_local Slot* t_slot;
+    static std::atomic<uint64_t> s_epoch;
+};
+
+/**
+ * @brief LockFreeValue的实现方式
+ * @details 0: 算术/枚举/指针类型, 直接用std::atomic<T>
+ *          1: 其它可平凡复制的类型, 用seqlock
+ *          2: 其它类型, 用Rcu保护的不可变副本
+ */
+template<class T>
+struct LockFreeValueKind {
+    static const int value = (std::is_arithmetic<T>::value || std::is_enum<T>::value
+                                || std::is_pointer<T>::value) ? 0
+                            : std::is_trivially_copyable<T>::value ? 1 : 2;
+};
+
+/**
+ * @brief 读多写少的值, 读取不加锁
+ * @details 写者之间需要外部互斥(例如在写锁内调用store), 读者可以在任意线程并发load
+ */
+template<class T, int Kind = LockFreeValueKind<T>::value>
+class LockFreeValue;
+
+/**
+ * @brief 算术/枚举/指针类型, 读取是一次load
+ */
+template<class T>
+class LockFreeValue<T, 0> : Noncopyable {
+public:
+    LockFreeValue(const T& v)
+        :m_val(v) {
+    }
+
+    T load() const {
+        return m_val.load(std::memory_order_acquire);
+    }
+
+    void store(const T& v) {
+        m_val.store(v, std::memory_order_release);
+    }
+private:
+    std::atomic<T> m_val;
+};
+
+/**
+ * @brief 可平凡复制的类型, seqlock
+ * @details 写者写之前和写之后各把序号加1, 读者读到奇数序号或者前后序号不同时重读
+ */
+template<class T>
+class LockFreeValue<T, 1> : Noncopyable {
+public:
+    LockFreeValue(const T& v)
+        :m_seq(0) {
+        write(v);
+    }
+
+    T load() const {
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type buf;
+        uint64_t words[WORDS];
+        while(true) {
+            uint32_t seq = m_seq.load(std::memory_order_acquire);
+            if(!(seq & 1)) {
+                for(size_t i = 0; i < WORDS; ++i) {
+                    words[i] = m_words[i].load(std::memory_order_relaxed);
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if(m_seq.load(std::memory_order_relaxed) == seq) {
+                    break;
+                }
+            }
+            sched_yield();
+        }
+        memcpy(&buf, words, sizeof(T));
+        return *reinterpret_cast<T*>(&buf);
+    }
+
+    void store(const T& v) {
+        uint32_t seq = m_seq.load(std::memory_order_relaxed);
+        m_seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        write(v);
+        m_seq.store(seq + 2, std::memory_order_release);
+    }
+private:
+    void write(const T& v) {
+        uint64_t words[WORDS] = {0};
+        memcpy(words, &v, sizeof(T));
+        for(size_t i = 0; i < WORDS; ++i) {
+            m_words[i].store(words[i], std::memory_order_relaxed);
+        }
+    }
+private:
+    static const size_t WORDS = (sizeof(T) + 7) / 8;
+    std::atomic<uint32_t> m_seq;
+    std::atomic<uint64_t> m_words[WORDS];
+};
+
+/**
+ * @brief 其它类型(字符串, 容器等), 修改时整体替换副本, 旧副本等读者退出Rcu临界区后释放
+ * @details 读取仍然要复制一份T, 但不加锁, 也不会被写者阻塞
+ */
+template<class T>
+class LockFreeValue<T, 2> : Noncopyable {
+public:
+    LockFreeValue(const T& v)
+        :m_ptr(new T(v)) {
+    }
+
+    ~LockFreeValue() {
+        delete m_ptr.load(std::memory_order_relaxed);
+    }
+
+    T load() const {
+        Rcu::ReadLock lock;
+        return *m_ptr.load(std::memory_order_acquire);
+    }
+
+    void store(const T& v) {
+        T* old = m_ptr.exchange(new T(v), std::memory_order_acq_rel);
+        Rcu::Synchronize();
+        delete old;
+    }
+private:
+    std::atomic<T*> m_ptr;
+};
+
 class Scheduler;
+/**
+ * @brief 协程信号量
+ * @details wait时没有信号量的协程让出执行权, 不阻塞线程, notify后重新调度
+ */
 class FiberSemaphore : Noncopyable {
 public:
     typedef Spinlock MutexType;
 
+    /**
+     * @brief 构造函数
+     * @param[in] initial_concurrency 信号量初始值
+     */
     FiberSemaphore(size_t initial_concurrency = 0);
     ~FiberSemaphore();
 
+    /**
+     * @brief 尝试获取信号量, 不等待
+     */
     bool tryWait();
+
+    /**
+     * @brief 获取信号量, 必须在协程调度器中调用
+     */
     void wait();
+
+    /**
+     * @brief 获取信号量, 最多等待timeout_ms毫秒
+     * @details 需要在IOManager中调用(使用定时器), 不在IOManager中时退化为wait
+     * @return 是否获取成功, 超时返回false
+     */
+    bool waitFor(uint64_t timeout_ms);
+
+    /**
+     * @brief 释放信号量, 有等待的协程时唤醒最早等待的一个
+     */
     void notify();
 
     size_t getConcurrency() const { return m_concurrency;}
     void reset() { m_concurrency = 0;}
 private:
+    /// 等待的协程
+    struct Waiter {
+        Scheduler* scheduler;
+        Fiber::ptr fiber;
+        /// 是否因超时被唤醒
+        bool timeout = false;
+    };
     MutexType m_mutex;
-    std::list<std::pair<Scheduler*, Fiber::ptr> > m_waiters;
+    std::list<std::shared_ptr<Waiter> > m_waiters;
     size_t m_concurrency;
-};*/
+};
 
 }
 
@@ -1,16 +1,23 @@
 #include "socket.h"
 #include "address.h"
+#include "config.h"
 #include "iomanager.h"
 #include "fd_manager.h"
 #include "log.h"
 #include "macro.h"
 #include "hook.h"
 #include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/sendfile.h>
 
 namespace muhui {
 
 static muhui::Logger::ptr g_logger = MUHUI_LOG_NAME("system");
 
+static muhui::ConfigVar<bool>::ptr g_ssl_ktls =
+    muhui::Config::Lookup("ssl.ktls", false, "ssl kernel tls offload after handshake");
+
 Socket::ptr Socket::CreateTCP(muhui::Address::ptr address) {
     Socket::ptr sock(new Socket(address->getFamily(), TCP, 0));
     return sock;
@@ -327,6 +334,80 @@ int Socket::recvFrom(iovec* buffers, size_t length, Address::ptr from, int flags
     return -1;
 }
 
+bool Socket::waitEvent(bool read) {
+    int64_t timeout = read ? getRecvTimeout() : getSendTimeout();
+    IOManager* iom = IOManager::GetThis();
+    if(iom && is_hook_enable()) {
+        IOManager::Event event = read ? IOManager::READ : IOManager::WRITE;
+        std::shared_ptr<int> cancelled(new int(0));
+        std::weak_ptr<int> wcancelled(cancelled);
+        int fd = m_sock;
+        Timer::ptr timer;
+        if(timeout >= 0) {
+            timer = iom->addConditionTimer(timeout, [wcancelled, fd, iom, event](){
+                auto c = wcancelled.lock();
+                if(!c || *c) {
+                    return;
+                }
+                *c = ETIMEDOUT;
+                iom->cancelEvent(fd, event);
+            }, wcancelled);
+        }
+        if(iom->addEvent(fd, event)) {
+            if(timer) {
+                timer->cancel();
+            }
+            return false;
+        }
+        Fiber::YieldToHold();
+        if(timer) {
+            timer->cancel();
+        }
+        if(*cancelled) {
+            errno = *cancelled;
+            return false;
+        }
+        return true;
+    }
+
+    //不在协程里, 阻塞当前线程等待
+    struct pollfd pfd;
+    pfd.fd = m_sock;
+    pfd.events = read ? POLLIN : POLLOUT;
+    pfd.revents = 0;
+    int rt = 0;
+    do {
+        rt = ::poll(&pfd, 1, timeout >= 0 ? (int)timeout : -1);
+    } while(rt < 0 && errno == EINTR);
+    if(rt == 0) {
+        errno = ETIMEDOUT;
+        return false;
+    }
+    return rt > 0;
+}
+
+ssize_t Socket::sendFile(int fd, off_t offset, size_t length) {
+    if(!isConnected()) {
+        return -1;
+    }
+    //sendfile没有hook, socket在系统层面是非阻塞的, EAGAIN时自己等待可写;
+    //用户设置了非阻塞时和hook的send一样直接返回
+    FdCtx::ptr ctx = FdMgr::GetInstance()->get(m_sock);
+    bool user_nonblock = ctx && ctx->getUserNonblock();
+    while(true) {
+        ssize_t rt = ::sendfile(m_sock, fd, &offset, length);
+        if(rt >= 0) {
+            return rt;
+        }
+        if(errno == EINTR) {
+            continue;
+        }
+        if(errno != EAGAIN || user_nonblock || !waitEvent(false)) {
+            return -1;
+        }
+    }
+}
+
 Address::ptr Socket::getRemoteAddress() {
     if(m_remoteAddress) {
         return m_remoteAddress;
@@ -472,15 +553,138 @@ struct _SSLInit {
         SSL_library_init();
         SSL_load_error_strings();
         OpenSSL_add_all_algorithms();
+        //SSL通过write写socket, 对端关闭后再写会触发SIGPIPE
+        signal(SIGPIPE, SIG_IGN);
     }
 };
 
 static _SSLInit s_init;
 
+/// 客户端会话缓存最多保存的会话数
+static const size_t s_ssl_session_cache_size = 1024;
+
+/**
+ * @brief 客户端会话缓存, key为 主机名/对端地址
+ */
+class SSLSessionCache {
+public:
+    typedef Mutex MutexType;
+
+    /**
+     * @brief 保存会话, 接管session的引用
+     */
+    void put(const std::string& key, SSL_SESSION* session) {
+        MutexType::Lock lock(m_mutex);
+        auto it = m_sessions.find(key);
+        if(it != m_sessions.end()) {
+            SSL_SESSION_free(it->second);
+            it->second = session;
+            return;
+        }
+        if(m_sessions.size() >= s_ssl_session_cache_size) {
+            SSL_SESSION_free(m_sessions.begin()->second);
+            m_sessions.erase(m_sessions.begin());
+        }
+        m_sessions[key] = session;
+    }
+
+    /**
+     * @brief 获取会话, 调用者负责SSL_SESSION_free
+     */
+    SSL_SESSION* get(const std::string& key) {
+        MutexType::Lock lock(m_mutex);
+        auto it = m_sessions.find(key);
+        if(it == m_sessions.end()) {
+            return nullptr;
+        }
+        SSL_SESSION_up_ref(it->second);
+        return it->second;
+    }
+
+    void clear() {
+        MutexType::Lock lock(m_mutex);
+        for(auto& i : m_sessions) {
+            SSL_SESSION_free(i.second);
+        }
+        m_sessions.clear();
+    }
+private:
+    MutexType m_mutex;
+    std::map<std::string, SSL_SESSION*> m_sessions;
+};
+
+static SSLSessionCache& GetSessionCache() {
+    //不析构, 其它静态对象析构时可能还有连接在使用
+    static SSLSessionCache* s_cache = new SSLSessionCache;
+    return *s_cache;
+}
+
+}
+
+std::shared_ptr<SSL_CTX> SSLSocket::CreateServerContext(const std::string& cert_file
+                                                        , const std::string& key_file) {
+    std::shared_ptr<SSL_CTX> ctx(SSL_CTX_new(SSLv23_server_method()), SSL_CTX_free);
+    if(!ctx) {
+        MUHUI_LOG_ERROR(g_logger) << "SSL_CTX_new error";
+        return nullptr;
+    }
+    if(SSL_CTX_use_certificate_chain_file(ctx.get(), cert_file.c_str()) != 1) {
+        MUHUI_LOG_ERROR(g_logger) << "SSL_CTX_use_certificate_chain_file("
+            << cert_file << ") error";
+        return nullptr;
+    }
+    if(SSL_CTX_use_PrivateKey_file(ctx.get(), key_file.c_str(), SSL_FILETYPE_PEM) != 1) {
+        MUHUI_LOG_ERROR(g_logger) << "SSL_CTX_use_PrivateKey_file("
+            << key_file << ") error";
+        return nullptr;
+    }
+    if(SSL_CTX_check_private_key(ctx.get()) != 1) {
+        MUHUI_LOG_ERROR(g_logger) << "SSL_CTX_check_private_key cert_file="
+            << cert_file << " key_file=" << key_file;
+        return nullptr;
+    }
+    //会话缓存(TLS1.2 session id)和Session Ticket都按SSL_CTX保存, 共享SSL_CTX的socket之间可以复用
+    static const unsigned char s_session_id_context[] = "muhui";
+    SSL_CTX_set_session_cache_mode(ctx.get(), SSL_SESS_CACHE_SERVER);
+    SSL_CTX_set_session_id_context(ctx.get(), s_session_id_context
+                                   , sizeof(s_session_id_context) - 1);
+    return ctx;
+}
+
+std::shared_ptr<SSL_CTX> SSLSocket::CreateClientContext() {
+    std::shared_ptr<SSL_CTX> ctx(SSL_CTX_new(SSLv23_client_method()), SSL_CTX_free);
+    if(!ctx) {
+        MUHUI_LOG_ERROR(g_logger) << "SSL_CTX_new error";
+        return nullptr;
+    }
+    //TLS1.3的会话在握手之后才收到, 通过回调放入缓存
+    SSL_CTX_set_session_cache_mode(ctx.get()
+            , SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx.get(), &SSLSocket::OnNewSession);
+    return ctx;
+}
+
+std::shared_ptr<SSL_CTX> SSLSocket::GetDefaultClientContext() {
+    static std::shared_ptr<SSL_CTX> s_ctx = CreateClientContext();
+    return s_ctx;
+}
+
+void SSLSocket::ClearSessionCache() {
+    GetSessionCache().clear();
+}
+
+int SSLSocket::OnNewSession(SSL* ssl, SSL_SESSION* session) {
+    SSLSocket* sock = (SSLSocket*)SSL_get_app_data(ssl);
+    if(!sock || sock->m_sessionKey.empty() || !SSL_SESSION_is_resumable(session)) {
+        return 0;
+    }
+    GetSessionCache().put(sock->m_sessionKey, session);
+    return 1;
 }
 
 SSLSocket::SSLSocket(int family, int type, int protocol)
-    :Socket(family, type, protocol) {
+    :Socket(family, type, protocol)
+    ,m_ktls(g_ssl_ktls->getValue()) {
 }
 
 Socket::ptr SSLSocket::accept() {
@@ -492,6 +696,7 @@ Socket::ptr SSLSocket::accept() {
         return nullptr;
     }
     sock->m_ctx = m_ctx;
+    sock->m_ktls = m_ktls;
     if(sock->init(newsock)) {
         return sock;
     }
@@ -503,14 +708,32 @@ bool SSLSocket::bind(const Address::ptr addr) {
 }
 
 bool SSLSocket::connect(const Address::ptr addr, uint64_t timeout_ms) {
-    bool v = Socket::connect(addr, timeout_ms);
-    if(v) {
-        m_ctx.reset(SSL_CTX_new(SSLv23_client_method()), SSL_CTX_free);
-        m_ssl.reset(SSL_new(m_ctx.get()),  SSL_free);
-        SSL_set_fd(m_ssl.get(), m_sock);
-        v = (SSL_connect(m_ssl.get()) == 1);
+    if(!Socket::connect(addr, timeout_ms)) {
+        return false;
     }
-    return v;
+    if(!m_ctx) {
+        m_ctx = GetDefaultClientContext();
+    }
+    m_handshaked = false;
+    m_ssl.reset(SSL_new(m_ctx.get()), SSL_free);
+    SSL_set_fd(m_ssl.get(), m_sock);
+    SSL_set_app_data(m_ssl.get(), this);
+    SSL_set_connect_state(m_ssl.get());
+    enableKtls();
+    if(!m_hostname.empty()) {
+        SSL_set_tlsext_host_name(m_ssl.get(), m_hostname.c_str());
+    }
+    m_sessionKey = m_hostname + "/" + addr->toString();
+    SSL_SESSION* session = GetSessionCache().get(m_sessionKey);
+    if(session) {
+        SSL_set_session(m_ssl.get(), session);
+        SSL_SESSION_free(session);
+    }
+    if(!handshake()) {
+        close();
+        return false;
+    }
+    return true;
 }
 
 bool SSLSocket::listen(int backlog) {
@@ -518,25 +741,112 @@ bool SSLSocket::listen(int backlog) {
 }
 
 bool SSLSocket::close() {
+    if(m_ssl && m_handshaked) {
+        //发送close_notify, 不等待对端回应; TLS1.2没有正常关闭的会话不能复用
+        ERR_clear_error();
+        SSL_shutdown(m_ssl.get());
+    }
+    m_handshaked = false;
+    m_ktlsSend = false;
+    m_ktlsRecv = false;
     return Socket::close();
 }
 
+bool SSLSocket::handshake() {
+    if(m_handshaked) {
+        return true;
+    }
+    if(!m_ssl) {
+        return false;
+    }
+    SSL* ssl = m_ssl.get();
+    if(doIO([ssl](){ return SSL_do_handshake(ssl); }, "SSL_do_handshake") <= 0) {
+        return false;
+    }
+    m_handshaked = true;
+    //OpenSSL在密钥生效时已经尝试过setsockopt(TLS_TX/TLS_RX), 内核不支持时保持用户态加密
+    m_ktlsSend = BIO_get_ktls_send(SSL_get_wbio(ssl));
+    m_ktlsRecv = BIO_get_ktls_recv(SSL_get_rbio(ssl));
+    return true;
+}
+
+void SSLSocket::enableKtls() {
+#ifdef SSL_OP_ENABLE_KTLS
+    if(m_ktls) {
+        SSL_set_options(m_ssl.get(), SSL_OP_ENABLE_KTLS);
+    }
+#endif
+}
+
+bool SSLSocket::isSessionReused() const {
+    return m_ssl && SSL_session_reused(m_ssl.get());
+}
+
+int SSLSocket::doIO(const std::function<int()>& op, const char* name) {
+    while(true) {
+        //错误队列是线程级的, 协程可能换了线程, 每次调用前清空
+        ERR_clear_error();
+        int rt = op();
+        if(rt > 0) {
+            return rt;
+        }
+        int err = SSL_get_error(m_ssl.get(), rt);
+        switch(err) {
+            case SSL_ERROR_WANT_READ:
+                if(!waitEvent(true)) {
+                    return -1;
+                }
+                continue;
+            case SSL_ERROR_WANT_WRITE:
+                if(!waitEvent(false)) {
+                    return -1;
+                }
+                continue;
+            case SSL_ERROR_ZERO_RETURN:
+                return 0;
+            case SSL_ERROR_SYSCALL:
+                //没有错误码时是对端直接关闭了连接
+                if(ERR_peek_error() == 0 && (rt == 0 || errno == 0)) {
+                    return 0;
+                }
+                return -1;
+            default: {
+                char buf[256] = {0};
+                ERR_error_string_n(ERR_get_error(), buf, sizeof(buf));
+                MUHUI_LOG_LIMIT_WARN(g_logger, 10, 1000) << name << " sock=" << m_sock
+                    << " ssl_error=" << err << " " << buf;
+                errno = EPROTO;
+                return -1;
+            }
+        }
+    }
+}
+
 int SSLSocket::send(const void* buffer, size_t length, int flags) {
-    if(m_ssl) {
-        return SSL_write(m_ssl.get(), buffer, length);
+    if(!m_ssl || !handshake()) {
+        return -1;
     }
-    return -1;
+    if(m_ktlsSend) {
+        return Socket::send(buffer, length, flags);
+    }
+    SSL* ssl = m_ssl.get();
+    return doIO([ssl, buffer, length](){
+        return SSL_write(ssl, buffer, length);
+    }, "SSL_write");
 }
 
 int SSLSocket::send(const iovec* buffers, size_t length, int flags) {
-    if(!m_ssl) {
+    if(!m_ssl || !handshake()) {
         return -1;
     }
+    if(m_ktlsSend) {
+        return Socket::send(buffers, length, flags);
+    }
     int total = 0;
     for(size_t i = 0; i < length; ++i) {
-        int tmp = SSL_write(m_ssl.get(), buffers[i].iov_base, buffers[i].iov_len);
+        int tmp = send(buffers[i].iov_base, buffers[i].iov_len, flags);
         if(tmp <= 0) {
-            return tmp;
+            return total ? total : tmp;
         }
         total += tmp;
         if(tmp != (int)buffers[i].iov_len) {
@@ -557,21 +867,24 @@ int SSLSocket::sendTo(const iovec* buffers, size_t length, const Address::ptr to
 }
 
 int SSLSocket::recv(void* buffer, size_t length, int flags) {
-    if(m_ssl) {
-        return SSL_read(m_ssl.get(), buffer, length);
+    if(!m_ssl || !handshake()) {
+        return -1;
     }
-    return -1;
+    SSL* ssl = m_ssl.get();
+    return doIO([ssl, buffer, length](){
+        return SSL_read(ssl, buffer, length);
+    }, "SSL_read");
 }
 
 int SSLSocket::recv(iovec* buffers, size_t length, int flags) {
-    if(!m_ssl) {
+    if(!m_ssl || !handshake()) {
         return -1;
     }
     int total = 0;
     for(size_t i = 0; i < length; ++i) {
-        int tmp = SSL_read(m_ssl.get(), buffers[i].iov_base, buffers[i].iov_len);
+        int tmp = recv(buffers[i].iov_base, buffers[i].iov_len, flags);
         if(tmp <= 0) {
-            return tmp;
+            return total ? total : tmp;
         }
         total += tmp;
         if(tmp != (int)buffers[i].iov_len) {
@@ -581,6 +894,22 @@ int SSLSocket::recv(iovec* buffers, size_t length, int flags) {
     return total;
 }
 
+ssize_t SSLSocket::sendFile(int fd, off_t offset, size_t length) {
+    if(!m_ssl || !handshake()) {
+        return -1;
+    }
+    if(m_ktlsSend) {
+        return Socket::sendFile(fd, offset, length);
+    }
+    //用户态加密, 每次最多读一个TLS记录大小
+    char buf[16 * 1024];
+    ssize_t n = ::pread(fd, buf, std::min(length, sizeof(buf)), offset);
+    if(n <= 0) {
+        return n;
+    }
+    return send(buf, n);
+}
+
 int SSLSocket::recvFrom(void* buffer, size_t length, Address::ptr from, int flags) {
     MUHUI_ASSERT(false);
     return -1;
@@ -593,31 +922,28 @@ int SSLSocket::recvFrom(iovec* buffers, size_t length, Address::ptr from, int fl
 
 bool SSLSocket::init(int sock) {
     bool v = Socket::init(sock);
+    if(v && !m_ctx) {
+        MUHUI_LOG_ERROR(g_logger) << "SSLSocket init without SSL_CTX, call loadCertificates first";
+        return false;
+    }
     if(v) {
+        //握手在第一次读写时进行, 不阻塞accept
+        m_handshaked = false;
         m_ssl.reset(SSL_new(m_ctx.get()),  SSL_free);
         SSL_set_fd(m_ssl.get(), m_sock);
-        v = (SSL_accept(m_ssl.get()) == 1);
+        SSL_set_app_data(m_ssl.get(), this);
+        SSL_set_accept_state(m_ssl.get());
+        enableKtls();
     }
     return v;
 }
 
 bool SSLSocket::loadCertificates(const std::string& cert_file, const std::string& key_file) {
-    m_ctx.reset(SSL_CTX_new(SSLv23_server_method()), SSL_CTX_free);
-    if(SSL_CTX_use_certificate_chain_file(m_ctx.get(), cert_file.c_str()) != 1) {
-        MUHUI_LOG_ERROR(g_logger) << "SSL_CTX_use_certificate_chain_file("
-            << cert_file << ") error";
-        return false;
-    }
-    if(SSL_CTX_use_PrivateKey_file(m_ctx.get(), key_file.c_str(), SSL_FILETYPE_PEM) != 1) {
-        MUHUI_LOG_ERROR(g_logger) << "SSL_CTX_use_PrivateKey_file("
-            << key_file << ") error";
-        return false;
-    }
-    if(SSL_CTX_check_private_key(m_ctx.get()) != 1) {
-        MUHUI_LOG_ERROR(g_logger) << "SSL_CTX_check_private_key cert_file="
-            << cert_file << " key_file=" << key_file;
+    std::shared_ptr<SSL_CTX> ctx = CreateServerContext(cert_file, key_file);
+    if(!ctx) {
         return false;
     }
+    m_ctx = ctx;
     return true;
 }
 
@@ -639,7 +965,14 @@ SSLSocket::ptr SSLSocket::CreateTCPSocket6() {
 std::ostream& SSLSocket::dump(std::ostream& os) const {
     os << "[SSLSocket sock=" << m_sock
        << " is_connected=" << m_isConnected
-       << " family=" << m_family
+       << " handshaked=" << m_handshaked;
+    if(m_handshaked) {
+        os << " version=" << SSL_get_version(m_ssl.get())
+           << " reused=" << SSL_session_reused(m_ssl.get())
+           << " ktls_send=" << m_ktlsSend
+           << " ktls_recv=" << m_ktlsRecv;
+    }
+    os << " family=" << m_family
        << " type=" << m_type
        << " protocol=" << m_protocol;
     if(m_localAddress) {
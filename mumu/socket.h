@@ -10,6 +10,7 @@
 #define __MUHUI_SOCKET_H__
 
 #include <memory>
+#include <functional>
 #include <netinet/tcp.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -288,6 +289,18 @@ public:
      */
     virtual int recvFrom(iovec* buffers, size_t length, Address::ptr from, int flags = 0);
 
+    /**
+     * @brief 用sendfile发送文件内容, 数据不经过用户态
+     * @param[in] fd 文件句柄
+     * @param[in] offset 文件中的起始偏移
+     * @param[in] length 最多发送的长度
+     * @return
+     *      @retval >0 发送成功对应大小的数据
+     *      @retval =0 文件已经结束
+     *      @retval <0 socket出错
+     */
+    virtual ssize_t sendFile(int fd, off_t offset, size_t length);
+
     /**
      * @brief 获取远端地址
      */
@@ -374,6 +387,14 @@ protected:
      * @brief 初始化sock
      */
     virtual bool init(int sock);
+
+    /**
+     * @brief 等待socket可读/可写, 超时时间取接收/发送超时
+     * @details 在IOManager的协程里注册事件后让出协程, 否则用poll等待
+     * @param[in] read 是否等待可读
+     * @return 超时或出错返回false
+     */
+    bool waitEvent(bool read);
 protected:
     /// socket句柄
     int m_sock;
@@ -391,6 +412,15 @@ protected:
     Address::ptr m_remoteAddress;
 };
 
+/**
+ * @brief TLS Socket
+ * @details 握手和读写遇到SSL_ERROR_WANT_READ/WANT_WRITE时, 在IOManager的协程里注册对应的事件后让出,
+ *          不在协程里时用poll等待, 不会占住工作线程. 服务端accept只建立TCP连接, 握手在第一次读写
+ *          (或显式调用handshake)时进行, 慢速客户端不会阻塞accept.
+ *          SSL_CTX在同一个服务器(TcpServer::loadCertificates)或客户端配置之间共享, 服务端开启会话缓存和
+ *          Session Ticket, 客户端按对端缓存会话, 重连时复用会话, 跳过完整握手.
+ *          可选kTLS(setKtls/配置ssl.ktls), 握手后由内核加密, 可以用sendFile发送文件
+ */
 class SSLSocket : public Socket {
 public:
     typedef std::shared_ptr<SSLSocket> ptr;
@@ -399,6 +429,30 @@ public:
     static SSLSocket::ptr CreateTCPSocket();
     static SSLSocket::ptr CreateTCPSocket6();
 
+    /**
+     * @brief 创建服务端SSL_CTX, 开启会话缓存和Session Ticket
+     * @param[in] cert_file 证书链文件(PEM)
+     * @param[in] key_file 私钥文件(PEM)
+     * @return 失败返回nullptr
+     */
+    static std::shared_ptr<SSL_CTX> CreateServerContext(const std::string& cert_file
+                                                        , const std::string& key_file);
+
+    /**
+     * @brief 创建客户端SSL_CTX, 新会话放入客户端会话缓存
+     */
+    static std::shared_ptr<SSL_CTX> CreateClientContext();
+
+    /**
+     * @brief 默认的客户端SSL_CTX, 没有设置SSL_CTX的客户端连接共用
+     */
+    static std::shared_ptr<SSL_CTX> GetDefaultClientContext();
+
+    /**
+     * @brief 清空客户端会话缓存
+     */
+    static void ClearSessionCache();
+
     SSLSocket(int family, int type, int protocol = 0);
     virtual Socket::ptr accept() override;
     virtual bool bind(const Address::ptr addr) override;
@@ -414,13 +468,100 @@ public:
     virtual int recvFrom(void* buffer, size_t length, Address::ptr from, int flags = 0) override;
     virtual int recvFrom(iovec* buffers, size_t length, Address::ptr from, int flags = 0) override;
 
+    /**
+     * @brief 发送文件内容
+     * @details 发送方向已切换到kTLS时直接sendfile, 由内核加密; 否则读到用户态后SSL_write
+     */
+    virtual ssize_t sendFile(int fd, off_t offset, size_t length) override;
+
+    /**
+     * @brief 加载证书, 为本socket单独创建服务端SSL_CTX
+     * @details 多个监听socket应共享同一个SSL_CTX(setContext), 否则Session Ticket不能跨socket复用
+     */
     bool loadCertificates(const std::string& cert_file, const std::string& key_file);
+
+    /**
+     * @brief 设置SSL_CTX, 在connect/accept之前调用
+     */
+    void setContext(std::shared_ptr<SSL_CTX> ctx) { m_ctx = ctx;}
+    std::shared_ptr<SSL_CTX> getContext() const { return m_ctx;}
+
+    /**
+     * @brief 设置SNI主机名, 同时作为客户端会话缓存的key的一部分, 在connect之前调用
+     */
+    void setHostname(const std::string& v) { m_hostname = v;}
+    const std::string& getHostname() const { return m_hostname;}
+
+    /**
+     * @brief 完成握手, 已完成时直接返回
+     * @details 客户端在connect里调用, 服务端在第一次读写时自动调用
+     */
+    bool handshake();
+
+    /**
+     * @brief 是否已完成握手
+     */
+    bool isHandshaked() const { return m_handshaked;}
+
+    /**
+     * @brief 设置是否尝试kTLS, 在connect/accept之前调用, 默认取配置ssl.ktls
+     * @details 开启后握手完成时由OpenSSL把密钥交给内核(TLS_TX/TLS_RX), 之后send/sendFile
+     *          直接走普通socket发送. 内核或OpenSSL不支持时保持用户态加密
+     */
+    void setKtls(bool v) { m_ktls = v;}
+    bool getKtls() const { return m_ktls;}
+
+    /**
+     * @brief 握手后发送方向是否由内核加密
+     */
+    bool isKtlsSend() const { return m_ktlsSend;}
+
+    /**
+     * @brief 握手后接收方向是否由内核解密
+     */
+    bool isKtlsRecv() const { return m_ktlsRecv;}
+
+    /**
+     * @brief 本次握手是否复用了之前的会话
+     */
+    bool isSessionReused() const;
+
     virtual std::ostream& dump(std::ostream& os) const override;
 protected:
     virtual bool init(int sock) override;
+private:
+    /**
+     * @brief 执行SSL操作, 需要读写时等待socket就绪后重试
+     * @param[in] op SSL_read/SSL_write/SSL_do_handshake等, 返回值同SSL_get_error的要求
+     * @param[in] name 操作名称, 用于日志
+     * @return >0 成功, 0 对端关闭, -1 出错
+     */
+    int doIO(const std::function<int()>& op, const char* name);
+
+    /**
+     * @brief 开启了kTLS时, 让OpenSSL在握手完成后把密钥交给内核
+     */
+    void enableKtls();
+
+    /**
+     * @brief 客户端会话缓存的回调, 保存新会话
+     */
+    static int OnNewSession(SSL* ssl, SSL_SESSION* session);
 private:
     std::shared_ptr<SSL_CTX> m_ctx;
     std::shared_ptr<SSL> m_ssl;
+    /// SNI主机名
+    std::string m_hostname;
+    /// 客户端会话缓存的key
+    std::string m_sessionKey;
+    /// 是否完成握手
+    bool m_handshaked = false;
+    /// 是否尝试kTLS
+    bool m_ktls;
+    /// 发送方向是否已切换到kTLS
+    bool m_ktlsSend = false;
+    /// 接收方向是否已切换到kTLS
+    bool m_ktlsRecv = false;
 };
 
 /**
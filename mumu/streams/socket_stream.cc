@@ -100,6 +100,47 @@ int SocketStream::write(ByteArray::ptr ba, size_t length) {
 
 }
 
+/**
+    * @brief 聚集写全部数据
+    * @details 只有发生部分发送时才拷贝iovec数组, 常见情况下没有额外开销
+    */
+int SocketStream::writeFixSize(const iovec* buffers, size_t count) {
+    if(!isConnected()) {
+        return -1;
+    }
+    size_t total = 0;
+    for(size_t i = 0; i < count; ++i) {
+        total += buffers[i].iov_len;
+    }
+    int rt = m_sock->send(buffers, count);
+    if(rt <= 0 || (size_t)rt == total) {
+        return rt;
+    }
+    std::vector<iovec> iovs(buffers, buffers + count);
+    iovec* iov = &iovs[0];
+    size_t left = total;
+    while(true) {
+        left -= rt;
+        if(left == 0) {
+            break;
+        }
+        //跳过已经发送完的内存块, 调整部分发送的内存块
+        size_t n = rt;
+        while(n >= iov->iov_len) {
+            n -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        iov->iov_base = (char*)iov->iov_base + n;
+        iov->iov_len -= n;
+        rt = m_sock->send(iov, count);
+        if(rt <= 0) {
+            return rt;
+        }
+    }
+    return total;
+}
+
 /**
     * @brief 关闭Socket
     */
@@ -80,6 +80,18 @@ public:
      */
     virtual int write(ByteArray::ptr ba, size_t length) override;
 
+    using Stream::writeFixSize;
+    /**
+     * @brief 聚集写, 一次系统调用发送多块内存, 部分发送时继续发送剩余部分
+     * @param[in] buffers 待发送的内存块
+     * @param[in] count 内存块数量
+     * @return
+     *      @retval >0 返回发送的数据总长度
+     *      @retval =0 socket被远端关闭
+     *      @retval <0 socket错误
+     */
+    int writeFixSize(const iovec* buffers, size_t count);
+
     /**
      * @brief 关闭Socket
      */
@@ -0,0 +1,133 @@
+#include "zlib_stream.h"
+#include <algorithm>
+#include <cstring>
+
+namespace muhui {
+
+/// 每次deflate的输出块大小
+static const size_t s_output_block = 16 * 1024;
+
+ZlibStream::ZlibStream()
+    : m_inited(false)
+    , m_finished(false) {
+    memset(&m_zstream, 0, sizeof(m_zstream));
+}
+
+ZlibStream::~ZlibStream() {
+    if(m_inited) {
+        deflateEnd(&m_zstream);
+    }
+}
+
+ZlibStream::ptr ZlibStream::CreateCompress(Type type, int level) {
+    ZlibStream::ptr rt(new ZlibStream);
+    //windowBits: 15 zlib, -15 原始deflate, 15 + 16 gzip
+    int window_bits = 15;
+    if(type == DEFLATE) {
+        window_bits = -15;
+    } else if(type == GZIP) {
+        window_bits = 15 + 16;
+    }
+    if(level < Z_DEFAULT_COMPRESSION || level > Z_BEST_COMPRESSION) {
+        level = Z_DEFAULT_COMPRESSION;
+    }
+    if(deflateInit2(&rt->m_zstream, level, Z_DEFLATED, window_bits
+                    , 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return nullptr;
+    }
+    rt->m_inited = true;
+    return rt;
+}
+
+bool ZlibStream::Compress(Type type, int level, const void* data, size_t length, std::string& out) {
+    ZlibStream::ptr zs = CreateCompress(type, level);
+    if(!zs) {
+        return false;
+    }
+    //一次压缩时预留足够的输出空间, 只需要一次deflate
+    zs->m_result.reserve(deflateBound(&zs->m_zstream, length));
+    if(zs->deflate(data, length, Z_FINISH) < 0) {
+        return false;
+    }
+    zs->m_finished = true;
+    out.swap(zs->m_result);
+    return true;
+}
+
+int ZlibStream::deflate(const void* data, size_t length, int flush) {
+    if(!m_inited || m_finished) {
+        return -1;
+    }
+    m_zstream.next_in = (Bytef*)data;
+    m_zstream.avail_in = length;
+    while(true) {
+        size_t size = m_result.size();
+        size_t avail = std::max<size_t>(s_output_block, m_result.capacity() - size);
+        m_result.resize(size + avail);
+        m_zstream.next_out = (Bytef*)&m_result[size];
+        m_zstream.avail_out = avail;
+        int rt = ::deflate(&m_zstream, flush);
+        m_result.resize(size + avail - m_zstream.avail_out);
+        if(rt == Z_STREAM_ERROR) {
+            return -1;
+        }
+        if(flush == Z_FINISH) {
+            if(rt == Z_STREAM_END) {
+                break;
+            }
+        } else if(m_zstream.avail_out != 0) {
+            //输出空间没有用完, 输入已全部处理
+            break;
+        }
+    }
+    return length;
+}
+
+int ZlibStream::read(void* buffer, size_t length) {
+    size_t n = std::min(length, m_result.size());
+    memcpy(buffer, m_result.c_str(), n);
+    m_result.erase(0, n);
+    return n;
+}
+
+int ZlibStream::read(ByteArray::ptr ba, size_t length) {
+    size_t n = std::min(length, m_result.size());
+    ba->write(m_result.c_str(), n);
+    m_result.erase(0, n);
+    return n;
+}
+
+int ZlibStream::write(const void* buffer, size_t length) {
+    return deflate(buffer, length, Z_NO_FLUSH);
+}
+
+int ZlibStream::write(ByteArray::ptr ba, size_t length) {
+    std::string data(length, '\0');
+    ba->read(&data[0], length);
+    return deflate(data.c_str(), length, Z_NO_FLUSH);
+}
+
+bool ZlibStream::flush() {
+    return deflate(nullptr, 0, Z_SYNC_FLUSH) >= 0;
+}
+
+void ZlibStream::close() {
+    if(m_finished) {
+        return;
+    }
+    deflate(nullptr, 0, Z_FINISH);
+    m_finished = true;
+}
+
+const char* ZlibStream::TypeToEncoding(Type type) {
+    switch(type) {
+        case GZIP:
+            return "gzip";
+        case ZLIB:
+            return "deflate";
+        default:
+            return "";
+    }
+}
+
+} // namespace muhui
@@ -0,0 +1,112 @@
+/**
+ * @file zlib_stream.h
+ * @author muhui (2571579302@qq.com)
+ * @brief zlib压缩流(gzip/deflate)
+ * @version 0.1
+ * @date 2023-02-20
+ */
+#ifndef __MUHUI_STREAMS_ZLIB_STREAM_H__
+#define __MUHUI_STREAMS_ZLIB_STREAM_H__
+#include "stream.h"
+#include <memory>
+#include <string>
+#include <zlib.h>
+
+namespace muhui {
+
+/**
+ * @brief zlib增量压缩流
+ * @details write写入原始数据, 压缩结果追加到内部缓存, 通过getResult/read取出.
+ *          flush让已写入的数据全部输出(可以单独解压), 适合分块发送;
+ *          close结束压缩流, 输出剩余数据和结尾(gzip的crc和长度)
+ */
+class ZlibStream : public Stream {
+public:
+    typedef std::shared_ptr<ZlibStream> ptr;
+
+    /// 压缩格式
+    enum Type {
+        /// zlib格式(HTTP的deflate)
+        ZLIB = 0,
+        /// 原始deflate数据, 没有头尾
+        DEFLATE,
+        /// gzip格式
+        GZIP
+    };
+
+    /**
+     * @brief 创建压缩流
+     * @param[in] type 压缩格式
+     * @param[in] level 压缩级别, -1为zlib默认(6), 0~9
+     * @return 初始化失败返回nullptr
+     */
+    static ZlibStream::ptr CreateCompress(Type type, int level = Z_DEFAULT_COMPRESSION);
+
+    /**
+     * @brief 一次压缩全部数据
+     * @param[out] out 压缩结果
+     * @return 是否成功
+     */
+    static bool Compress(Type type, int level, const void* data, size_t length, std::string& out);
+
+    ~ZlibStream();
+
+    /**
+     * @brief 读取压缩结果
+     * @return 返回读取的长度, 没有数据时返回0
+     */
+    virtual int read(void* buffer, size_t length) override;
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+
+    /**
+     * @brief 压缩数据, 结果追加到内部缓存
+     * @return 成功返回length, 失败返回-1
+     */
+    virtual int write(const void* buffer, size_t length) override;
+    virtual int write(ByteArray::ptr ba, size_t length) override;
+
+    /**
+     * @brief 输出已写入数据的压缩结果(Z_SYNC_FLUSH)
+     * @return 是否成功
+     */
+    bool flush();
+
+    /**
+     * @brief 结束压缩流(Z_FINISH), 之后不能再写入
+     */
+    virtual void close() override;
+
+    /**
+     * @brief 是否已经结束
+     */
+    bool isFinished() const { return m_finished;}
+
+    /**
+     * @brief 返回未取出的压缩结果
+     */
+    std::string& getResult() { return m_result;}
+
+    /**
+     * @brief 返回压缩格式对应的Content-Encoding
+     */
+    static const char* TypeToEncoding(Type type);
+private:
+    ZlibStream();
+
+    /**
+     * @brief 执行deflate, 输出追加到m_result
+     */
+    int deflate(const void* data, size_t length, int flush);
+private:
+    /// zlib状态
+    z_stream m_zstream;
+    /// 压缩结果
+    std::string m_result;
+    /// 是否初始化成功
+    bool m_inited;
+    /// 是否已经结束
+    bool m_finished;
+};
+
+} // namespace muhui
+#endif // !__MUHUI_STREAMS_ZLIB_STREAM_H__
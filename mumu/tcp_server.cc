@@ -45,7 +45,7 @@ bool TcpServer::bind(const std::vector<Address::ptr>& addrs,
                      bool ssl) {
     m_ssl = ssl;
     for (auto& addr : addrs) {
-        Socket::ptr sock = Socket::CreateTCP(addr);
+        Socket::ptr sock = ssl ? SSLSocket::CreateTCP(addr) : Socket::CreateTCP(addr);
         if (!sock->bind(addr)) {
             MUHUI_LOG_ERROR(g_logger)
                 << "bind fail errno=" << errno << " errstr=" << strerror(errno)
@@ -84,7 +84,8 @@ void TcpServer::startAccept(Socket::ptr sock) {
             m_ioWorker->schedule(std::bind(
                 &TcpServer::handleClient, shared_from_this(), client));
         } else {
-            MUHUI_LOG_ERROR(g_logger)
+            //fd耗尽等情况下每次accept都失败, 限流避免日志本身拖垮进程
+            MUHUI_LOG_LIMIT_ERROR(g_logger, 10, 1000)
                 << "accept errno=" << errno << " errstr=" << strerror(errno);
         }
     }
@@ -118,19 +119,19 @@ void TcpServer::handleClient(Socket::ptr client) {
     MUHUI_LOG_INFO(g_logger) << "tcp server virtrul handleClient: " << *client;
 }
 
-#if 0
 bool TcpServer::loadCertificates(const std::string& cert_file, const std::string& key_file) {
+    std::shared_ptr<SSL_CTX> ctx = SSLSocket::CreateServerContext(cert_file, key_file);
+    if(!ctx) {
+        return false;
+    }
     for(auto& i : m_socks) {
         auto ssl_socket = std::dynamic_pointer_cast<SSLSocket>(i);
         if(ssl_socket) {
-            if(!ssl_socket->loadCertificates(cert_file, key_file)) {
-                return false;
-            }
+            ssl_socket->setContext(ctx);
         }
     }
     return true;
 }
-#endif
 
 std::string TcpServer::toString(const std::string& prefix) {
     std::stringstream ss;
@@ -144,8 +144,12 @@ class TcpServer : public std::enable_shared_from_this<TcpServer>, Noncopyable {
                       std::vector<Address::ptr>& fails,
                       bool ssl = false);
 
-    // bool loadCertificates(const std::string& cert_file, const std::string&
-    // key_file);
+    /**
+     * @brief 为ssl监听socket加载证书
+     * @details 所有监听socket共用一个SSL_CTX, 会话缓存和Session Ticket密钥在它们之间共享
+     * @pre 需要bind(ssl = true)成功后执行
+     */
+    bool loadCertificates(const std::string& cert_file, const std::string& key_file);
 
     /**
      * @brief 启动服务
@@ -17,8 +17,23 @@ namespace muhui {
 
 static muhui::Logger::ptr g_logger = MUHUI_LOG_NAME("system");
 
+//线程ID缓存, 0表示未获取; fork后子进程中重新获取
+static thread_local pid_t t_thread_id = 0;
+
+namespace {
+struct _ThreadIdIniter {
+    _ThreadIdIniter() {
+        pthread_atfork(nullptr, nullptr, [](){ t_thread_id = 0; });
+    }
+};
+static _ThreadIdIniter s_thread_id_initer;
+}
+
 pid_t GetThreadId() {
-    return syscall(SYS_gettid);
+    if(!t_thread_id) {
+        t_thread_id = syscall(SYS_gettid);
+    }
+    return t_thread_id;
 }
 
 uint32_t GetFiberId() {
@@ -32,6 +32,7 @@ namespace muhui {
 
 /**
  * @brief 返回当前线程的ID
+ * @details 每个线程第一次调用时获取并缓存
  */
 pid_t GetThreadId();
 
@@ -0,0 +1,65 @@
+#include "arena.h"
+#include "log.h"
+#include "macro.h"
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_ROOT();
+
+void test_alloc() {
+    muhui::Arena::ptr arena(new muhui::Arena(1024));
+    for(int i = 0; i < 100; ++i) {
+        void* p = arena->alloc(i + 1, 16);
+        MUHUI_ASSERT(((uintptr_t)p & 15) == 0);
+        memset(p, i, i + 1);
+    }
+    //大对象单独分配
+    void* big = arena->alloc(64 * 1024);
+    memset(big, 0, 64 * 1024);
+    MUHUI_LOG_INFO(g_logger) << "used=" << arena->getUsed()
+        << " capacity=" << arena->getCapacity();
+    arena->reset();
+    //多个块合并成一个块
+    MUHUI_LOG_INFO(g_logger) << "after reset used=" << arena->getUsed()
+        << " capacity=" << arena->getCapacity();
+    MUHUI_ASSERT(arena->getUsed() == 0);
+    MUHUI_ASSERT(arena->getCapacity() < 64 * 1024);
+}
+
+void test_allocator() {
+    muhui::Arena::ptr arena(new muhui::Arena);
+    {
+        typedef std::basic_string<char, std::char_traits<char>
+                    , muhui::ArenaAllocator<char> > String;
+        std::vector<String, muhui::ArenaAllocator<String> > vec(
+                    (muhui::ArenaAllocator<String>(arena)));
+        for(int i = 0; i < 100; ++i) {
+            vec.push_back(String(std::string(i, 'a').c_str()
+                        , muhui::ArenaAllocator<char>(arena)));
+        }
+        for(int i = 0; i < 100; ++i) {
+            MUHUI_ASSERT(vec[i].size() == (size_t)i);
+        }
+        MUHUI_ASSERT(arena.use_count() > 1);
+    }
+    MUHUI_ASSERT(arena.use_count() == 1);
+    MUHUI_LOG_INFO(g_logger) << "used=" << arena->getUsed()
+        << " capacity=" << arena->getCapacity();
+    arena->reset();
+
+    //arena为空时使用堆内存
+    std::map<int, int, std::less<int>
+        , muhui::ArenaAllocator<std::pair<const int, int> > > m;
+    for(int i = 0; i < 100; ++i) {
+        m[i] = i;
+    }
+    MUHUI_ASSERT(m.size() == 100);
+}
+
+int main(int argc, char** argv) {
+    test_alloc();
+    test_allocator();
+    return 0;
+}
@@ -0,0 +1,211 @@
+/**
+ * @file test_async_log.cc
+ * @brief AsyncLogAppender测试: 多线程写入, 缓冲区满的处理方式, YAML配置
+ */
+#include "config.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+#include <fstream>
+#include <unistd.h>
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_ROOT();
+
+static const int s_threads = 8;
+static const int s_lines = 20000;
+
+/**
+ * @brief 读取文件的所有行
+ */
+static std::vector<std::string> ReadLines(const std::string& file) {
+    std::vector<std::string> lines;
+    std::ifstream ifs(file);
+    std::string line;
+    while(std::getline(ifs, line)) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+/**
+ * @brief 多个线程同时写日志, 检查行数和每个线程内的顺序
+ */
+static uint64_t WriteLines(muhui::Logger::ptr logger, int threads, int lines) {
+    uint64_t begin = muhui::GetCurrentUS();
+    std::vector<muhui::Thread::ptr> thrs;
+    for(int t = 0; t < threads; ++t) {
+        thrs.push_back(muhui::Thread::ptr(new muhui::Thread([logger, t, lines](){
+            for(int i = 0; i < lines; ++i) {
+                MUHUI_LOG_INFO(logger) << "thread " << t << " line " << i;
+            }
+        }, "w_" + std::to_string(t))));
+    }
+    for(auto& i : thrs) {
+        i->join();
+    }
+    return muhui::GetCurrentUS() - begin;
+}
+
+static void test_order() {
+    std::string file = "/tmp/test_async_log.log";
+    ::unlink(file.c_str());
+    muhui::Logger::ptr logger = MUHUI_LOG_NAME("async_order");
+    muhui::AsyncLogAppender::ptr ap(new muhui::AsyncLogAppender(file, 64 * 1024));
+    logger->setFormatter("%t %m%n");
+    logger->addAppender(ap);
+
+    uint64_t us = WriteLines(logger, s_threads, s_lines);
+    ap->flush();
+    std::vector<std::string> lines = ReadLines(file);
+    MUHUI_LOG_INFO(g_logger) << "async: " << lines.size() << " lines " << us << "us"
+                             << " writev=" << ap->getWrites();
+    MUHUI_ASSERT(lines.size() == (size_t)s_threads * s_lines);
+    MUHUI_ASSERT(ap->getWrites() < lines.size());
+
+    std::vector<int> next(s_threads, 0);
+    for(auto& i : lines) {
+        int t = -1, n = -1;
+        MUHUI_ASSERT(sscanf(i.c_str(), "%*d thread %d line %d", &t, &n) == 2);
+        MUHUI_ASSERT(t >= 0 && t < s_threads);
+        MUHUI_ASSERT(next[t] == n);
+        ++next[t];
+    }
+    logger->clearAppender();
+
+    //同样的负载用FileLogAppender对比
+    std::string sync_file = "/tmp/test_async_log_sync.log";
+    ::unlink(sync_file.c_str());
+    logger->addAppender(muhui::LogAppender::ptr(new muhui::FileLogAppender(sync_file)));
+    us = WriteLines(logger, s_threads, s_lines);
+    MUHUI_LOG_INFO(g_logger) << "file: " << s_threads * s_lines << " lines " << us << "us";
+    logger->clearAppender();
+}
+
+static void test_overflow(muhui::AsyncLogAppender::OverflowPolicy overflow) {
+    std::string file = "/tmp/test_async_log_overflow.log";
+    ::unlink(file.c_str());
+    muhui::Logger::ptr logger = MUHUI_LOG_NAME("async_overflow");
+    muhui::AsyncLogAppender::ptr ap(new muhui::AsyncLogAppender(file, 4096, overflow));
+    logger->setFormatter("%m%n");
+    logger->addAppender(ap);
+
+    //单线程连续写, 缓冲区很小, 后台线程来不及写出
+    std::string msg(200, 'x');
+    for(int i = 0; i < s_lines; ++i) {
+        MUHUI_LOG_INFO(logger) << msg;
+    }
+    ap->flush();
+    std::vector<std::string> lines = ReadLines(file);
+    size_t written = 0, reported = 0;
+    for(auto& i : lines) {
+        unsigned long n = 0;
+        if(sscanf(i.c_str(), "AsyncLogAppender dropped %lu", &n) == 1) {
+            reported += n;
+        } else {
+            MUHUI_ASSERT(i == msg);
+            ++written;
+        }
+    }
+    MUHUI_LOG_INFO(g_logger) << "overflow=" << muhui::AsyncLogAppender::OverflowToString(overflow)
+                             << " written=" << written << " dropped=" << ap->getDropped()
+                             << " reported=" << reported;
+    MUHUI_ASSERT(written + ap->getDropped() == (size_t)s_lines);
+    if(overflow == muhui::AsyncLogAppender::BLOCK) {
+        MUHUI_ASSERT(ap->getDropped() == 0);
+    } else if(overflow == muhui::AsyncLogAppender::DROP) {
+        MUHUI_ASSERT(reported == 0);
+    } else {
+        MUHUI_ASSERT(reported == ap->getDropped());
+    }
+    logger->clearAppender();
+}
+
+/**
+ * @brief 超过缓冲区一半大小的行和普通行交替写入, 检查整行写出并且线程内保持顺序
+ */
+static void test_large_line() {
+    std::string file = "/tmp/test_async_log_large.log";
+    ::unlink(file.c_str());
+    muhui::Logger::ptr logger = MUHUI_LOG_NAME("async_large");
+    muhui::AsyncLogAppender::ptr ap(new muhui::AsyncLogAppender(file, 4096));
+    logger->setFormatter("%m%n");
+    logger->addAppender(ap);
+
+    const int threads = 4;
+    const int lines = 500;
+    std::vector<muhui::Thread::ptr> thrs;
+    for(int t = 0; t < threads; ++t) {
+        thrs.push_back(muhui::Thread::ptr(new muhui::Thread([logger, t, lines](){
+            for(int i = 0; i < lines; ++i) {
+                if(i % 10 == 0) {
+                    MUHUI_LOG_INFO(logger) << "thread " << t << " line " << i << " "
+                                           << std::string(3000 + i, 'x');
+                } else {
+                    MUHUI_LOG_INFO(logger) << "thread " << t << " line " << i;
+                }
+            }
+        }, "w_" + std::to_string(t))));
+    }
+    for(auto& i : thrs) {
+        i->join();
+    }
+    ap->flush();
+    std::vector<std::string> result = ReadLines(file);
+    MUHUI_ASSERT(result.size() == (size_t)threads * lines);
+    std::vector<int> next(threads, 0);
+    for(auto& i : result) {
+        int t = -1, n = -1;
+        MUHUI_ASSERT(sscanf(i.c_str(), "thread %d line %d", &t, &n) == 2);
+        MUHUI_ASSERT(t >= 0 && t < threads);
+        MUHUI_ASSERT(next[t] == n);
+        if(n % 10 == 0) {
+            MUHUI_ASSERT(i.size() > (size_t)(3000 + n));
+            MUHUI_ASSERT(i.find_first_not_of('x', i.size() - 3000 - n) == std::string::npos);
+        }
+        ++next[t];
+    }
+    logger->clearAppender();
+}
+
+static void test_config() {
+    std::string file = "/tmp/test_async_log_config.log";
+    ::unlink(file.c_str());
+    YAML::Node root = YAML::Load(
+        "logs:\n"
+        "    - name: async_config\n"
+        "      level: info\n"
+        "      formatter: '%m%n'\n"
+        "      appenders:\n"
+        "          - type: AsyncLogAppender\n"
+        "            file: " + file + "\n"
+        "            buffer_size: 65536\n"
+        "            overflow: drop_count\n");
+    muhui::Config::LoadFromYaml(root);
+    muhui::Logger::ptr logger = MUHUI_LOG_NAME("async_config");
+    std::string yaml = logger->toYamlString();
+    MUHUI_LOG_INFO(g_logger) << yaml;
+    MUHUI_ASSERT(yaml.find("AsyncLogAppender") != std::string::npos);
+    MUHUI_ASSERT(yaml.find("drop_count") != std::string::npos);
+    MUHUI_ASSERT(yaml.find("65536") != std::string::npos);
+
+    MUHUI_LOG_INFO(logger) << "hello async";
+    //重新加载配置时旧的Appender析构, 析构前写出剩余的日志
+    muhui::Config::LoadFromYaml(YAML::Load(
+        "logs:\n"
+        "    - name: async_config\n"
+        "      appenders:\n"
+        "          - type: StdoutLogAppender\n"));
+    std::vector<std::string> lines = ReadLines(file);
+    MUHUI_ASSERT(lines.size() == 1 && lines[0] == "hello async");
+}
+
+int main(int argc, char** argv) {
+    test_order();
+    test_overflow(muhui::AsyncLogAppender::BLOCK);
+    test_overflow(muhui::AsyncLogAppender::DROP);
+    test_overflow(muhui::AsyncLogAppender::DROP_COUNT);
+    test_large_line();
+    test_config();
+    MUHUI_LOG_INFO(g_logger) << "test_async_log ok";
+    return 0;
+}
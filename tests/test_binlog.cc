@@ -0,0 +1,218 @@
+/**
+ * @file test_binlog.cc
+ * @brief 二进制日志测试: 写入后解码, 输出到普通Appender, 多线程, YAML配置, 与文本日志的耗时对比
+ */
+#include "binlog.h"
+#include "config.h"
+#include "macro.h"
+#include "util.h"
+#include <fstream>
+#include <unistd.h>
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_ROOT();
+
+/**
+ * @brief 保存格式化结果的Appender
+ */
+class StringLogAppender : public muhui::LogAppender {
+public:
+    typedef std::shared_ptr<StringLogAppender> ptr;
+    void log(const muhui::Logger::ptr& logger, muhui::LogLevel::Level level, const muhui::LogEvent::ptr& event) override {
+        m_lines.push_back(m_formatter->format(logger, level, event));
+    }
+    std::string toYamlString() override { return "";}
+    std::vector<std::string> m_lines;
+};
+
+/**
+ * @brief 解码文件中的全部日志
+ */
+static std::vector<muhui::binlog::Reader::Line> ReadAll(const std::string& file) {
+    std::vector<muhui::binlog::Reader::Line> lines;
+    std::ifstream ifs(file, std::ios::binary);
+    muhui::binlog::Reader reader(ifs);
+    muhui::binlog::Reader::Line line;
+    while(reader.next(line)) {
+        lines.push_back(line);
+    }
+    if(!reader.getError().empty()) {
+        MUHUI_LOG_ERROR(g_logger) << file << ": " << reader.getError();
+    }
+    MUHUI_ASSERT(reader.getError().empty());
+    return lines;
+}
+
+enum Color {
+    RED = 1,
+    GREEN = 2
+};
+
+static void test_roundtrip() {
+    std::string file = "/tmp/test_binlog.bin";
+    ::unlink(file.c_str());
+    muhui::Logger::ptr logger = MUHUI_LOG_NAME("binlog_roundtrip");
+    muhui::BinLogAppender::ptr ap(new muhui::BinLogAppender(file));
+    logger->addAppender(ap);
+
+    std::string name = "muhui";
+    const char* null_str = nullptr;
+    MUHUI_BINLOG_INFO(logger, "hello binlog");
+    MUHUI_BINLOG_INFO(logger, "user %s login, uid=%d cost=%.3f", name, 42, 1.5);
+    MUHUI_BINLOG_WARN(logger, "%5d|%-5s|%x|%c|%lu|%s", -7, "ab", 255u, 'z', (size_t)123, null_str);
+    MUHUI_BINLOG_ERROR(logger, "color=%d ok=%d 100%%", GREEN, true);
+    MUHUI_BINLOG_DEBUG(logger, "big %s", std::string(10000, 'x'));
+    MUHUI_LOG_INFO(logger) << "text line";
+    //同一调用点多次执行只注册一次格式
+    size_t count = muhui::BinLogFormat::GetCount();
+    for(int i = 0; i < 3; ++i) {
+        MUHUI_BINLOG_INFO(logger, "loop %d", i);
+    }
+    MUHUI_ASSERT(muhui::BinLogFormat::GetCount() == count + 1);
+    ap->flush();
+
+    std::vector<muhui::binlog::Reader::Line> lines = ReadAll(file);
+    for(auto& i : lines) {
+        MUHUI_LOG_INFO(g_logger) << i.toString().substr(0, 120);
+    }
+    MUHUI_ASSERT(lines.size() == 9);
+    MUHUI_ASSERT(lines[0].message == "hello binlog");
+    MUHUI_ASSERT(lines[0].level == muhui::LogLevel::INFO);
+    MUHUI_ASSERT(lines[0].threadId == (uint32_t)muhui::GetThreadId());
+    MUHUI_ASSERT(lines[0].file.find("test_binlog.cc") != std::string::npos);
+    MUHUI_ASSERT(lines[1].message == "user muhui login, uid=42 cost=1.500");
+    MUHUI_ASSERT(lines[2].message == "   -7|ab   |ff|z|123|(null)");
+    MUHUI_ASSERT(lines[2].level == muhui::LogLevel::WARN);
+    MUHUI_ASSERT(lines[3].message == "color=2 ok=1 100%");
+    //记录长度有上限, 长字符串被截断
+    MUHUI_ASSERT(lines[4].message.size() > 4000 && lines[4].message.size() < 4096);
+    MUHUI_ASSERT(lines[5].message == "text line");
+    MUHUI_ASSERT(lines[8].message == "loop 2");
+    uint64_t now = muhui::binlog::GetTimeNs();
+    MUHUI_ASSERT(lines[8].time <= now && now - lines[8].time < 10 * 1000000000ull);
+    logger->clearAppender();
+}
+
+static void test_text_fallback() {
+    muhui::Logger::ptr logger = MUHUI_LOG_NAME("binlog_text");
+    StringLogAppender::ptr ap(new StringLogAppender);
+    logger->setFormatter("%p %l %m");
+    logger->addAppender(ap);
+    int line = __LINE__ + 1;
+    MUHUI_BINLOG_ERROR(logger, "%s=%d %.2f %p", "key", -1, 3.14159, (void*)0x10);
+    MUHUI_ASSERT(ap->m_lines.size() == 1);
+    MUHUI_LOG_INFO(g_logger) << ap->m_lines[0];
+    MUHUI_ASSERT(ap->m_lines[0] == "ERROR " + std::to_string(line) + " key=-1 3.14 0x10");
+
+    //级别过滤
+    logger->setLevel(muhui::LogLevel::WARN);
+    MUHUI_BINLOG_INFO(logger, "filtered %d", 1);
+    MUHUI_ASSERT(ap->m_lines.size() == 1);
+    logger->clearAppender();
+}
+
+static void test_threads() {
+    std::string file = "/tmp/test_binlog_threads.bin";
+    ::unlink(file.c_str());
+    muhui::Logger::ptr logger = MUHUI_LOG_NAME("binlog_threads");
+    muhui::BinLogAppender::ptr ap(new muhui::BinLogAppender(file, 64 * 1024));
+    logger->addAppender(ap);
+
+    int threads = 4, count = 20000;
+    std::vector<muhui::Thread::ptr> thrs;
+    for(int t = 0; t < threads; ++t) {
+        thrs.push_back(muhui::Thread::ptr(new muhui::Thread([logger, t, count](){
+            for(int i = 0; i < count; ++i) {
+                MUHUI_BINLOG_INFO(logger, "thread %d line %d", t, i);
+            }
+        }, "binlog_" + std::to_string(t))));
+    }
+    for(auto& i : thrs) {
+        i->join();
+    }
+    ap->flush();
+
+    std::vector<muhui::binlog::Reader::Line> lines = ReadAll(file);
+    MUHUI_ASSERT(lines.size() == (size_t)threads * count);
+    std::vector<int> next(threads, 0);
+    for(auto& i : lines) {
+        int t = -1, n = -1;
+        MUHUI_ASSERT(sscanf(i.message.c_str(), "thread %d line %d", &t, &n) == 2);
+        MUHUI_ASSERT(t >= 0 && t < threads && next[t] == n);
+        ++next[t];
+    }
+    logger->clearAppender();
+}
+
+static void test_config() {
+    std::string file = "/tmp/test_binlog_config.bin";
+    ::unlink(file.c_str());
+    muhui::Config::LoadFromYaml(YAML::Load(
+        "logs:\n"
+        "    - name: binlog_config\n"
+        "      level: info\n"
+        "      appenders:\n"
+        "          - type: BinLogAppender\n"
+        "            file: " + file + "\n"
+        "            overflow: drop_count\n"));
+    muhui::Logger::ptr logger = MUHUI_LOG_NAME("binlog_config");
+    std::string yaml = logger->toYamlString();
+    MUHUI_LOG_INFO(g_logger) << yaml;
+    MUHUI_ASSERT(yaml.find("BinLogAppender") != std::string::npos);
+    MUHUI_ASSERT(yaml.find("drop_count") != std::string::npos);
+
+    MUHUI_BINLOG_INFO(logger, "hello %s", "config");
+    //重新加载配置时旧的Appender析构, 析构前写出剩余的日志
+    muhui::Config::LoadFromYaml(YAML::Load(
+        "logs:\n"
+        "    - name: binlog_config\n"
+        "      appenders:\n"
+        "          - type: StdoutLogAppender\n"));
+    std::vector<muhui::binlog::Reader::Line> lines = ReadAll(file);
+    MUHUI_ASSERT(lines.size() == 1 && lines[0].message == "hello config");
+}
+
+/**
+ * @brief 同样的内容分别用二进制日志和文本日志写文件
+ */
+static void bench() {
+    int n = 1000000;
+    std::string bin_file = "/tmp/test_binlog_bench.bin";
+    std::string text_file = "/tmp/test_binlog_bench.log";
+    ::unlink(bin_file.c_str());
+    ::unlink(text_file.c_str());
+    muhui::Logger::ptr logger = MUHUI_LOG_NAME("binlog_bench");
+
+    muhui::BinLogAppender::ptr bin(new muhui::BinLogAppender(bin_file));
+    logger->addAppender(bin);
+    uint64_t begin = muhui::GetCurrentUS();
+    for(int i = 0; i < n; ++i) {
+        MUHUI_BINLOG_INFO(logger, "bench line %d cost %.3f", i, i * 0.5);
+    }
+    uint64_t us = muhui::GetCurrentUS() - begin;
+    bin->flush();
+    MUHUI_LOG_INFO(g_logger) << "binlog: " << n << " lines " << us << "us "
+                             << us * 1000.0 / n << "ns/line";
+    logger->clearAppender();
+
+    muhui::AsyncLogAppender::ptr text(new muhui::AsyncLogAppender(text_file));
+    logger->addAppender(text);
+    begin = muhui::GetCurrentUS();
+    for(int i = 0; i < n; ++i) {
+        MUHUI_LOG_INFO(logger) << "bench line " << i << " cost " << i * 0.5;
+    }
+    us = muhui::GetCurrentUS() - begin;
+    text->flush();
+    MUHUI_LOG_INFO(g_logger) << "text: " << n << " lines " << us << "us "
+                             << us * 1000.0 / n << "ns/line";
+    logger->clearAppender();
+}
+
+int main(int argc, char** argv) {
+    test_roundtrip();
+    test_text_fallback();
+    test_threads();
+    test_config();
+    bench();
+    MUHUI_LOG_INFO(g_logger) << "test_binlog ok";
+    return 0;
+}
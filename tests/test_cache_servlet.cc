@@ -0,0 +1,141 @@
+/**
+ * @file test_cache_servlet.cc
+ * @brief CacheServlet测试, 请求同进程内的HttpServer
+ */
+#include "address.h"
+#include "http/cache_servlet.h"
+#include "http/http_connection.h"
+#include "http/http_server.h"
+#include "iomanager.h"
+#include "log.h"
+#include "macro.h"
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_ROOT();
+
+static muhui::http::HttpServer::ptr s_server;
+static std::atomic<int> s_calls = {0};
+
+static void run() {
+    s_server.reset(new muhui::http::HttpServer(true));
+    muhui::Address::ptr addr = muhui::Address::LookupAny("127.0.0.1:8023");
+    while(!s_server->bind(addr)) {
+        sleep(1);
+    }
+    auto sd = s_server->getServletDispatch();
+    auto page = std::make_shared<muhui::http::FunctionServlet>([](muhui::http::HttpRequest::ptr req,
+                               muhui::http::HttpResponce::ptr rsp,
+                               muhui::http::HttpSession::ptr session){
+        ++s_calls;
+        if(req->getQuery() == "nostore") {
+            rsp->setHeader("Cache-Control", "no-store");
+        } else if(req->getQuery() == "huge") {
+            //乘1000后会溢出
+            rsp->setHeader("Cache-Control", "max-age=18446744073709552");
+        } else if(req->getQuery() != "default") {
+            rsp->setHeader("Cache-Control", "public, max-age=60");
+        }
+        rsp->setBody("page " + req->getPath() + "?" + req->getQuery()
+                + std::string(1000, 'x'));
+        return 0;
+    });
+    //缓存预算约20个响应, 没有max-age时缓存200ms
+    muhui::http::CacheServlet::ptr cache(new muhui::http::CacheServlet(page, 20 * 2500, 200, 4));
+    sd->addGlobServlet("/page/*", cache);
+    s_server->start();
+
+    muhui::http::HttpConnectionPool::ptr pool(new muhui::http::HttpConnectionPool(
+                "127.0.0.1", "", 8023, 4, 4, 5000, 30000, 10000));
+
+    //第二次请求命中, 不调用被包装的servlet
+    auto r1 = pool->doGet("/page/a?x=1", 1000);
+    auto r2 = pool->doGet("/page/a?x=1", 1000);
+    MUHUI_ASSERT2(r1->result == 0 && r2->result == 0, r2->toString());
+    MUHUI_ASSERT(s_calls == 1);
+    MUHUI_ASSERT(r1->response->getBody() == r2->response->getBody());
+    std::string etag = r2->response->getHeader("etag");
+    MUHUI_ASSERT(!etag.empty() && etag == r1->response->getHeader("etag"));
+    MUHUI_LOG_INFO(g_logger) << "cache hit ok, etag=" << etag;
+
+    //query不同是不同的key
+    pool->doGet("/page/a?x=2", 1000);
+    MUHUI_ASSERT(s_calls == 2);
+
+    //If-None-Match
+    auto r3 = pool->doGet("/page/a?x=1", 1000, {{"If-None-Match", "W/" + etag}});
+    MUHUI_ASSERT2(r3->result == 0, r3->toString());
+    MUHUI_ASSERT(r3->response->getStatus() == muhui::http::HttpStatus::NOT_MODIFIED);
+    MUHUI_ASSERT(r3->response->getBody().empty());
+    MUHUI_ASSERT(s_calls == 2);
+    MUHUI_LOG_INFO(g_logger) << "304 ok";
+
+    //no-store不缓存, 请求no-cache不使用缓存
+    pool->doGet("/page/b?nostore", 1000);
+    pool->doGet("/page/b?nostore", 1000);
+    MUHUI_ASSERT(s_calls == 4);
+    pool->doGet("/page/a?x=1", 1000, {{"Cache-Control", "no-cache"}});
+    MUHUI_ASSERT(s_calls == 5);
+
+    //默认缓存时间过期
+    pool->doGet("/page/c?default", 1000);
+    pool->doGet("/page/c?default", 1000);
+    MUHUI_ASSERT(s_calls == 6);
+    usleep(250 * 1000);
+    pool->doGet("/page/c?default", 1000);
+    MUHUI_ASSERT(s_calls == 7);
+    MUHUI_LOG_INFO(g_logger) << "cache-control ok";
+
+    //流水线请求的命中与未命中混合
+    std::vector<muhui::http::HttpRequest::ptr> reqs;
+    for(int i = 0; i < 10; ++i) {
+        muhui::http::HttpRequest::ptr req = std::make_shared<muhui::http::HttpRequest>();
+        req->setPath("/page/p");
+        req->setQuery("i=" + std::to_string(i % 3));
+        reqs.push_back(req);
+    }
+    auto rs = pool->doRequests(reqs, 1000);
+    for(int i = 0; i < 10; ++i) {
+        MUHUI_ASSERT2(rs[i]->result == 0, rs[i]->toString());
+        MUHUI_ASSERT(rs[i]->response->getBody().compare(0, 12
+                    , "page /page/p?i=" + std::to_string(i % 3), 0, 12) == 0);
+    }
+    MUHUI_ASSERT(s_calls == 10);
+    MUHUI_LOG_INFO(g_logger) << "pipelining ok";
+
+    //HTTP/1.0和HTTP/1.1的报文分别缓存
+    int calls = s_calls;
+    for(uint8_t ver : {0x10, 0x11, 0x10, 0x11}) {
+        muhui::http::HttpRequest::ptr req = std::make_shared<muhui::http::HttpRequest>(ver);
+        req->setPath("/page/ver");
+        auto r = pool->doRequest(req, 1000);
+        MUHUI_ASSERT2(r->result == 0, r->toString());
+        MUHUI_ASSERT(r->response->getVersion() == ver);
+    }
+    MUHUI_ASSERT(s_calls == calls + 2);
+    MUHUI_LOG_INFO(g_logger) << "version ok";
+
+    //很大的max-age不会溢出成很短的缓存时间
+    calls = s_calls;
+    pool->doGet("/page/d?huge", 1000);
+    usleep(500 * 1000);
+    pool->doGet("/page/d?huge", 1000);
+    MUHUI_ASSERT(s_calls == calls + 1);
+    MUHUI_LOG_INFO(g_logger) << "huge max-age ok";
+
+    //超过字节预算时LRU淘汰
+    for(int i = 0; i < 100; ++i) {
+        pool->doGet("/page/lru?i=" + std::to_string(i), 1000);
+    }
+    MUHUI_ASSERT(cache->getBytes() <= 20 * 2500);
+    MUHUI_LOG_INFO(g_logger) << "lru ok, count=" << cache->getCount() << " bytes=" << cache->getBytes()
+        << " hits=" << cache->getHits() << " misses=" << cache->getMisses()
+        << " not_modified=" << cache->getNotModified();
+
+    s_server->stop();
+    MUHUI_LOG_INFO(g_logger) << "all tests passed";
+}
+
+int main(int argc, char** argv) {
+    muhui::IOManager iom(2);
+    iom.schedule(run);
+    return 0;
+}
@@ -0,0 +1,185 @@
+/**
+ * @file test_config_reload.cc
+ * @brief 配置增量加载测试: 只通知变化的配置项, 一批修改全部写入后才通知, 解析失败保留原配置, 监视文件自动加载
+ */
+#include "config.h"
+#include "macro.h"
+#include "util.h"
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_ROOT();
+
+static muhui::ConfigVar<int>::ptr g_a =
+    muhui::Config::Lookup("reload.a", (int)1, "a");
+static muhui::ConfigVar<int>::ptr g_b =
+    muhui::Config::Lookup("reload.b", (int)1, "b");
+static muhui::ConfigVar<std::vector<std::string> >::ptr g_list =
+    muhui::Config::Lookup("reload.list", std::vector<std::string>{"x"}, "list");
+
+static void WriteFile(const std::string& file, const std::string& content) {
+    std::ofstream ofs(file, std::ios::trunc);
+    ofs << content;
+}
+
+static void test_diff() {
+    int a_calls = 0, b_calls = 0, list_calls = 0;
+    g_a->addListener([&a_calls](const int& ov, const int& nv){
+        //同一批的其它修改已经写入
+        MUHUI_ASSERT(g_a->getValue() == nv);
+        MUHUI_ASSERT(g_b->getValue() == 2);
+        ++a_calls;
+    });
+    g_b->addListener([&b_calls](const int& ov, const int& nv){
+        MUHUI_ASSERT(g_a->getValue() == 2);
+        ++b_calls;
+    });
+    g_list->addListener([&list_calls](const std::vector<std::string>& ov
+                , const std::vector<std::string>& nv){
+        ++list_calls;
+    });
+
+    YAML::Node root = YAML::Load(
+        "reload:\n"
+        "    a: 2\n"
+        "    b: 2\n"
+        "    list: [x]\n"
+        "    unknown: 1\n");
+    //Diff不修改当前值
+    std::vector<muhui::ConfigVarBase::Change::ptr> changes = muhui::Config::Diff(root);
+    MUHUI_ASSERT(changes.size() == 2);
+    MUHUI_ASSERT(g_a->getValue() == 1 && a_calls == 0);
+    MUHUI_ASSERT(muhui::Config::Apply(changes) == 2);
+    MUHUI_ASSERT(a_calls == 1 && b_calls == 1 && list_calls == 0);
+
+    //没有变化时不通知
+    muhui::Config::LoadFromYaml(root);
+    MUHUI_ASSERT(a_calls == 1 && b_calls == 1 && list_calls == 0);
+
+    //Diff之后被setValue改过的配置项, Apply时按实际的旧值比较
+    changes = muhui::Config::Diff(YAML::Load("reload: {list: [y, z]}"));
+    MUHUI_ASSERT(changes.size() == 1);
+    g_list->setValue({"y", "z"});
+    MUHUI_ASSERT(list_calls == 1);
+    MUHUI_ASSERT(muhui::Config::Apply(changes) == 0);
+    MUHUI_ASSERT(list_calls == 1);
+
+    g_a->clearListener();
+    g_b->clearListener();
+    g_list->clearListener();
+}
+
+static void test_file() {
+    std::string dir = "/tmp/test_config_reload";
+    mkdir(dir.c_str(), 0755);
+    std::string file = dir + "/conf.yml";
+    WriteFile(file, "reload:\n    a: 10\n    b: 10\n");
+    MUHUI_ASSERT(muhui::Config::LoadFromFile(file));
+    MUHUI_ASSERT(g_a->getValue() == 10 && g_b->getValue() == 10);
+
+    //解析失败时配置不变
+    WriteFile(file, "reload:\n    a: [10\n");
+    MUHUI_ASSERT(!muhui::Config::LoadFromFile(file));
+    MUHUI_ASSERT(!muhui::Config::LoadFromFile(dir + "/not_exists.yml"));
+    MUHUI_ASSERT(g_a->getValue() == 10);
+}
+
+/**
+ * @brief 等待配置项变成v
+ */
+static bool WaitValue(muhui::ConfigVar<int>::ptr var, int v) {
+    uint64_t begin = muhui::GetCurrentMS();
+    while(var->getValue() != v) {
+        if(muhui::GetCurrentMS() - begin > 3000) {
+            return false;
+        }
+        usleep(10 * 1000);
+    }
+    return true;
+}
+
+static void test_watch() {
+    std::string dir = "/tmp/test_config_reload";
+    std::string file = dir + "/conf.yml";
+    WriteFile(file, "reload:\n    a: 20\n");
+    muhui::ConfigWatcher::ptr watcher(new muhui::ConfigWatcher(file, 50));
+    MUHUI_ASSERT(watcher->start());
+    MUHUI_ASSERT(watcher->reload());
+    MUHUI_ASSERT(g_a->getValue() == 20);
+
+    //原地写入
+    WriteFile(file, "reload:\n    a: 21\n");
+    MUHUI_ASSERT(WaitValue(g_a, 21));
+
+    //写临时文件再rename
+    WriteFile(dir + "/conf.yml.tmp", "reload:\n    a: 22\n");
+    MUHUI_ASSERT(rename((dir + "/conf.yml.tmp").c_str(), file.c_str()) == 0);
+    MUHUI_ASSERT(WaitValue(g_a, 22));
+
+    //同目录其它文件不触发加载
+    uint64_t count = watcher->getReloadCount();
+    WriteFile(dir + "/other.yml", "reload:\n    a: 23\n");
+    usleep(200 * 1000);
+    MUHUI_ASSERT(watcher->getReloadCount() == count && g_a->getValue() == 22);
+
+    //连续写入合并成一次加载
+    for(int i = 0; i < 10; ++i) {
+        WriteFile(file, "reload:\n    a: " + std::to_string(30 + i) + "\n");
+    }
+    MUHUI_ASSERT(WaitValue(g_a, 39));
+    usleep(200 * 1000);
+    MUHUI_LOG_INFO(g_logger) << "reload count: " << watcher->getReloadCount() - count;
+    MUHUI_ASSERT(watcher->getReloadCount() - count < 10);
+
+    //写坏的文件不影响原配置
+    WriteFile(file, "reload:\n    a: [1\n");
+    usleep(200 * 1000);
+    MUHUI_ASSERT(g_a->getValue() == 39 && watcher->getErrorCount() == 1);
+
+    watcher->stop();
+    WriteFile(file, "reload:\n    a: 40\n");
+    usleep(200 * 1000);
+    MUHUI_ASSERT(g_a->getValue() == 39);
+}
+
+/**
+ * @brief 大量配置项中只修改一个
+ */
+static void bench() {
+    int n = 2000;
+    std::vector<muhui::ConfigVar<int>::ptr> vars;
+    std::stringstream ss;
+    ss << "bench:\n";
+    for(int i = 0; i < n; ++i) {
+        std::string name = "k" + std::to_string(i);
+        vars.push_back(muhui::Config::Lookup("bench." + name, 0, name));
+        ss << "    " << name << ": " << i << "\n";
+    }
+    YAML::Node root = YAML::Load(ss.str());
+    muhui::Config::LoadFromYaml(root);
+    int calls = 0;
+    for(auto& i : vars) {
+        i->addListener([&calls](const int& ov, const int& nv){
+            ++calls;
+        });
+    }
+    root["bench"]["k7"] = -7;
+    uint64_t begin = muhui::GetCurrentUS();
+    muhui::Config::LoadFromYaml(root);
+    uint64_t us = muhui::GetCurrentUS() - begin;
+    MUHUI_ASSERT(calls == 1 && vars[7]->getValue() == -7);
+    MUHUI_LOG_INFO(g_logger) << n << " keys, 1 changed: " << us << "us, notified " << calls;
+    for(auto& i : vars) {
+        i->clearListener();
+    }
+}
+
+int main(int argc, char** argv) {
+    test_diff();
+    test_file();
+    test_watch();
+    bench();
+    MUHUI_LOG_INFO(g_logger) << "test_config_reload ok";
+    return 0;
+}
@@ -0,0 +1,171 @@
+/**
+ * @file test_config_value.cc
+ * @brief 无锁读取配置测试: 三种LockFreeValue实现, 读写并发时不会读到写了一半的值, 与加读锁读取的耗时对比
+ */
+#include "config.h"
+#include "macro.h"
+#include "util.h"
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_ROOT();
+
+/**
+ * @brief 可平凡复制但不能原子读写的类型, 三个字段始终相等
+ */
+struct Triple {
+    uint64_t a;
+    uint64_t b;
+    uint64_t c;
+};
+
+static void test_kind() {
+    static_assert(muhui::LockFreeValueKind<int>::value == 0, "int");
+    static_assert(muhui::LockFreeValueKind<bool>::value == 0, "bool");
+    static_assert(muhui::LockFreeValueKind<muhui::LogLevel::Level>::value == 0, "enum");
+    static_assert(muhui::LockFreeValueKind<Triple>::value == 1, "trivially copyable");
+    static_assert(muhui::LockFreeValueKind<std::string>::value == 2, "string");
+    static_assert(muhui::LockFreeValueKind<std::vector<int> >::value == 2, "vector");
+}
+
+static void test_config_var() {
+    muhui::ConfigVar<int>::ptr iv = muhui::Config::Lookup("test.value.int", (int)1, "int");
+    muhui::ConfigVar<std::string>::ptr sv = muhui::Config::Lookup("test.value.str"
+            , std::string("a"), "string");
+    muhui::ConfigVar<std::vector<int> >::ptr vv = muhui::Config::Lookup("test.value.vec"
+            , std::vector<int>{1, 2}, "vector");
+    MUHUI_ASSERT(iv->getValue() == 1);
+    MUHUI_ASSERT(sv->getValue() == "a");
+    MUHUI_ASSERT(vv->getValue().size() == 2);
+
+    //回调里看到的仍是旧值, 返回后读到新值
+    int calls = 0;
+    iv->addListener([&calls, iv](const int& ov, const int& nv){
+        MUHUI_ASSERT(ov == 1 && nv == 2);
+        MUHUI_ASSERT(iv->getValue() == 1);
+        ++calls;
+    });
+    iv->setValue(2);
+    MUHUI_ASSERT(iv->getValue() == 2 && calls == 1);
+    iv->clearListener();
+
+    muhui::Config::LoadFromYaml(YAML::Load(
+        "test:\n"
+        "    value:\n"
+        "        str: hello\n"
+        "        vec: [3, 4, 5]\n"));
+    MUHUI_ASSERT(sv->getValue() == "hello");
+    MUHUI_ASSERT(vv->getValue() == std::vector<int>({3, 4, 5}));
+    MUHUI_ASSERT(sv->toString() == "hello");
+}
+
+/**
+ * @brief 一个线程不断写, 其它线程检查读到的值是完整的
+ */
+template<class T, class Make, class Check>
+static void test_concurrent(const char* name, Make make, Check check) {
+    muhui::LockFreeValue<T> value(make(0));
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> reads(0);
+    std::vector<muhui::Thread::ptr> thrs;
+    for(int t = 0; t < 3; ++t) {
+        thrs.push_back(muhui::Thread::ptr(new muhui::Thread([&value, &stop, &reads, check](){
+            uint64_t n = 0;
+            while(!stop) {
+                MUHUI_ASSERT(check(value.load()));
+                ++n;
+            }
+            reads += n;
+        }, std::string("value_") + name)));
+    }
+    uint64_t writes = 0;
+    uint64_t begin = muhui::GetCurrentMS();
+    while(muhui::GetCurrentMS() - begin < 300) {
+        value.store(make(++writes));
+    }
+    stop = true;
+    for(auto& i : thrs) {
+        i->join();
+    }
+    MUHUI_ASSERT(check(value.load()));
+    MUHUI_LOG_INFO(g_logger) << name << ": writes=" << writes << " reads=" << reads;
+}
+
+static void test_concurrent() {
+    test_concurrent<uint64_t>("atomic", [](uint64_t i){ return i;}
+            , [](uint64_t v){ return true;});
+    test_concurrent<Triple>("seqlock", [](uint64_t i){ return Triple{i, i, i};}
+            , [](const Triple& v){ return v.a == v.b && v.b == v.c;});
+    test_concurrent<std::vector<uint64_t> >("rcu"
+            , [](uint64_t i){ return std::vector<uint64_t>(i % 16 + 1, i);}
+            , [](const std::vector<uint64_t>& v){
+                for(auto& i : v) {
+                    if(i != v[0]) {
+                        return false;
+                    }
+                }
+                return v.size() == v[0] % 16 + 1;
+            });
+}
+
+/**
+ * @brief 原来的读法: 加读锁后复制
+ */
+template<class T>
+class LockedValue {
+public:
+    LockedValue(const T& v) : m_val(v) {}
+    const T getValue() {
+        muhui::RWMutex::ReadLock lock(m_mutex);
+        return m_val;
+    }
+private:
+    T m_val;
+    muhui::RWMutex m_mutex;
+};
+
+template<class V>
+static double bench(V& v, int n) {
+    uint64_t sum = 0;
+    uint64_t begin = muhui::GetCurrentUS();
+    for(int i = 0; i < n; ++i) {
+        sum += v->getValue();
+    }
+    uint64_t us = muhui::GetCurrentUS() - begin;
+    MUHUI_ASSERT(sum == (uint64_t)n * 4096);
+    return us * 1000.0 / n;
+}
+
+static void bench() {
+    int n = 10000000;
+    muhui::ConfigVar<uint64_t>::ptr fast = muhui::Config::Lookup("test.value.bench"
+            , (uint64_t)4096, "bench");
+    std::shared_ptr<LockedValue<uint64_t> > locked(new LockedValue<uint64_t>(4096));
+    MUHUI_LOG_INFO(g_logger) << "uint64_t: lock-free " << bench(fast, n)
+                             << "ns/op, read lock " << bench(locked, n) << "ns/op";
+
+    std::string s(64, 'x');
+    muhui::ConfigVar<std::string>::ptr sv = muhui::Config::Lookup("test.value.bench_str"
+            , s, "bench");
+    LockedValue<std::string> ls(s);
+    n = 1000000;
+    uint64_t begin = muhui::GetCurrentUS();
+    for(int i = 0; i < n; ++i) {
+        MUHUI_ASSERT(sv->getValue().size() == 64);
+    }
+    uint64_t us1 = muhui::GetCurrentUS() - begin;
+    begin = muhui::GetCurrentUS();
+    for(int i = 0; i < n; ++i) {
+        MUHUI_ASSERT(ls.getValue().size() == 64);
+    }
+    uint64_t us2 = muhui::GetCurrentUS() - begin;
+    MUHUI_LOG_INFO(g_logger) << "std::string: lock-free " << us1 * 1000.0 / n
+                             << "ns/op, read lock " << us2 * 1000.0 / n << "ns/op";
+}
+
+int main(int argc, char** argv) {
+    test_kind();
+    test_config_var();
+    test_concurrent();
+    bench();
+    MUHUI_LOG_INFO(g_logger) << "test_config_value ok";
+    return 0;
+}
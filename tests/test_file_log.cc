@@ -0,0 +1,158 @@
+/**
+ * @file test_file_log.cc
+ * @brief FileLogAppender测试: 缓冲写出, 按大小轮转, 外部轮转后重新打开
+ */
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <unistd.h>
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_ROOT();
+
+static const std::string s_dir = "/tmp/test_file_log";
+
+static size_t CountLines(const std::string& file) {
+    std::ifstream ifs(file);
+    std::string line;
+    size_t n = 0;
+    while(std::getline(ifs, line)) {
+        ++n;
+    }
+    return n;
+}
+
+/**
+ * @brief 目录下以prefix开头的文件
+ */
+static std::vector<std::string> ListFiles(const std::string& prefix) {
+    std::vector<std::string> files;
+    DIR* dir = opendir(s_dir.c_str());
+    if(!dir) {
+        return files;
+    }
+    while(struct dirent* e = readdir(dir)) {
+        std::string name = e->d_name;
+        if(name.compare(0, prefix.size(), prefix) == 0) {
+            files.push_back(s_dir + "/" + name);
+        }
+    }
+    closedir(dir);
+    return files;
+}
+
+static void Clean() {
+    for(auto& i : ListFiles("")) {
+        ::unlink(i.c_str());
+    }
+    mkdir(s_dir.c_str(), 0755);
+}
+
+static void test_buffer() {
+    std::string file = s_dir + "/buffer.log";
+    muhui::Logger::ptr logger = MUHUI_LOG_NAME("file_buffer");
+    muhui::FileLogAppender::ptr ap(new muhui::FileLogAppender(file, 64 * 1024, 300));
+    logger->setFormatter("%m%n");
+    logger->addAppender(ap);
+
+    for(int i = 0; i < 100; ++i) {
+        MUHUI_LOG_INFO(logger) << "line " << i;
+    }
+    //还在缓冲区中
+    MUHUI_ASSERT(CountLines(file) == 0);
+    //ERROR唤醒定时器线程写出, 不等flush_interval
+    MUHUI_LOG_ERROR(logger) << "error";
+    uint64_t begin = muhui::GetCurrentMS();
+    while(CountLines(file) != 101 && muhui::GetCurrentMS() - begin < 2000) {
+        usleep(1000);
+    }
+    MUHUI_LOG_INFO(g_logger) << "error flush after " << muhui::GetCurrentMS() - begin << "ms";
+    MUHUI_ASSERT(CountLines(file) == 101);
+    MUHUI_ASSERT(muhui::GetCurrentMS() - begin < 200);
+
+    MUHUI_LOG_INFO(logger) << "timer";
+    begin = muhui::GetCurrentMS();
+    while(CountLines(file) != 102 && muhui::GetCurrentMS() - begin < 2000) {
+        usleep(10 * 1000);
+    }
+    MUHUI_LOG_INFO(g_logger) << "timer flush after " << muhui::GetCurrentMS() - begin << "ms";
+    MUHUI_ASSERT(CountLines(file) == 102);
+    logger->clearAppender();
+}
+
+static void test_size_rotate() {
+    std::string file = s_dir + "/size.log";
+    muhui::Logger::ptr logger = MUHUI_LOG_NAME("file_size");
+    //每4KB写出一次, 超过16KB轮转
+    muhui::FileLogAppender::ptr ap(new muhui::FileLogAppender(file, 4096, 1000, 16 * 1024));
+    logger->setFormatter("%m%n");
+    logger->addAppender(ap);
+
+    std::string msg(99, 'x');
+    for(int i = 0; i < 1000; ++i) {
+        MUHUI_LOG_INFO(logger) << msg;
+    }
+    ap->flush();
+    std::vector<std::string> files = ListFiles("size.log");
+    size_t total = 0;
+    for(auto& i : files) {
+        total += CountLines(i);
+    }
+    MUHUI_LOG_INFO(g_logger) << "size rotate: files=" << files.size() << " lines=" << total;
+    MUHUI_ASSERT(files.size() >= 5);
+    MUHUI_ASSERT(total == 1000);
+    MUHUI_ASSERT(ap->getFileSize() < 16 * 1024);
+    logger->clearAppender();
+}
+
+static void test_external_rotate() {
+    std::string file = s_dir + "/ext.log";
+    muhui::Logger::ptr logger = MUHUI_LOG_NAME("file_ext");
+    muhui::FileLogAppender::ptr ap(new muhui::FileLogAppender(file, 64 * 1024, 100));
+    logger->setFormatter("%m%n");
+    logger->addAppender(ap);
+
+    MUHUI_LOG_INFO(logger) << "before";
+    ap->flush();
+    //模拟logrotate: 移走文件, 定时器发现inode变化后重新创建
+    rename(file.c_str(), (file + ".1").c_str());
+    uint64_t begin = muhui::GetCurrentMS();
+    while(access(file.c_str(), F_OK) != 0 && muhui::GetCurrentMS() - begin < 2000) {
+        usleep(10 * 1000);
+    }
+    MUHUI_ASSERT(access(file.c_str(), F_OK) == 0);
+    MUHUI_LOG_INFO(logger) << "after";
+    ap->flush();
+    MUHUI_ASSERT(CountLines(file + ".1") == 1);
+    MUHUI_ASSERT(CountLines(file) == 1);
+    logger->clearAppender();
+}
+
+static void bench() {
+    std::string file = s_dir + "/bench.log";
+    muhui::Logger::ptr logger = MUHUI_LOG_NAME("file_bench");
+    muhui::FileLogAppender::ptr ap(new muhui::FileLogAppender(file));
+    logger->addAppender(ap);
+    int n = 200000;
+    uint64_t begin = muhui::GetCurrentUS();
+    for(int i = 0; i < n; ++i) {
+        MUHUI_LOG_INFO(logger) << "bench line " << i;
+    }
+    ap->flush();
+    uint64_t us = muhui::GetCurrentUS() - begin;
+    MUHUI_LOG_INFO(g_logger) << "bench: " << n << " lines " << us << "us "
+                             << us * 1000 / n << "ns/line";
+    logger->clearAppender();
+}
+
+int main(int argc, char** argv) {
+    Clean();
+    test_buffer();
+    test_size_rotate();
+    test_external_rotate();
+    bench();
+    MUHUI_LOG_INFO(g_logger) << "test_file_log ok";
+    return 0;
+}
@@ -0,0 +1,300 @@
+/**
+ * @file test_http2.cc
+ * @brief HTTP/2(h2c)测试, 请求同进程内的HttpServer
+ */
+#include "address.h"
+#include "http/http_connection.h"
+#include "http/http_server.h"
+#include "http2/hpack.h"
+#include "http2/http2_session.h"
+#include "iomanager.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_ROOT();
+
+static muhui::http::HttpServer::ptr s_server;
+
+static std::string FromHex(const std::string& hex) {
+    std::string rt;
+    for(size_t i = 0; i + 1 < hex.size(); i += 2) {
+        rt.push_back((char)strtol(hex.substr(i, 2).c_str(), nullptr, 16));
+    }
+    return rt;
+}
+
+static void test_hpack() {
+    using muhui::http2::HeaderList;
+    //RFC7541 C.4 使用Huffman编码的请求序列
+    const char* blocks[] = {
+        "828684418cf1e3c2e5f23a6ba0ab90f4ff",
+        "828684be5886a8eb10649cbf",
+        "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf"
+    };
+    muhui::http2::HPackDecoder decoder;
+    HeaderList headers;
+    for(auto b : blocks) {
+        std::string data = FromHex(b);
+        headers.clear();
+        MUHUI_ASSERT(decoder.decode((const uint8_t*)data.c_str(), data.size(), headers) == 0);
+    }
+    MUHUI_ASSERT(headers.size() == 5);
+    MUHUI_ASSERT(headers[1].second == "https" && headers[2].second == "/index.html");
+    MUHUI_ASSERT(headers[3].second == "www.example.com");
+    MUHUI_ASSERT(headers[4].first == "custom-key" && headers[4].second == "custom-value");
+    MUHUI_ASSERT(decoder.getTable().getSize() == 164);
+
+    //编码后解码一致, 重复的字段使用动态表索引
+    muhui::http2::HPackEncoder encoder;
+    muhui::http2::HPackDecoder decoder2;
+    HeaderList in = {{":status", "200"}, {"content-type", "text/html"}
+                     , {"x-request-id", "abcdef"}, {"set-cookie", "a=b"}
+                     , {"content-length", "12345"}};
+    std::string first;
+    encoder.encode(in, first);
+    std::string second;
+    encoder.encode(in, second);
+    MUHUI_ASSERT(second.size() < first.size());
+    for(auto s : {first, second}) {
+        HeaderList out;
+        MUHUI_ASSERT(decoder2.decode((const uint8_t*)s.c_str(), s.size(), out) == 0);
+        MUHUI_ASSERT(out == in);
+    }
+    //set-cookie不加入动态表
+    MUHUI_ASSERT(encoder.getTable().getCount() == 2);
+    MUHUI_LOG_INFO(g_logger) << "hpack ok, " << first.size() << " -> " << second.size() << " bytes";
+}
+
+/**
+ * @brief 逐字节读取一个HTTP/1.1响应头, 不多读后面的数据
+ */
+static std::string ReadHead(muhui::Socket::ptr sock) {
+    std::string head;
+    while(head.find("\r\n\r\n") == std::string::npos) {
+        char c;
+        MUHUI_ASSERT(sock->recv(&c, 1) == 1);
+        head.push_back(c);
+    }
+    return head;
+}
+
+/**
+ * @brief h2c升级
+ * @param[in] pipelined 为true时升级请求之前流水线发送一个普通请求, 它的响应要在101之前收到
+ */
+static void test_upgrade(muhui::Address::ptr addr, bool pipelined) {
+    muhui::Socket::ptr sock = muhui::Socket::CreateTCP(addr);
+    MUHUI_ASSERT(sock->connect(addr));
+    sock->setRecvTimeout(1000);
+    std::string req;
+    if(pipelined) {
+        req = "GET /slow?first HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    }
+    req += "GET /slow?upgrade HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+        "Connection: Upgrade, HTTP2-Settings\r\nUpgrade: h2c\r\n"
+        "HTTP2-Settings: AAMAAABkAAQAAP__\r\n\r\n";
+    MUHUI_ASSERT(sock->send(req.c_str(), req.size()) == (int)req.size());
+    std::string head = ReadHead(sock);
+    if(pipelined) {
+        MUHUI_ASSERT2(head.find("HTTP/1.1 200") == 0, head);
+        std::string body(strlen("/slow?first"), '\0');
+        for(size_t n = 0; n < body.size();) {
+            int rt = sock->recv(&body[n], body.size() - n);
+            MUHUI_ASSERT(rt > 0);
+            n += rt;
+        }
+        MUHUI_ASSERT2(body == "/slow?first", body);
+        head = ReadHead(sock);
+    }
+    //101响应之后是HTTP/2帧
+    MUHUI_ASSERT2(head.find("HTTP/1.1 101") == 0, head);
+
+    muhui::SocketStream::ptr stream = std::make_shared<muhui::SocketStream>(sock);
+    std::string preface(muhui::http2::CLIENT_PREFACE, muhui::http2::CLIENT_PREFACE_SIZE);
+    //空SETTINGS帧
+    preface.append("\x00\x00\x00\x04\x00\x00\x00\x00\x00", 9);
+    MUHUI_ASSERT(stream->writeFixSize(preface.c_str(), preface.size()) > 0);
+
+    muhui::http2::HPackDecoder decoder;
+    muhui::http2::HeaderList headers;
+    std::string body;
+    bool end = false;
+    bool settings = false;
+    while(!end) {
+        muhui::http2::Frame frame;
+        MUHUI_ASSERT(muhui::http2::ReadFrame(stream.get(), frame, 1 << 20) > 0);
+        if(frame.header.type == muhui::http2::FrameType::SETTINGS) {
+            settings = true;
+            continue;
+        }
+        //服务端的第一帧是SETTINGS
+        MUHUI_ASSERT(settings);
+        if(frame.header.streamId != 1) {
+            continue;
+        }
+        if(frame.header.type == muhui::http2::FrameType::HEADERS) {
+            MUHUI_ASSERT(decoder.decode((const uint8_t*)frame.payload.c_str()
+                        , frame.payload.size(), headers) == 0);
+        } else if(frame.header.type == muhui::http2::FrameType::DATA) {
+            body.append(frame.payload);
+        }
+        end = frame.hasFlag(muhui::http2::END_STREAM);
+    }
+    MUHUI_ASSERT(!headers.empty() && headers[0].first == ":status" && headers[0].second == "200");
+    MUHUI_ASSERT2(body == "/slow?upgrade", body);
+    stream->close();
+    MUHUI_LOG_INFO(g_logger) << "upgrade ok, pipelined=" << pipelined;
+}
+
+static void run() {
+    test_hpack();
+
+    //FrameWriter: 多帧合并到一次writev
+    {
+        muhui::Address::ptr any = muhui::Address::LookupAny("127.0.0.1:0");
+        muhui::Socket::ptr listener = muhui::Socket::CreateTCP(any);
+        MUHUI_ASSERT(listener->bind(any) && listener->listen());
+        muhui::Socket::ptr a = muhui::Socket::CreateTCP(any);
+        MUHUI_ASSERT(a->connect(listener->getLocalAddress()));
+        muhui::Socket::ptr b = listener->accept();
+        MUHUI_ASSERT(b);
+        muhui::SocketStream sa(a);
+        muhui::http2::FrameWriter writer(&sa);
+        auto data = std::make_shared<const std::string>(1000, 'x');
+        for(uint32_t i = 1; i < 200; i += 2) {
+            writer.enqueueData(muhui::http2::END_STREAM, i, data, i, 100);
+        }
+        MUHUI_ASSERT(writer.flush() > 0);
+        MUHUI_ASSERT(writer.getWrites() == 1 && writer.getFrames() == 100);
+        muhui::SocketStream sb(b);
+        muhui::http2::Frame frame;
+        for(uint32_t i = 1; i < 200; i += 2) {
+            MUHUI_ASSERT(muhui::http2::ReadFrame(&sb, frame, 16384) > 0);
+            MUHUI_ASSERT(frame.header.streamId == i && frame.payload == data->substr(i, 100));
+        }
+        MUHUI_LOG_INFO(g_logger) << "frame writer ok";
+    }
+
+    s_server.reset(new muhui::http::HttpServer(true));
+    s_server->setHttp2(true);
+    muhui::Address::ptr addr = muhui::Address::LookupAny("127.0.0.1:8026");
+    while(!s_server->bind(addr)) {
+        sleep(1);
+    }
+    auto sd = s_server->getServletDispatch();
+    sd->addServlet("/slow", [](muhui::http::HttpRequest::ptr req,
+                               muhui::http::HttpResponce::ptr rsp,
+                               muhui::http::HttpSession::ptr session){
+        usleep(100 * 1000);
+        rsp->setBody(req->getPath() + "?" + req->getQuery());
+        return 0;
+    });
+    sd->addServlet("/big", [](muhui::http::HttpRequest::ptr req,
+                              muhui::http::HttpResponce::ptr rsp,
+                              muhui::http::HttpSession::ptr session){
+        std::string body(4 * 1024 * 1024, '\0');
+        for(size_t i = 0; i < body.size(); ++i) {
+            body[i] = (char)(i * 13);
+        }
+        rsp->setBody(body);
+        return 0;
+    });
+    sd->addServlet("/echo", [](muhui::http::HttpRequest::ptr req,
+                               muhui::http::HttpResponce::ptr rsp,
+                               muhui::http::HttpSession::ptr session){
+        rsp->setHeader("X-Method", muhui::http::HttpMethodToString(req->getMethod()));
+        rsp->setHeader("X-Cookie", req->getHeader("Cookie"));
+        rsp->setBody(req->getBody());
+        return 0;
+    });
+    s_server->start();
+
+    auto h2 = muhui::http2::Http2Session::Connect(addr, 1000);
+    MUHUI_ASSERT(h2);
+
+    //100个并发的慢请求复用一个连接
+    const int count = 100;
+    std::atomic<int> done = {0};
+    uint64_t start = muhui::GetCurrentMS();
+    for(int i = 0; i < count; ++i) {
+        muhui::IOManager::GetThis()->schedule([h2, i, &done](){
+            muhui::http::HttpRequest::ptr req = std::make_shared<muhui::http::HttpRequest>();
+            req->setPath("/slow");
+            req->setQuery("i=" + std::to_string(i));
+            req->setHeader("Host", "127.0.0.1");
+            auto r = h2->request(req, 5000);
+            MUHUI_ASSERT2(r->result == 0, r->toString());
+            MUHUI_ASSERT(r->response->getBody() == "/slow?i=" + std::to_string(i));
+            ++done;
+        });
+    }
+    while(done < count) {
+        usleep(10 * 1000);
+    }
+    uint64_t used = muhui::GetCurrentMS() - start;
+    MUHUI_ASSERT2(used < 2000, used);
+    MUHUI_LOG_INFO(g_logger) << "concurrent streams ok, " << count << " requests in "
+        << used << "ms, client writes=" << h2->getFrameWriter().getWrites()
+        << " frames=" << h2->getFrameWriter().getFrames();
+
+    //超过窗口的响应体, 依赖WINDOW_UPDATE
+    muhui::http::HttpRequest::ptr req = std::make_shared<muhui::http::HttpRequest>();
+    req->setPath("/big");
+    auto r = h2->request(req, 5000);
+    MUHUI_ASSERT2(r->result == 0, r->toString());
+    const std::string& big = r->response->getBody();
+    MUHUI_ASSERT(big.size() == 4 * 1024 * 1024);
+    for(size_t i = 0; i < big.size(); ++i) {
+        MUHUI_ASSERT(big[i] == (char)(i * 13));
+    }
+    MUHUI_ASSERT(r->response->getHeader("content-length") == std::to_string(big.size()));
+    MUHUI_LOG_INFO(g_logger) << "flow control ok";
+
+    //超过窗口的请求体
+    req = std::make_shared<muhui::http::HttpRequest>();
+    req->setMethod(muhui::http::HttpMethod::POST);
+    req->setPath("/echo");
+    req->setHeader("Cookie", "a=1; b=2");
+    std::string post(3 * 1024 * 1024 + 7, 'p');
+    req->setBody(post);
+    r = h2->request(req, 5000);
+    MUHUI_ASSERT2(r->result == 0, r->toString());
+    MUHUI_ASSERT(r->response->getBody() == post);
+    MUHUI_ASSERT(r->response->getHeader("x-method") == "POST");
+    MUHUI_ASSERT(r->response->getHeader("x-cookie") == "a=1; b=2");
+    MUHUI_LOG_INFO(g_logger) << "post ok";
+
+    //超时后发送RST_STREAM, 连接继续可用
+    req = std::make_shared<muhui::http::HttpRequest>();
+    req->setPath("/slow");
+    r = h2->request(req, 20);
+    MUHUI_ASSERT2(r->result == (int)muhui::http::HttpResult::Error::TIMEOUT, r->toString());
+    req->setPath("/none");
+    r = h2->request(req, 1000);
+    MUHUI_ASSERT2(r->result == 0, r->toString());
+    MUHUI_ASSERT(r->response->getStatus() == muhui::http::HttpStatus::NOT_FOUND);
+    usleep(150 * 1000);
+    MUHUI_ASSERT(h2->getStreamCount() == 0);
+    MUHUI_LOG_INFO(g_logger) << "cancel ok";
+    h2->close();
+
+    test_upgrade(addr, false);
+    test_upgrade(addr, true);
+
+    //HTTP/1.1不受影响
+    muhui::http::HttpConnectionPool::ptr pool(new muhui::http::HttpConnectionPool(
+                "127.0.0.1", "", 8026, 2, 2, 5000, 30000, 100));
+    r = pool->doGet("/slow?http1", 1000);
+    MUHUI_ASSERT2(r->result == 0 && r->response->getBody() == "/slow?http1", r->toString());
+    MUHUI_LOG_INFO(g_logger) << "http/1.1 ok";
+
+    s_server->stop();
+    MUHUI_LOG_INFO(g_logger) << "all tests passed";
+}
+
+int main(int argc, char** argv) {
+    muhui::IOManager iom(2);
+    iom.schedule(run);
+    return 0;
+}
@@ -0,0 +1,208 @@
+/**
+ * @file test_http_compress.cc
+ * @brief HTTP响应压缩测试, 请求同进程内的HttpServer
+ */
+#include "address.h"
+#include "config.h"
+#include "http/cache_servlet.h"
+#include "http/http_compress.h"
+#include "http/http_connection.h"
+#include "http/http_server.h"
+#include "iomanager.h"
+#include "log.h"
+#include "macro.h"
+#include <zlib.h>
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_ROOT();
+
+static muhui::http::HttpServer::ptr s_server;
+static std::atomic<int> s_calls = {0};
+
+/**
+ * @brief 解压gzip或zlib格式的数据
+ */
+static bool Inflate(const std::string& in, std::string& out) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    //15 + 32 自动识别gzip/zlib头
+    if(inflateInit2(&zs, 15 + 32) != Z_OK) {
+        return false;
+    }
+    zs.next_in = (Bytef*)in.c_str();
+    zs.avail_in = in.size();
+    char buf[4096];
+    int rt = Z_OK;
+    while(rt == Z_OK) {
+        zs.next_out = (Bytef*)buf;
+        zs.avail_out = sizeof(buf);
+        rt = inflate(&zs, Z_NO_FLUSH);
+        out.append(buf, sizeof(buf) - zs.avail_out);
+    }
+    inflateEnd(&zs);
+    return rt == Z_STREAM_END;
+}
+
+static std::string MakeText(size_t size) {
+    std::string text;
+    while(text.size() < size) {
+        text += "line " + std::to_string(text.size() % 97) + " of some compressible text\n";
+    }
+    text.resize(size);
+    return text;
+}
+
+static void test_negotiate() {
+    using muhui::http::HttpCompressor;
+    MUHUI_ASSERT(HttpCompressor::Negotiate("gzip, deflate, br") == HttpCompressor::GZIP);
+    MUHUI_ASSERT(HttpCompressor::Negotiate("deflate") == HttpCompressor::DEFLATE);
+    MUHUI_ASSERT(HttpCompressor::Negotiate("gzip;q=0, deflate") == HttpCompressor::DEFLATE);
+    MUHUI_ASSERT(HttpCompressor::Negotiate("gzip;q=0.0") == HttpCompressor::IDENTITY);
+    MUHUI_ASSERT(HttpCompressor::Negotiate("*") == HttpCompressor::GZIP);
+    MUHUI_ASSERT(HttpCompressor::Negotiate("*;q=0") == HttpCompressor::IDENTITY);
+    MUHUI_ASSERT(HttpCompressor::Negotiate("br") == HttpCompressor::IDENTITY);
+    MUHUI_ASSERT(HttpCompressor::Negotiate("") == HttpCompressor::IDENTITY);
+    MUHUI_ASSERT(HttpCompressor::IsCompressible("text/html; charset=utf-8"));
+    MUHUI_ASSERT(HttpCompressor::IsCompressible("application/json"));
+    MUHUI_ASSERT(HttpCompressor::IsCompressible("image/svg+xml"));
+    MUHUI_ASSERT(!HttpCompressor::IsCompressible("image/png"));
+    MUHUI_ASSERT(!HttpCompressor::IsCompressible("application/gzip"));
+    MUHUI_LOG_INFO(g_logger) << "negotiate ok";
+}
+
+static muhui::http::HttpResult::ptr Get(muhui::http::HttpConnectionPool::ptr pool
+                                        , const std::string& path
+                                        , const std::string& accept) {
+    std::map<std::string, std::string> headers;
+    if(!accept.empty()) {
+        headers["Accept-Encoding"] = accept;
+    }
+    auto r = pool->doGet(path, 1000, headers);
+    MUHUI_ASSERT2(r->result == 0, r->toString());
+    return r;
+}
+
+static void run() {
+    //默认不压缩, 不改变已有HttpServer的输出
+    MUHUI_ASSERT(!muhui::http::HttpCompressor::IsEnabled());
+    muhui::Config::Lookup<bool>("http.compress.enable")->setValue(true);
+    test_negotiate();
+
+    s_server.reset(new muhui::http::HttpServer(true));
+    muhui::Address::ptr addr = muhui::Address::LookupAny("127.0.0.1:8024");
+    while(!s_server->bind(addr)) {
+        sleep(1);
+    }
+    const std::string text = MakeText(20000);
+    auto sd = s_server->getServletDispatch();
+    sd->addServlet("/text", [&text](muhui::http::HttpRequest::ptr req,
+                                    muhui::http::HttpResponce::ptr rsp,
+                                    muhui::http::HttpSession::ptr session){
+        rsp->setHeader("Content-Type", "text/plain");
+        rsp->setHeader("ETag", "\"v1\"");
+        rsp->setBody(text);
+        return 0;
+    });
+    sd->addServlet("/small", [](muhui::http::HttpRequest::ptr req,
+                                muhui::http::HttpResponce::ptr rsp,
+                                muhui::http::HttpSession::ptr session){
+        rsp->setBody("small body");
+        return 0;
+    });
+    sd->addServlet("/png", [&text](muhui::http::HttpRequest::ptr req,
+                                   muhui::http::HttpResponce::ptr rsp,
+                                   muhui::http::HttpSession::ptr session){
+        rsp->setHeader("Content-Type", "image/png");
+        rsp->setBody(text);
+        return 0;
+    });
+    sd->addServlet("/chunk", [&text](muhui::http::HttpRequest::ptr req,
+                                     muhui::http::HttpResponce::ptr rsp,
+                                     muhui::http::HttpSession::ptr session){
+        rsp->setHeader("Content-Type", "text/plain");
+        session->beginChunkedResponse(rsp);
+        for(size_t i = 0; i < text.size(); i += 5000) {
+            session->sendChunk(text.substr(i, 5000));
+        }
+        session->endChunkedResponse();
+        return 0;
+    });
+    auto page = std::make_shared<muhui::http::FunctionServlet>([&text](muhui::http::HttpRequest::ptr req,
+                                   muhui::http::HttpResponce::ptr rsp,
+                                   muhui::http::HttpSession::ptr session){
+        ++s_calls;
+        rsp->setHeader("Cache-Control", "max-age=60");
+        rsp->setBody(text);
+        return 0;
+    });
+    muhui::http::CacheServlet::ptr cache(new muhui::http::CacheServlet(page, 1024 * 1024, 0, 4));
+    sd->addGlobServlet("/cached/*", cache);
+    s_server->start();
+
+    muhui::http::HttpConnectionPool::ptr pool(new muhui::http::HttpConnectionPool(
+                "127.0.0.1", "", 8024, 4, 4, 5000, 30000, 10000));
+
+    //gzip和deflate
+    const char* encodings[] = {"gzip", "deflate"};
+    for(auto enc : encodings) {
+        auto r = Get(pool, "/text", enc);
+        MUHUI_ASSERT(r->response->getHeader("content-encoding") == enc);
+        MUHUI_ASSERT(r->response->getHeader("vary") == "Accept-Encoding");
+        MUHUI_ASSERT(r->response->getHeader("etag") == std::string("\"v1-") + enc + "\"");
+        std::string body;
+        MUHUI_ASSERT(Inflate(r->response->getBody(), body));
+        MUHUI_ASSERT(body == text);
+        MUHUI_LOG_INFO(g_logger) << enc << " ok, " << text.size() << " -> "
+            << r->response->getBody().size();
+    }
+    //重复请求命中压缩缓存, 结果相同
+    auto r1 = Get(pool, "/text", "gzip");
+    auto r2 = Get(pool, "/text", "gzip");
+    MUHUI_ASSERT(r1->response->getBody() == r2->response->getBody());
+
+    //不接受压缩, 消息体太小, 已压缩的类型
+    auto r = Get(pool, "/text", "");
+    MUHUI_ASSERT(r->response->getHeader("content-encoding").empty());
+    MUHUI_ASSERT(r->response->getHeader("etag") == "\"v1\"");
+    MUHUI_ASSERT(r->response->getBody() == text);
+    r = Get(pool, "/small", "gzip");
+    MUHUI_ASSERT(r->response->getHeader("content-encoding").empty());
+    r = Get(pool, "/png", "gzip");
+    MUHUI_ASSERT(r->response->getHeader("content-encoding").empty());
+    MUHUI_ASSERT(r->response->getBody() == text);
+    MUHUI_LOG_INFO(g_logger) << "skip ok";
+
+    //分块发送的响应
+    r = Get(pool, "/chunk", "gzip");
+    MUHUI_ASSERT(r->response->getHeader("content-encoding") == "gzip");
+    std::string body;
+    MUHUI_ASSERT(Inflate(r->response->getBody(), body));
+    MUHUI_ASSERT(body == text);
+    r = Get(pool, "/chunk", "");
+    MUHUI_ASSERT(r->response->getBody() == text);
+    MUHUI_LOG_INFO(g_logger) << "chunked ok";
+
+    //CacheServlet按编码分别缓存
+    r1 = Get(pool, "/cached/a", "gzip");
+    r2 = Get(pool, "/cached/a", "gzip");
+    MUHUI_ASSERT(s_calls == 1);
+    MUHUI_ASSERT(r2->response->getHeader("content-encoding") == "gzip");
+    MUHUI_ASSERT(r1->response->getBody() == r2->response->getBody());
+    r = Get(pool, "/cached/a", "");
+    MUHUI_ASSERT(s_calls == 2);
+    MUHUI_ASSERT(r->response->getBody() == text);
+    r = Get(pool, "/cached/a", "");
+    MUHUI_ASSERT(s_calls == 2);
+    MUHUI_ASSERT(r->response->getHeader("etag") != r2->response->getHeader("etag"));
+    cache->invalidate("/cached/a", "");
+    MUHUI_ASSERT(cache->getCount() == 0);
+    MUHUI_LOG_INFO(g_logger) << "cache variant ok";
+
+    s_server->stop();
+    MUHUI_LOG_INFO(g_logger) << "all tests passed";
+}
+
+int main(int argc, char** argv) {
+    muhui::IOManager iom(2);
+    iom.schedule(run);
+    return 0;
+}
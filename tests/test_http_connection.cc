@@ -0,0 +1,155 @@
+/**
+ * @file test_http_connection.cc
+ * @brief HttpConnectionPool测试, 请求同进程内的HttpServer
+ */
+#include "address.h"
+#include "http/http_connection.h"
+#include "http/http_server.h"
+#include "iomanager.h"
+#include "log.h"
+#include "macro.h"
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_ROOT();
+
+static muhui::http::HttpServer::ptr s_server;
+
+static void start_server() {
+    s_server.reset(new muhui::http::HttpServer(true));
+    muhui::Address::ptr addr = muhui::Address::LookupAny("127.0.0.1:8022");
+    while(!s_server->bind(addr)) {
+        sleep(1);
+    }
+    auto sd = s_server->getServletDispatch();
+    sd->addServlet("/echo", [](muhui::http::HttpRequest::ptr req,
+                               muhui::http::HttpResponce::ptr rsp,
+                               muhui::http::HttpSession::ptr session){
+        rsp->setBody(req->getPath() + "?" + req->getQuery() + " " + req->getBody());
+        return 0;
+    });
+    sd->addServlet("/chunk", [](muhui::http::HttpRequest::ptr req,
+                                muhui::http::HttpResponce::ptr rsp,
+                                muhui::http::HttpSession::ptr session){
+        session->beginChunkedResponse(rsp);
+        for(int i = 0; i < 10; ++i) {
+            session->sendChunk("chunk " + std::to_string(i) + "\n");
+        }
+        session->endChunkedResponse();
+        return 0;
+    });
+    sd->addServlet("/close", [](muhui::http::HttpRequest::ptr req,
+                                muhui::http::HttpResponce::ptr rsp,
+                                muhui::http::HttpSession::ptr session){
+        rsp->setClose(true);
+        rsp->setBody("bye");
+        return 0;
+    });
+    sd->addServlet("/slow", [](muhui::http::HttpRequest::ptr req,
+                               muhui::http::HttpResponce::ptr rsp,
+                               muhui::http::HttpSession::ptr session){
+        usleep(50 * 1000);
+        rsp->setBody("slow");
+        return 0;
+    });
+    s_server->start();
+}
+
+static void test_pool() {
+    //最多同时使用4个连接, 保留4个空闲连接, 空闲5s, 存活30s, 每个连接最多100个请求
+    muhui::http::HttpConnectionPool::ptr pool(new muhui::http::HttpConnectionPool(
+                "127.0.0.1", "", 8022, 4, 4, 5000, 30000, 100));
+
+    //长连接复用
+    for(int i = 0; i < 10; ++i) {
+        auto r = pool->doPost("/echo?i=" + std::to_string(i), 1000, {}, "hello");
+        MUHUI_ASSERT2(r->result == 0, r->toString());
+        MUHUI_ASSERT(r->response->getBody() == "/echo?i=" + std::to_string(i) + " hello");
+    }
+    MUHUI_ASSERT(pool->getTotal() == 1);
+    MUHUI_LOG_INFO(g_logger) << "keep-alive reuse ok, total=" << pool->getTotal();
+
+    //chunked响应解码
+    auto r = pool->doGet("/chunk", 1000);
+    MUHUI_ASSERT2(r->result == 0, r->toString());
+    std::string expect;
+    for(int i = 0; i < 10; ++i) {
+        expect += "chunk " + std::to_string(i) + "\n";
+    }
+    MUHUI_ASSERT(r->response->getBody() == expect);
+    MUHUI_ASSERT(pool->getTotal() == 1);
+    MUHUI_LOG_INFO(g_logger) << "chunked body ok";
+
+    //服务器要求关闭的连接不放回池中
+    r = pool->doGet("/close", 1000);
+    MUHUI_ASSERT2(r->result == 0 && r->response->isClose(), r->toString());
+    MUHUI_ASSERT(pool->getTotal() == 0);
+    MUHUI_LOG_INFO(g_logger) << "connection: close ok";
+
+    //流水线
+    std::vector<muhui::http::HttpRequest::ptr> reqs;
+    for(int i = 0; i < 20; ++i) {
+        muhui::http::HttpRequest::ptr req = std::make_shared<muhui::http::HttpRequest>();
+        req->setPath(i % 2 ? "/echo" : "/chunk");
+        req->setQuery("p=" + std::to_string(i));
+        reqs.push_back(req);
+    }
+    auto rs = pool->doRequests(reqs, 1000);
+    for(int i = 0; i < 20; ++i) {
+        MUHUI_ASSERT2(rs[i]->result == 0, rs[i]->toString());
+        MUHUI_ASSERT(rs[i]->response->getBody()
+                == (i % 2 ? "/echo?p=" + std::to_string(i) + " " : expect));
+    }
+    MUHUI_ASSERT(pool->getTotal() == 1);
+    MUHUI_LOG_INFO(g_logger) << "pipelining ok";
+
+    //连接数达到上限时协程等待归还的连接
+    auto iom = muhui::IOManager::GetThis();
+    std::shared_ptr<std::atomic<int> > done(new std::atomic<int>(0));
+    uint64_t start = muhui::GetCurrentMS();
+    for(int i = 0; i < 16; ++i) {
+        iom->schedule([pool, done](){
+            auto r = pool->doGet("/slow", 2000);
+            MUHUI_ASSERT2(r->result == 0, r->toString());
+            MUHUI_ASSERT(pool->getTotal() <= 4);
+            ++*done;
+        });
+    }
+    while(*done < 16) {
+        usleep(10 * 1000);
+    }
+    uint64_t used = muhui::GetCurrentMS() - start;
+    MUHUI_LOG_INFO(g_logger) << "16 slow requests on 4 connections used " << used << "ms"
+        << " total=" << pool->getTotal() << " idle=" << pool->getIdleCount();
+    MUHUI_ASSERT(pool->getTotal() <= 4);
+
+    //取连接等待超时
+    std::vector<muhui::http::HttpConnection::ptr> conns;
+    for(int i = 0; i < 4; ++i) {
+        conns.push_back(pool->getConnection(100));
+        MUHUI_ASSERT(conns.back());
+    }
+    start = muhui::GetCurrentMS();
+    MUHUI_ASSERT(!pool->getConnection(100));
+    used = muhui::GetCurrentMS() - start;
+    MUHUI_ASSERT(used >= 90);
+    conns.clear();
+    MUHUI_LOG_INFO(g_logger) << "pool wait timeout ok, waited " << used << "ms";
+
+    //连接比连接池存活得更久
+    muhui::http::HttpConnection::ptr conn = pool->getConnection(100);
+    MUHUI_ASSERT(conn);
+    pool.reset();
+    conn.reset();
+    MUHUI_LOG_INFO(g_logger) << "outlive pool ok";
+
+    s_server->stop();
+    MUHUI_LOG_INFO(g_logger) << "all tests passed";
+}
+
+int main(int argc, char** argv) {
+    muhui::IOManager iom(2);
+    iom.schedule([](){
+        start_server();
+        test_pool();
+    });
+    return 0;
+}
@@ -1,6 +1,9 @@
 #include "http/http_parser.h"
 #include "log.h"
+#include "macro.h"
+#include <algorithm>
 #include <cstddef>
+#include <cstring>
 static muhui::Logger::ptr g_logger = MUHUI_LOG_ROOT();
 
 static char test_request_data[] = "POST / HTTP/1.1\r\n"
@@ -52,7 +55,41 @@ void test_response() {
     MUHUI_LOG_INFO(g_logger) << parser.getData()->toString();
     MUHUI_LOG_INFO(g_logger) << tmp;
 }
+void test_decode() {
+    //所有方法都能解码, 前缀相同的方法不会误判
+#define XX(num, name, str) { \
+        std::string m = #str; \
+        m.erase(std::remove(m.begin(), m.end(), ' '), m.end()); \
+        MUHUI_ASSERT(muhui::http::charsToHttpMethod(m.c_str(), m.size()) \
+                    == muhui::http::HttpMethod::name); \
+    }
+    HTTP_METHOD_MAP(XX)
+#undef XX
+    MUHUI_ASSERT(muhui::http::charsToHttpMethod("GE", 2)
+                == muhui::http::HttpMethod::INVALID_METHOD);
+    MUHUI_ASSERT(muhui::http::charsToHttpMethod("GETX", 4)
+                == muhui::http::HttpMethod::INVALID_METHOD);
+
+    muhui::http::HttpRequestParser parser;
+    std::string tmp = "GET / HTTP/1.1\r\n"
+                      "CONTENT-length: 10\r\n"
+                      "Connection: Keep-Alive, Upgrade\r\n"
+                      "Transfer-Encoding: gzip, chunked\r\n\r\n";
+    parser.execute(&tmp[0], tmp.size());
+    auto req = parser.getData();
+    req->init();
+    MUHUI_ASSERT(parser.getcontentLength() == 10);
+    MUHUI_ASSERT(!req->isClose());
+    MUHUI_ASSERT(req->isChunked());
+    MUHUI_ASSERT(muhui::http::HttpHeaders::LookupId("Host", 4)
+                == muhui::http::HttpHeaderId::HOST);
+    req->delHeader("transfer-encoding");
+    MUHUI_ASSERT(!req->isChunked());
+    MUHUI_LOG_INFO(g_logger) << "test_decode ok";
+}
+
 int main(int argc, char* *argv) {
+    test_decode();
     test();
     MUHUI_LOG_INFO(g_logger) << "----------";
     test_response();
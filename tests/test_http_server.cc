@@ -1,9 +1,10 @@
 #include "address.h"
 #include "http/http_server.h"
 #include "iomanager.h"
+#include "stream.h"
 
 void run() {
-    muhui::http::HttpServer::ptr server(new muhui::http::HttpServer);
+    muhui::http::HttpServer::ptr server(new muhui::http::HttpServer(true));
     muhui::Address::ptr addr = muhui::Address::LookupAny("0.0.0.0:8020");
     while(!server->bind(addr)) {
         sleep(2);
@@ -22,6 +23,40 @@ void run() {
         rsp->setBody("Glob:\r\n" + req->toString());
         return 0;
     });
+    sd->addServlet("/mumu/user/:id/*path", [](muhui::http::HttpRequest::ptr req,
+                                  muhui::http::HttpResponce::ptr rsp,
+                                  muhui::http::HttpSession::ptr session){
+        rsp->setBody("user id=" + req->getParam("id")
+                + " path=" + req->getParam("path"));
+        return 0;
+    });
+    sd->addServlet("/mumu/upload", [](muhui::http::HttpRequest::ptr req,
+                                  muhui::http::HttpResponce::ptr rsp,
+                                  muhui::http::HttpSession::ptr session){
+        uint64_t total = req->getBody().size();
+        auto body = req->getBodyStream();
+        if(body) {
+            char buf[4096];
+            int rt = 0;
+            while((rt = body->read(buf, sizeof(buf))) > 0) {
+                total += rt;
+            }
+        }
+        rsp->setBody("upload size=" + std::to_string(total)
+                + " stream=" + std::to_string(req->isStreamBody()));
+        return 0;
+    });
+    sd->addServlet("/mumu/chunk", [](muhui::http::HttpRequest::ptr req,
+                                 muhui::http::HttpResponce::ptr rsp,
+                                 muhui::http::HttpSession::ptr session){
+        //边生成边发送, 不整体缓存响应
+        session->beginChunkedResponse(rsp);
+        for(int i = 0; i < 10; ++i) {
+            session->sendChunk("chunk " + std::to_string(i) + "\n");
+        }
+        session->endChunkedResponse();
+        return 0;
+    });
     server->start();
 }
 
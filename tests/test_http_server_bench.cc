@@ -0,0 +1,198 @@
+/**
+ * @file test_http_server_bench.cc
+ * @brief HttpServer压测, 进程内客户端协程循环发送请求, 统计requests/sec
+ * @details 用法: test_http_server_bench [并发连接数] [持续秒数] [响应消息体字节数] [流水线深度]
+ */
+#include "address.h"
+#include "http/http_server.h"
+#include "iomanager.h"
+#include "log.h"
+#include "socket.h"
+#include "util.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <strings.h>
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_ROOT();
+
+static int s_concurrency = 16;
+static int s_seconds = 5;
+static int s_body_size = 1024;
+static int s_pipeline = 1;
+
+static muhui::http::HttpServer::ptr s_server;
+static muhui::Address::ptr s_addr;
+static bool s_stop = false;
+static std::atomic<int> s_running(0);
+static std::atomic<uint64_t> s_requests(0);
+static std::atomic<uint64_t> s_bytes(0);
+static std::atomic<uint64_t> s_errors(0);
+static uint64_t s_start_ms = 0;
+
+/// 全局operator new调用次数, 用于统计每个请求的堆分配次数
+static std::atomic<uint64_t> s_allocs(0);
+
+void* operator new(size_t size) {
+    ++s_allocs;
+    void* p = malloc(size ? size : 1);
+    if(!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+static const char s_request[] = "GET /bench HTTP/1.1\r\n"
+                                "Host: 127.0.0.1\r\n"
+                                "Connection: keep-alive\r\n\r\n";
+
+/**
+ * @brief 接收一个完整的响应
+ * @param[in, out] buf 接收缓存, 返回时移除已接收的响应
+ * @param[out] close 服务端是否要求关闭连接
+ * @param[out] size 响应总长度
+ */
+static bool recv_response(muhui::Socket::ptr sock, std::string& buf
+                          , bool& close, size_t& size) {
+    char tmp[16 * 1024];
+    size_t header_end = std::string::npos;
+    while((header_end = buf.find("\r\n\r\n")) == std::string::npos) {
+        int rt = sock->recv(tmp, sizeof(tmp));
+        if(rt <= 0) {
+            return false;
+        }
+        buf.append(tmp, rt);
+    }
+    header_end += 4;
+    size_t length = 0;
+    const char* cl = strcasestr(buf.c_str(), "content-length:");
+    if(cl && (size_t)(cl - buf.c_str()) < header_end) {
+        length = strtoull(cl + 15, nullptr, 10);
+    }
+    const char* conn = strcasestr(buf.c_str(), "connection: close");
+    close = conn && (size_t)(conn - buf.c_str()) < header_end;
+    size = header_end + length;
+    while(buf.size() < size) {
+        int rt = sock->recv(tmp, sizeof(tmp));
+        if(rt <= 0) {
+            return false;
+        }
+        buf.append(tmp, rt);
+    }
+    buf.erase(0, size);
+    return true;
+}
+
+static void report() {
+    uint64_t used = muhui::GetCurrentMS() - s_start_ms;
+    double secs = used / 1000.0;
+    MUHUI_LOG_INFO(g_logger) << "concurrency=" << s_concurrency
+        << " body_size=" << s_body_size
+        << " pipeline=" << s_pipeline
+        << " time=" << secs << "s"
+        << " requests=" << s_requests
+        << " errors=" << s_errors
+        << " requests/sec=" << (uint64_t)(s_requests / secs)
+        << " allocs/request=" << (s_requests ? (double)s_allocs / s_requests : 0)
+        << " MB/sec=" << (s_bytes / secs / 1024 / 1024);
+}
+
+static void client() {
+    muhui::Socket::ptr sock;
+    std::string buf;
+    //流水线: 一次发送多个请求, 再依次接收响应
+    std::string requests;
+    for(int i = 0; i < s_pipeline; ++i) {
+        requests.append(s_request, sizeof(s_request) - 1);
+    }
+    while(!s_stop) {
+        if(!sock) {
+            sock = muhui::Socket::CreateTCP(s_addr);
+            if(!sock->connect(s_addr)) {
+                ++s_errors;
+                sock.reset();
+                continue;
+            }
+            buf.clear();
+        }
+        if(sock->send(requests.c_str(), requests.size()) <= 0) {
+            ++s_errors;
+            sock.reset();
+            continue;
+        }
+        bool close = false;
+        for(int i = 0; i < s_pipeline && !close; ++i) {
+            size_t size = 0;
+            if(!recv_response(sock, buf, close, size)) {
+                ++s_errors;
+                close = true;
+                break;
+            }
+            ++s_requests;
+            s_bytes += size;
+        }
+        if(close) {
+            sock.reset();
+        }
+    }
+    if(sock) {
+        sock->close();
+    }
+    if(--s_running == 0) {
+        report();
+        s_server->stop();
+    }
+}
+
+static void run() {
+    s_server.reset(new muhui::http::HttpServer(true));
+    s_addr = muhui::Address::LookupAny("127.0.0.1:8021");
+    while(!s_server->bind(s_addr)) {
+        sleep(2);
+    }
+    std::string body(s_body_size, 'x');
+    s_server->getServletDispatch()->addServlet("/bench"
+            , [body](muhui::http::HttpRequest::ptr req
+                    , muhui::http::HttpResponce::ptr rsp
+                    , muhui::http::HttpSession::ptr session) {
+        rsp->setBody(body);
+        return 0;
+    });
+    s_server->start();
+
+    s_start_ms = muhui::GetCurrentMS();
+    s_allocs = 0;
+    s_running = s_concurrency;
+    for(int i = 0; i < s_concurrency; ++i) {
+        muhui::IOManager::GetThis()->schedule(client);
+    }
+    muhui::IOManager::GetThis()->addTimer(s_seconds * 1000, [](){
+        s_stop = true;
+    });
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        s_concurrency = atoi(argv[1]);
+    }
+    if(argc > 2) {
+        s_seconds = atoi(argv[2]);
+    }
+    if(argc > 3) {
+        s_body_size = atoi(argv[3]);
+    }
+    if(argc > 4) {
+        s_pipeline = atoi(argv[4]);
+    }
+    //压测时关闭调试日志
+    MUHUI_LOG_ROOT()->setLevel(muhui::LogLevel::INFO);
+    MUHUI_LOG_NAME("system")->setLevel(muhui::LogLevel::WARN);
+    muhui::IOManager iom(2);
+    iom.schedule(run);
+    return 0;
+}
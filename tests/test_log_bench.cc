@@ -0,0 +1,60 @@
+/**
+ * @file test_log_bench.cc
+ * @brief 日志压测, 输出默认格式下每行日志的耗时(ns)
+ * @details 用法: test_log_bench [行数]
+ *          - null: 格式化后丢弃, 衡量构造LogEvent和格式化的开销
+ *          - file: 输出到FileLogAppender
+ */
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+#include <unistd.h>
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_ROOT();
+
+static int s_count = 1000000;
+
+/**
+ * @brief 格式化后丢弃的Appender
+ */
+class NullLogAppender : public muhui::LogAppender {
+public:
+    typedef std::shared_ptr<NullLogAppender> ptr;
+    void log(const muhui::Logger::ptr& logger, muhui::LogLevel::Level level, const muhui::LogEvent::ptr& event) override {
+        m_bytes += m_formatter->formatLocal(logger, level, event).size();
+    }
+    std::string toYamlString() override { return "";}
+    uint64_t getBytes() const { return m_bytes;}
+private:
+    uint64_t m_bytes = 0;
+};
+
+static void run(const std::string& name, muhui::LogAppender::ptr appender) {
+    muhui::Logger::ptr logger = MUHUI_LOG_NAME("bench_" + name);
+    logger->addAppender(appender);
+    for(int i = 0; i < 1000; ++i) {
+        MUHUI_LOG_INFO(logger) << "warm up " << i;
+    }
+    uint64_t begin = muhui::GetCurrentUS();
+    for(int i = 0; i < s_count; ++i) {
+        MUHUI_LOG_INFO(logger) << "bench line " << i;
+    }
+    uint64_t us = muhui::GetCurrentUS() - begin;
+    MUHUI_LOG_INFO(g_logger) << name << ": " << s_count << " lines " << us << "us "
+                             << us * 1000.0 / s_count << "ns/line";
+    logger->clearAppender();
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        s_count = atoi(argv[1]);
+    }
+    NullLogAppender::ptr null_appender(new NullLogAppender);
+    run("null", null_appender);
+    MUHUI_ASSERT(null_appender->getBytes() > 0);
+
+    std::string file = "/tmp/test_log_bench.log";
+    ::unlink(file.c_str());
+    run("file", muhui::LogAppender::ptr(new muhui::FileLogAppender(file)));
+    return 0;
+}
@@ -0,0 +1,156 @@
+/**
+ * @file test_log_limit.cc
+ * @brief 限流/采样日志测试: 每个调用点的计数, 多线程, 丢弃条数的汇总, 被丢弃时的耗时
+ */
+#include "config.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+#include <unistd.h>
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_ROOT();
+
+/**
+ * @brief 只计数的Appender
+ */
+class CountLogAppender : public muhui::LogAppender {
+public:
+    typedef std::shared_ptr<CountLogAppender> ptr;
+    void log(const muhui::Logger::ptr& logger, muhui::LogLevel::Level level, const muhui::LogEvent::ptr& event) override {
+        ++m_count;
+    }
+    std::string toYamlString() override { return "";}
+    std::atomic<uint64_t> m_count{0};
+};
+
+static void test_limit() {
+    muhui::Logger::ptr logger = MUHUI_LOG_NAME("limit");
+    CountLogAppender::ptr ap(new CountLogAppender);
+    logger->addAppender(ap);
+
+    //一个窗口内只输出5条
+    for(int i = 0; i < 1000; ++i) {
+        MUHUI_LOG_LIMIT_ERROR(logger, 5, 200) << "limited " << i;
+    }
+    MUHUI_ASSERT(ap->m_count == 5);
+
+    //新窗口重新计数
+    usleep(250 * 1000);
+    for(int i = 0; i < 1000; ++i) {
+        MUHUI_LOG_LIMIT_ERROR(logger, 5, 200) << "limited " << i;
+    }
+    MUHUI_ASSERT(ap->m_count == 10);
+
+    //每个调用点独立计数
+    ap->m_count = 0;
+    for(int i = 0; i < 100; ++i) {
+        MUHUI_LOG_LIMIT_WARN(logger, 1, 10000) << "a";
+        MUHUI_LOG_LIMIT_WARN(logger, 1, 10000) << "b";
+    }
+    MUHUI_ASSERT(ap->m_count == 2);
+
+    //级别不够时不计数
+    logger->setLevel(muhui::LogLevel::ERROR);
+    for(int i = 0; i < 100; ++i) {
+        MUHUI_LOG_LIMIT_INFO(logger, 1, 10000) << "filtered";
+    }
+    MUHUI_ASSERT(ap->m_count == 2);
+    logger->setLevel(muhui::LogLevel::DEBUG);
+    logger->clearAppender();
+}
+
+static void test_threads() {
+    muhui::Logger::ptr logger = MUHUI_LOG_NAME("limit_threads");
+    CountLogAppender::ptr ap(new CountLogAppender);
+    logger->addAppender(ap);
+    std::vector<muhui::Thread::ptr> thrs;
+    for(int t = 0; t < 4; ++t) {
+        thrs.push_back(muhui::Thread::ptr(new muhui::Thread([logger](){
+            for(int i = 0; i < 100000; ++i) {
+                MUHUI_LOG_LIMIT_ERROR(logger, 100, 60000) << "threads " << i;
+            }
+        }, "limit_" + std::to_string(t))));
+    }
+    for(auto& i : thrs) {
+        i->join();
+    }
+    MUHUI_LOG_INFO(g_logger) << "threads: written=" << ap->m_count;
+    MUHUI_ASSERT(ap->m_count == 100);
+    logger->clearAppender();
+}
+
+static void test_sample() {
+    muhui::Logger::ptr logger = MUHUI_LOG_NAME("sample");
+    CountLogAppender::ptr ap(new CountLogAppender);
+    logger->addAppender(ap);
+    int n = 100000;
+    for(int i = 0; i < n; ++i) {
+        MUHUI_LOG_SAMPLE_INFO(logger, 100) << "sample " << i;
+    }
+    MUHUI_LOG_INFO(g_logger) << "sample 1/100: written=" << ap->m_count << " of " << n;
+    MUHUI_ASSERT(ap->m_count > 800 && ap->m_count < 1200);
+
+    ap->m_count = 0;
+    for(int i = 0; i < 100; ++i) {
+        MUHUI_LOG_SAMPLE_INFO(logger, 1) << "always";
+    }
+    MUHUI_ASSERT(ap->m_count == 100);
+    logger->clearAppender();
+}
+
+static void test_report() {
+    //前面的测试已经丢弃了日志
+    std::string report = muhui::LogLimiter::Report();
+    MUHUI_LOG_INFO(g_logger) << report;
+    MUHUI_ASSERT(report.find("test_log_limit.cc:") != std::string::npos);
+    //汇总后清零
+    MUHUI_ASSERT(muhui::LogLimiter::Report().empty());
+
+    //后台定时器按配置的间隔输出到system日志
+    muhui::Config::Lookup<uint64_t>("log.limit_report_interval")->setValue(200);
+    muhui::Logger::ptr system = MUHUI_LOG_NAME("system");
+    CountLogAppender::ptr ap(new CountLogAppender);
+    system->addAppender(ap);
+    muhui::Logger::ptr logger = MUHUI_LOG_NAME("report");
+    logger->addAppender(muhui::LogAppender::ptr(new CountLogAppender));
+    for(int i = 0; i < 1000; ++i) {
+        MUHUI_LOG_LIMIT_ERROR(logger, 1, 60000) << "report";
+    }
+    uint64_t begin = muhui::GetCurrentMS();
+    while(ap->m_count == 0 && muhui::GetCurrentMS() - begin < 2000) {
+        usleep(10 * 1000);
+    }
+    MUHUI_ASSERT(ap->m_count == 1);
+    system->clearAppender();
+    logger->clearAppender();
+}
+
+static void bench() {
+    muhui::Logger::ptr logger = MUHUI_LOG_NAME("limit_bench");
+    logger->addAppender(muhui::LogAppender::ptr(new CountLogAppender));
+    int n = 1000000;
+    uint64_t begin = muhui::GetCurrentUS();
+    for(int i = 0; i < n; ++i) {
+        MUHUI_LOG_LIMIT_ERROR(logger, 10, 1000) << "bench " << i;
+    }
+    uint64_t us = muhui::GetCurrentUS() - begin;
+    MUHUI_LOG_INFO(g_logger) << "limited: " << us * 1000.0 / n << "ns/line";
+
+    begin = muhui::GetCurrentUS();
+    for(int i = 0; i < n; ++i) {
+        MUHUI_LOG_ERROR(logger) << "bench " << i;
+    }
+    us = muhui::GetCurrentUS() - begin;
+    MUHUI_LOG_INFO(g_logger) << "unlimited: " << us * 1000.0 / n << "ns/line";
+    logger->clearAppender();
+}
+
+int main(int argc, char** argv) {
+    test_limit();
+    test_threads();
+    test_sample();
+    test_report();
+    bench();
+    MUHUI_LOG_INFO(g_logger) << "test_log_limit ok";
+    return 0;
+}
@@ -0,0 +1,114 @@
+/**
+ * @file test_logger_reload.cc
+ * @brief 多线程写日志的同时替换Appender: 被移除的Appender析构后不会再被调用, 以及多线程写日志的耗时
+ */
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_ROOT();
+
+static std::atomic<uint64_t> s_alive(0);
+static std::atomic<uint64_t> s_calls(0);
+
+/**
+ * @brief 只计数的Appender, 析构后被调用时断言失败
+ */
+class CountLogAppender : public muhui::LogAppender {
+public:
+    typedef std::shared_ptr<CountLogAppender> ptr;
+    CountLogAppender() : m_magic(s_magic) { ++s_alive;}
+    ~CountLogAppender() {
+        m_magic = 0;
+        --s_alive;
+    }
+    void log(const muhui::Logger::ptr& logger, muhui::LogLevel::Level level, const muhui::LogEvent::ptr& event) override {
+        MUHUI_ASSERT(m_magic == s_magic);
+        ++s_calls;
+    }
+    std::string toYamlString() override { return "";}
+private:
+    static const uint64_t s_magic = 0x6c6f6761707064ull;
+    volatile uint64_t m_magic;
+};
+
+/**
+ * @brief 什么都不做的Appender, 只衡量Logger本身的开销
+ */
+class NullLogAppender : public muhui::LogAppender {
+public:
+    void log(const muhui::Logger::ptr& logger, muhui::LogLevel::Level level, const muhui::LogEvent::ptr& event) override {}
+    std::string toYamlString() override { return "";}
+};
+
+static void test_reload() {
+    muhui::Logger::ptr logger = MUHUI_LOG_NAME("reload");
+    std::atomic<bool> stop(false);
+    std::vector<muhui::Thread::ptr> thrs;
+    for(int t = 0; t < 4; ++t) {
+        thrs.push_back(muhui::Thread::ptr(new muhui::Thread([logger, &stop](){
+            while(!stop) {
+                MUHUI_LOG_INFO(logger) << "reload";
+            }
+        }, "reload_" + std::to_string(t))));
+    }
+
+    for(int i = 0; i < 2000; ++i) {
+        switch(i % 4) {
+            case 0:
+                logger->addAppender(muhui::LogAppender::ptr(new CountLogAppender));
+                break;
+            case 1:
+                logger->setAppenders({muhui::LogAppender::ptr(new CountLogAppender)
+                                      , muhui::LogAppender::ptr(new CountLogAppender)});
+                break;
+            case 2:
+                logger->addAppender(muhui::LogAppender::ptr(new CountLogAppender));
+                break;
+            default:
+                logger->clearAppender();
+                //被移除的Appender已经析构
+                MUHUI_ASSERT(s_alive == 0);
+                break;
+        }
+    }
+    stop = true;
+    for(auto& i : thrs) {
+        i->join();
+    }
+    logger->clearAppender();
+    MUHUI_LOG_INFO(g_logger) << "reload: calls=" << s_calls << " alive=" << s_alive;
+    MUHUI_ASSERT(s_alive == 0);
+    MUHUI_ASSERT(s_calls > 0);
+}
+
+static void bench(int threads) {
+    muhui::Logger::ptr logger = MUHUI_LOG_NAME("reload_bench");
+    logger->setFormatter("%m%n");
+    logger->addAppender(muhui::LogAppender::ptr(new NullLogAppender));
+    int n = 500000;
+    uint64_t begin = muhui::GetCurrentUS();
+    std::vector<muhui::Thread::ptr> thrs;
+    for(int t = 0; t < threads; ++t) {
+        thrs.push_back(muhui::Thread::ptr(new muhui::Thread([logger, n](){
+            for(int i = 0; i < n; ++i) {
+                MUHUI_LOG_INFO(logger) << "bench";
+            }
+        }, "reload_bench")));
+    }
+    for(auto& i : thrs) {
+        i->join();
+    }
+    uint64_t us = muhui::GetCurrentUS() - begin;
+    MUHUI_LOG_INFO(g_logger) << "threads=" << threads << " " << n << " lines/thread "
+                             << us * 1000.0 / n << "ns/line";
+    logger->clearAppender();
+}
+
+int main(int argc, char** argv) {
+    test_reload();
+    bench(1);
+    bench(4);
+    MUHUI_LOG_INFO(g_logger) << "test_logger_reload ok";
+    return 0;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file test_servlet_router_bench.cc
+ * @brief ServletDispatch路由匹配压测
+ * @details 用法: test_servlet_router_bench [路由数] [查找次数]
+ *          路由按 精准/带参数/前缀模糊/其它模糊 四类均分,
+ *          与之前逐个fnmatch的线性匹配对比
+ */
+#include "http/servlet.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+#include <fnmatch.h>
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_ROOT();
+
+static int s_routes = 10000;
+static int s_lookups = 1000000;
+
+class NopServlet : public muhui::http::Servlet {
+public:
+    NopServlet(const std::string& name)
+        : Servlet(name) {}
+    int32_t handle(muhui::http::HttpRequest::ptr request
+                , muhui::http::HttpResponce::ptr response
+                , muhui::http::HttpSession::ptr session) override {
+        return 0;
+    }
+};
+
+/**
+ * @brief 之前的匹配方式: 精准匹配后逐个fnmatch
+ */
+static muhui::http::Servlet::ptr linear_match(
+            const std::unordered_map<std::string, muhui::http::Servlet::ptr>& datas
+            , const std::vector<std::pair<std::string, muhui::http::Servlet::ptr> >& globs
+            , const std::string& uri) {
+    auto it = datas.find(uri);
+    if(it != datas.end()) {
+        return it->second;
+    }
+    for(auto& i : globs) {
+        if(!fnmatch(i.first.c_str(), uri.c_str(), 0)) {
+            return i.second;
+        }
+    }
+    return nullptr;
+}
+
+static void bench(const std::string& name, const std::vector<std::string>& uris
+                  , muhui::http::ServletDispatch::ptr sd
+                  , const std::unordered_map<std::string, muhui::http::Servlet::ptr>& datas
+                  , const std::vector<std::pair<std::string, muhui::http::Servlet::ptr> >& globs) {
+    size_t hits = 0;
+    uint64_t start = muhui::GetCurrentUS();
+    for(int i = 0; i < s_lookups; ++i) {
+        muhui::http::ServletRouter::ParamList params;
+        auto slt = sd->getMatchedServlet(uris[i % uris.size()], &params);
+        hits += slt != sd->getDefault();
+    }
+    uint64_t radix_us = muhui::GetCurrentUS() - start;
+
+    //线性匹配很慢, 只跑1/100
+    int linear_lookups = s_lookups / 100;
+    start = muhui::GetCurrentUS();
+    for(int i = 0; i < linear_lookups; ++i) {
+        linear_match(datas, globs, uris[i % uris.size()]);
+    }
+    uint64_t linear_us = muhui::GetCurrentUS() - start;
+
+    MUHUI_LOG_INFO(g_logger) << name << ": hits=" << hits << "/" << s_lookups
+        << " radix=" << (radix_us * 1000.0 / s_lookups) << "ns/lookup"
+        << " linear=" << (linear_us * 1000.0 / linear_lookups) << "ns/lookup";
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        s_routes = atoi(argv[1]);
+    }
+    if(argc > 2) {
+        s_lookups = atoi(argv[2]);
+    }
+    MUHUI_LOG_NAME("system")->setLevel(muhui::LogLevel::WARN);
+
+    muhui::http::ServletDispatch::ptr sd(new muhui::http::ServletDispatch);
+    std::unordered_map<std::string, muhui::http::Servlet::ptr> datas;
+    std::vector<std::pair<std::string, muhui::http::Servlet::ptr> > globs;
+    std::vector<std::string> statics, params, prefixes, patterns, misses;
+    int n = s_routes / 4;
+    for(int i = 0; i < n; ++i) {
+        std::string id = std::to_string(i);
+        muhui::http::Servlet::ptr slt(new NopServlet("nop" + id));
+
+        sd->addServlet("/api/v1/res" + id, slt);
+        datas["/api/v1/res" + id] = slt;
+        statics.push_back("/api/v1/res" + id);
+
+        //带参数的uri, 线性匹配中等价于fnmatch模式
+        sd->addServlet("/user" + id + "/:id/profile", slt);
+        globs.push_back(std::make_pair("/user" + id + "/*/profile", slt));
+        params.push_back("/user" + id + "/" + std::to_string(i * 7) + "/profile");
+
+        sd->addGlobServlet("/static" + id + "/*", slt);
+        globs.push_back(std::make_pair("/static" + id + "/*", slt));
+        prefixes.push_back("/static" + id + "/css/main.css");
+
+        sd->addGlobServlet("/img" + id + "/*.png", slt);
+        globs.push_back(std::make_pair("/img" + id + "/*.png", slt));
+        patterns.push_back("/img" + id + "/logo.png");
+
+        misses.push_back("/none/" + id);
+    }
+
+    //检查参数提取
+    muhui::http::ServletRouter::ParamList pl;
+    auto slt = sd->getMatchedServlet("/user42/1001/profile", &pl);
+    MUHUI_ASSERT(slt->getName() == "nop42");
+    MUHUI_ASSERT(pl.size() == 1 && pl[0].first == "id" && pl[0].second == "1001");
+    MUHUI_ASSERT(sd->getMatchedServlet("/static7/a/b")->getName() == "nop7");
+    MUHUI_ASSERT(sd->getMatchedServlet("/img9/x.png")->getName() == "nop9");
+    MUHUI_ASSERT(sd->getMatchedServlet("/img9/x.jpg") == sd->getDefault());
+
+    MUHUI_LOG_INFO(g_logger) << "routes=" << n * 4;
+    bench("static", statics, sd, datas, globs);
+    bench("param", params, sd, datas, globs);
+    bench("prefix glob", prefixes, sd, datas, globs);
+    bench("fnmatch glob", patterns, sd, datas, globs);
+    bench("miss", misses, sd, datas, globs);
+    return 0;
+}
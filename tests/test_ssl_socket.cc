@@ -0,0 +1,314 @@
+/**
+ * @file test_ssl_socket.cc
+ * @brief SSLSocket测试: TcpServer上的TLS回显, 会话复用, 慢速客户端不阻塞accept, 非阻塞读写让出协程, 完整握手与复用握手的耗时对比, kTLS下发送文件
+ */
+#include "address.h"
+#include "config.h"
+#include "hook.h"
+#include "iomanager.h"
+#include "log.h"
+#include "macro.h"
+#include "socket.h"
+#include "tcp_server.h"
+#include "util.h"
+#include <fcntl.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_ROOT();
+
+static const char* s_cert_file = "/tmp/test_ssl_socket.crt";
+static const char* s_key_file = "/tmp/test_ssl_socket.key";
+static const char* s_data_file = "/tmp/test_ssl_socket.data";
+
+/**
+ * @brief 生成自签名证书
+ */
+static bool GenerateCert() {
+    EVP_PKEY* pkey = nullptr;
+    EVP_PKEY_CTX* pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    if(!pctx || EVP_PKEY_keygen_init(pctx) <= 0
+            || EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pctx, NID_X9_62_prime256v1) <= 0
+            || EVP_PKEY_keygen(pctx, &pkey) <= 0) {
+        EVP_PKEY_CTX_free(pctx);
+        return false;
+    }
+    EVP_PKEY_CTX_free(pctx);
+
+    X509* x509 = X509_new();
+    ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+    X509_gmtime_adj(X509_getm_notBefore(x509), 0);
+    X509_gmtime_adj(X509_getm_notAfter(x509), 3600);
+    X509_set_pubkey(x509, pkey);
+    X509_NAME* name = X509_get_subject_name(x509);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)"localhost", -1, -1, 0);
+    X509_set_issuer_name(x509, name);
+    X509_sign(x509, pkey, EVP_sha256());
+
+    bool ok = false;
+    FILE* kf = fopen(s_key_file, "w");
+    FILE* cf = fopen(s_cert_file, "w");
+    if(kf && cf) {
+        ok = PEM_write_PrivateKey(kf, pkey, nullptr, nullptr, 0, nullptr, nullptr) == 1
+            && PEM_write_X509(cf, x509) == 1;
+    }
+    if(kf) {
+        fclose(kf);
+    }
+    if(cf) {
+        fclose(cf);
+    }
+    X509_free(x509);
+    EVP_PKEY_free(pkey);
+    return ok;
+}
+
+/**
+ * @brief 回显服务器
+ */
+class EchoServer : public muhui::TcpServer {
+public:
+    typedef std::shared_ptr<EchoServer> ptr;
+    void handleClient(muhui::Socket::ptr client) override {
+        char buf[4096];
+        while(true) {
+            int rt = client->recv(buf, sizeof(buf));
+            if(rt <= 0) {
+                break;
+            }
+            //file开头的消息回复整个数据文件
+            if(rt >= 4 && memcmp(buf, "file", 4) == 0) {
+                if(!sendFile(client)) {
+                    break;
+                }
+                continue;
+            }
+            //delay开头的消息晚一点回复
+            if(rt >= 5 && memcmp(buf, "delay", 5) == 0) {
+                usleep(50 * 1000);
+            }
+            if(client->send(buf, rt) != rt) {
+                break;
+            }
+        }
+        client->close();
+    }
+private:
+    bool sendFile(muhui::Socket::ptr client) {
+        int fd = open(s_data_file, O_RDONLY);
+        if(fd < 0) {
+            return false;
+        }
+        off_t size = lseek(fd, 0, SEEK_END);
+        off_t offset = 0;
+        while(offset < size) {
+            ssize_t rt = client->sendFile(fd, offset, size - offset);
+            if(rt <= 0) {
+                break;
+            }
+            offset += rt;
+        }
+        ::close(fd);
+        return offset == size;
+    }
+};
+
+static muhui::Address::ptr s_addr;
+
+/**
+ * @brief 连接并回显一次
+ */
+static muhui::SSLSocket::ptr Echo(const std::string& msg) {
+    muhui::SSLSocket::ptr sock = muhui::SSLSocket::CreateTCP(s_addr);
+    sock->setHostname("localhost");
+    if(!sock->connect(s_addr, 1000)) {
+        return nullptr;
+    }
+    MUHUI_ASSERT(sock->send(msg.c_str(), msg.size()) == (int)msg.size());
+    std::string buf(msg.size(), '\0');
+    MUHUI_ASSERT(sock->recv(&buf[0], buf.size()) == (int)msg.size());
+    MUHUI_ASSERT(buf == msg);
+    return sock;
+}
+
+static void test_echo() {
+    muhui::SSLSocket::ptr sock = Echo("hello");
+    MUHUI_ASSERT(sock && sock->isHandshaked());
+    MUHUI_ASSERT(!sock->isSessionReused());
+    MUHUI_LOG_INFO(g_logger) << *sock;
+    sock->close();
+
+    //复用上一次的会话
+    sock = Echo("hello again");
+    MUHUI_ASSERT(sock && sock->isSessionReused());
+    MUHUI_LOG_INFO(g_logger) << *sock;
+    sock->close();
+
+    //iovec
+    sock = Echo("x");
+    std::string a = "abc", b = "defg";
+    iovec iov[2];
+    iov[0].iov_base = &a[0];
+    iov[0].iov_len = a.size();
+    iov[1].iov_base = &b[0];
+    iov[1].iov_len = b.size();
+    MUHUI_ASSERT(sock->send(iov, 2) == 7);
+    std::string out(7, '\0');
+    int n = 0;
+    while(n < 7) {
+        int rt = sock->recv(&out[n], 7 - n);
+        MUHUI_ASSERT(rt > 0);
+        n += rt;
+    }
+    MUHUI_ASSERT(out == "abcdefg");
+    sock->close();
+    MUHUI_LOG_INFO(g_logger) << "echo ok";
+}
+
+static void test_slow_client() {
+    //只建立TCP连接不发送ClientHello, 服务端的握手不能阻塞后面的连接
+    std::vector<muhui::Socket::ptr> slow;
+    for(int i = 0; i < 3; ++i) {
+        muhui::Socket::ptr s = muhui::Socket::CreateTCP(s_addr);
+        MUHUI_ASSERT(s->connect(s_addr, 1000));
+        slow.push_back(s);
+    }
+    uint64_t begin = muhui::GetCurrentMS();
+    muhui::SSLSocket::ptr sock = Echo("after slow");
+    MUHUI_ASSERT(sock);
+    MUHUI_ASSERT(muhui::GetCurrentMS() - begin < 1000);
+    sock->close();
+    for(auto& i : slow) {
+        i->close();
+    }
+    MUHUI_LOG_INFO(g_logger) << "slow client ok";
+}
+
+static void test_nonblock() {
+    //用户设置了非阻塞时hook不再等待, SSL返回WANT_READ, 由SSLSocket注册事件后让出协程
+    muhui::SSLSocket::ptr sock = Echo("nonblock");
+    MUHUI_ASSERT(sock);
+    int fd = sock->getSocket();
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    char buf[64];
+    sock->setRecvTimeout(100);
+    uint64_t begin = muhui::GetCurrentMS();
+    MUHUI_ASSERT(sock->recv(buf, sizeof(buf)) == -1 && errno == ETIMEDOUT);
+    uint64_t cost = muhui::GetCurrentMS() - begin;
+    MUHUI_ASSERT(cost >= 90 && cost < 1000);
+
+    //对端晚一点回复, 期间让出协程
+    MUHUI_ASSERT(sock->send("delay", 5) == 5);
+    sock->setRecvTimeout(1000);
+    begin = muhui::GetCurrentMS();
+    int n = 0;
+    while(n < 5) {
+        int rt = sock->recv(buf + n, 5 - n);
+        MUHUI_ASSERT(rt > 0);
+        n += rt;
+    }
+    MUHUI_ASSERT(std::string(buf, 5) == "delay");
+    MUHUI_ASSERT(muhui::GetCurrentMS() - begin >= 40);
+    sock->close();
+    MUHUI_LOG_INFO(g_logger) << "nonblock ok";
+}
+
+static void bench() {
+    int n = 100;
+    uint64_t begin = muhui::GetCurrentUS();
+    for(int i = 0; i < n; ++i) {
+        muhui::SSLSocket::ClearSessionCache();
+        muhui::SSLSocket::ptr sock = Echo("bench");
+        MUHUI_ASSERT(sock && !sock->isSessionReused());
+        sock->close();
+    }
+    uint64_t full = muhui::GetCurrentUS() - begin;
+
+    begin = muhui::GetCurrentUS();
+    int reused = 0;
+    for(int i = 0; i < n; ++i) {
+        muhui::SSLSocket::ptr sock = Echo("bench");
+        MUHUI_ASSERT(sock);
+        reused += sock->isSessionReused();
+        sock->close();
+    }
+    uint64_t resumed = muhui::GetCurrentUS() - begin;
+    MUHUI_LOG_INFO(g_logger) << "full handshake: " << full / n << "us/conn, resumed: "
+                             << resumed / n << "us/conn (" << reused << "/" << n << " reused)";
+    MUHUI_ASSERT(reused >= n - 1);
+}
+
+/**
+ * @brief 开启kTLS的服务端用sendFile发送文件, 内核不支持时回退到用户态加密, 内容都要一致
+ */
+static void test_ktls() {
+    std::string data(1024 * 1024 + 123, '\0');
+    for(size_t i = 0; i < data.size(); ++i) {
+        data[i] = (char)(i * 131 + i / 7);
+    }
+    FILE* fp = fopen(s_data_file, "w");
+    MUHUI_ASSERT(fp && fwrite(&data[0], 1, data.size(), fp) == data.size());
+    fclose(fp);
+
+    muhui::Config::Lookup<bool>("ssl.ktls")->setValue(true);
+    muhui::Address::ptr addr = muhui::Address::LookupAny("127.0.0.1:8028");
+    EchoServer::ptr server(new EchoServer);
+    MUHUI_ASSERT(server->bind(addr, true));
+    MUHUI_ASSERT(server->loadCertificates(s_cert_file, s_key_file));
+    server->start();
+
+    muhui::SSLSocket::ptr sock = muhui::SSLSocket::CreateTCP(addr);
+    MUHUI_ASSERT(sock->getKtls());
+    MUHUI_ASSERT(sock->connect(addr, 1000));
+    MUHUI_LOG_INFO(g_logger) << *sock;
+    uint64_t begin = muhui::GetCurrentUS();
+    MUHUI_ASSERT(sock->send("file", 4) == 4);
+    std::string out(data.size(), '\0');
+    size_t n = 0;
+    while(n < out.size()) {
+        int rt = sock->recv(&out[n], out.size() - n);
+        MUHUI_ASSERT(rt > 0);
+        n += rt;
+    }
+    uint64_t us = muhui::GetCurrentUS() - begin;
+    MUHUI_ASSERT(out == data);
+
+    //连接仍然可用
+    std::string buf(5, '\0');
+    MUHUI_ASSERT(sock->send("hello", 5) == 5);
+    MUHUI_ASSERT(sock->recv(&buf[0], 5) == 5 && buf == "hello");
+    MUHUI_LOG_INFO(g_logger) << "ktls file: " << data.size() << " bytes in " << us
+                             << "us, client ktls_send=" << sock->isKtlsSend()
+                             << " ktls_recv=" << sock->isKtlsRecv();
+    sock->close();
+    server->stop();
+    muhui::Config::Lookup<bool>("ssl.ktls")->setValue(false);
+    unlink(s_data_file);
+}
+
+static void run() {
+    MUHUI_ASSERT(GenerateCert());
+    s_addr = muhui::Address::LookupAny("127.0.0.1:8027");
+    EchoServer::ptr server(new EchoServer);
+    MUHUI_ASSERT(server->bind(s_addr, true));
+    //证书错误时加载失败
+    MUHUI_ASSERT(!server->loadCertificates(s_key_file, s_key_file));
+    MUHUI_ASSERT(server->loadCertificates(s_cert_file, s_key_file));
+    server->start();
+
+    test_echo();
+    test_slow_client();
+    test_nonblock();
+    bench();
+    test_ktls();
+
+    server->stop();
+    MUHUI_LOG_INFO(g_logger) << "test_ssl_socket ok";
+}
+
+int main(int argc, char** argv) {
+    muhui::IOManager iom(2);
+    iom.schedule(run);
+    return 0;
+}
@@ -0,0 +1,196 @@
+/**
+ * @file test_ws_server.cc
+ * @brief WebSocket测试, 请求同进程内的HttpServer
+ */
+#include "address.h"
+#include "config.h"
+#include "http/http_connection.h"
+#include "http/http_server.h"
+#include "http/ws_session.h"
+#include "iomanager.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+
+static muhui::Logger::ptr g_logger = MUHUI_LOG_ROOT();
+
+static muhui::http::HttpServer::ptr s_server;
+static std::atomic<int> s_connected = {0};
+static std::atomic<int> s_closed = {0};
+
+static void test_mask() {
+    //SIMD掩码与逐字节异或结果一致
+    const uint8_t key[4] = {0x12, 0x34, 0x56, 0x78};
+    for(size_t len = 0; len < 300; ++len) {
+        std::string data(len, '\0');
+        for(size_t i = 0; i < len; ++i) {
+            data[i] = (char)(i * 7);
+        }
+        std::string expect = data;
+        for(size_t i = 0; i < len; ++i) {
+            expect[i] ^= key[i % 4];
+        }
+        muhui::http::WSSession::Mask(&data[0], len, key);
+        MUHUI_ASSERT(data == expect);
+    }
+
+    std::string big(16 * 1024 * 1024, 'x');
+    uint64_t start = muhui::GetCurrentUS();
+    for(int i = 0; i < 10; ++i) {
+        muhui::http::WSSession::Mask(&big[0], big.size(), key);
+    }
+    uint64_t used = muhui::GetCurrentUS() - start;
+    MUHUI_LOG_INFO(g_logger) << "mask ok, " << (big.size() * 10.0 / used) << " MB/s";
+}
+
+static void test_utf8() {
+    using muhui::http::WSSession;
+    MUHUI_ASSERT(WSSession::IsValidUtf8("", 0));
+    std::string ok = "hello, \xe4\xbd\xa0\xe5\xa5\xbd \xf0\x9f\x98\x80 \xc2\xa9 \xf4\x8f\xbf\xbf";
+    MUHUI_ASSERT(WSSession::IsValidUtf8(ok.c_str(), ok.size()));
+    const char* bad[] = {
+        "\x80",                //单独的后续字节
+        "\xc0\xaf",            //过长编码
+        "\xe0\x80\xaf",        //过长编码
+        "\xed\xa0\x80",        //代理区
+        "\xf4\x90\x80\x80",    //超过U+10FFFF
+        "\xf5\x80\x80\x80",
+        "abcdefgh\xe4\xbd",     //截断
+        "\xe4\x41\xa0",        //后续字节错误
+    };
+    for(auto i : bad) {
+        MUHUI_ASSERT2(!WSSession::IsValidUtf8(i, strlen(i)), i);
+    }
+    MUHUI_LOG_INFO(g_logger) << "utf8 ok";
+}
+
+static void run() {
+    test_mask();
+    test_utf8();
+
+    s_server.reset(new muhui::http::HttpServer(true));
+    muhui::Address::ptr addr = muhui::Address::LookupAny("127.0.0.1:8025");
+    while(!s_server->bind(addr)) {
+        sleep(1);
+    }
+    auto wsd = s_server->getWSServletDispatch();
+    wsd->addServlet("/ws/echo", [](muhui::http::HttpRequest::ptr header,
+                                   muhui::http::WSFrameMessage::ptr msg,
+                                   muhui::http::WSSession::ptr session){
+        if(msg->getData() == "bye") {
+            return 1;
+        }
+        session->sendMessage(msg);
+        return 0;
+    }, [](muhui::http::HttpRequest::ptr header, muhui::http::WSSession::ptr session){
+        ++s_connected;
+        return 0;
+    }, [](muhui::http::HttpRequest::ptr header, muhui::http::WSSession::ptr session){
+        ++s_closed;
+        return 0;
+    });
+    //服务端分片发送
+    wsd->addServlet("/ws/room/:id", [](muhui::http::HttpRequest::ptr header,
+                                       muhui::http::WSFrameMessage::ptr msg,
+                                       muhui::http::WSSession::ptr session){
+        session->sendMessage("room " + header->getParam("id") + ": ", muhui::http::WSOpcode::TEXT_FRAME, false);
+        session->sendMessage(msg->getData(), muhui::http::WSOpcode::CONTINUE, true);
+        return 0;
+    });
+    s_server->getServletDispatch()->addServlet("/http", [](muhui::http::HttpRequest::ptr req,
+                                                           muhui::http::HttpResponce::ptr rsp,
+                                                           muhui::http::HttpSession::ptr session){
+        rsp->setBody("http");
+        return 0;
+    });
+    s_server->start();
+
+    //文本和二进制(64位长度)消息
+    auto ws = muhui::http::WSSession::Connect(addr, "/ws/echo", "127.0.0.1", 1000);
+    MUHUI_ASSERT(ws);
+    ws->sendMessage("hello");
+    auto msg = ws->recvMessage();
+    MUHUI_ASSERT(msg && msg->getOpcode() == muhui::http::WSOpcode::TEXT_FRAME);
+    MUHUI_ASSERT(msg->getData() == "hello");
+    std::string bin(200 * 1024, '\0');
+    for(size_t i = 0; i < bin.size(); ++i) {
+        bin[i] = (char)(i * 31);
+    }
+    ws->sendMessage(bin, muhui::http::WSOpcode::BIN_FRAME);
+    msg = ws->recvMessage();
+    MUHUI_ASSERT(msg && msg->getOpcode() == muhui::http::WSOpcode::BIN_FRAME);
+    MUHUI_ASSERT(msg->getData() == bin);
+    MUHUI_LOG_INFO(g_logger) << "echo ok";
+
+    //客户端分片, 分片之间夹着PING
+    ws->sendFrame(muhui::http::WSOpcode::TEXT_FRAME, "hel", 3, false);
+    ws->ping();
+    ws->sendFrame(muhui::http::WSOpcode::CONTINUE, "lo ", 3, false);
+    ws->sendFrame(muhui::http::WSOpcode::CONTINUE, "world", 5, true);
+    msg = ws->recvMessage();
+    MUHUI_ASSERT(msg && msg->getData() == "hello world");
+    MUHUI_LOG_INFO(g_logger) << "fragment ok";
+
+    //servlet返回非0时关闭
+    ws->sendMessage("bye");
+    MUHUI_ASSERT(!ws->recvMessage());
+    usleep(50 * 1000);
+    MUHUI_ASSERT(s_connected == 1 && s_closed == 1);
+    MUHUI_LOG_INFO(g_logger) << "close ok";
+
+    //带参数的路由和服务端分片
+    ws = muhui::http::WSSession::Connect(addr, "/ws/room/42", "127.0.0.1", 1000);
+    MUHUI_ASSERT(ws);
+    ws->sendMessage("hi");
+    msg = ws->recvMessage();
+    MUHUI_ASSERT(msg && msg->getData() == "room 42: hi");
+    ws->close();
+    MUHUI_LOG_INFO(g_logger) << "route ok";
+
+    //没有WSServlet的路径不握手, 普通HTTP请求不受影响
+    MUHUI_ASSERT(!muhui::http::WSSession::Connect(addr, "/ws/none", "127.0.0.1", 1000));
+    muhui::http::HttpConnectionPool::ptr pool(new muhui::http::HttpConnectionPool(
+                "127.0.0.1", "", 8025, 2, 2, 5000, 30000, 100));
+    auto r = pool->doGet("/http", 1000);
+    MUHUI_ASSERT2(r->result == 0 && r->response->getBody() == "http", r->toString());
+    //缺少Sec-WebSocket-Version
+    muhui::http::HttpRequest::ptr req = std::make_shared<muhui::http::HttpRequest>();
+    req->setPath("/ws/echo");
+    req->setWebsocket(true);
+    req->setHeader("Connection", "Upgrade");
+    req->setHeader("Upgrade", "websocket");
+    r = pool->doRequest(req, 1000);
+    MUHUI_ASSERT2(r->result == 0, r->toString());
+    MUHUI_ASSERT(r->response->getStatus() == muhui::http::HttpStatus::UPGRADE_REQUIRED);
+    MUHUI_LOG_INFO(g_logger) << "handshake reject ok";
+
+    //客户端不读取(不回复PONG)时心跳超时关闭
+    muhui::Config::Lookup<uint64_t>("websocket.keepalive.interval")->setValue(100);
+    ws = muhui::http::WSSession::Connect(addr, "/ws/echo", "127.0.0.1", 1000);
+    MUHUI_ASSERT(ws);
+    uint64_t start = muhui::GetCurrentMS();
+    while(s_closed != 2 && muhui::GetCurrentMS() - start < 1000) {
+        usleep(10 * 1000);
+    }
+    MUHUI_LOG_INFO(g_logger) << "keepalive closed after " << muhui::GetCurrentMS() - start << "ms";
+    MUHUI_ASSERT(s_closed == 2);
+    MUHUI_ASSERT(!ws->recvMessage());
+    MUHUI_LOG_INFO(g_logger) << "keepalive timeout ok";
+
+    //文本消息不是UTF-8时服务端以1007关闭
+    muhui::Config::Lookup<uint64_t>("websocket.keepalive.interval")->setValue(30000);
+    ws = muhui::http::WSSession::Connect(addr, "/ws/echo", "127.0.0.1", 1000);
+    MUHUI_ASSERT(ws);
+    ws->sendMessage(std::string("bad \xc0\xaf"));
+    MUHUI_ASSERT(!ws->recvMessage());
+    MUHUI_LOG_INFO(g_logger) << "invalid utf8 ok";
+
+    s_server->stop();
+    MUHUI_LOG_INFO(g_logger) << "all tests passed";
+}
+
+int main(int argc, char** argv) {
+    muhui::IOManager iom(2);
+    iom.schedule(run);
+    return 0;
+}
@@ -0,0 +1,39 @@
+/**
+ * @file binlog_decode.cc
+ * @brief 把BinLogAppender写出的二进制日志解码为文本
+ * @details 用法: binlog_decode [文件]..., 不指定文件时读标准输入
+ */
+#include "binlog.h"
+#include <fstream>
+#include <iostream>
+
+static int Decode(std::istream& is, const std::string& name) {
+    muhui::binlog::Reader reader(is);
+    muhui::binlog::Reader::Line line;
+    while(reader.next(line)) {
+        std::cout << line.toString() << '\n';
+    }
+    if(!reader.getError().empty()) {
+        std::cerr << name << ": " << reader.getError() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    std::ios::sync_with_stdio(false);
+    if(argc < 2) {
+        return Decode(std::cin, "stdin");
+    }
+    int rt = 0;
+    for(int i = 1; i < argc; ++i) {
+        std::ifstream ifs(argv[i], std::ios::binary);
+        if(!ifs) {
+            std::cerr << "open " << argv[i] << " failed" << std::endl;
+            rt = 1;
+            continue;
+        }
+        rt |= Decode(ifs, argv[i]);
+    }
+    return rt;
+}